@@ -4,6 +4,7 @@
 
 #include <sys/types.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cstdio>
 #include <cstdlib>
@@ -13,8 +14,11 @@
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/memtablerep.h"
+#include "leveldb/merge_operator.h"
 #include "leveldb/write_batch.h"
 #include "port/port.h"
+#include "util/coding.h"
 #include "util/crc32c.h"
 #include "util/histogram.h"
 #include "util/mutexlock.h"
@@ -30,6 +34,8 @@
 //      fill100K      -- write N/1000 100K values in random order in async mode
 //      deleteseq     -- delete N keys in sequential order
 //      deleterandom  -- delete N keys in random order
+//      mergerandom   -- add 1 to N 8-byte counters in random key order with
+//                       a merge operator instead of a read and a write
 //      readseq       -- read N times sequentially
 //      readreverse   -- read N times in reverse order
 //      readrandom    -- read N times in random order
@@ -39,9 +45,14 @@
 //      seekordered   -- N ordered seeks
 //      open          -- cost of opening a DB
 //      crc32c        -- repeated crc32c of 4K of data
+//      cachehit      -- N random Lookup/Release pairs on the block cache,
+//                       inserting block-sized entries on misses (needs
+//                       --cache_size; run with --threads for contention)
 //   Meta operations:
 //      compact     -- Compact the entire DB
 //      stats       -- Print DB stats
+//      writeamp    -- Print the write amplification of the fill and
+//                     overwrite benchmarks since the DB was created
 //      sstables    -- Print sstable info
 //      heapprofile -- Dump a heap profile (if supported by this port)
 static const char *FLAGS_benchmarks =
@@ -88,10 +99,84 @@ static bool FLAGS_comparisons = false;
 // (initialized to default value by "main")
 static int FLAGS_write_buffer_size = 0;
 
+// Maximum number of memtables, the active one included, held in memory.
+// (initialized to default value by "main")
+static int FLAGS_max_write_buffer_number = 0;
+
+// If true, flush all queued immutable memtables into one level-0 table.
+static bool FLAGS_merge_memtables_on_flush = false;
+
+// Bytes per second that writes slow down to while compactions fall behind.
+// (initialized to default value by "main")
+static uint64_t FLAGS_delayed_write_rate = 0;
+
+// Estimated pending compaction bytes at which writes slow down and stop.
+// (initialized to default value by "main")
+static uint64_t FLAGS_soft_pending_compaction_bytes_limit = 0;
+static uint64_t FLAGS_hard_pending_compaction_bytes_limit = 0;
+
 // Number of bytes written to each file.
 // (initialized to default value by "main")
 static int FLAGS_max_file_size = 0;
 
+// Factor by which file sizes grow from one level to the next.
+// (initialized to default value by "main")
+static int FLAGS_target_file_size_multiplier = 0;
+
+// Number of level-0 files that start a compaction, slow down writes and
+// stop writes.
+// (initialized to default value by "main")
+static int FLAGS_level0_file_num_compaction_trigger = 0;
+static int FLAGS_level0_slowdown_writes_trigger = 0;
+static int FLAGS_level0_stop_writes_trigger = 0;
+
+// Size limit of level-1.
+// (initialized to default value by "main")
+static uint64_t FLAGS_max_bytes_for_level_base = 0;
+
+// Factor by which the size limit grows from one level to the next.
+// (initialized to default value by "main")
+static double FLAGS_max_bytes_for_level_multiplier = 0;
+
+// Comma-separated extra factors for the size limits of level-2 and up.
+static const char *FLAGS_max_bytes_for_level_multiplier_additional = nullptr;
+
+// If true, derive the level size limits from the size of the largest level.
+static bool FLAGS_level_compaction_dynamic_level_bytes = false;
+
+// Share of deletion markers at which a table is compacted; 0 disables.
+// (initialized to default value by "main")
+static double FLAGS_deletion_ratio_compaction_trigger = 0;
+
+// Compaction style: 0 for leveled, 1 for universal (tiered) and 2 for FIFO
+// compaction.
+static int FLAGS_compaction_style = 0;
+
+// File picked by leveled compaction: 0 for round-robin, 1 for the smallest
+// overlap with the next level relative to its size and 2 for the oldest data.
+static int FLAGS_compaction_pri = 0;
+
+// Size ratio, merge width bounds and size amplification limit of universal
+// compaction.
+// (initialized to default values by "main")
+static int FLAGS_universal_size_ratio = 0;
+static int FLAGS_universal_min_merge_width = 0;
+static int FLAGS_universal_max_merge_width = 0;
+static int FLAGS_universal_max_size_amplification_percent = 0;
+
+// Size limit of all files and age limit in seconds of FIFO compaction.
+// (initialized to default values by "main")
+static uint64_t FLAGS_fifo_max_table_files_size = 0;
+static uint64_t FLAGS_fifo_ttl = 0;
+
+// Maximum number of background compactions running at once.
+// (initialized to default value by "main")
+static int FLAGS_max_background_compactions = 0;
+
+// Maximum number of key ranges a single compaction is split into.
+// (initialized to default value by "main")
+static int FLAGS_max_subcompactions = 0;
+
 // Approximate size of user data packed per block (before compression.
 // (initialized to default value by "main")
 static int FLAGS_block_size = 0;
@@ -100,6 +185,12 @@ static int FLAGS_block_size = 0;
 // Negative means use default settings.
 static int FLAGS_cache_size = -1;
 
+// Block cache implementation: "lru" or "clock".
+static const char *FLAGS_cache_type = "lru";
+
+// A clock cache is split into 2^cache_shard_bits shards.
+static int FLAGS_cache_shard_bits = 4;
+
 // Maximum number of files to keep open at the same time (use default if == 0)
 static int FLAGS_open_files = 0;
 
@@ -118,6 +209,27 @@ static bool FLAGS_use_existing_db = false;
 // If true, reuse existing log/MANIFEST files when re-opening a database.
 static bool FLAGS_reuse_logs = false;
 
+// If true, overlap the log write of a batch group with the memtable
+// insert of the previous one.
+static bool FLAGS_enable_pipelined_write = false;
+
+// If true, the writers of a pipelined batch group insert their own
+// batches into the memtable concurrently.
+static bool FLAGS_allow_concurrent_memtable_write = false;
+
+// Memtable representation: "skiplist", "hash_skiplist" or "vector".
+static const char *FLAGS_memtablerep = "skiplist";
+
+// Number of leading key bytes that pick a hash_skiplist bucket.
+static int FLAGS_memtable_prefix_length = 16;
+
+// Size of the chunks that memtable blocks are carved out of (0: allocate
+// every block separately).
+static int FLAGS_memtable_chunk_size = 0;
+
+// If true, back memtable chunks with huge pages.
+static bool FLAGS_memtable_huge_pages = false;
+
 // Use the db with the following name.
 static const char *FLAGS_db = nullptr;
 
@@ -312,6 +424,8 @@ namespace leveldb {
 
             void AddBytes(int64_t n) { bytes_ += n; }
 
+            int64_t bytes() const { return bytes_; }
+
             void Report(const Slice &name) {
                 // Pretend at least one op was done in case we are running a benchmark
                 // that does not call FinishedSingleOp().
@@ -376,6 +490,8 @@ namespace leveldb {
     private:
         Cache *cache_;
         const FilterPolicy *filter_policy_;
+        const MemTableRepFactory *memtable_factory_;
+        const MergeOperator *merge_operator_;
         DB *db_;
         int num_;
         int value_size_;
@@ -385,6 +501,32 @@ namespace leveldb {
         int heap_counter_;
         CountComparator count_comparator_;
         int total_thread_count_;
+        // Bytes of keys and values written by the fill and overwrite
+        // benchmarks since the DB was created.
+        int64_t user_bytes_written_;
+
+        static Cache *NewCache(size_t capacity) {
+            if (strcmp(FLAGS_cache_type, "lru") == 0) {
+                return NewLRUCache(capacity);
+            } else if (strcmp(FLAGS_cache_type, "clock") == 0) {
+                return NewClockCache(capacity, FLAGS_cache_shard_bits,
+                                     FLAGS_block_size);
+            }
+            std::fprintf(stderr, "unknown cache_type '%s'\n", FLAGS_cache_type);
+            std::exit(1);
+        }
+
+        static const MemTableRepFactory *NewMemTableRepFactory() {
+            if (strcmp(FLAGS_memtablerep, "skiplist") == 0) {
+                return nullptr;
+            } else if (strcmp(FLAGS_memtablerep, "hash_skiplist") == 0) {
+                return NewHashSkipListRepFactory(FLAGS_memtable_prefix_length);
+            } else if (strcmp(FLAGS_memtablerep, "vector") == 0) {
+                return NewVectorRepFactory();
+            }
+            std::fprintf(stderr, "unknown memtablerep '%s'\n", FLAGS_memtablerep);
+            std::exit(1);
+        }
 
         void PrintHeader() {
             const int kKeySize = 16 + FLAGS_key_prefix;
@@ -466,10 +608,12 @@ namespace leveldb {
 
     public:
         Benchmark()
-                : cache_(FLAGS_cache_size >= 0 ? NewLRUCache(FLAGS_cache_size) : nullptr),
+                : cache_(FLAGS_cache_size >= 0 ? NewCache(FLAGS_cache_size) : nullptr),
                   filter_policy_(FLAGS_bloom_bits >= 0
                                  ? NewBloomFilterPolicy(FLAGS_bloom_bits)
                                  : nullptr),
+                  memtable_factory_(NewMemTableRepFactory()),
+                  merge_operator_(NewUInt64AddOperator()),
                   db_(nullptr),
                   num_(FLAGS_num),
                   value_size_(FLAGS_value_size),
@@ -477,7 +621,8 @@ namespace leveldb {
                   reads_(FLAGS_reads < 0 ? FLAGS_num : FLAGS_reads),
                   heap_counter_(0),
                   count_comparator_(BytewiseComparator()),
-                  total_thread_count_(0) {
+                  total_thread_count_(0),
+                  user_bytes_written_(0) {
             std::vector<std::string> files;
             g_env->GetChildren(FLAGS_db, &files);
             for (size_t i = 0; i < files.size(); i++) {
@@ -494,6 +639,8 @@ namespace leveldb {
             delete db_;
             delete cache_;
             delete filter_policy_;
+            delete memtable_factory_;
+            delete merge_operator_;
         }
 
         void Run() {
@@ -571,6 +718,9 @@ namespace leveldb {
                     method = &Benchmark::DeleteSeq;
                 } else if (name == Slice("deleterandom")) {
                     method = &Benchmark::DeleteRandom;
+                } else if (name == Slice("mergerandom")) {
+                    fresh_db = true;
+                    method = &Benchmark::MergeRandom;
                 } else if (name == Slice("readwhilewriting")) {
                     num_threads++;  // Add extra thread for writing
                     method = &Benchmark::ReadWhileWriting;
@@ -578,6 +728,12 @@ namespace leveldb {
                     method = &Benchmark::Compact;
                 } else if (name == Slice("crc32c")) {
                     method = &Benchmark::Crc32c;
+                } else if (name == Slice("cachehit")) {
+                    if (cache_ == nullptr) {
+                        std::fprintf(stderr, "cachehit requires --cache_size\n");
+                    } else {
+                        method = &Benchmark::CacheHit;
+                    }
                 } else if (name == Slice("snappycomp")) {
                     method = &Benchmark::SnappyCompress;
                 } else if (name == Slice("snappyuncomp")) {
@@ -586,6 +742,8 @@ namespace leveldb {
                     HeapProfile();
                 } else if (name == Slice("stats")) {
                     PrintStats("leveldb.stats");
+                } else if (name == Slice("writeamp")) {
+                    PrintWriteAmp();
                 } else if (name == Slice("sstables")) {
                     PrintStats("leveldb.sstables");
                 } else {
@@ -605,6 +763,7 @@ namespace leveldb {
                         db_ = nullptr;
                         DestroyDB(FLAGS_db, Options());
                         Open();
+                        user_bytes_written_ = 0;
                     }
                 }
 
@@ -685,6 +844,10 @@ namespace leveldb {
                 arg[0].thread->stats.Merge(arg[i].thread->stats);
             }
             arg[0].thread->stats.Report(name);
+            if (method == &Benchmark::WriteSeq || method == &Benchmark::WriteRandom ||
+                method == &Benchmark::MergeRandom) {
+                user_bytes_written_ += arg[0].thread->stats.bytes();
+            }
             if (FLAGS_comparisons) {
                 fprintf(stdout, "Comparisons: %zu\n", count_comparator_.comparisons());
                 count_comparator_.reset();
@@ -716,6 +879,30 @@ namespace leveldb {
             thread->stats.AddMessage(label);
         }
 
+        static void DeleteCacheEntry(const Slice &key, void *value) {}
+
+        void CacheHit(ThreadState *thread) {
+            const size_t charge = FLAGS_block_size;
+            char key[8];
+            int64_t hits = 0;
+            for (int i = 0; i < reads_; i++) {
+                EncodeFixed64(key, thread->rand.Uniform(num_));
+                Cache::Handle *handle = cache_->Lookup(Slice(key, sizeof(key)));
+                if (handle != nullptr) {
+                    hits++;
+                } else {
+                    handle = cache_->Insert(Slice(key, sizeof(key)), nullptr, charge,
+                                            &DeleteCacheEntry);
+                }
+                cache_->Release(handle);
+                thread->stats.FinishedSingleOp();
+            }
+            char msg[100];
+            std::snprintf(msg, sizeof(msg), "(%.1f%% hits)",
+                          100.0 * hits / std::max(reads_, 1));
+            thread->stats.AddMessage(msg);
+        }
+
         void SnappyCompress(ThreadState *thread) {
             RandomGenerator gen;
             Slice input = gen.Generate(Options().block_size);
@@ -770,14 +957,64 @@ namespace leveldb {
             options.create_if_missing = !FLAGS_use_existing_db;
             options.block_cache = cache_;
             options.write_buffer_size = FLAGS_write_buffer_size;
+            options.max_write_buffer_number = FLAGS_max_write_buffer_number;
+            options.merge_memtables_on_flush = FLAGS_merge_memtables_on_flush;
+            options.delayed_write_rate = FLAGS_delayed_write_rate;
+            options.soft_pending_compaction_bytes_limit =
+                    FLAGS_soft_pending_compaction_bytes_limit;
+            options.hard_pending_compaction_bytes_limit =
+                    FLAGS_hard_pending_compaction_bytes_limit;
             options.max_file_size = FLAGS_max_file_size;
+            options.target_file_size_multiplier = FLAGS_target_file_size_multiplier;
+            options.level0_file_num_compaction_trigger =
+                    FLAGS_level0_file_num_compaction_trigger;
+            options.level0_slowdown_writes_trigger =
+                    FLAGS_level0_slowdown_writes_trigger;
+            options.level0_stop_writes_trigger = FLAGS_level0_stop_writes_trigger;
+            options.max_bytes_for_level_base = FLAGS_max_bytes_for_level_base;
+            options.max_bytes_for_level_multiplier =
+                    FLAGS_max_bytes_for_level_multiplier;
+            options.level_compaction_dynamic_level_bytes =
+                    FLAGS_level_compaction_dynamic_level_bytes;
+            options.deletion_ratio_compaction_trigger =
+                    FLAGS_deletion_ratio_compaction_trigger;
+            if (FLAGS_max_bytes_for_level_multiplier_additional != nullptr) {
+                const char *p = FLAGS_max_bytes_for_level_multiplier_additional;
+                while (*p != '\0') {
+                    char *end;
+                    const long m = strtol(p, &end, 10);
+                    if (end == p) break;  // Not a number
+                    options.max_bytes_for_level_multiplier_additional.push_back(
+                            static_cast<int>(m));
+                    p = (*end == ',') ? end + 1 : end;
+                }
+            }
+            options.compaction_style =
+                    static_cast<CompactionStyle>(FLAGS_compaction_style);
+            options.compaction_pri = static_cast<CompactionPri>(FLAGS_compaction_pri);
+            options.universal_size_ratio = FLAGS_universal_size_ratio;
+            options.universal_min_merge_width = FLAGS_universal_min_merge_width;
+            options.universal_max_merge_width = FLAGS_universal_max_merge_width;
+            options.universal_max_size_amplification_percent =
+                    FLAGS_universal_max_size_amplification_percent;
+            options.fifo_max_table_files_size = FLAGS_fifo_max_table_files_size;
+            options.fifo_ttl = FLAGS_fifo_ttl;
+            options.max_background_compactions = FLAGS_max_background_compactions;
+            options.max_subcompactions = FLAGS_max_subcompactions;
             options.block_size = FLAGS_block_size;
             if (FLAGS_comparisons) {
                 options.comparator = &count_comparator_;
             }
             options.max_open_files = FLAGS_open_files;
             options.filter_policy = filter_policy_;
+            options.memtable_factory = memtable_factory_;
+            options.merge_operator = merge_operator_;
             options.reuse_logs = FLAGS_reuse_logs;
+            options.enable_pipelined_write = FLAGS_enable_pipelined_write;
+            options.allow_concurrent_memtable_write =
+                    FLAGS_allow_concurrent_memtable_write;
+            options.memtable_chunk_size = FLAGS_memtable_chunk_size;
+            options.memtable_huge_pages = FLAGS_memtable_huge_pages;
             Status s = DB::Open(options, FLAGS_db, &db_);
             if (!s.ok()) {
                 std::fprintf(stderr, "open error: %s\n", s.ToString().c_str());
@@ -959,6 +1196,25 @@ namespace leveldb {
 
         void DeleteRandom(ThreadState *thread) { DoDelete(thread, false); }
 
+        void MergeRandom(ThreadState *thread) {
+            char one[8];
+            EncodeFixed64(one, 1);
+            int64_t bytes = 0;
+            KeyBuffer key;
+            for (int i = 0; i < num_; i++) {
+                const int k = thread->rand.Uniform(FLAGS_num);
+                key.Set(k);
+                Status s = db_->Merge(write_options_, key.slice(), Slice(one, 8));
+                if (!s.ok()) {
+                    std::fprintf(stderr, "merge error: %s\n", s.ToString().c_str());
+                    std::exit(1);
+                }
+                bytes += sizeof(one) + key.slice().size();
+                thread->stats.FinishedSingleOp();
+            }
+            thread->stats.AddBytes(bytes);
+        }
+
         void ReadWhileWriting(ThreadState *thread) {
             if (thread->tid > 0) {
                 ReadRandom(thread);
@@ -1000,6 +1256,27 @@ namespace leveldb {
             std::fprintf(stdout, "\n%s\n", stats.c_str());
         }
 
+        void PrintWriteAmp() {
+            std::string written;
+            if (!db_->GetProperty("leveldb.compaction-bytes-written", &written)) {
+                std::fprintf(stdout, "writeamp     : (failed)\n");
+                return;
+            }
+            const double table_bytes = std::strtoull(written.c_str(), nullptr, 10);
+            if (user_bytes_written_ == 0) {
+                std::fprintf(stdout, "writeamp     : (no data written)\n");
+                return;
+            }
+            // Only counts the compactions that have finished so far, so run
+            // it after a benchmark that lets them quiesce (e.g. "compact").
+            std::fprintf(stdout,
+                         "writeamp     : %11.3f (%.1f MB written to tables for "
+                         "%.1f MB of data)\n",
+                         table_bytes / user_bytes_written_, table_bytes / 1048576.0,
+                         user_bytes_written_ / 1048576.0);
+            std::fflush(stdout);
+        }
+
         static void WriteToFile(void *arg, const char *buf, int n) {
             reinterpret_cast<WritableFile *>(arg)->Append(Slice(buf, n));
         }
@@ -1027,7 +1304,40 @@ namespace leveldb {
 
 int main(int argc, char **argv) {
     FLAGS_write_buffer_size = leveldb::Options().write_buffer_size;
+    FLAGS_max_write_buffer_number =
+            leveldb::Options().max_write_buffer_number;
+    FLAGS_delayed_write_rate = leveldb::Options().delayed_write_rate;
+    FLAGS_soft_pending_compaction_bytes_limit =
+            leveldb::Options().soft_pending_compaction_bytes_limit;
+    FLAGS_hard_pending_compaction_bytes_limit =
+            leveldb::Options().hard_pending_compaction_bytes_limit;
     FLAGS_max_file_size = leveldb::Options().max_file_size;
+    FLAGS_target_file_size_multiplier =
+            leveldb::Options().target_file_size_multiplier;
+    FLAGS_level0_file_num_compaction_trigger =
+            leveldb::Options().level0_file_num_compaction_trigger;
+    FLAGS_level0_slowdown_writes_trigger =
+            leveldb::Options().level0_slowdown_writes_trigger;
+    FLAGS_level0_stop_writes_trigger =
+            leveldb::Options().level0_stop_writes_trigger;
+    FLAGS_max_bytes_for_level_base = leveldb::Options().max_bytes_for_level_base;
+    FLAGS_max_bytes_for_level_multiplier =
+            leveldb::Options().max_bytes_for_level_multiplier;
+    FLAGS_deletion_ratio_compaction_trigger =
+            leveldb::Options().deletion_ratio_compaction_trigger;
+    FLAGS_universal_size_ratio = leveldb::Options().universal_size_ratio;
+    FLAGS_universal_min_merge_width =
+            leveldb::Options().universal_min_merge_width;
+    FLAGS_universal_max_merge_width =
+            leveldb::Options().universal_max_merge_width;
+    FLAGS_universal_max_size_amplification_percent =
+            leveldb::Options().universal_max_size_amplification_percent;
+    FLAGS_fifo_max_table_files_size =
+            leveldb::Options().fifo_max_table_files_size;
+    FLAGS_fifo_ttl = leveldb::Options().fifo_ttl;
+    FLAGS_max_background_compactions =
+            leveldb::Options().max_background_compactions;
+    FLAGS_max_subcompactions = leveldb::Options().max_subcompactions;
     FLAGS_block_size = leveldb::Options().block_size;
     FLAGS_open_files = leveldb::Options().max_open_files;
     std::string default_db_path;
@@ -1035,6 +1345,7 @@ int main(int argc, char **argv) {
     for (int i = 1; i < argc; i++) {
         double d;
         int n;
+        unsigned long long u;
         char junk;
         if (leveldb::Slice(argv[i]).starts_with("--benchmarks=")) {
             FLAGS_benchmarks = argv[i] + strlen("--benchmarks=");
@@ -1052,6 +1363,13 @@ int main(int argc, char **argv) {
         } else if (sscanf(argv[i], "--reuse_logs=%d%c", &n, &junk) == 1 &&
                    (n == 0 || n == 1)) {
             FLAGS_reuse_logs = n;
+        } else if (sscanf(argv[i], "--enable_pipelined_write=%d%c", &n, &junk) == 1 &&
+                   (n == 0 || n == 1)) {
+            FLAGS_enable_pipelined_write = n;
+        } else if (sscanf(argv[i], "--allow_concurrent_memtable_write=%d%c", &n,
+                          &junk) == 1 &&
+                   (n == 0 || n == 1)) {
+            FLAGS_allow_concurrent_memtable_write = n;
         } else if (sscanf(argv[i], "--num=%d%c", &n, &junk) == 1) {
             FLAGS_num = n;
         } else if (sscanf(argv[i], "--reads=%d%c", &n, &junk) == 1) {
@@ -1062,8 +1380,78 @@ int main(int argc, char **argv) {
             FLAGS_value_size = n;
         } else if (sscanf(argv[i], "--write_buffer_size=%d%c", &n, &junk) == 1) {
             FLAGS_write_buffer_size = n;
+        } else if (sscanf(argv[i], "--max_write_buffer_number=%d%c", &n, &junk) ==
+                   1) {
+            FLAGS_max_write_buffer_number = n;
+        } else if (sscanf(argv[i], "--merge_memtables_on_flush=%d%c", &n, &junk) ==
+                       1 &&
+                   (n == 0 || n == 1)) {
+            FLAGS_merge_memtables_on_flush = n;
+        } else if (sscanf(argv[i], "--delayed_write_rate=%llu%c", &u, &junk) == 1) {
+            FLAGS_delayed_write_rate = u;
+        } else if (sscanf(argv[i], "--soft_pending_compaction_bytes_limit=%llu%c",
+                          &u, &junk) == 1) {
+            FLAGS_soft_pending_compaction_bytes_limit = u;
+        } else if (sscanf(argv[i], "--hard_pending_compaction_bytes_limit=%llu%c",
+                          &u, &junk) == 1) {
+            FLAGS_hard_pending_compaction_bytes_limit = u;
         } else if (sscanf(argv[i], "--max_file_size=%d%c", &n, &junk) == 1) {
             FLAGS_max_file_size = n;
+        } else if (sscanf(argv[i], "--target_file_size_multiplier=%d%c", &n,
+                          &junk) == 1) {
+            FLAGS_target_file_size_multiplier = n;
+        } else if (sscanf(argv[i], "--level0_file_num_compaction_trigger=%d%c", &n,
+                          &junk) == 1) {
+            FLAGS_level0_file_num_compaction_trigger = n;
+        } else if (sscanf(argv[i], "--level0_slowdown_writes_trigger=%d%c", &n,
+                          &junk) == 1) {
+            FLAGS_level0_slowdown_writes_trigger = n;
+        } else if (sscanf(argv[i], "--level0_stop_writes_trigger=%d%c", &n,
+                          &junk) == 1) {
+            FLAGS_level0_stop_writes_trigger = n;
+        } else if (sscanf(argv[i], "--max_bytes_for_level_base=%llu%c", &u,
+                          &junk) == 1) {
+            FLAGS_max_bytes_for_level_base = u;
+        } else if (sscanf(argv[i], "--max_bytes_for_level_multiplier=%lf%c", &d,
+                          &junk) == 1) {
+            FLAGS_max_bytes_for_level_multiplier = d;
+        } else if (strncmp(argv[i], "--max_bytes_for_level_multiplier_additional=",
+                           44) == 0) {
+            FLAGS_max_bytes_for_level_multiplier_additional = argv[i] + 44;
+        } else if (sscanf(argv[i], "--level_compaction_dynamic_level_bytes=%d%c", &n,
+                          &junk) == 1 &&
+                   (n == 0 || n == 1)) {
+            FLAGS_level_compaction_dynamic_level_bytes = n;
+        } else if (sscanf(argv[i], "--deletion_ratio_compaction_trigger=%lf%c", &d,
+                          &junk) == 1) {
+            FLAGS_deletion_ratio_compaction_trigger = d;
+        } else if (sscanf(argv[i], "--compaction_style=%d%c", &n, &junk) == 1 &&
+                   (n >= 0 && n <= 2)) {
+            FLAGS_compaction_style = n;
+        } else if (sscanf(argv[i], "--compaction_pri=%d%c", &n, &junk) == 1 &&
+                   (n >= 0 && n <= 2)) {
+            FLAGS_compaction_pri = n;
+        } else if (sscanf(argv[i], "--universal_size_ratio=%d%c", &n, &junk) == 1) {
+            FLAGS_universal_size_ratio = n;
+        } else if (sscanf(argv[i], "--universal_min_merge_width=%d%c", &n,
+                          &junk) == 1) {
+            FLAGS_universal_min_merge_width = n;
+        } else if (sscanf(argv[i], "--universal_max_merge_width=%d%c", &n,
+                          &junk) == 1) {
+            FLAGS_universal_max_merge_width = n;
+        } else if (sscanf(argv[i], "--universal_max_size_amplification_percent=%d%c",
+                          &n, &junk) == 1) {
+            FLAGS_universal_max_size_amplification_percent = n;
+        } else if (sscanf(argv[i], "--fifo_max_table_files_size=%llu%c", &u,
+                          &junk) == 1) {
+            FLAGS_fifo_max_table_files_size = u;
+        } else if (sscanf(argv[i], "--fifo_ttl=%llu%c", &u, &junk) == 1) {
+            FLAGS_fifo_ttl = u;
+        } else if (sscanf(argv[i], "--max_background_compactions=%d%c", &n,
+                          &junk) == 1) {
+            FLAGS_max_background_compactions = n;
+        } else if (sscanf(argv[i], "--max_subcompactions=%d%c", &n, &junk) == 1) {
+            FLAGS_max_subcompactions = n;
         } else if (sscanf(argv[i], "--block_size=%d%c", &n, &junk) == 1) {
             FLAGS_block_size = n;
         } else if (sscanf(argv[i], "--key_prefix=%d%c", &n, &junk) == 1) {
@@ -1072,6 +1460,19 @@ int main(int argc, char **argv) {
             FLAGS_cache_size = n;
         } else if (sscanf(argv[i], "--bloom_bits=%d%c", &n, &junk) == 1) {
             FLAGS_bloom_bits = n;
+        } else if (strncmp(argv[i], "--cache_type=", 13) == 0) {
+            FLAGS_cache_type = argv[i] + 13;
+        } else if (sscanf(argv[i], "--cache_shard_bits=%d%c", &n, &junk) == 1) {
+            FLAGS_cache_shard_bits = n;
+        } else if (strncmp(argv[i], "--memtablerep=", 14) == 0) {
+            FLAGS_memtablerep = argv[i] + 14;
+        } else if (sscanf(argv[i], "--memtable_prefix_length=%d%c", &n, &junk) == 1) {
+            FLAGS_memtable_prefix_length = n;
+        } else if (sscanf(argv[i], "--memtable_chunk_size=%d%c", &n, &junk) == 1) {
+            FLAGS_memtable_chunk_size = n;
+        } else if (sscanf(argv[i], "--memtable_huge_pages=%d%c", &n, &junk) == 1 &&
+                   (n == 0 || n == 1)) {
+            FLAGS_memtable_huge_pages = n;
         } else if (sscanf(argv[i], "--open_files=%d%c", &n, &junk) == 1) {
             FLAGS_open_files = n;
         } else if (strncmp(argv[i], "--db=", 5) == 0) {
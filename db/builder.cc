@@ -6,22 +6,51 @@
 
 #include "db/dbformat.h"
 #include "db/filename.h"
+#include "db/range_tombstone.h"
 #include "db/table_cache.h"
 #include "db/version_edit.h"
+#include "leveldb/compaction_filter.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
 
 namespace leveldb {
 
+    bool FilterEntry(const CompactionFilter *filter, int level,
+                     ParsedInternalKey *ikey, Slice *key, Slice *value,
+                     std::string *key_buf, std::string *value_buf) {
+        assert(ikey->type == kTypeValue);
+        bool value_changed = false;
+        value_buf->clear();
+        if (filter->Filter(level, ikey->user_key, *value, value_buf,
+                           &value_changed)) {
+            ikey->type = kTypeDeletion;
+            key_buf->clear();
+            AppendInternalKey(key_buf, *ikey);
+            *key = *key_buf;
+            *value = Slice();
+            return true;
+        }
+        if (value_changed) {
+            *value = *value_buf;
+            return true;
+        }
+        return false;
+    }
+
     Status BuildTable(const std::string &dbname, Env *env, const Options &options,
-                      TableCache *table_cache, Iterator *iter, FileMetaData *meta) {
+                      TableCache *table_cache, Iterator *iter,
+                      const std::vector<RangeTombstone> &range_dels,
+                      FileMetaData *meta, SequenceNumber newest_snapshot) {
         Status s;
         meta->file_size = 0;
+        meta->num_range_deletions = 0;
+        meta->num_entries = 0;
+        meta->num_deletions = 0;
         iter->SeekToFirst();
 
         std::string fname = TableFileName(dbname, meta->number);
-        if (iter->Valid()) {
+        if (iter->Valid() || !range_dels.empty()) {
             WritableFile *file;
             s = env->NewWritableFile(fname, &file);
             if (!s.ok()) {
@@ -29,19 +58,77 @@ namespace leveldb {
             }
 
             TableBuilder *builder = new TableBuilder(options, file);
-            meta->smallest.DecodeFrom(iter->key());
+            // Tables are built with the internal key comparator
+            const Comparator *ucmp =
+                    static_cast<const InternalKeyComparator *>(options.comparator)
+                            ->user_comparator();
+            std::string current_user_key;
+            bool has_current_user_key = false;
+            std::string key_buf, value_buf;
             Slice key;
             for (; iter->Valid(); iter->Next()) {
                 key = iter->key();
-                builder->Add(key, iter->value());
+                Slice value = iter->value();
+                ParsedInternalKey ikey;
+                if (options.compaction_filter != nullptr &&
+                    ParseInternalKey(key, &ikey)) {
+                    // Entries are sorted newest first for each user key
+                    const bool newest = !has_current_user_key ||
+                                        ucmp->Compare(ikey.user_key,
+                                                      Slice(current_user_key)) != 0;
+                    if (newest) {
+                        current_user_key.assign(ikey.user_key.data(),
+                                                ikey.user_key.size());
+                        has_current_user_key = true;
+                        if (ikey.type == kTypeValue &&
+                            ikey.sequence > newest_snapshot) {
+                            FilterEntry(options.compaction_filter, 0, &ikey, &key,
+                                        &value, &key_buf, &value_buf);
+                        }
+                    }
+                }
+                if (builder->NumEntries() == 0) {
+                    meta->smallest.DecodeFrom(key);
+                }
+                if (key.size() >= 8 && ExtractValueType(key) == kTypeDeletion) {
+                    meta->num_deletions++;
+                }
+                builder->Add(key, value);
             }
+            meta->num_entries = builder->NumEntries();
             if (!key.empty()) {
                 meta->largest.DecodeFrom(key);
             }
 
+            // The range of the table includes its tombstones
+            const Comparator *icmp = options.comparator;
+            bool has_range = !key.empty();
+            for (const RangeTombstone &t : range_dels) {
+                if (ucmp->Compare(t.start, t.end) >= 0) {
+                    continue;  // Empty range
+                }
+                const InternalKey start = t.SerializeKey();
+                const InternalKey end = t.SerializeEndKey();
+                builder->AddRangeTombstone(start.Encode(), t.end);
+                if (!has_range ||
+                    icmp->Compare(start.Encode(), meta->smallest.Encode()) < 0) {
+                    meta->smallest = start;
+                }
+                if (!has_range ||
+                    icmp->Compare(end.Encode(), meta->largest.Encode()) > 0) {
+                    meta->largest = end;
+                }
+                has_range = true;
+            }
+            meta->num_range_deletions = builder->NumRangeTombstones();
+
             // Finish and check for builder errors
-            s = builder->Finish();
-            if (s.ok()) {
+            if (has_range) {
+                s = builder->Finish();
+            } else {
+                builder->Abandon();
+            }
+            if (s.ok() && has_range) {
                 meta->file_size = builder->FileSize();
                 assert(meta->file_size > 0);
             }
@@ -57,7 +144,7 @@ namespace leveldb {
             delete file;
             file = nullptr;
 
-            if (s.ok()) {
+            if (s.ok() && meta->file_size > 0) {
                 // Verify that the table is usable
                 Iterator *it = table_cache->NewIterator(ReadOptions(), meta->number,
                                                         meta->file_size);
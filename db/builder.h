@@ -5,6 +5,10 @@
 #ifndef STORAGE_LEVELDB_DB_BUILDER_H_
 #define STORAGE_LEVELDB_DB_BUILDER_H_
 
+#include <string>
+#include <vector>
+
+#include "db/dbformat.h"
 #include "leveldb/status.h"
 
 namespace leveldb {
@@ -12,6 +16,8 @@ namespace leveldb {
     struct Options;
     struct FileMetaData;
 
+    class CompactionFilter;
+
     class Env;
 
     class Iterator;
@@ -20,13 +26,29 @@ namespace leveldb {
 
     class VersionEdit;
 
-// Build a Table file from the contents of *iter.  The generated file
-// will be named according to meta->number.  On success, the rest of
-// *meta will be filled with metadata about the generated table.
-// If no data is present in *iter, meta->file_size will be set to
-// zero, and no Table file will be produced.
+    struct RangeTombstone;
+
+// Build a Table file from the contents of *iter and the range tombstones
+// in "range_dels".  The generated file will be named according to
+// meta->number.  On success, the rest of *meta will be filled with metadata
+// about the generated table.
+// If no data is present in *iter or "range_dels", meta->file_size will be
+// set to zero, and no Table file will be produced.
+// The newest value of each key with a sequence number above newest_snapshot
+// is passed through options.compaction_filter, if any.
     Status BuildTable(const std::string &dbname, Env *env, const Options &options,
-                      TableCache *table_cache, Iterator *iter, FileMetaData *meta);
+                      TableCache *table_cache, Iterator *iter,
+                      const std::vector<RangeTombstone> &range_dels,
+                      FileMetaData *meta, SequenceNumber newest_snapshot);
+
+// Pass the value of the entry *key,*value, whose parsed key is *ikey, to
+// "filter" for an output to "level".  If the filter removes the value, the
+// entry is changed to a deletion marker whose key is stored in *key_buf;
+// if it replaces the value, *value is changed to the new value stored in
+// *value_buf.  Returns true iff the entry was changed.
+    bool FilterEntry(const CompactionFilter *filter, int level,
+                     ParsedInternalKey *ikey, Slice *key, Slice *value,
+                     std::string *key_buf, std::string *value_buf);
 
 }  // namespace leveldb
 
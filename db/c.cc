@@ -10,13 +10,19 @@
 #include <cstdlib>
 
 #include "leveldb/cache.h"
+#include "leveldb/compaction_filter.h"
+#include "leveldb/merge_operator.h"
 #include "leveldb/comparator.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/memtablerep.h"
 #include "leveldb/write_batch.h"
 
 using leveldb::Cache;
+using leveldb::CompactionFilter;
+using leveldb::CompactionPri;
+using leveldb::CompactionStyle;
 using leveldb::Comparator;
 using leveldb::CompressionType;
 using leveldb::DB;
@@ -27,8 +33,15 @@ using leveldb::Iterator;
 using leveldb::kMajorVersion;
 using leveldb::kMinorVersion;
 using leveldb::Logger;
+using leveldb::MemTableRepFactory;
+using leveldb::MergeOperator;
 using leveldb::NewBloomFilterPolicy;
+using leveldb::NewClockCache;
+using leveldb::NewHashSkipListRepFactory;
 using leveldb::NewLRUCache;
+using leveldb::NewSkipListRepFactory;
+using leveldb::NewUInt64AddOperator;
+using leveldb::NewVectorRepFactory;
 using leveldb::Options;
 using leveldb::RandomAccessFile;
 using leveldb::Range;
@@ -67,6 +80,9 @@ struct leveldb_options_t {
 struct leveldb_cache_t {
     Cache *rep;
 };
+struct leveldb_memtablerep_factory_t {
+    const MemTableRepFactory *rep;
+};
 struct leveldb_seqfile_t {
     SequentialFile *rep;
 };
@@ -144,6 +160,88 @@ struct leveldb_filterpolicy_t : public FilterPolicy {
                           const char *filter, size_t filter_length){};
 };
 
+struct leveldb_compactionfilter_t : public CompactionFilter {
+    ~leveldb_compactionfilter_t() override { (*destructor_)(state_); }
+
+    const char *Name() const override { return (*name_)(state_); }
+
+    bool Filter(int level, const Slice &key, const Slice &existing_value,
+                std::string *new_value, bool *value_changed) const override {
+        char *value = nullptr;
+        size_t len = 0;
+        uint8_t changed = 0;
+        const bool remove = (*filter_)(state_, level, key.data(), key.size(),
+                                       existing_value.data(),
+                                       existing_value.size(), &value, &len,
+                                       &changed);
+        if (value != nullptr) {
+            if (changed) {
+                new_value->assign(value, len);
+            }
+            std::free(value);
+        }
+        *value_changed = (changed != 0);
+        return remove;
+    }
+
+    void *state_{};
+
+    void (*destructor_)(void *){};
+
+    const char *(*name_)(void *){};
+
+    uint8_t (*filter_)(void *, int level, const char *key, size_t key_length,
+                       const char *existing_value, size_t value_length,
+                       char **new_value, size_t *new_value_length,
+                       uint8_t *value_changed){};
+};
+
+struct leveldb_mergeoperator_t : public MergeOperator {
+    ~leveldb_mergeoperator_t() override { (*destructor_)(state_); }
+
+    const char *Name() const override { return (*name_)(state_); }
+
+    bool FullMerge(const Slice &key, const Slice *existing_value,
+                   const std::vector<Slice> &operands,
+                   std::string *new_value) const override {
+        const int n = static_cast<int>(operands.size());
+        std::vector<const char *> operand_pointers(n);
+        std::vector<size_t> operand_sizes(n);
+        for (int i = 0; i < n; i++) {
+            operand_pointers[i] = operands[i].data();
+            operand_sizes[i] = operands[i].size();
+        }
+        uint8_t success = 0;
+        size_t len = 0;
+        char *value = (*full_merge_)(
+                state_, key.data(), key.size(),
+                existing_value != nullptr ? existing_value->data() : nullptr,
+                existing_value != nullptr ? existing_value->size() : 0,
+                existing_value != nullptr, &operand_pointers[0], &operand_sizes[0],
+                n, &success, &len);
+        if (value != nullptr) {
+            if (success) {
+                new_value->assign(value, len);
+            }
+            std::free(value);
+        }
+        return success != 0;
+    }
+
+    void *state_{};
+
+    void (*destructor_)(void *){};
+
+    const char *(*name_)(void *){};
+
+    char *(*full_merge_)(void *, const char *key, size_t key_length,
+                         const char *existing_value, size_t value_length,
+                         uint8_t has_existing_value,
+                         const char *const *operands_list,
+                         const size_t *operands_list_length, int num_operands,
+                         uint8_t *success, size_t *new_value_length){};
+};
+
 struct leveldb_env_t {
     Env *rep;
     bool is_default;
@@ -198,6 +296,22 @@ void leveldb_delete(leveldb_t *db, const leveldb_writeoptions_t *options,
     SaveError(errptr, db->rep->Delete(options->rep, Slice(key, keylen)));
 }
 
+void leveldb_merge(leveldb_t *db, const leveldb_writeoptions_t *options,
+                   const char *key, size_t keylen, const char *val,
+                   size_t vallen, char **errptr) {
+    SaveError(errptr,
+              db->rep->Merge(options->rep, Slice(key, keylen), Slice(val, vallen)));
+}
+
+void leveldb_delete_range(leveldb_t *db, const leveldb_writeoptions_t *options,
+                          const char *start_key, size_t start_keylen,
+                          const char *limit_key, size_t limit_keylen,
+                          char **errptr) {
+    SaveError(errptr, db->rep->DeleteRange(options->rep,
+                                           Slice(start_key, start_keylen),
+                                           Slice(limit_key, limit_keylen)));
+}
+
 void leveldb_write(leveldb_t *db, const leveldb_writeoptions_t *options,
                    leveldb_writebatch_t *batch, char **errptr) {
     SaveError(errptr, db->rep->Write(options->rep, &batch->rep));
@@ -344,6 +458,18 @@ void leveldb_writebatch_delete(leveldb_writebatch_t *b, const char *key,
     b->rep.Delete(Slice(key, klen));
 }
 
+void leveldb_writebatch_merge(leveldb_writebatch_t *b, const char *key,
+                              size_t klen, const char *val, size_t vlen) {
+    b->rep.Merge(Slice(key, klen), Slice(val, vlen));
+}
+
+void leveldb_writebatch_delete_range(leveldb_writebatch_t *b,
+                                     const char *start_key, size_t start_klen,
+                                     const char *limit_key, size_t limit_klen) {
+    b->rep.DeleteRange(Slice(start_key, start_klen),
+                       Slice(limit_key, limit_klen));
+}
+
 void leveldb_writebatch_iterate(const leveldb_writebatch_t *b, void *state,
                                 void (*put)(void *, const char *k, size_t klen,
                                             const char *v, size_t vlen),
@@ -391,6 +517,16 @@ void leveldb_options_set_filter_policy(leveldb_options_t *opt,
     opt->rep.filter_policy = policy;
 }
 
+void leveldb_options_set_compaction_filter(leveldb_options_t *opt,
+                                           leveldb_compactionfilter_t *filter) {
+    opt->rep.compaction_filter = filter;
+}
+
+void leveldb_options_set_merge_operator(leveldb_options_t *opt,
+                                        leveldb_mergeoperator_t *merge_operator) {
+    opt->rep.merge_operator = merge_operator;
+}
+
 void leveldb_options_set_create_if_missing(leveldb_options_t *opt, uint8_t v) {
     opt->rep.create_if_missing = v;
 }
@@ -435,10 +571,151 @@ void leveldb_options_set_max_file_size(leveldb_options_t *opt, size_t s) {
     opt->rep.max_file_size = s;
 }
 
+void leveldb_options_set_target_file_size_multiplier(leveldb_options_t *opt,
+                                                     int n) {
+    opt->rep.target_file_size_multiplier = n;
+}
+
+void leveldb_options_set_level0_file_num_compaction_trigger(
+        leveldb_options_t *opt, int n) {
+    opt->rep.level0_file_num_compaction_trigger = n;
+}
+
+void leveldb_options_set_level0_slowdown_writes_trigger(leveldb_options_t *opt,
+                                                        int n) {
+    opt->rep.level0_slowdown_writes_trigger = n;
+}
+
+void leveldb_options_set_level0_stop_writes_trigger(leveldb_options_t *opt,
+                                                    int n) {
+    opt->rep.level0_stop_writes_trigger = n;
+}
+
+void leveldb_options_set_max_bytes_for_level_base(leveldb_options_t *opt,
+                                                  uint64_t n) {
+    opt->rep.max_bytes_for_level_base = n;
+}
+
+void leveldb_options_set_max_bytes_for_level_multiplier(leveldb_options_t *opt,
+                                                        double n) {
+    opt->rep.max_bytes_for_level_multiplier = n;
+}
+
+void leveldb_options_set_max_bytes_for_level_multiplier_additional(
+        leveldb_options_t *opt, const int *level_values, size_t num_levels) {
+    opt->rep.max_bytes_for_level_multiplier_additional.assign(
+            level_values, level_values + num_levels);
+}
+
+void leveldb_options_set_level_compaction_dynamic_level_bytes(
+        leveldb_options_t *opt, uint8_t v) {
+    opt->rep.level_compaction_dynamic_level_bytes = v;
+}
+
+void leveldb_options_set_deletion_ratio_compaction_trigger(
+        leveldb_options_t *opt, double v) {
+    opt->rep.deletion_ratio_compaction_trigger = v;
+}
+
+void leveldb_options_set_max_background_compactions(leveldb_options_t *opt,
+                                                    int n) {
+    opt->rep.max_background_compactions = n;
+}
+
+void leveldb_options_set_max_subcompactions(leveldb_options_t *opt, int n) {
+    opt->rep.max_subcompactions = n;
+}
+
+void leveldb_options_set_enable_pipelined_write(leveldb_options_t *opt,
+                                                uint8_t v) {
+    opt->rep.enable_pipelined_write = v;
+}
+
+void leveldb_options_set_allow_concurrent_memtable_write(leveldb_options_t *opt,
+                                                         uint8_t v) {
+    opt->rep.allow_concurrent_memtable_write = v;
+}
+
+void leveldb_options_set_max_write_buffer_number(leveldb_options_t *opt,
+                                                 int n) {
+    opt->rep.max_write_buffer_number = n;
+}
+
+void leveldb_options_set_merge_memtables_on_flush(leveldb_options_t *opt,
+                                                  uint8_t v) {
+    opt->rep.merge_memtables_on_flush = v;
+}
+
+void leveldb_options_set_delayed_write_rate(leveldb_options_t *opt,
+                                            uint64_t rate) {
+    opt->rep.delayed_write_rate = rate;
+}
+
+void leveldb_options_set_soft_pending_compaction_bytes_limit(
+        leveldb_options_t *opt, uint64_t limit) {
+    opt->rep.soft_pending_compaction_bytes_limit = limit;
+}
+
+void leveldb_options_set_hard_pending_compaction_bytes_limit(
+        leveldb_options_t *opt, uint64_t limit) {
+    opt->rep.hard_pending_compaction_bytes_limit = limit;
+}
+
+void leveldb_options_set_memtable_factory(leveldb_options_t *opt,
+                                          leveldb_memtablerep_factory_t *f) {
+    opt->rep.memtable_factory = (f != nullptr) ? f->rep : nullptr;
+}
+
+void leveldb_options_set_memtable_chunk_size(leveldb_options_t *opt,
+                                             size_t s) {
+    opt->rep.memtable_chunk_size = s;
+}
+
+void leveldb_options_set_memtable_huge_pages(leveldb_options_t *opt,
+                                             uint8_t v) {
+    opt->rep.memtable_huge_pages = v;
+}
+
 void leveldb_options_set_compression(leveldb_options_t *opt, int t) {
     opt->rep.compression = static_cast<CompressionType>(t);
 }
 
+void leveldb_options_set_compaction_style(leveldb_options_t *opt, int style) {
+    opt->rep.compaction_style = static_cast<CompactionStyle>(style);
+}
+
+void leveldb_options_set_compaction_pri(leveldb_options_t *opt, int pri) {
+    opt->rep.compaction_pri = static_cast<CompactionPri>(pri);
+}
+
+void leveldb_options_set_universal_size_ratio(leveldb_options_t *opt, int n) {
+    opt->rep.universal_size_ratio = n;
+}
+
+void leveldb_options_set_universal_min_merge_width(leveldb_options_t *opt,
+                                                   int n) {
+    opt->rep.universal_min_merge_width = n;
+}
+
+void leveldb_options_set_universal_max_merge_width(leveldb_options_t *opt,
+                                                   int n) {
+    opt->rep.universal_max_merge_width = n;
+}
+
+void leveldb_options_set_universal_max_size_amplification_percent(
+        leveldb_options_t *opt, int n) {
+    opt->rep.universal_max_size_amplification_percent = n;
+}
+
+void leveldb_options_set_fifo_max_table_files_size(leveldb_options_t *opt,
+                                                   uint64_t v) {
+    opt->rep.fifo_max_table_files_size = v;
+}
+
+void leveldb_options_set_fifo_ttl(leveldb_options_t *opt, uint64_t v) {
+    opt->rep.fifo_ttl = v;
+}
+
 leveldb_comparator_t *leveldb_comparator_create(
         void *state, void (*destructor)(void *),
         int (*compare)(void *, const char *a, size_t alen, const char *b,
@@ -503,6 +780,72 @@ leveldb_filterpolicy_t *leveldb_filterpolicy_create_bloom(int bits_per_key) {
     return wrapper;
 }
 
+leveldb_compactionfilter_t *leveldb_compactionfilter_create(
+        void *state, void (*destructor)(void *),
+        uint8_t (*filter)(void *, int level, const char *key, size_t key_length,
+                          const char *existing_value, size_t value_length,
+                          char **new_value, size_t *new_value_length,
+                          uint8_t *value_changed),
+        const char *(*name)(void *)) {
+    auto *result = new leveldb_compactionfilter_t;
+    result->state_ = state;
+    result->destructor_ = destructor;
+    result->filter_ = filter;
+    result->name_ = name;
+    return result;
+}
+
+void leveldb_compactionfilter_destroy(leveldb_compactionfilter_t *filter) {
+    delete filter;
+}
+
+leveldb_mergeoperator_t *leveldb_mergeoperator_create(
+        void *state, void (*destructor)(void *),
+        char *(*full_merge)(void *, const char *key, size_t key_length,
+                            const char *existing_value, size_t value_length,
+                            uint8_t has_existing_value,
+                            const char *const *operands_list,
+                            const size_t *operands_list_length, int num_operands,
+                            uint8_t *success, size_t *new_value_length),
+        const char *(*name)(void *)) {
+    auto *result = new leveldb_mergeoperator_t;
+    result->state_ = state;
+    result->destructor_ = destructor;
+    result->full_merge_ = full_merge;
+    result->name_ = name;
+    return result;
+}
+
+void leveldb_mergeoperator_destroy(leveldb_mergeoperator_t *merge_operator) {
+    delete merge_operator;
+}
+
+leveldb_mergeoperator_t *leveldb_mergeoperator_create_uint64add() {
+    // Make a leveldb_mergeoperator_t, but override all of its methods so
+    // they delegate to a NewUInt64AddOperator() instead of user
+    // supplied C functions.
+    struct Wrapper : public leveldb_mergeoperator_t {
+        static void DoNothing(void *) {}
+
+        ~Wrapper() { delete rep_; }
+
+        const char *Name() const { return rep_->Name(); }
+
+        bool FullMerge(const Slice &key, const Slice *existing_value,
+                       const std::vector<Slice> &operands,
+                       std::string *new_value) const override {
+            return rep_->FullMerge(key, existing_value, operands, new_value);
+        }
+
+        const MergeOperator *rep_;
+    };
+    auto *wrapper = new Wrapper;
+    wrapper->rep_ = NewUInt64AddOperator();
+    wrapper->state_ = nullptr;
+    wrapper->destructor_ = &Wrapper::DoNothing;
+    return wrapper;
+}
+
 leveldb_readoptions_t *leveldb_readoptions_create() {
     return new leveldb_readoptions_t;
 }
@@ -539,11 +882,42 @@ leveldb_cache_t *leveldb_cache_create_lru(size_t capacity) {
     return c;
 }
 
+leveldb_cache_t *leveldb_cache_create_clock(size_t capacity, int num_shard_bits,
+                                            size_t estimated_entry_charge) {
+    auto *c = new leveldb_cache_t;
+    c->rep = NewClockCache(capacity, num_shard_bits, estimated_entry_charge);
+    return c;
+}
+
 void leveldb_cache_destroy(leveldb_cache_t *cache) {
     delete cache->rep;
     delete cache;
 }
 
+leveldb_memtablerep_factory_t *leveldb_memtablerep_factory_create_skiplist() {
+    auto *f = new leveldb_memtablerep_factory_t;
+    f->rep = NewSkipListRepFactory();
+    return f;
+}
+
+leveldb_memtablerep_factory_t *leveldb_memtablerep_factory_create_hash_skiplist(
+        size_t prefix_length, size_t bucket_count) {
+    auto *f = new leveldb_memtablerep_factory_t;
+    f->rep = NewHashSkipListRepFactory(prefix_length, bucket_count);
+    return f;
+}
+
+leveldb_memtablerep_factory_t *leveldb_memtablerep_factory_create_vector() {
+    auto *f = new leveldb_memtablerep_factory_t;
+    f->rep = NewVectorRepFactory();
+    return f;
+}
+
+void leveldb_memtablerep_factory_destroy(leveldb_memtablerep_factory_t *f) {
+    delete f->rep;
+    delete f;
+}
+
 leveldb_env_t *leveldb_create_default_env() {
     auto *result = new leveldb_env_t;
     result->rep = Env::Default();
@@ -146,6 +146,62 @@ uint8_t FilterKeyMatch(void *arg, const char *key, size_t length,
     return fake_filter_result;
 }
 
+// Compaction filter: removes "bar" and uppercases the value of "foo".
+static const char *CompactionFilterName(void *arg) {
+    return "TestCompactionFilter";
+}
+
+static uint8_t CompactionFilterFilter(
+        void *arg, int level, const char *key, size_t key_length,
+        const char *existing_value, size_t value_length,
+        char **new_value, size_t *new_value_length, uint8_t *value_changed) {
+    if (key_length == 3 && memcmp(key, "bar", 3) == 0) {
+        return 1;
+    }
+    if (key_length == 3 && memcmp(key, "foo", 3) == 0) {
+        *new_value = malloc(value_length);
+        for (size_t i = 0; i < value_length; i++) {
+            (*new_value)[i] = (char) (existing_value[i] - 'a' + 'A');
+        }
+        *new_value_length = value_length;
+        *value_changed = 1;
+    }
+    return 0;
+}
+
+// Merge operator: joins the existing value and the operands with ','.
+static const char *MergeOperatorName(void *arg) {
+    return "TestMergeOperator";
+}
+
+static char *MergeOperatorFullMerge(
+        void *arg, const char *key, size_t key_length,
+        const char *existing_value, size_t value_length,
+        uint8_t has_existing_value, const char *const *operands_list,
+        const size_t *operands_list_length, int num_operands,
+        uint8_t *success, size_t *new_value_length) {
+    size_t len = has_existing_value ? value_length : 0;
+    for (int i = 0; i < num_operands; i++) {
+        len += 1 + operands_list_length[i];
+    }
+    char *result = malloc(len + 1);
+    size_t pos = 0;
+    if (has_existing_value) {
+        memcpy(result, existing_value, value_length);
+        pos = value_length;
+    }
+    for (int i = 0; i < num_operands; i++) {
+        if (pos > 0) {
+            result[pos++] = ',';
+        }
+        memcpy(result + pos, operands_list[i], operands_list_length[i]);
+        pos += operands_list_length[i];
+    }
+    *success = 1;
+    *new_value_length = pos;
+    return result;
+}
+
 int main(int argc, char **argv) {
     leveldb_t *db;
     leveldb_comparator_t *cmp;
@@ -373,6 +429,127 @@ int main(int argc, char **argv) {
         leveldb_filterpolicy_destroy(policy);
     }
 
+    StartPhase("compactionfilter");
+    {
+        leveldb_compactionfilter_t *filter = leveldb_compactionfilter_create(
+                NULL, FilterDestroy, CompactionFilterFilter, CompactionFilterName);
+        leveldb_close(db);
+        leveldb_destroy_db(options, dbname, &err);
+        leveldb_options_set_compaction_filter(options, filter);
+        db = leveldb_open(options, dbname, &err);
+        CheckNoError(err);
+        leveldb_put(db, woptions, "foo", 3, "foovalue", 8, &err);
+        CheckNoError(err);
+        leveldb_put(db, woptions, "bar", 3, "barvalue", 8, &err);
+        CheckNoError(err);
+        leveldb_put(db, woptions, "box", 3, "boxvalue", 8, &err);
+        CheckNoError(err);
+        leveldb_compact_range(db, NULL, 0, NULL, 0);
+        CheckGet(db, roptions, "foo", "FOOVALUE");
+        CheckGet(db, roptions, "bar", NULL);
+        CheckGet(db, roptions, "box", "boxvalue");
+
+        leveldb_close(db);
+        leveldb_destroy_db(options, dbname, &err);
+        leveldb_options_set_compaction_filter(options, NULL);
+        db = leveldb_open(options, dbname, &err);
+        CheckNoError(err);
+        leveldb_compactionfilter_destroy(filter);
+    }
+
+    StartPhase("mergeoperator");
+    {
+        leveldb_mergeoperator_t *merge_operator = leveldb_mergeoperator_create(
+                NULL, FilterDestroy, MergeOperatorFullMerge, MergeOperatorName);
+        leveldb_close(db);
+        leveldb_destroy_db(options, dbname, &err);
+        leveldb_options_set_merge_operator(options, merge_operator);
+        db = leveldb_open(options, dbname, &err);
+        CheckNoError(err);
+        leveldb_put(db, woptions, "foo", 3, "a", 1, &err);
+        CheckNoError(err);
+        leveldb_merge(db, woptions, "foo", 3, "b", 1, &err);
+        CheckNoError(err);
+        leveldb_writebatch_t *wb = leveldb_writebatch_create();
+        leveldb_writebatch_merge(wb, "foo", 3, "c", 1);
+        leveldb_writebatch_merge(wb, "bar", 3, "x", 1);
+        leveldb_write(db, woptions, wb, &err);
+        CheckNoError(err);
+        leveldb_writebatch_destroy(wb);
+        CheckGet(db, roptions, "foo", "a,b,c");
+        CheckGet(db, roptions, "bar", "x");
+        leveldb_compact_range(db, NULL, 0, NULL, 0);
+        CheckGet(db, roptions, "foo", "a,b,c");
+        CheckGet(db, roptions, "bar", "x");
+
+        leveldb_close(db);
+        leveldb_destroy_db(options, dbname, &err);
+        leveldb_options_set_merge_operator(options, NULL);
+        db = leveldb_open(options, dbname, &err);
+        CheckNoError(err);
+        leveldb_mergeoperator_destroy(merge_operator);
+    }
+
+    StartPhase("deleterange");
+    {
+        leveldb_put(db, woptions, "a", 1, "va", 2, &err);
+        CheckNoError(err);
+        leveldb_put(db, woptions, "b", 1, "vb", 2, &err);
+        CheckNoError(err);
+        leveldb_put(db, woptions, "c", 1, "vc", 2, &err);
+        CheckNoError(err);
+        leveldb_delete_range(db, woptions, "a", 1, "b", 1, &err);
+        CheckNoError(err);
+        leveldb_writebatch_t *wb = leveldb_writebatch_create();
+        leveldb_writebatch_delete_range(wb, "b", 1, "c", 1);
+        leveldb_write(db, woptions, wb, &err);
+        CheckNoError(err);
+        leveldb_writebatch_destroy(wb);
+        CheckGet(db, roptions, "a", NULL);
+        CheckGet(db, roptions, "b", NULL);
+        CheckGet(db, roptions, "c", "vc");
+        leveldb_compact_range(db, NULL, 0, NULL, 0);
+        CheckGet(db, roptions, "a", NULL);
+        CheckGet(db, roptions, "b", NULL);
+        CheckGet(db, roptions, "c", "vc");
+    }
+
+    StartPhase("memtablerep");
+    for (run = 0; run < 3; run++) {
+        leveldb_memtablerep_factory_t *factory;
+        if (run == 0) {
+            factory = leveldb_memtablerep_factory_create_skiplist();
+        } else if (run == 1) {
+            factory = leveldb_memtablerep_factory_create_hash_skiplist(2, 100);
+        } else {
+            factory = leveldb_memtablerep_factory_create_vector();
+        }
+
+        // Create new database
+        leveldb_close(db);
+        leveldb_destroy_db(options, dbname, &err);
+        leveldb_options_set_memtable_factory(options, factory);
+        db = leveldb_open(options, dbname, &err);
+        CheckNoError(err);
+        leveldb_put(db, woptions, "foo", 3, "foovalue", 8, &err);
+        CheckNoError(err);
+        leveldb_put(db, woptions, "bar", 3, "barvalue", 8, &err);
+        CheckNoError(err);
+        CheckGet(db, roptions, "foo", "foovalue");
+        CheckGet(db, roptions, "bar", "barvalue");
+        leveldb_compact_range(db, NULL, 0, NULL, 0);
+        CheckGet(db, roptions, "foo", "foovalue");
+        CheckGet(db, roptions, "bar", "barvalue");
+
+        // The factory must outlive the database
+        leveldb_close(db);
+        leveldb_destroy_db(options, dbname, &err);
+        leveldb_options_set_memtable_factory(options, NULL);
+        db = leveldb_open(options, dbname, &err);
+        CheckNoError(err);
+        leveldb_memtablerep_factory_destroy(factory);
+    }
+
     StartPhase("cleanup");
     leveldb_close(db);
     leveldb_options_destroy(options);
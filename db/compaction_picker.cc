@@ -0,0 +1,497 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/compaction_picker.h"
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+#include "db/version_set.h"
+#include "leveldb/env.h"
+#include "leveldb/options.h"
+
+namespace leveldb {
+
+// Fewest level-0 files worth merging into one while level-0 waits for a
+// compaction into the base level.
+static const size_t kMinFilesForIntraLevel0Compaction = 4;
+
+bool LevelCompactionPicker::NeedsCompaction() const {
+  const Version* v = vset_->current_;
+  if (vset_->running_compactions_.empty()) {
+    return (v->compaction_score_ >= 1) || (v->file_to_compact_ != nullptr) ||
+           !v->files_marked_for_compaction_.empty();
+  }
+
+  // Only report work that PickCompaction() may be able to start next to
+  // the running compactions.
+  bool level0_busy = false;
+  for (Compaction* r : vset_->running_compactions_) {
+    if (r->level() == 0 && r->output_level() != 0) {
+      level0_busy = true;
+    }
+  }
+  for (int level = 0; level < config::kNumLevels - 1; level++) {
+    if (v->level_scores_[level] < 1) {
+      continue;
+    }
+    if (level == 0 && level0_busy) {
+      std::vector<FileMetaData*> inputs;
+      if (PickIntraLevel0Inputs(&inputs)) {
+        return true;
+      }
+      continue;
+    }
+    for (FileMetaData* f : v->files_[level]) {
+      if (!f->being_compacted) {
+        return true;
+      }
+    }
+  }
+  for (const auto& marked : v->files_marked_for_compaction_) {
+    if (!marked.second->being_compacted) {
+      return true;
+    }
+  }
+  return (v->file_to_compact_ != nullptr &&
+          !v->file_to_compact_->being_compacted);
+}
+
+Compaction* LevelCompactionPicker::PickCompaction() {
+  const Version* v = vset_->current_;
+  Compaction* c = nullptr;
+
+  // We prefer compactions triggered by too much data in a level over the
+  // compactions triggered by deletion markers, and those over the
+  // compactions triggered by seeks.  Levels are tried from the highest
+  // score down so that a level whose files are all taken by running
+  // compactions does not hold up the others.
+  int levels[config::kNumLevels - 1];
+  for (int level = 0; level < config::kNumLevels - 1; level++) {
+    levels[level] = level;
+  }
+  std::stable_sort(levels, levels + config::kNumLevels - 1,
+                   [v](int a, int b) {
+                     return v->level_scores_[a] > v->level_scores_[b];
+                   });
+  for (int i = 0; i < config::kNumLevels - 1 && c == nullptr; i++) {
+    const int level = levels[i];
+    if (v->level_scores_[level] < 1) {
+      break;
+    }
+    c = PickSizeCompaction(level);
+    if (c == nullptr && level == 0) {
+      c = PickIntraLevel0Compaction();
+    }
+  }
+
+  for (size_t i = 0; i < v->files_marked_for_compaction_.size() && c == nullptr;
+       i++) {
+    const auto& marked = v->files_marked_for_compaction_[i];
+    if (!marked.second->being_compacted) {
+      c = SetupCompaction(marked.first, marked.second);
+    }
+  }
+
+  if (c == nullptr && v->file_to_compact_ != nullptr &&
+      !v->file_to_compact_->being_compacted) {
+    c = SetupCompaction(v->file_to_compact_level_, v->file_to_compact_);
+  }
+  return c;
+}
+
+Compaction* LevelCompactionPicker::PickSizeCompaction(int level) {
+  assert(level >= 0);
+  assert(level + 1 < config::kNumLevels);
+  const std::vector<FileMetaData*>& files = vset_->current_->files_[level];
+  if (files.empty()) {
+    return nullptr;
+  }
+
+  std::vector<FileMetaData*> candidates;
+  if (level == 0 ||
+      vset_->options_->compaction_pri == kCompactionPriRoundRobin) {
+    // Pick the first file that comes after compact_pointer_[level]
+    const std::string& pointer = vset_->compact_pointer_[level];
+    size_t start = 0;
+    while (start < files.size() && !pointer.empty() &&
+           vset_->icmp_.Compare(files[start]->largest.Encode(), pointer) <=
+               0) {
+      start++;
+    }
+    if (start == files.size()) {
+      // Wrap-around to the beginning of the key space
+      start = 0;
+    }
+    for (size_t i = 0; i < files.size(); i++) {
+      candidates.push_back(files[(start + i) % files.size()]);
+    }
+  } else {
+    candidates = files;
+    SortByCompactionPri(level, &candidates);
+  }
+
+  // Skip over files that cannot be compacted next to the running
+  // compactions.
+  for (FileMetaData* f : candidates) {
+    if (f->being_compacted) {
+      continue;
+    }
+    Compaction* c = SetupCompaction(level, f);
+    if (c != nullptr) {
+      return c;
+    }
+  }
+  return nullptr;
+}
+
+void LevelCompactionPicker::SortByCompactionPri(
+    int level, std::vector<FileMetaData*>* files) const {
+  if (vset_->options_->compaction_pri == kCompactionPriOldestDataFirst) {
+    // Files of unknown age come first, they predate the others
+    std::stable_sort(files->begin(), files->end(),
+                     [](const FileMetaData* a, const FileMetaData* b) {
+                       return a->creation_time < b->creation_time;
+                     });
+    return;
+  }
+  if (vset_->options_->compaction_pri != kCompactionPriMinOverlappingRatio) {
+    return;
+  }
+
+  // Both levels are sorted and their files disjoint, so one pass over the
+  // next level finds the bytes that each file overlaps.
+  const Version* current = vset_->current_;
+  const Comparator* ucmp = vset_->icmp_.user_comparator();
+  const std::vector<FileMetaData*>& next =
+      current->files_[VersionSet::OutputLevel(current, level)];
+  std::vector<std::pair<double, FileMetaData*>> scored;
+  size_t first = 0;
+  for (FileMetaData* f : *files) {
+    while (first < next.size() &&
+           ucmp->Compare(next[first]->largest.user_key(),
+                         f->smallest.user_key()) < 0) {
+      first++;
+    }
+    uint64_t overlapping = 0;
+    for (size_t i = first;
+         i < next.size() && ucmp->Compare(next[i]->smallest.user_key(),
+                                          f->largest.user_key()) <= 0;
+         i++) {
+      overlapping += next[i]->file_size;
+    }
+    scored.emplace_back(static_cast<double>(overlapping) /
+                            std::max<uint64_t>(f->file_size, 1),
+                        f);
+  }
+  std::stable_sort(scored.begin(), scored.end(),
+                   [](const std::pair<double, FileMetaData*>& a,
+                      const std::pair<double, FileMetaData*>& b) {
+                     return a.first < b.first;
+                   });
+  for (size_t i = 0; i < scored.size(); i++) {
+    (*files)[i] = scored[i].second;
+  }
+}
+
+bool LevelCompactionPicker::PickIntraLevel0Inputs(
+    std::vector<FileMetaData*>* inputs) const {
+  inputs->clear();
+  // A table being flushed took its file number before the output would,
+  // yet holds newer data.
+  if (vset_->flush_running_) {
+    return false;
+  }
+  for (Compaction* r : vset_->running_compactions_) {
+    if (r->output_level() == 0) {
+      return false;
+    }
+  }
+
+  // The output is numbered as the newest file of level-0, so it has to
+  // replace the newest files: take them from the newest one down to the
+  // first one that is already being compacted.  Larger outputs would only
+  // make the next compaction into the base level larger.
+  std::vector<FileMetaData*> files = vset_->current_->files_[0];
+  std::sort(files.begin(), files.end(), [](FileMetaData* a, FileMetaData* b) {
+    return a->number > b->number;
+  });
+  const uint64_t limit = vset_->options_->max_bytes_for_level_base;
+  uint64_t total = 0;
+  for (FileMetaData* f : files) {
+    if (f->being_compacted || total + f->file_size > limit) {
+      break;
+    }
+    inputs->push_back(f);
+    total += f->file_size;
+  }
+  return inputs->size() >= kMinFilesForIntraLevel0Compaction;
+}
+
+Compaction* LevelCompactionPicker::PickIntraLevel0Compaction() {
+  std::vector<FileMetaData*> inputs;
+  if (!PickIntraLevel0Inputs(&inputs)) {
+    return nullptr;
+  }
+  Compaction* c = new Compaction(vset_->options_, 0, 0);
+  c->input_version_ = vset_->current_;
+  c->input_version_->Ref();
+  c->inputs_[0] = inputs;
+  vset_->GetRange(inputs, &c->smallest_, &c->largest_);
+  if (vset_->ConflictsWithRunningCompaction(c)) {
+    delete c;
+    return nullptr;
+  }
+
+  // Level-0 outputs have to stay a single file, see above.
+  c->max_output_file_size_ = std::numeric_limits<uint64_t>::max();
+  c->output_number_ = vset_->NewFileNumber();
+  return c;
+}
+
+Compaction* LevelCompactionPicker::SetupCompaction(int level,
+                                                   FileMetaData* f) {
+  Version* current = vset_->current_;
+  Compaction* c = new Compaction(vset_->options_, level,
+                                 VersionSet::OutputLevel(current, level));
+  c->input_version_ = current;
+  c->input_version_->Ref();
+  c->inputs_[0].push_back(f);
+
+  // Files in level 0 may overlap each other, so pick up all overlapping ones
+  if (level == 0) {
+    InternalKey smallest, largest;
+    vset_->GetRange(c->inputs_[0], &smallest, &largest);
+    // Note that the next call will discard the file we placed in
+    // c->inputs_[0] earlier and replace it with an overlapping set
+    // which will include the picked file.
+    current->GetOverlappingInputs(0, &smallest, &largest, &c->inputs_[0]);
+    assert(!c->inputs_[0].empty());
+  }
+
+  vset_->SetupOtherInputs(c);
+  vset_->ExpandTrivialMove(c);
+
+  if (vset_->ConflictsWithRunningCompaction(c)) {
+    delete c;
+    return nullptr;
+  }
+  return c;
+}
+
+Compaction* LevelCompactionPicker::CompactRange(int level,
+                                                const InternalKey* begin,
+                                                const InternalKey* end) {
+  Version* current = vset_->current_;
+  std::vector<FileMetaData*> inputs;
+  current->GetOverlappingInputs(level, begin, end, &inputs);
+  if (inputs.empty()) {
+    return nullptr;
+  }
+
+  // Avoid compacting too much in one shot in case the range is large.
+  // But we cannot do this for level-0 since level-0 files can overlap
+  // and we must not pick one file and drop another older file if the
+  // two files overlap.
+  if (level > 0) {
+    const uint64_t limit = MaxFileSizeForLevel(vset_->options_, level);
+    uint64_t total = 0;
+    for (size_t i = 0; i < inputs.size(); i++) {
+      uint64_t s = inputs[i]->file_size;
+      total += s;
+      if (total >= limit) {
+        inputs.resize(i + 1);
+        break;
+      }
+    }
+  }
+
+  Compaction* c = new Compaction(vset_->options_, level,
+                                 VersionSet::OutputLevel(current, level));
+  c->input_version_ = current;
+  c->input_version_->Ref();
+  c->inputs_[0] = inputs;
+  vset_->SetupOtherInputs(c);
+  return c;
+}
+
+bool UniversalCompactionPicker::NeedsCompaction() const {
+  const Version* v = vset_->current_;
+  const std::vector<FileMetaData*>& runs = v->files_[0];
+  if (runs.size() < 2 ||
+      runs.size() < static_cast<size_t>(
+                        vset_->options_->level0_file_num_compaction_trigger)) {
+    return false;
+  }
+  // A table being flushed took its file number before the output of a
+  // merge picked now would, yet holds newer data.
+  if (vset_->flush_running_) {
+    return false;
+  }
+  // Runs have to be merged one compaction at a time, see
+  // VersionSet::ConflictsWithRunningCompaction().
+  for (Compaction* r : vset_->running_compactions_) {
+    if (r->level() == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+Compaction* UniversalCompactionPicker::PickCompaction() {
+  if (!NeedsCompaction()) {
+    return nullptr;
+  }
+  const Options* options = vset_->options_;
+  std::vector<FileMetaData*> runs = vset_->current_->files_[0];
+  std::sort(runs.begin(), runs.end(), [](FileMetaData* a, FileMetaData* b) {
+    return a->number > b->number;
+  });
+
+  // (1) Bound the space amplification.
+  const uint64_t oldest_bytes = runs.back()->file_size;
+  const uint64_t newer_bytes = TotalFileSize(runs) - oldest_bytes;
+  if (newer_bytes * 100 >
+      oldest_bytes * options->universal_max_size_amplification_percent) {
+    Log(options->info_log,
+        "Universal: size amplification %llu%% merges all %d runs\n",
+        static_cast<unsigned long long>(newer_bytes * 100 /
+                                        std::max<uint64_t>(oldest_bytes, 1)),
+        static_cast<int>(runs.size()));
+    return NewCompaction(runs);
+  }
+
+  // (2) Merge the newest runs of similar size.
+  const size_t max_width =
+      static_cast<size_t>(options->universal_max_merge_width);
+  const size_t min_width =
+      static_cast<size_t>(options->universal_min_merge_width);
+  size_t width = 1;
+  uint64_t candidate_bytes = runs[0]->file_size;
+  while (width < runs.size() && width < max_width &&
+         runs[width]->file_size * 100 <=
+             candidate_bytes * (100 + options->universal_size_ratio)) {
+    candidate_bytes += runs[width]->file_size;
+    width++;
+  }
+
+  // (3) Otherwise just get back under the trigger.
+  if (width < min_width) {
+    const size_t excess =
+        runs.size() - options->level0_file_num_compaction_trigger + 1;
+    width = std::min(std::max(excess, min_width), max_width);
+    width = std::min(width, runs.size());
+    Log(options->info_log, "Universal: %d runs, merging the newest %d\n",
+        static_cast<int>(runs.size()), static_cast<int>(width));
+  } else {
+    Log(options->info_log, "Universal: merging %d runs of similar size\n",
+        static_cast<int>(width));
+  }
+  runs.resize(width);
+  return NewCompaction(runs);
+}
+
+Compaction* UniversalCompactionPicker::CompactRange(int level,
+                                                    const InternalKey* begin,
+                                                    const InternalKey* end) {
+  // The runs all overlap each other, so they are merged as a whole
+  // whatever the range.
+  const std::vector<FileMetaData*>& runs = vset_->current_->files_[0];
+  if (level != 0 || runs.empty()) {
+    return nullptr;
+  }
+  return NewCompaction(runs);
+}
+
+Compaction* UniversalCompactionPicker::NewCompaction(
+    const std::vector<FileMetaData*>& runs) {
+  Compaction* c = new Compaction(vset_->options_, 0, 0);
+  c->input_version_ = vset_->current_;
+  c->input_version_->Ref();
+  c->inputs_[0] = runs;
+  vset_->GetRange(runs, &c->smallest_, &c->largest_);
+  if (vset_->ConflictsWithRunningCompaction(c)) {
+    delete c;
+    return nullptr;
+  }
+
+  // A run is a single file, whose number has to be smaller than those of
+  // the memtables flushed while the compaction runs.
+  c->max_output_file_size_ = std::numeric_limits<uint64_t>::max();
+  c->output_number_ = vset_->NewFileNumber();
+  return c;
+}
+
+void FIFOCompactionPicker::ExpiredFiles(
+    std::vector<FileMetaData*>* expired) const {
+  const Options* options = vset_->options_;
+  std::vector<FileMetaData*> files = vset_->current_->files_[0];
+  std::sort(files.begin(), files.end(), [](FileMetaData* a, FileMetaData* b) {
+    return a->number < b->number;
+  });
+
+  uint64_t total = TotalFileSize(files);
+  const uint64_t now = vset_->env_->NowMicros() / 1000000;
+  expired->clear();
+  for (FileMetaData* f : files) {
+    const bool too_large = (options->fifo_max_table_files_size > 0 &&
+                            total > options->fifo_max_table_files_size);
+    const bool too_old = (options->fifo_ttl > 0 && f->creation_time > 0 &&
+                          f->creation_time + options->fifo_ttl <= now);
+    if (!too_large && !too_old) {
+      break;
+    }
+    expired->push_back(f);
+    total -= f->file_size;
+  }
+}
+
+bool FIFOCompactionPicker::NeedsCompaction() const {
+  for (Compaction* r : vset_->running_compactions_) {
+    if (r->level() == 0) {
+      return false;
+    }
+  }
+  std::vector<FileMetaData*> expired;
+  ExpiredFiles(&expired);
+  return !expired.empty();
+}
+
+Compaction* FIFOCompactionPicker::PickCompaction() {
+  if (!NeedsCompaction()) {
+    return nullptr;
+  }
+  Compaction* c = new Compaction(vset_->options_, 0, 0);
+  c->deletion_compaction_ = true;
+  c->input_version_ = vset_->current_;
+  c->input_version_->Ref();
+  ExpiredFiles(&c->inputs_[0]);
+  vset_->GetRange(c->inputs_[0], &c->smallest_, &c->largest_);
+  Log(vset_->options_->info_log, "FIFO: deleting %d files (%lld bytes)\n",
+      static_cast<int>(c->inputs_[0].size()),
+      static_cast<long long>(TotalFileSize(c->inputs_[0])));
+  return c;
+}
+
+Compaction* FIFOCompactionPicker::CompactRange(int level,
+                                               const InternalKey* begin,
+                                               const InternalKey* end) {
+  // Nothing is ever merged.
+  return nullptr;
+}
+
+CompactionPicker* NewCompactionPicker(VersionSet* vset,
+                                      const Options& options) {
+  switch (options.compaction_style) {
+    case kCompactionStyleUniversal:
+      return new UniversalCompactionPicker(vset);
+    case kCompactionStyleFIFO:
+      return new FIFOCompactionPicker(vset);
+    default:
+      return new LevelCompactionPicker(vset);
+  }
+}
+
+}  // namespace leveldb
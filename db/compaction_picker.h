@@ -0,0 +1,151 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A CompactionPicker decides which files of the current version are merged
+// next.  VersionSet owns one picker, chosen by Options::compaction_style,
+// and registers the compactions it returns as running.
+//
+// Like VersionSet, pickers require external synchronization.
+
+#ifndef STORAGE_LEVELDB_DB_COMPACTION_PICKER_H_
+#define STORAGE_LEVELDB_DB_COMPACTION_PICKER_H_
+
+#include <vector>
+
+#include "db/dbformat.h"
+
+namespace leveldb {
+
+class Compaction;
+struct FileMetaData;
+class VersionSet;
+struct Options;
+
+class CompactionPicker {
+ public:
+  explicit CompactionPicker(VersionSet* vset) : vset_(vset) {}
+
+  CompactionPicker(const CompactionPicker&) = delete;
+  CompactionPicker& operator=(const CompactionPicker&) = delete;
+
+  virtual ~CompactionPicker() = default;
+
+  // Returns true iff PickCompaction() may find work in the current version
+  // that does not conflict with the running compactions.
+  virtual bool NeedsCompaction() const = 0;
+
+  // Return a new compaction of the current version that does not conflict
+  // with the running compactions, or nullptr if there is nothing to do.
+  virtual Compaction* PickCompaction() = 0;
+
+  // Return a compaction of the files of the current version in "level"
+  // that overlap [begin,end], or nullptr if there are none.
+  // begin==nullptr and end==nullptr stand for the ends of the key space.
+  virtual Compaction* CompactRange(int level, const InternalKey* begin,
+                                   const InternalKey* end) = 0;
+
+ protected:
+  VersionSet* const vset_;
+};
+
+// Keeps every level below level-0 a single sorted run whose size limit is
+// a multiple of the limit of the level above it, and merges a file with the
+// files it overlaps in the next level once its level grows over the limit.
+// While level-0 has too many files but cannot be compacted into the base
+// level next to the running compactions, merges its newest files into one
+// level-0 file instead, so that reads check fewer files and writes are not
+// held up by the level-0 triggers.
+class LevelCompactionPicker : public CompactionPicker {
+ public:
+  explicit LevelCompactionPicker(VersionSet* vset) : CompactionPicker(vset) {}
+
+  bool NeedsCompaction() const override;
+  Compaction* PickCompaction() override;
+  Compaction* CompactRange(int level, const InternalKey* begin,
+                           const InternalKey* end) override;
+
+ private:
+  // Build a size compaction of "level" that starts with the first file
+  // that is not being compacted, in the order of Options::compaction_pri.
+  // Level-0 and kCompactionPriRoundRobin start after the compaction pointer
+  // of "level".  Returns nullptr if every candidate conflicts with a running
+  // compaction.
+  Compaction* PickSizeCompaction(int level);
+
+  // Sort "files", the files of "level", in the order in which
+  // Options::compaction_pri tries them.
+  void SortByCompactionPri(int level, std::vector<FileMetaData*>* files) const;
+
+  // Store in *inputs the level-0 files that an intra level-0 compaction
+  // would merge, newest first.  Returns true iff there are enough of them
+  // and the compaction can run next to the running compactions.
+  bool PickIntraLevel0Inputs(std::vector<FileMetaData*>* inputs) const;
+
+  // Return a compaction that merges level-0 files into a single level-0
+  // file, or nullptr if PickIntraLevel0Inputs() finds nothing to do.
+  Compaction* PickIntraLevel0Compaction();
+
+  // Build a compaction of "f" in "level" together with the files it has to
+  // be merged with.  Returns nullptr if the result conflicts with a
+  // running compaction.
+  Compaction* SetupCompaction(int level, FileMetaData* f);
+};
+
+// Keeps the data in level-0 as a list of sorted runs, one file each, and
+// merges the newest runs into one once there are
+// Options::level0_file_num_compaction_trigger of them:
+//
+// (1) all runs, if the runs other than the oldest one add up to more than
+//     Options::universal_max_size_amplification_percent of the oldest one;
+// (2) otherwise as many of the newest runs as are of similar size (see
+//     Options::universal_size_ratio);
+// (3) otherwise the newest runs needed to get back under the trigger.
+//
+// A merge always includes the newest run and leaves out only older runs,
+// and its output is numbered when it is picked, never while a memtable is
+// being flushed, so that the file numbers in level-0 keep ordering the runs
+// from oldest to newest.  Files that the level style left in the other
+// levels are older than all of level-0 and are not compacted any further,
+// not even by CompactRange().
+class UniversalCompactionPicker : public CompactionPicker {
+ public:
+  explicit UniversalCompactionPicker(VersionSet* vset)
+      : CompactionPicker(vset) {}
+
+  bool NeedsCompaction() const override;
+  Compaction* PickCompaction() override;
+  Compaction* CompactRange(int level, const InternalKey* begin,
+                           const InternalKey* end) override;
+
+ private:
+  // Return a compaction that merges "runs" into a single level-0 file.
+  Compaction* NewCompaction(const std::vector<FileMetaData*>& runs);
+};
+
+// Keeps the data in level-0 and never merges files.  Deletes the oldest
+// files, by file number, once all of them add up to more than
+// Options::fifo_max_table_files_size, and any file whose oldest data was
+// written Options::fifo_ttl seconds ago or earlier.  Files that other styles
+// left in the other levels are kept.
+class FIFOCompactionPicker : public CompactionPicker {
+ public:
+  explicit FIFOCompactionPicker(VersionSet* vset) : CompactionPicker(vset) {}
+
+  bool NeedsCompaction() const override;
+  Compaction* PickCompaction() override;
+  Compaction* CompactRange(int level, const InternalKey* begin,
+                           const InternalKey* end) override;
+
+ private:
+  // Store in *expired the level-0 files to delete, oldest first.
+  void ExpiredFiles(std::vector<FileMetaData*>* expired) const;
+};
+
+// Return a new picker for the compaction style in "options".
+CompactionPicker* NewCompactionPicker(VersionSet* vset,
+                                      const Options& options);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_COMPACTION_PICKER_H_
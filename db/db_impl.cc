@@ -19,6 +19,8 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/merge_helper.h"
+#include "db/range_tombstone.h"
 #include "db/table_cache.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
@@ -42,12 +44,23 @@ namespace leveldb {
 // Information kept for every waiting writer
     struct DBImpl::Writer {
         explicit Writer(port::Mutex *mu)
-                : batch(nullptr), sync(false), done(false), cv(mu) {}
+                : batch(nullptr), sync(false), done(false), last_sequence(0),
+                  insert_into(nullptr), leader(nullptr), pending_inserts(0), cv(mu) {}
 
         Status status;
         WriteBatch *batch;
         bool sync;
         bool done;
+        // Last sequence number of the group led by this writer.  Only used
+        // for pipelined writes, where it is assigned before the group has
+        // been applied to the memtable.
+        SequenceNumber last_sequence;
+        // Concurrent memtable writes: a follower inserts its own batch into
+        // "insert_into" once its leader sets it, and then decrements the
+        // leader's "pending_inserts".
+        MemTable *insert_into;
+        Writer *leader;
+        int pending_inserts;
         port::CondVar cv;
     };
 
@@ -57,6 +70,9 @@ namespace leveldb {
             uint64_t number{};
             uint64_t file_size{};
             InternalKey smallest, largest;
+            uint64_t num_range_deletions{};
+            uint64_t num_entries{};
+            uint64_t num_deletions{};
         };
 
         Output *current_output() { return &outputs[outputs.size() - 1]; }
@@ -64,9 +80,15 @@ namespace leveldb {
         explicit CompactionState(Compaction *c)
                 : compaction(c),
                   smallest_snapshot(0),
+                  newest_snapshot(0),
+                  begin(nullptr),
+                  end(nullptr),
+                  range_dels(nullptr),
+                  has_range_del_lower(false),
                   outfile(nullptr),
                   builder(nullptr),
-                  total_bytes(0) {}
+                  total_bytes(0),
+                  imm_micros(0) {}
 
         Compaction *const compaction;
 
@@ -76,6 +98,41 @@ namespace leveldb {
         // we can drop all entries for the same key with sequence numbers < S.
         SequenceNumber smallest_snapshot;
 
+        // Values with sequence numbers <= newest_snapshot may be read through
+        // a snapshot and are not passed to the compaction filter.
+        SequenceNumber newest_snapshot;
+
+        // Sequence numbers of the live snapshots, oldest first.  The entries
+        // between two consecutive snapshots are all read by the same
+        // snapshots, so only the newest entry for a user key in such a
+        // stripe needs to be kept.
+        std::vector<SequenceNumber> snapshots;
+
+        // Return the oldest snapshot that reads the entries with sequence
+        // number "seq", or kMaxSequenceNumber if only the current state does.
+        SequenceNumber EarliestVisibleSnapshot(SequenceNumber seq) const {
+            auto it = std::lower_bound(snapshots.begin(), snapshots.end(), seq);
+            return (it == snapshots.end()) ? kMaxSequenceNumber : *it;
+        }
+
+        // Only user keys in [*begin,*end) are compacted by this state; a null
+        // bound is unbounded.  Set when the compaction is split into ranges
+        // (subcompactions) that are processed concurrently.
+        const Slice *begin;
+        const Slice *end;
+
+        // Position in the compaction's key space of this state's pass.
+        Compaction::Cursor cursor;
+
+        // Range tombstones of the inputs, shared by the states of a
+        // compaction, or nullptr if there are none.  Each output file gets
+        // the parts of them that fall between the previous output file and
+        // the next one, from range_del_lower on (unbounded if
+        // !has_range_del_lower).
+        const RangeTombstoneSet *range_dels;
+        std::string range_del_lower;
+        bool has_range_del_lower;
+
         std::vector<Output> outputs;
 
         // State kept for output being generated
@@ -83,6 +140,20 @@ namespace leveldb {
         TableBuilder *builder;
 
         uint64_t total_bytes;
+
+        // Micros spent flushing imm_ from within this state's pass.  The
+        // flushes never overlap, so the sum over the states of a compaction
+        // stays within its running time.
+        uint64_t imm_micros;
+    };
+
+// Work item of a subcompaction that runs on a thread of its own.
+    struct DBImpl::SubcompactionState {
+        DBImpl *db;
+        CompactionState *compact;
+        Iterator *input;
+        Status status;
+        int *running;  // Count of unfinished subcompactions, guarded by db->mutex_
     };
 
 // Fix user-supplied options to be reasonable
@@ -101,8 +172,40 @@ namespace leveldb {
         result.filter_policy = (src.filter_policy != nullptr) ? ipolicy : nullptr;
         ClipToRange(&result.max_open_files, 64 + kNumNonTableCacheFiles, 50000);
         ClipToRange(&result.write_buffer_size, 64 << 10, 1 << 30);
+        ClipToRange(&result.max_write_buffer_number, 2, 64);
+        if (result.delayed_write_rate == 0) {
+            result.delayed_write_rate = Options().delayed_write_rate;
+        }
         ClipToRange(&result.max_file_size, 1 << 20, 1 << 30);
+        ClipToRange(&result.target_file_size_multiplier, 1, 100);
+        ClipToRange(&result.level0_file_num_compaction_trigger, 1, 1000);
+        // Writes must not slow down or stop before level-0 compactions start.
+        ClipToRange(&result.level0_slowdown_writes_trigger,
+                    result.level0_file_num_compaction_trigger, 1000);
+        ClipToRange(&result.level0_stop_writes_trigger,
+                    result.level0_slowdown_writes_trigger, 1000);
+        ClipToRange(&result.max_bytes_for_level_base, uint64_t{64} << 10,
+                    uint64_t{1} << 40);
+        ClipToRange(&result.max_bytes_for_level_multiplier, 1.0, 1000.0);
+        ClipToRange(&result.deletion_ratio_compaction_trigger, 0.0, 1.0);
+        for (int &m : result.max_bytes_for_level_multiplier_additional) {
+            ClipToRange(&m, 1, 1000);
+        }
+        ClipToRange(&result.universal_size_ratio, 0, 1 << 20);
+        ClipToRange(&result.universal_min_merge_width, 2, 1 << 30);
+        ClipToRange(&result.universal_max_merge_width,
+                    result.universal_min_merge_width, 1 << 30);
+        ClipToRange(&result.universal_max_size_amplification_percent, 0, 1 << 20);
         ClipToRange(&result.block_size, 1 << 10, 4 << 20);
+        ClipToRange(&result.max_background_compactions, 1, 64);
+        ClipToRange(&result.max_subcompactions, 1, 64);
+        if (result.memtable_chunk_size != 0) {
+            ClipToRange(&result.memtable_chunk_size, 64 << 10, 1 << 30);
+        }
+        if (result.memtable_factory != nullptr &&
+            !result.memtable_factory->SupportsConcurrentInserts()) {
+            result.allow_concurrent_memtable_write = false;
+        }
         if (result.info_log == nullptr) {
             // Open a log file in the same directory as the db
             src.env->CreateDir(dbname);  // In case it does not exist
@@ -138,23 +241,30 @@ namespace leveldb {
               shutting_down_(false),
               background_work_finished_signal_(&mutex_),
               mem_(nullptr),
-              imm_(nullptr),
               has_imm_(false),
               logfile_(nullptr),
               logfile_number_(0),
               log_(nullptr),
               seed_(0),
               tmp_batch_(new WriteBatch),
-              background_compaction_scheduled_(false),
+              background_compactions_scheduled_(0),
+              background_flush_scheduled_(false),
+              flush_in_progress_(false),
               manual_compaction_(nullptr),
               versions_(new VersionSet(dbname_, &options_, table_cache_,
-                                       &internal_comparator_)) {}
+                                       &internal_comparator_)),
+              bytes_flushed_(0),
+              stall_micros_(),
+              stall_count_(),
+              write_controller_(options_) {
+        env_->SetBackgroundThreads(options_.max_background_compactions);
+    }
 
     DBImpl::~DBImpl() {
         // Wait for background work to finish.
         mutex_.Lock();
         shutting_down_.store(true, std::memory_order_release);
-        while (background_compaction_scheduled_) {
+        while (background_compactions_scheduled_ > 0 || background_flush_scheduled_) {
             background_work_finished_signal_.Wait();
         }
         mutex_.Unlock();
@@ -165,7 +275,9 @@ namespace leveldb {
 
         delete versions_;
         if (mem_ != nullptr) mem_->Unref();
-        if (imm_ != nullptr) imm_->Unref();
+        for (MemTable *imm : imm_) {
+            imm->Unref();
+        }
         delete tmp_batch_;
         delete log_;
         delete logfile_;
@@ -439,7 +551,7 @@ namespace leveldb {
             WriteBatchInternal::SetContents(&batch, record);
 
             if (mem == nullptr) {
-                mem = new MemTable(internal_comparator_);
+                mem = NewMemTable();
                 mem->Ref();
             }
             status = WriteBatchInternal::InsertInto(&batch, mem);
@@ -456,7 +568,9 @@ namespace leveldb {
             if (mem->ApproximateMemoryUsage() > options_.write_buffer_size) {
                 compactions++;
                 *save_manifest = true;
-                status = WriteLevel0Table(mem, edit, nullptr);
+                uint64_t file_number;
+                status = WriteLevel0Table({mem}, edit, nullptr, &file_number);
+                pending_outputs_.erase(file_number);
                 mem->Unref();
                 mem = nullptr;
                 if (!status.ok()) {
@@ -485,7 +599,7 @@ namespace leveldb {
                     mem = nullptr;
                 } else {
                     // mem can be nullptr if lognum exists but was empty.
-                    mem_ = new MemTable(internal_comparator_);
+                    mem_ = NewMemTable();
                     mem_->Ref();
                 }
             }
@@ -495,7 +609,9 @@ namespace leveldb {
             // mem did not get reused; compact it.
             if (status.ok()) {
                 *save_manifest = true;
-                status = WriteLevel0Table(mem, edit, nullptr);
+                uint64_t file_number;
+                status = WriteLevel0Table({mem}, edit, nullptr, &file_number);
+                pending_outputs_.erase(file_number);
             }
             mem->Unref();
         }
@@ -503,29 +619,70 @@ namespace leveldb {
         return status;
     }
 
-    Status DBImpl::WriteLevel0Table(MemTable *mem, VersionEdit *edit,
-                                    Version *base) {
+    MemTable *DBImpl::NewMemTable() const {
+        return new MemTable(internal_comparator_, options_.memtable_factory,
+                            options_.memtable_chunk_size,
+                            options_.memtable_huge_pages);
+    }
+
+    Status DBImpl::WriteLevel0Table(const std::vector<MemTable *> &mems,
+                                    VersionEdit *edit, Version *base,
+                                    uint64_t *file_number) {
         mutex_.AssertHeld();
+        assert(!mems.empty());
         const uint64_t start_micros = env_->NowMicros();
         FileMetaData meta;
         meta.number = versions_->NewFileNumber();
+        // The oldest data was written when the oldest memtable got its first
+        // entry.  Memtables rebuilt from the log do not know when that was.
+        meta.creation_time = start_micros / 1000000;
+        for (MemTable *mem : mems) {
+            const uint64_t t = mem->first_write_time();
+            if (t != 0 && t < meta.creation_time) {
+                meta.creation_time = t;
+            }
+        }
         pending_outputs_.insert(meta.number);
-        Iterator *iter = mem->NewIterator();
-        Log(options_.info_log, "Level-0 table #%llu: started",
-            (unsigned long long) meta.number);
+        *file_number = meta.number;
+        for (MemTable *mem : mems) {
+            mem->MarkReadOnly();
+        }
+        Log(options_.info_log, "Level-0 table #%llu: started from %d memtables",
+            (unsigned long long) meta.number, static_cast<int>(mems.size()));
 
+        const SequenceNumber newest_snapshot =
+                snapshots_.empty() ? 0 : snapshots_.newest()->sequence_number();
         Status s;
+        versions_->SetFlushRunning(true);
         {
             mutex_.Unlock();
-            s = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+            // Created without the lock: some memtable representations sort
+            // their entries here.
+            std::vector<Iterator *> list;
+            std::vector<RangeTombstone> range_dels;
+            for (MemTable *mem : mems) {
+                list.push_back(mem->NewIterator());
+                Iterator *range_del_iter = mem->NewRangeTombstoneIterator();
+                if (range_del_iter != nullptr && s.ok()) {
+                    s = AppendRangeTombstones(range_del_iter, &range_dels);
+                } else {
+                    delete range_del_iter;
+                }
+            }
+            Iterator *iter = NewMergingIterator(&internal_comparator_, &list[0],
+                                                list.size());
+            if (s.ok()) {
+                s = BuildTable(dbname_, env_, options_, table_cache_, iter,
+                               range_dels, &meta, newest_snapshot);
+            }
+            delete iter;
             mutex_.Lock();
         }
+        versions_->SetFlushRunning(false);
 
         Log(options_.info_log, "Level-0 table #%llu: %lld bytes %s",
             (unsigned long long) meta.number, (unsigned long long) meta.file_size,
             s.ToString().c_str());
-        delete iter;
-        pending_outputs_.erase(meta.number);
 
         // Note that if file_size is zero, the file has been deleted and
         // should not be added to the manifest.
@@ -536,46 +693,66 @@ namespace leveldb {
             if (base != nullptr) {
                 level = base->PickLevelForMemTableOutput(min_user_key, max_user_key);
             }
-            edit->AddFile(level, meta.number, meta.file_size, meta.smallest,
-                          meta.largest);
+            edit->AddFile(level, meta);
         }
 
         CompactionStats stats;
         stats.micros = env_->NowMicros() - start_micros;
         stats.bytes_written = meta.file_size;
+        stats.bytes_in = meta.file_size;
         stats_[level].Add(stats);
+        bytes_flushed_ += meta.file_size;
         return s;
     }
 
     void DBImpl::CompactMemTable() {
         mutex_.AssertHeld();
-        assert(imm_ != nullptr);
+        assert(!imm_.empty());
+        assert(!flush_in_progress_);
+        flush_in_progress_ = true;
 
-        // Save the contents of the memtable as a new Table
+        // Flush the oldest immutable memtable, or all of them into a single
+        // table.  Memtables switched out while the lock is released below
+        // are appended to imm_ and left for the next flush.
+        const size_t n = options_.merge_memtables_on_flush ? imm_.size() : 1;
+        std::vector<MemTable *> mems(imm_.begin(), imm_.begin() + n);
+
+        // Save the contents of the memtables as a new Table
         VersionEdit edit;
         Version *base = versions_->current();
         base->Ref();
-        Status s = WriteLevel0Table(imm_, &edit, base);
+        uint64_t file_number;
+        Status s = WriteLevel0Table(mems, &edit, base, &file_number);
         base->Unref();
 
         if (s.ok() && shutting_down_.load(std::memory_order_acquire)) {
             s = Status::IOError("Deleting DB during memtable compaction");
         }
 
-        // Replace immutable memtable with the generated Table
+        // Replace the immutable memtables with the generated Table
         if (s.ok()) {
             edit.SetPrevLogNumber(0);
-            edit.SetLogNumber(logfile_number_);  // Earlier logs no longer needed
+            // Logs older than the first memtable that is still unflushed are
+            // no longer needed.
+            edit.SetLogNumber(n < imm_.size() ? imm_log_numbers_[n]
+                                              : logfile_number_);
             s = versions_->LogAndApply(&edit, &mutex_);
         }
+        pending_outputs_.erase(file_number);
 
         if (s.ok()) {
             // Commit to the new state
-            imm_->Unref();
-            imm_ = nullptr;
-            has_imm_.store(false, std::memory_order_release);
+            for (MemTable *mem : mems) {
+                mem->Unref();
+            }
+            imm_.erase(imm_.begin(), imm_.begin() + n);
+            imm_log_numbers_.erase(imm_log_numbers_.begin(),
+                                   imm_log_numbers_.begin() + n);
+            has_imm_.store(!imm_.empty(), std::memory_order_release);
+            flush_in_progress_ = false;
             RemoveObsoleteFiles();
         } else {
+            flush_in_progress_ = false;
             RecordBackgroundError(s);
         }
     }
@@ -642,10 +819,10 @@ namespace leveldb {
         if (s.ok()) {
             // Wait until the compaction completes
             MutexLock l(&mutex_);
-            while (imm_ != nullptr && bg_error_.ok()) {
+            while (!imm_.empty() && bg_error_.ok()) {
                 background_work_finished_signal_.Wait();
             }
-            if (imm_ != nullptr) {
+            if (!imm_.empty()) {
                 s = bg_error_;
             }
         }
@@ -662,59 +839,112 @@ namespace leveldb {
 
     void DBImpl::MaybeScheduleCompaction() {
         mutex_.AssertHeld();
-        if (background_compaction_scheduled_) {
-            // Already scheduled
+        MaybeScheduleFlush();
+        if (background_compactions_scheduled_ >=
+            options_.max_background_compactions) {
+            // Already scheduled as many as allowed
         } else if (shutting_down_.load(std::memory_order_acquire)) {
             // DB is being deleted; no more background compactions
         } else if (!bg_error_.ok()) {
             // Already got an error; no more changes
-        } else if (imm_ == nullptr && manual_compaction_ == nullptr &&
+        } else if (manual_compaction_ == nullptr &&
                    !versions_->NeedsCompaction()) {
             // No work to be done
         } else {
-            background_compaction_scheduled_ = true;
+            background_compactions_scheduled_++;
             env_->Schedule(&DBImpl::BGWork, this);
         }
     }
 
+    void DBImpl::MaybeScheduleFlush() {
+        mutex_.AssertHeld();
+        if (background_flush_scheduled_) {
+            // Already scheduled
+        } else if (shutting_down_.load(std::memory_order_acquire)) {
+            // DB is being deleted; no more background flushes
+        } else if (!bg_error_.ok()) {
+            // Already got an error; no more changes
+        } else if (imm_.empty()) {
+            // No work to be done
+        } else if (flush_in_progress_) {
+            // A compaction is flushing imm_ and schedules the rest when done
+        } else {
+            // Flushes go to their own lane so that they never wait for a long
+            // running compaction to finish.
+            background_flush_scheduled_ = true;
+            env_->ScheduleHighPriority(&DBImpl::BGFlushWork, this);
+        }
+    }
+
     void DBImpl::BGWork(void *db) {
         reinterpret_cast<DBImpl *>(db)->BackgroundCall();
     }
 
+    void DBImpl::BGFlushWork(void *db) {
+        reinterpret_cast<DBImpl *>(db)->BackgroundFlushCall();
+    }
+
+    void DBImpl::BackgroundFlushCall() {
+        MutexLock l(&mutex_);
+        assert(background_flush_scheduled_);
+        if (shutting_down_.load(std::memory_order_acquire)) {
+            // No more background work when shutting down.
+        } else if (!bg_error_.ok()) {
+            // No more background work after a background error.
+        } else if (!imm_.empty() && !flush_in_progress_) {
+            CompactMemTable();
+        }
+
+        background_flush_scheduled_ = false;
+
+        // The new level-0 file may call for a compaction, and more immutable
+        // memtables may be waiting to be flushed.
+        MaybeScheduleCompaction();
+        background_work_finished_signal_.SignalAll();
+    }
+
     void DBImpl::BackgroundCall() {
         MutexLock l(&mutex_);
-        assert(background_compaction_scheduled_);
+        assert(background_compactions_scheduled_ > 0);
+        bool did_work = false;
         if (shutting_down_.load(std::memory_order_acquire)) {
             // No more background work when shutting down.
         } else if (!bg_error_.ok()) {
             // No more background work after a background error.
         } else {
-            BackgroundCompaction();
+            did_work = BackgroundCompaction();
         }
 
-        background_compaction_scheduled_ = false;
+        background_compactions_scheduled_--;
 
         // Previous compaction may have produced too many files in a level,
-        // so reschedule another compaction if needed.
-        MaybeScheduleCompaction();
+        // so reschedule another compaction if needed.  A call that found
+        // nothing to do leaves that to the running compactions, which would
+        // otherwise be raced by an endless chain of idle calls.
+        if (did_work) {
+            MaybeScheduleCompaction();
+        }
         background_work_finished_signal_.SignalAll();
     }
 
-    void DBImpl::BackgroundCompaction() {
+    bool DBImpl::BackgroundCompaction() {
         mutex_.AssertHeld();
 
-        if (imm_ != nullptr) {
-            CompactMemTable();
-            return;
-        }
-
         Compaction *c;
         bool is_manual = (manual_compaction_ != nullptr);
         InternalKey manual_end;
-        if (is_manual) {
+        if (is_manual && (versions_->NumRunningCompactions() > 0 ||
+                          versions_->FlushRunning())) {
+            // A manual compaction runs alone.  Do not start anything else so
+            // that the running compactions drain.  It does not start next to
+            // a flush either, which would otherwise leave a universal merge
+            // numbered after a table that holds newer data.
+            return false;
+        } else if (is_manual) {
             ManualCompaction *m = manual_compaction_;
             c = versions_->CompactRange(m->level, m->begin, m->end);
-            m->done = (c == nullptr);
+            // A compaction within a level rewrites all of the level at once.
+            m->done = (c == nullptr || c->level() == c->output_level());
             if (c != nullptr) {
                 manual_end = c->input(0, c->num_input_files(0) - 1)->largest;
             }
@@ -725,26 +955,50 @@ namespace leveldb {
                 (m->done ? "(end)" : manual_end.DebugString().c_str()));
         } else {
             c = versions_->PickCompaction();
+            if (c == nullptr) {
+                return false;
+            }
+            // There may be room for another compaction next to this one.
+            MaybeScheduleCompaction();
         }
 
         Status status;
         if (c == nullptr) {
             // Nothing to do
-        } else if (!is_manual && c->IsTrivialMove()) {
-            // Move file to next level
-            assert(c->num_input_files(0) == 1);
-            FileMetaData *f = c->input(0, 0);
-            c->edit()->RemoveFile(c->level(), f->number);
-            c->edit()->AddFile(c->level() + 1, f->number, f->file_size, f->smallest,
-                               f->largest);
+        } else if (c->IsDeletionCompaction()) {
+            // Drop the input files without reading them
+            c->AddInputDeletions(c->edit());
             status = versions_->LogAndApply(c->edit(), &mutex_);
             if (!status.ok()) {
                 RecordBackgroundError(status);
             }
             VersionSet::LevelSummaryStorage tmp;
-            Log(options_.info_log, "Moved #%lld to level-%d %lld bytes %s: %s\n",
-                static_cast<unsigned long long>(f->number), c->level() + 1,
-                static_cast<unsigned long long>(f->file_size),
+            Log(options_.info_log, "Deleted %d files from level-%d: %s: %s\n",
+                c->num_input_files(0), c->level(), status.ToString().c_str(),
+                versions_->LevelSummary(&tmp));
+            c->ReleaseInputs();
+            RemoveObsoleteFiles();
+        } else if (!is_manual && c->IsTrivialMove()) {
+            // Move files to the output level
+            uint64_t bytes = 0;
+            for (int i = 0; i < c->num_input_files(0); i++) {
+                FileMetaData *f = c->input(0, i);
+                c->edit()->RemoveFile(c->level(), f->number);
+                c->edit()->AddFile(c->output_level(), *f);
+                bytes += f->file_size;
+            }
+            status = versions_->LogAndApply(c->edit(), &mutex_);
+            if (status.ok()) {
+                stats_[c->output_level()].bytes_in += bytes;
+            } else {
+                RecordBackgroundError(status);
+            }
+            VersionSet::LevelSummaryStorage tmp;
+            Log(options_.info_log,
+                "Moved %d files from #%lld to level-%d %lld bytes %s: %s\n",
+                c->num_input_files(0),
+                static_cast<unsigned long long>(c->input(0, 0)->number),
+                c->output_level(), static_cast<unsigned long long>(bytes),
                 status.ToString().c_str(), versions_->LevelSummary(&tmp));
         } else {
             CompactionState *compact = new CompactionState(c);
@@ -779,6 +1033,7 @@ namespace leveldb {
             }
             manual_compaction_ = nullptr;
         }
+        return true;
     }
 
     void DBImpl::CleanupCompaction(CompactionState *compact) {
@@ -804,7 +1059,12 @@ namespace leveldb {
         uint64_t file_number;
         {
             mutex_.Lock();
-            file_number = versions_->NewFileNumber();
+            file_number = compact->compaction->output_number();
+            if (file_number == 0) {
+                file_number = versions_->NewFileNumber();
+            } else {
+                assert(compact->outputs.empty());
+            }
             pending_outputs_.insert(file_number);
             CompactionState::Output out;
             out.number = file_number;
@@ -823,18 +1083,69 @@ namespace leveldb {
         return s;
     }
 
+    void DBImpl::ClipRangeTombstones(CompactionState *compact, const Slice *upper,
+                                     std::vector<RangeTombstone> *pieces) {
+        const Comparator *ucmp = user_comparator();
+        for (const RangeTombstone &t : compact->range_dels->tombstones()) {
+            Slice start = t.start;
+            Slice end = t.end;
+            if (compact->has_range_del_lower &&
+                ucmp->Compare(start, compact->range_del_lower) < 0) {
+                start = compact->range_del_lower;
+            }
+            if (upper != nullptr && ucmp->Compare(end, *upper) > 0) {
+                end = *upper;
+            }
+            if (ucmp->Compare(start, end) >= 0) {
+                continue;
+            }
+            if (t.seq <= compact->smallest_snapshot &&
+                compact->compaction->IsBaseLevelForRange(start, end)) {
+                // Every entry it deletes is dropped by this compaction
+                continue;
+            }
+            pieces->emplace_back(start, end, t.seq);
+        }
+    }
+
     Status DBImpl::FinishCompactionOutputFile(CompactionState *compact,
-                                              Iterator *input) {
+                                              Iterator *input, const Slice *upper) {
         assert(compact != nullptr);
         assert(compact->outfile != nullptr);
         assert(compact->builder != nullptr);
 
-        const uint64_t output_number = compact->current_output()->number;
+        CompactionState::Output *const out = compact->current_output();
+        const uint64_t output_number = out->number;
         assert(output_number != 0);
 
+        // The range of the file includes its part of the range tombstones
+        if (compact->range_dels != nullptr) {
+            std::vector<RangeTombstone> pieces;
+            ClipRangeTombstones(compact, upper, &pieces);
+            bool has_range = compact->builder->NumEntries() > 0;
+            for (const RangeTombstone &t : pieces) {
+                const InternalKey start = t.SerializeKey();
+                const InternalKey end = t.SerializeEndKey();
+                compact->builder->AddRangeTombstone(start.Encode(), t.end);
+                if (!has_range || internal_comparator_.Compare(start, out->smallest) < 0) {
+                    out->smallest = start;
+                }
+                if (!has_range || internal_comparator_.Compare(end, out->largest) > 0) {
+                    out->largest = end;
+                }
+                has_range = true;
+            }
+            out->num_range_deletions = pieces.size();
+            if (upper != nullptr) {
+                compact->range_del_lower.assign(upper->data(), upper->size());
+                compact->has_range_del_lower = true;
+            }
+        }
+
         // Check for iterator errors
         Status s = input->status();
-        const uint64_t current_entries = compact->builder->NumEntries();
+        out->num_entries = compact->builder->NumEntries();
+        const uint64_t current_entries = out->num_entries + out->num_range_deletions;
         if (s.ok()) {
             s = compact->builder->Finish();
         } else {
@@ -864,7 +1175,8 @@ namespace leveldb {
             delete iter;
             if (s.ok()) {
                 Log(options_.info_log, "Generated table #%llu@%d: %lld keys, %lld bytes",
-                    (unsigned long long) output_number, compact->compaction->level(),
+                    (unsigned long long) output_number,
+                    compact->compaction->output_level(),
                     (unsigned long long) current_entries,
                     (unsigned long long) current_bytes);
             }
@@ -876,67 +1188,99 @@ namespace leveldb {
         mutex_.AssertHeld();
         Log(options_.info_log, "Compacted %d@%d + %d@%d files => %lld bytes",
             compact->compaction->num_input_files(0), compact->compaction->level(),
-            compact->compaction->num_input_files(1), compact->compaction->level() + 1,
+            compact->compaction->num_input_files(1),
+            compact->compaction->output_level(),
             static_cast<long long>(compact->total_bytes));
 
-        // Add compaction outputs
-        compact->compaction->AddInputDeletions(compact->compaction->edit());
-        const int level = compact->compaction->level();
+        // Add compaction outputs.  They hold data as old as the oldest input.
+        Compaction *const c = compact->compaction;
+        c->AddInputDeletions(c->edit());
+        uint64_t creation_time = 0;
+        for (int which = 0; which < 2; which++) {
+            for (int i = 0; i < c->num_input_files(which); i++) {
+                const uint64_t t = c->input(which, i)->creation_time;
+                if (t != 0 && (creation_time == 0 || t < creation_time)) {
+                    creation_time = t;
+                }
+            }
+        }
+        const int level = c->output_level();
         for (size_t i = 0; i < compact->outputs.size(); i++) {
             const CompactionState::Output &out = compact->outputs[i];
-            compact->compaction->edit()->AddFile(level + 1, out.number, out.file_size,
-                                                 out.smallest, out.largest);
+            FileMetaData f;
+            f.number = out.number;
+            f.file_size = out.file_size;
+            f.smallest = out.smallest;
+            f.largest = out.largest;
+            f.creation_time = creation_time;
+            f.num_range_deletions = out.num_range_deletions;
+            f.num_entries = out.num_entries;
+            f.num_deletions = out.num_deletions;
+            c->edit()->AddFile(level, f);
         }
         return versions_->LogAndApply(compact->compaction->edit(), &mutex_);
     }
 
-    Status DBImpl::DoCompactionWork(CompactionState *compact) {
-        const uint64_t start_micros = env_->NowMicros();
-        int64_t imm_micros = 0;  // Micros spent doing imm_ compactions
+    void DBImpl::BGSubcompactionWork(void *arg) {
+        SubcompactionState *sub = reinterpret_cast<SubcompactionState *>(arg);
+        DBImpl *db = sub->db;
+        sub->status = db->DoCompactionRange(sub->compact, sub->input);
+        MutexLock l(&db->mutex_);
+        (*sub->running)--;
+        db->background_work_finished_signal_.SignalAll();
+    }
 
-        Log(options_.info_log, "Compacting %d@%d + %d@%d files",
-            compact->compaction->num_input_files(0), compact->compaction->level(),
-            compact->compaction->num_input_files(1),
-            compact->compaction->level() + 1);
+    // User key at which an output file that ends before "key" is split.
+    // Corrupted keys are kept as they are.
+    static Slice OutputBoundary(const Slice &key) {
+        return key.size() >= 8 ? ExtractUserKey(key) : key;
+    }
 
-        assert(versions_->NumLevelFiles(compact->compaction->level()) > 0);
-        assert(compact->builder == nullptr);
-        assert(compact->outfile == nullptr);
-        if (snapshots_.empty()) {
-            compact->smallest_snapshot = versions_->LastSequence();
+    Status DBImpl::DoCompactionRange(CompactionState *compact, Iterator *input) {
+        if (compact->begin != nullptr) {
+            InternalKey start(*compact->begin, kMaxSequenceNumber, kValueTypeForSeek);
+            input->Seek(start.Encode());
+            compact->range_del_lower = compact->begin->ToString();
+            compact->has_range_del_lower = true;
         } else {
-            compact->smallest_snapshot = snapshots_.oldest()->sequence_number();
+            input->SeekToFirst();
         }
-
-        Iterator *input = versions_->MakeInputIterator(compact->compaction);
-
-        // Release mutex while we're actually doing the compaction work
-        mutex_.Unlock();
-
-        input->SeekToFirst();
         Status status;
         ParsedInternalKey ikey;
         std::string current_user_key;
         bool has_current_user_key = false;
         SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
+        std::string filtered_key, filtered_value;
+        std::string zeroed_key;
         while (input->Valid() && !shutting_down_.load(std::memory_order_acquire)) {
-            // Prioritize immutable compaction work
-            if (has_imm_.load(std::memory_order_relaxed)) {
-                const uint64_t imm_start = env_->NowMicros();
+            // Prioritize immutable compaction work if the env has no thread
+            // of its own for it, as the flush may be queued behind us.
+            if (has_imm_.load(std::memory_order_relaxed) &&
+                !env_->HasHighPriorityThread()) {
                 mutex_.Lock();
-                if (imm_ != nullptr) {
+                if (!imm_.empty() && !flush_in_progress_) {
+                    const uint64_t imm_start = env_->NowMicros();
                     CompactMemTable();
-                    // Wake up MakeRoomForWrite() if necessary.
+                    // The new level-0 file may call for a compaction, and
+                    // MakeRoomForWrite() may be waiting for the flush.
+                    MaybeScheduleCompaction();
                     background_work_finished_signal_.SignalAll();
+                    compact->imm_micros += (env_->NowMicros() - imm_start);
                 }
                 mutex_.Unlock();
-                imm_micros += (env_->NowMicros() - imm_start);
             }
 
             Slice key = input->key();
-            if (compact->compaction->ShouldStopBefore(key) &&
+            Slice value = input->value();
+            if (compact->end != nullptr && key.size() >= 8 &&
+                user_comparator()->Compare(ExtractUserKey(key), *compact->end) >= 0) {
+                // The rest belongs to another range
+                break;
+            }
+            if (compact->compaction->ShouldStopBefore(key, &compact->cursor) &&
                 compact->builder != nullptr) {
-                status = FinishCompactionOutputFile(compact, input);
+                const Slice upper = OutputBoundary(key);
+                status = FinishCompactionOutputFile(compact, input, &upper);
                 if (!status.ok()) {
                     break;
                 }
@@ -957,14 +1301,29 @@ namespace leveldb {
                     current_user_key.assign(ikey.user_key.data(), ikey.user_key.size());
                     has_current_user_key = true;
                     last_sequence_for_key = kMaxSequenceNumber;
+
+                    // A value removed by the filter becomes a deletion marker,
+                    // which the rules below may drop along with the older
+                    // entries for the key.
+                    if (options_.compaction_filter != nullptr &&
+                        ikey.type == kTypeValue &&
+                        ikey.sequence > compact->newest_snapshot) {
+                        FilterEntry(options_.compaction_filter,
+                                    compact->compaction->output_level(), &ikey, &key,
+                                    &value, &filtered_key, &filtered_value);
+                    }
                 }
 
-                if (last_sequence_for_key <= compact->smallest_snapshot) {
-                    // Hidden by an newer entry for same user key
+                if (last_sequence_for_key != kMaxSequenceNumber &&
+                    compact->EarliestVisibleSnapshot(last_sequence_for_key) ==
+                    compact->EarliestVisibleSnapshot(ikey.sequence)) {
+                    // Hidden by an newer entry for same user key that every
+                    // snapshot reading this entry reads instead
                     drop = true;  // (A)
                 } else if (ikey.type == kTypeDeletion &&
                            ikey.sequence <= compact->smallest_snapshot &&
-                           compact->compaction->IsBaseLevelForKey(ikey.user_key)) {
+                           compact->compaction->IsBaseLevelForKey(ikey.user_key,
+                                                                  &compact->cursor)) {
                     // For this user key:
                     // (1) there is no data in higher levels
                     // (2) data in lower levels will have larger sequence numbers
@@ -973,9 +1332,39 @@ namespace leveldb {
                     //     few iterations of this loop (by rule (A) above).
                     // Therefore this deletion marker is obsolete and can be dropped.
                     drop = true;
+                } else if (compact->range_dels != nullptr &&
+                           compact->range_dels->ShouldDelete(
+                                   ikey.user_key, ikey.sequence,
+                                   compact->EarliestVisibleSnapshot(ikey.sequence))) {
+                    // Deleted by a range tombstone that every snapshot reading
+                    // this entry sees
+                    drop = true;
+                }
+
+                if (ikey.type != kTypeMerge) {
+                    // Merge operands build on the older entries, so they
+                    // never hide them.
+                    last_sequence_for_key = ikey.sequence;
                 }
 
-                last_sequence_for_key = ikey.sequence;
+                if (!drop && ikey.type == kTypeValue && ikey.sequence != 0 &&
+                    ikey.sequence <= compact->smallest_snapshot &&
+                    (compact->range_dels == nullptr ||
+                     compact->range_dels->MaxCoveringSequence(ikey.user_key,
+                                                              ikey.sequence) == 0) &&
+                    compact->compaction->IsBaseLevelForKey(ikey.user_key,
+                                                           &compact->cursor)) {
+                    // Every snapshot reads this value and no older entry for
+                    // the key is left, so its sequence number carries no
+                    // information.  Zero it so that the keys of the last
+                    // level share longer prefixes.  Range tombstones older
+                    // than the value would cover it with a zero sequence
+                    // number, so keys under one keep theirs.
+                    zeroed_key.clear();
+                    AppendInternalKey(&zeroed_key,
+                                      ParsedInternalKey(ikey.user_key, 0, kTypeValue));
+                    key = zeroed_key;
+                }
             }
 #if 0
             Log(options_.info_log,
@@ -983,31 +1372,25 @@ namespace leveldb {
                 "%d smallest_snapshot: %d",
                 ikey.user_key.ToString().c_str(),
                 (int)ikey.sequence, ikey.type, kTypeValue, drop,
-                compact->compaction->IsBaseLevelForKey(ikey.user_key),
+                compact->compaction->IsBaseLevelForKey(ikey.user_key, &compact->cursor),
                 (int)last_sequence_for_key, (int)compact->smallest_snapshot);
 #endif
 
-            if (!drop) {
-                // Open output file if necessary
-                if (compact->builder == nullptr) {
-                    status = OpenCompactionOutputFile(compact);
-                    if (!status.ok()) {
-                        break;
-                    }
-                }
-                if (compact->builder->NumEntries() == 0) {
-                    compact->current_output()->smallest.DecodeFrom(key);
+            if (!drop && ikey.type == kTypeMerge &&
+                options_.merge_operator != nullptr) {
+                status = CompactMergeOperands(compact, input, current_user_key,
+                                              &last_sequence_for_key);
+                if (!status.ok()) {
+                    break;
                 }
-                compact->current_output()->largest.DecodeFrom(key);
-                compact->builder->Add(key, input->value());
+                // "input" already points past the operands
+                continue;
+            }
 
-                // Close output file if it is big enough
-                if (compact->builder->FileSize() >=
-                    compact->compaction->MaxOutputFileSize()) {
-                    status = FinishCompactionOutputFile(compact, input);
-                    if (!status.ok()) {
-                        break;
-                    }
+            if (!drop) {
+                status = AddCompactionOutput(compact, input, key, value);
+                if (!status.ok()) {
+                    break;
                 }
             }
 
@@ -1017,28 +1400,280 @@ namespace leveldb {
         if (status.ok() && shutting_down_.load(std::memory_order_acquire)) {
             status = Status::IOError("Deleting DB during compaction");
         }
+        if (status.ok() && compact->builder == nullptr &&
+            compact->range_dels != nullptr) {
+            // The range tombstones past the last entry need a file of their own
+            std::vector<RangeTombstone> pieces;
+            ClipRangeTombstones(compact, compact->end, &pieces);
+            if (!pieces.empty()) {
+                status = OpenCompactionOutputFile(compact);
+            }
+        }
         if (status.ok() && compact->builder != nullptr) {
-            status = FinishCompactionOutputFile(compact, input);
+            status = FinishCompactionOutputFile(compact, input, compact->end);
         }
         if (status.ok()) {
             status = input->status();
         }
         delete input;
-        input = nullptr;
+        return status;
+    }
+
+    Status DBImpl::AddCompactionOutput(CompactionState *compact, Iterator *input,
+                                       const Slice &key, const Slice &value) {
+        // Close output file if it is big enough.  This is done before adding
+        // the next entry, whose key bounds the range tombstones of the file.
+        if (compact->builder != nullptr &&
+            compact->builder->FileSize() >=
+            compact->compaction->MaxOutputFileSize()) {
+            const Slice upper = OutputBoundary(key);
+            Status s = FinishCompactionOutputFile(compact, input, &upper);
+            if (!s.ok()) {
+                return s;
+            }
+        }
+
+        // Open output file if necessary
+        if (compact->builder == nullptr) {
+            Status s = OpenCompactionOutputFile(compact);
+            if (!s.ok()) {
+                return s;
+            }
+        }
+        if (compact->builder->NumEntries() == 0) {
+            compact->current_output()->smallest.DecodeFrom(key);
+        }
+        compact->current_output()->largest.DecodeFrom(key);
+        if (key.size() >= 8 && ExtractValueType(key) == kTypeDeletion) {
+            compact->current_output()->num_deletions++;
+        }
+        compact->builder->Add(key, value);
+        return Status::OK();
+    }
+
+    Status DBImpl::CompactMergeOperands(CompactionState *compact, Iterator *input,
+                                        const std::string &user_key,
+                                        SequenceNumber *last_sequence_for_key) {
+        // Collect the run of operands, newest first.  The run stops at the
+        // first operand deleted by a range tombstone, which is left for the
+        // caller along with the older entries.
+        const SequenceNumber covering_seq =
+                compact->range_dels != nullptr
+                ? compact->range_dels->MaxCoveringSequence(user_key,
+                                                           kMaxSequenceNumber)
+                : 0;
+        std::vector<std::string> operand_keys;
+        std::vector<std::string> operands;
+        ParsedInternalKey ikey;
+        bool parsed;
+        bool covered = (ExtractSequence(input->key()) < covering_seq);
+        do {
+            operand_keys.push_back(input->key().ToString());
+            operands.push_back(input->value().ToString());
+            input->Next();
+            parsed = input->Valid() && ParseInternalKey(input->key(), &ikey);
+        } while (parsed && ikey.type == kTypeMerge &&
+                 user_comparator()->Compare(ikey.user_key, user_key) == 0 &&
+                 !covered && ikey.sequence >= covering_seq);
+
+        // Operands that every snapshot sees can be combined with the entry
+        // they were written on top of, or with nothing if no older data can
+        // exist for the key.  So can all of them if no snapshot sees that
+        // entry.  Operands are not combined across a range tombstone.
+        const bool same_key =
+                parsed && user_comparator()->Compare(ikey.user_key, user_key) == 0;
+        const bool has_base = same_key && ikey.type != kTypeMerge;
+        if (same_key && ikey.sequence < covering_seq) {
+            covered = true;
+        }
+        size_t first_combined = 0;
+        if (!has_base || ikey.sequence <= compact->newest_snapshot) {
+            while (first_combined < operand_keys.size() &&
+                   ExtractSequence(operand_keys[first_combined]) >
+                   compact->smallest_snapshot) {
+                first_combined++;
+            }
+        }
+        if (!has_base &&
+            ((!parsed && input->Valid()) ||
+             !compact->compaction->IsBaseLevelForKey(user_key, &compact->cursor))) {
+            first_combined = operand_keys.size();
+        }
+        if (covered) {
+            first_combined = operand_keys.size();
+        }
+
+        std::string merged;
+        if (first_combined < operand_keys.size()) {
+            Slice existing;
+            if (has_base && ikey.type == kTypeValue) {
+                existing = input->value();
+            }
+            const std::vector<std::string> combined(
+                    operands.begin() + first_combined, operands.end());
+            Status s = FullMerge(options_.merge_operator, user_key,
+                                 (has_base && ikey.type == kTypeValue) ? &existing
+                                                                       : nullptr,
+                                 combined, &merged);
+            if (!s.ok()) {
+                // Keep the operands, so that the reads of the key report
+                // the error instead of the compactions.
+                Log(options_.info_log, "Merge: %s\n", s.ToString().c_str());
+                first_combined = operand_keys.size();
+            }
+        }
+
+        for (size_t i = 0; i < first_combined; i++) {
+            Status s = AddCompactionOutput(compact, input, operand_keys[i],
+                                           operands[i]);
+            if (!s.ok()) {
+                return s;
+            }
+        }
+        if (first_combined == operand_keys.size()) {
+            return Status::OK();
+        }
+
+        if (has_base) {
+            // The result hides what the base entry hid
+            *last_sequence_for_key = ikey.sequence;
+            input->Next();
+        }
+        std::string merged_key;
+        AppendInternalKey(&merged_key,
+                          ParsedInternalKey(user_key,
+                                            ExtractSequence(operand_keys[first_combined]),
+                                            kTypeValue));
+        return AddCompactionOutput(compact, input, merged_key, merged);
+    }
+
+    Status DBImpl::DoCompactionWork(CompactionState *compact) {
+        const uint64_t start_micros = env_->NowMicros();
+
+        Log(options_.info_log, "Compacting %d@%d + %d@%d files",
+            compact->compaction->num_input_files(0), compact->compaction->level(),
+            compact->compaction->num_input_files(1),
+            compact->compaction->output_level());
+
+        assert(versions_->NumLevelFiles(compact->compaction->level()) > 0);
+        assert(compact->builder == nullptr);
+        assert(compact->outfile == nullptr);
+        if (snapshots_.empty()) {
+            compact->smallest_snapshot = versions_->LastSequence();
+        } else {
+            compact->smallest_snapshot = snapshots_.oldest()->sequence_number();
+            compact->newest_snapshot = snapshots_.newest()->sequence_number();
+        }
+        snapshots_.GetSequenceNumbers(&compact->snapshots);
+
+        // Read the range tombstones of the inputs without the lock.  The
+        // tombstones of level() are newer than the entries of output_level()
+        // in their range, so the files of output_level() that they cover
+        // with tombstones every snapshot sees need not be read.
+        Compaction *const c = compact->compaction;
+        std::vector<RangeTombstone> range_dels;
+        std::vector<FileMetaData *> covered;
+        mutex_.Unlock();
+        Status status = c->AddRangeTombstones(0, &range_dels);
+        if (status.ok() && !range_dels.empty() && c->level() != c->output_level()) {
+            const RangeTombstoneSet upper_range_dels(user_comparator(), range_dels);
+            for (int i = 0; i < c->num_input_files(1); i++) {
+                FileMetaData *f = c->input(1, i);
+                if (f->num_range_deletions == 0 &&
+                    upper_range_dels.CoversRange(f->smallest.user_key(),
+                                                 f->largest.user_key(),
+                                                 compact->smallest_snapshot)) {
+                    covered.push_back(f);
+                }
+            }
+        }
+        if (status.ok()) {
+            status = c->AddRangeTombstones(1, &range_dels);
+        }
+        mutex_.Lock();
+        if (!status.ok()) {
+            return status;
+        }
+        if (!covered.empty()) {
+            Log(options_.info_log, "Dropping %d files deleted by range tombstones",
+                static_cast<int>(covered.size()));
+            c->SkipCoveredInputs(covered);
+        }
+        const RangeTombstoneSet input_range_dels(user_comparator(), range_dels);
+        compact->range_dels = input_range_dels.empty() ? nullptr : &input_range_dels;
+
+        // Split the compaction into key ranges if allowed, one of which is
+        // compacted on this thread and the others on threads of their own.
+        std::vector<Slice> boundaries;
+        versions_->SplitCompaction(compact->compaction, options_.max_subcompactions,
+                                   &boundaries);
+        std::vector<SubcompactionState> subs(boundaries.size());
+        int running = static_cast<int>(subs.size());
+        for (size_t i = 0; i < subs.size(); i++) {
+            CompactionState *sub = new CompactionState(compact->compaction);
+            sub->smallest_snapshot = compact->smallest_snapshot;
+            sub->newest_snapshot = compact->newest_snapshot;
+            sub->snapshots = compact->snapshots;
+            sub->range_dels = compact->range_dels;
+            sub->begin = &boundaries[i];
+            sub->end = (i + 1 < boundaries.size() ? &boundaries[i + 1] : nullptr);
+            subs[i].db = this;
+            subs[i].compact = sub;
+            subs[i].input = versions_->MakeInputIterator(compact->compaction);
+            subs[i].running = &running;
+        }
+        compact->end = boundaries.empty() ? nullptr : &boundaries[0];
+        if (!subs.empty()) {
+            Log(options_.info_log, "Compacting in %d ranges",
+                static_cast<int>(subs.size()) + 1);
+        }
+        Iterator *input = versions_->MakeInputIterator(compact->compaction);
+        for (size_t i = 0; i < subs.size(); i++) {
+            env_->StartThread(&DBImpl::BGSubcompactionWork, &subs[i]);
+        }
+
+        // Release mutex while we're actually doing the compaction work
+        mutex_.Unlock();
+        status = DoCompactionRange(compact, input);
+        mutex_.Lock();
+
+        // Gather the outputs of the other ranges in key order.
+        while (running > 0) {
+            background_work_finished_signal_.Wait();
+        }
+        for (size_t i = 0; i < subs.size(); i++) {
+            CompactionState *sub = subs[i].compact;
+            if (status.ok()) {
+                status = subs[i].status;
+            }
+            if (sub->builder != nullptr) {
+                sub->builder->Abandon();
+                delete sub->builder;
+            }
+            delete sub->outfile;
+            compact->outputs.insert(compact->outputs.end(), sub->outputs.begin(),
+                                    sub->outputs.end());
+            compact->total_bytes += sub->total_bytes;
+            compact->imm_micros += sub->imm_micros;
+            delete sub;
+        }
 
         CompactionStats stats;
-        stats.micros = env_->NowMicros() - start_micros - imm_micros;
+        stats.micros = env_->NowMicros() - start_micros - compact->imm_micros;
         for (int which = 0; which < 2; which++) {
             for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
                 stats.bytes_read += compact->compaction->input(which, i)->file_size;
             }
         }
+        if (compact->compaction->level() != compact->compaction->output_level()) {
+            for (int i = 0; i < compact->compaction->num_input_files(0); i++) {
+                stats.bytes_in += compact->compaction->input(0, i)->file_size;
+            }
+        }
         for (size_t i = 0; i < compact->outputs.size(); i++) {
             stats.bytes_written += compact->outputs[i].file_size;
         }
-
-        mutex_.Lock();
-        stats_[compact->compaction->level() + 1].Add(stats);
+        stats_[compact->compaction->output_level()].Add(stats);
 
         if (status.ok()) {
             status = InstallCompactionResults(compact);
@@ -1057,9 +1692,10 @@ namespace leveldb {
             port::Mutex *const mu;
             Version *const version GUARDED_BY(mu);
             MemTable *const mem GUARDED_BY(mu);
-            MemTable *const imm GUARDED_BY(mu);
+            const std::vector<MemTable *> imm GUARDED_BY(mu);
 
-            IterState(port::Mutex *mutex, MemTable *mem, MemTable *imm, Version *version)
+            IterState(port::Mutex *mutex, MemTable *mem,
+                      const std::vector<MemTable *> &imm, Version *version)
                     : mu(mutex), version(version), mem(mem), imm(imm) {}
         };
 
@@ -1067,7 +1703,9 @@ namespace leveldb {
             IterState *state = reinterpret_cast<IterState *>(arg1);
             state->mu->Lock();
             state->mem->Unref();
-            if (state->imm != nullptr) state->imm->Unref();
+            for (MemTable *imm : state->imm) {
+                imm->Unref();
+            }
             state->version->Unref();
             state->mu->Unlock();
             delete state;
@@ -1077,28 +1715,45 @@ namespace leveldb {
 
     Iterator *DBImpl::NewInternalIterator(const ReadOptions &options,
                                           SequenceNumber *latest_snapshot,
-                                          uint32_t *seed) {
+                                          uint32_t *seed,
+                                          std::vector<RangeTombstone> *range_dels) {
         mutex_.Lock();
         *latest_snapshot = versions_->LastSequence();
 
         // Collect together all needed child iterators
         std::vector<Iterator *> list;
-        list.push_back(mem_->NewIterator());
-        mem_->Ref();
-        if (imm_ != nullptr) {
-            list.push_back(imm_->NewIterator());
-            imm_->Ref();
+        std::vector<MemTable *> mems(1, mem_);
+        mems.insert(mems.end(), imm_.rbegin(), imm_.rend());
+        for (MemTable *mem : mems) {
+            list.push_back(mem->NewIterator());
+            mem->Ref();
+            Iterator *range_del_iter =
+                    range_dels != nullptr ? mem->NewRangeTombstoneIterator() : nullptr;
+            if (range_del_iter != nullptr) {
+                // A memtable iterator cannot fail
+                AppendRangeTombstones(range_del_iter, range_dels);
+            }
         }
         versions_->current()->AddIterators(options, &list);
         Iterator *internal_iter =
                 NewMergingIterator(&internal_comparator_, &list[0], list.size());
         versions_->current()->Ref();
 
-        IterState *cleanup = new IterState(&mutex_, mem_, imm_, versions_->current());
+        Version *const version = versions_->current();
+        IterState *cleanup = new IterState(&mutex_, mem_, imm_, version);
         internal_iter->RegisterCleanup(CleanupIteratorState, cleanup, nullptr);
 
         *seed = ++seed_;
         mutex_.Unlock();
+
+        // The tables of the version are read without the lock
+        if (range_dels != nullptr) {
+            Status s = version->AddRangeTombstones(range_dels);
+            if (!s.ok()) {
+                delete internal_iter;
+                return NewErrorIterator(s);
+            }
+        }
         return internal_iter;
     }
 
@@ -1126,10 +1781,12 @@ namespace leveldb {
         }
 
         MemTable *mem = mem_;
-        MemTable *imm = imm_;
+        std::vector<MemTable *> imm(imm_.rbegin(), imm_.rend());  // Newest first
         Version *current = versions_->current();
         mem->Ref();
-        if (imm != nullptr) imm->Ref();
+        for (MemTable *m : imm) {
+            m->Ref();
+        }
         current->Ref();
 
         bool have_stat_update = false;
@@ -1138,16 +1795,27 @@ namespace leveldb {
         // Unlock while reading from files and memtables
         {
             mutex_.Unlock();
-            // First look in the memtable, then in the immutable memtable (if any).
+            // First look in the memtable, then in the immutable memtables from
+            // newest to oldest.
             LookupKey lkey(key, snapshot);
-            if (mem->Get(lkey, value, &s)) {
-                // Done
-            } else if (imm != nullptr && imm->Get(lkey, value, &s)) {
-                // Done
-            } else {
-                s = current->Get(options, lkey, value, &stats);
+            std::vector<std::string> operands;
+            SequenceNumber max_covering_tombstone_seq = 0;
+            bool done = mem->Get(lkey, value, &s, &operands,
+                                 &max_covering_tombstone_seq);
+            for (size_t i = 0; !done && i < imm.size(); i++) {
+                done = imm[i]->Get(lkey, value, &s, &operands,
+                                   &max_covering_tombstone_seq);
+            }
+            if (!done) {
+                s = current->Get(options, lkey, value, &operands,
+                                 &max_covering_tombstone_seq, &stats);
                 have_stat_update = true;
             }
+            if (!operands.empty() && (s.ok() || s.IsNotFound())) {
+                const Slice existing_value(*value);
+                s = FullMerge(options_.merge_operator, key,
+                              s.ok() ? &existing_value : nullptr, operands, value);
+            }
             mutex_.Lock();
         }
 
@@ -1155,7 +1823,9 @@ namespace leveldb {
             MaybeScheduleCompaction();
         }
         mem->Unref();
-        if (imm != nullptr) imm->Unref();
+        for (MemTable *m : imm) {
+            m->Unref();
+        }
         current->Unref();
         return s;
     }
@@ -1164,8 +1834,13 @@ namespace leveldb {
         // 序列号
         SequenceNumber latest_snapshot;
         uint32_t seed;
-        Iterator *iter = NewInternalIterator(options, &latest_snapshot, &seed);
-        return NewDBIterator(this, user_comparator(), iter,
+        std::vector<RangeTombstone> range_dels;
+        Iterator *iter =
+                NewInternalIterator(options, &latest_snapshot, &seed, &range_dels);
+        return NewDBIterator(this, user_comparator(), options_.merge_operator, iter,
+                             range_dels.empty()
+                             ? nullptr
+                             : new RangeTombstoneSet(user_comparator(), range_dels),
                              (options.snapshot != nullptr
                               ? static_cast<const SnapshotImpl *>(options.snapshot)
                                       ->sequence_number()
@@ -1199,7 +1874,27 @@ namespace leveldb {
         return DB::Delete(options, key);
     }
 
+    Status DBImpl::Merge(const WriteOptions &options, const Slice &key,
+                         const Slice &value) {
+        if (options_.merge_operator == nullptr) {
+            return Status::NotSupported("Merge() requires Options::merge_operator");
+        }
+        return DB::Merge(options, key, value);
+    }
+
+    Status DBImpl::DeleteRange(const WriteOptions &options, const Slice &begin_key,
+                               const Slice &end_key) {
+        if (user_comparator()->Compare(begin_key, end_key) > 0) {
+            return Status::InvalidArgument("DeleteRange() end key before begin key");
+        }
+        return DB::DeleteRange(options, begin_key, end_key);
+    }
+
     Status DBImpl::Write(const WriteOptions &options, WriteBatch *updates) {
+        if (options_.enable_pipelined_write) {
+            return PipelinedWrite(options, updates);
+        }
+
         Writer w(&mutex_);
         w.batch = updates;
         w.sync = options.sync;
@@ -1219,7 +1914,8 @@ namespace leveldb {
         uint64_t last_sequence = versions_->LastSequence();
         Writer *last_writer = &w;
         if (status.ok() && updates != nullptr) {  // nullptr batch is for compactions
-            WriteBatch *write_batch = BuildBatchGroup(&last_writer);
+            WriteBatch *write_batch = BuildBatchGroup(&last_writer, tmp_batch_);
+            DelayWrite(WriteBatchInternal::ByteSize(write_batch));
             WriteBatchInternal::SetSequence(write_batch, last_sequence + 1);
             last_sequence += WriteBatchInternal::Count(write_batch);
 
@@ -1272,9 +1968,167 @@ namespace leveldb {
         return status;
     }
 
+    Status DBImpl::PipelinedWrite(const WriteOptions &options,
+                                  WriteBatch *updates) {
+        Writer w(&mutex_);
+        w.batch = updates;
+        w.sync = options.sync;
+        w.done = false;
+
+        MutexLock l(&mutex_);
+        writers_.push_back(&w);
+        // Followers leave writers_ before they are done, so check for an
+        // empty queue before looking at its front.
+        while (!w.done && (writers_.empty() || &w != writers_.front())) {
+            if (w.insert_into != nullptr) {
+                // Our leader wants us to apply our own batch alongside the
+                // rest of the group.
+                MemTable *mem = w.insert_into;
+                w.insert_into = nullptr;
+                mutex_.Unlock();
+                w.status = WriteBatchInternal::InsertIntoConcurrently(updates, mem);
+                mutex_.Lock();
+                if (--w.leader->pending_inserts == 0) {
+                    w.leader->cv.Signal();
+                }
+                continue;
+            }
+            w.cv.Wait();
+        }
+        if (w.done) {
+            return w.status;
+        }
+
+        // Log stage.  May temporarily unlock and wait.
+        Status status = MakeRoomForWrite(updates == nullptr);
+        Writer *last_writer = &w;
+        WriteBatch *write_batch = nullptr;
+        WriteBatch group_batch;
+        if (status.ok() && updates != nullptr) {  // nullptr batch is for compactions
+            write_batch = BuildBatchGroup(&last_writer, &group_batch);
+            DelayWrite(WriteBatchInternal::ByteSize(write_batch));
+
+            // Groups that have been logged but not yet applied to the memtable
+            // already own the sequence numbers up to the newest one of them.
+            SequenceNumber last_sequence =
+                    memtable_writers_.empty() ? versions_->LastSequence()
+                                              : memtable_writers_.back()->last_sequence;
+            WriteBatchInternal::SetSequence(write_batch, last_sequence + 1);
+            w.last_sequence = last_sequence + WriteBatchInternal::Count(write_batch);
+
+            // &w is the only writer of the log until it hands the group over
+            // to the memtable stage below.
+            mutex_.Unlock();
+            status = log_->AddRecord(WriteBatchInternal::Contents(write_batch));
+            bool sync_error = false;
+            if (status.ok() && options.sync) {
+                status = logfile_->Sync();
+                if (!status.ok()) {
+                    sync_error = true;
+                }
+            }
+            mutex_.Lock();
+            if (sync_error) {
+                // The state of the log file is indeterminate: the log record we
+                // just added may or may not show up when the DB is re-opened.
+                // So we force the DB into a mode where all future writes fail.
+                RecordBackgroundError(status);
+            }
+        }
+
+        // Take the group off the log queue so that the next group can be
+        // logged while this one is applied to the memtable.
+        std::vector<Writer *> group;
+        while (true) {
+            Writer *ready = writers_.front();
+            writers_.pop_front();
+            group.push_back(ready);
+            if (ready == last_writer) break;
+        }
+        if (!writers_.empty()) {
+            writers_.front()->cv.Signal();
+        }
+
+        // Memtable stage.  Groups are applied one at a time and in the order
+        // in which they were logged, so that their sequence numbers become
+        // visible in order.
+        if (write_batch != nullptr) {
+            memtable_writers_.push_back(&w);
+            while (&w != memtable_writers_.front()) {
+                w.cv.Wait();
+            }
+            if (status.ok() && options_.allow_concurrent_memtable_write &&
+                group.size() > 1) {
+                status = ConcurrentMemTableInsert(group, write_batch);
+            } else if (status.ok()) {
+                mutex_.Unlock();
+                status = WriteBatchInternal::InsertInto(write_batch, mem_);
+                mutex_.Lock();
+            }
+            versions_->SetLastSequence(w.last_sequence);
+            memtable_writers_.pop_front();
+            if (!memtable_writers_.empty()) {
+                memtable_writers_.front()->cv.Signal();
+            } else if (!writers_.empty()) {
+                // The head of the log queue may wait for the memtable stage to
+                // drain before it switches to a new memtable.
+                writers_.front()->cv.Signal();
+            }
+        }
+
+        for (size_t i = 1; i < group.size(); i++) {
+            group[i]->status = status;
+            group[i]->done = true;
+            group[i]->cv.Signal();
+        }
+        return status;
+    }
+
+// Apply every batch of a logged group to mem_, each writer inserting its
+// own batch, and wait until all of them are done.
+// REQUIRES: group[0] is the group leader and at the front of memtable_writers_
+    Status DBImpl::ConcurrentMemTableInsert(const std::vector<Writer *> &group,
+                                            WriteBatch *write_batch) {
+        mutex_.AssertHeld();
+        Writer *leader = group[0];
+        MemTable *mem = mem_;
+
+        // Hand out the sequence numbers that were assigned to the whole group
+        // to its individual batches.
+        SequenceNumber sequence = WriteBatchInternal::Sequence(write_batch);
+        for (Writer *w : group) {
+            if (w->batch != nullptr) {
+                WriteBatchInternal::SetSequence(w->batch, sequence);
+                sequence += WriteBatchInternal::Count(w->batch);
+            }
+        }
+        assert(sequence == leader->last_sequence + 1);
+
+        for (size_t i = 1; i < group.size(); i++) {
+            if (group[i]->batch != nullptr) {
+                group[i]->insert_into = mem;
+                group[i]->leader = leader;
+                leader->pending_inserts++;
+                group[i]->cv.Signal();
+            }
+        }
+
+        mutex_.Unlock();
+        Status status = WriteBatchInternal::InsertIntoConcurrently(leader->batch, mem);
+        mutex_.Lock();
+        while (leader->pending_inserts > 0) {
+            leader->cv.Wait();
+        }
+        for (size_t i = 1; i < group.size() && status.ok(); i++) {
+            status = group[i]->status;
+        }
+        return status;
+    }
+
 // REQUIRES: Writer list must be non-empty
 // REQUIRES: First writer must have a non-null batch
-    WriteBatch *DBImpl::BuildBatchGroup(Writer **last_writer) {
+    WriteBatch *DBImpl::BuildBatchGroup(Writer **last_writer,
+                                        WriteBatch *tmp_batch) {
         mutex_.AssertHeld();
         assert(!writers_.empty());
         Writer *first = writers_.front();
@@ -1311,7 +2165,7 @@ namespace leveldb {
                 // Append to *result
                 if (result == first->batch) {
                     // Switch to temporary batch instead of disturbing caller's batch
-                    result = tmp_batch_;
+                    result = tmp_batch;
                     assert(WriteBatchInternal::Count(result) == 0);
                     WriteBatchInternal::Append(result, first->batch);
                 }
@@ -1327,38 +2181,49 @@ namespace leveldb {
     Status DBImpl::MakeRoomForWrite(bool force) {
         mutex_.AssertHeld();
         assert(!writers_.empty());
-        bool allow_delay = !force;
+        const bool writing = !force;
         Status s;
         while (true) {
             if (!bg_error_.ok()) {
                 // Yield previous error
                 s = bg_error_;
                 break;
-            } else if (allow_delay && versions_->NumLevelFiles(0) >=
-                                      config::kL0_SlowdownWritesTrigger) {
-                // We are getting close to hitting a hard limit on the number of
-                // L0 files.  Rather than delaying a single write by several
-                // seconds when we hit the hard limit, start delaying each
-                // individual write by 1ms to reduce latency variance.  Also,
-                // this delay hands over some CPU to the compaction thread in
-                // case it is sharing the same core as the writer.
-                mutex_.Unlock();
-                env_->SleepForMicroseconds(1000);
-                allow_delay = false;  // Do not delay a single write more than once
-                mutex_.Lock();
             } else if (!force &&
                        (mem_->ApproximateMemoryUsage() <= options_.write_buffer_size)) {
                 // There is room in current memtable
                 break;
-            } else if (imm_ != nullptr) {
-                // We have filled up the current memtable, but the previous
-                // one is still being compacted, so we wait.
+            } else if (imm_.size() + 1 >= static_cast<size_t>(
+                               options_.max_write_buffer_number)) {
+                // We have filled up the current memtable, but as many
+                // previous ones as allowed are still waiting to be flushed,
+                // so we wait.
                 Log(options_.info_log, "Current memtable full; waiting...\n");
+                const uint64_t start_micros = env_->NowMicros();
                 background_work_finished_signal_.Wait();
-            } else if (versions_->NumLevelFiles(0) >= config::kL0_StopWritesTrigger) {
-                // There are too many level-0 files.
+                RecordStall(kStallMemtableFull, start_micros);
+            } else if (options_.compaction_style != kCompactionStyleFIFO &&
+                       versions_->NumLevelFiles(0) >=
+                       options_.level0_stop_writes_trigger) {
+                // There are too many level-0 files.  FIFO compaction keeps
+                // all of its files in level-0 and never merges them, so it
+                // is exempt.
                 Log(options_.info_log, "Too many L0 files; waiting...\n");
+                const uint64_t start_micros = env_->NowMicros();
+                background_work_finished_signal_.Wait();
+                RecordStall(kStallLevel0Stop, start_micros);
+            } else if (options_.hard_pending_compaction_bytes_limit > 0 &&
+                       versions_->EstimatedPendingCompactionBytes() >=
+                       options_.hard_pending_compaction_bytes_limit) {
+                // Compactions are too far behind.
+                Log(options_.info_log, "Too many pending compaction bytes; waiting...\n");
+                const uint64_t start_micros = env_->NowMicros();
                 background_work_finished_signal_.Wait();
+                RecordStall(kStallPendingCompactionStop, start_micros);
+            } else if (!memtable_writers_.empty()) {
+                // Pipelined writes: groups that were logged to the current log
+                // file are still being applied to mem_.  Wait for them before
+                // mem_ is handed over to a flush.
+                writers_.front()->cv.Wait();
             } else {
                 // Attempt to switch to a new memtable and trigger compaction of old
                 assert(versions_->PrevLogNumber() == 0);
@@ -1372,20 +2237,71 @@ namespace leveldb {
                 }
                 delete log_;
                 delete logfile_;
+                imm_.push_back(mem_);
+                imm_log_numbers_.push_back(logfile_number_);
+                has_imm_.store(true, std::memory_order_release);
+                mem_->MarkReadOnly();
                 logfile_ = lfile;
                 logfile_number_ = new_log_number;
                 log_ = new log::Writer(lfile);
-                imm_ = mem_;
-                has_imm_.store(true, std::memory_order_release);
-                mem_ = new MemTable(internal_comparator_);
+                mem_ = NewMemTable();
                 mem_->Ref();
                 force = false;  // Do not force another compaction if have room
                 MaybeScheduleCompaction();
             }
         }
+        if (s.ok() && writing && mem_->first_write_time() == 0) {
+            // The writer is about to add the first entries to mem_
+            mem_->SetFirstWriteTime(env_->NowMicros() / 1000000);
+        }
         return s;
     }
 
+    void DBImpl::UpdateWriteController() {
+        mutex_.AssertHeld();
+        const int level0_files = (options_.compaction_style == kCompactionStyleFIFO)
+                                 ? 0
+                                 : versions_->NumLevelFiles(0);
+        write_controller_.Update(level0_files,
+                                 versions_->EstimatedPendingCompactionBytes());
+    }
+
+// REQUIRES: mutex_ is held
+// REQUIRES: this thread is currently at the front of the writer queue
+    void DBImpl::DelayWrite(uint64_t bytes) {
+        mutex_.AssertHeld();
+        UpdateWriteController();
+        const uint64_t start_micros = env_->NowMicros();
+        uint64_t delay = write_controller_.GetDelay(start_micros, bytes);
+        if (delay == 0) {
+            return;
+        }
+        // Sleep in short steps, so that writes speed up again as soon as the
+        // compactions catch up.  Sleeping also hands over some CPU to the
+        // compaction thread in case it is sharing the same core as the writer.
+        static const uint64_t kDelayStepMicros = 1000;
+        while (delay > 0 && write_controller_.IsDelayed() &&
+               !shutting_down_.load(std::memory_order_acquire) && bg_error_.ok()) {
+            const uint64_t step = std::min(delay, kDelayStepMicros);
+            mutex_.Unlock();
+            env_->SleepForMicroseconds(static_cast<int>(step));
+            mutex_.Lock();
+            delay -= step;
+            UpdateWriteController();
+        }
+        RecordStall(kStallDelayedWrite, start_micros);
+    }
+
+    void DBImpl::RecordStall(StallCause cause, uint64_t start_micros) {
+        mutex_.AssertHeld();
+        stall_micros_[cause] += env_->NowMicros() - start_micros;
+        stall_count_[cause]++;
+    }
+
+    static const char *const kStallCauseNames[] = {
+            "delayed-write", "memtable-full", "level0-stop",
+            "pending-compaction-stop"};
+
     bool DBImpl::GetProperty(const Slice &property, std::string *value) {
         value->clear();
 
@@ -1412,31 +2328,107 @@ namespace leveldb {
             char buf[200];
             std::snprintf(buf, sizeof(buf),
                           "                               Compactions\n"
-                          "Level  Files Size(MB) Time(sec) Read(MB) Write(MB)\n"
-                          "--------------------------------------------------\n");
+                          "Level  Files Size(MB) Time(sec) Read(MB) Write(MB) W-Amp\n"
+                          "--------------------------------------------------------\n");
             value->append(buf);
+            CompactionStats total;
+            int total_files = 0;
+            double total_mb = 0;
             for (int level = 0; level < config::kNumLevels; level++) {
                 int files = versions_->NumLevelFiles(level);
+                double mb = versions_->NumLevelBytes(level) / 1048576.0;
                 if (stats_[level].micros > 0 || files > 0) {
-                    std::snprintf(buf, sizeof(buf), "%3d %8d %8.0f %9.0f %8.0f %9.0f\n",
-                                  level, files, versions_->NumLevelBytes(level) / 1048576.0,
-                                  stats_[level].micros / 1e6,
+                    std::snprintf(buf, sizeof(buf),
+                                  "%3d %8d %8.0f %9.0f %8.0f %9.0f %5.1f\n",
+                                  level, files, mb, stats_[level].micros / 1e6,
                                   stats_[level].bytes_read / 1048576.0,
-                                  stats_[level].bytes_written / 1048576.0);
+                                  stats_[level].bytes_written / 1048576.0,
+                                  stats_[level].WriteAmplification());
                     value->append(buf);
                 }
+                total.Add(stats_[level]);
+                total_files += files;
+                total_mb += mb;
             }
+            // Overall, bytes written to tables for each byte flushed
+            total.bytes_in = bytes_flushed_;
+            std::snprintf(buf, sizeof(buf),
+                          "Sum %8d %8.0f %9.0f %8.0f %9.0f %5.1f\n",
+                          total_files, total_mb, total.micros / 1e6,
+                          total.bytes_read / 1048576.0,
+                          total.bytes_written / 1048576.0,
+                          total.WriteAmplification());
+            value->append(buf);
+
+            std::snprintf(buf, sizeof(buf),
+                          "\n"
+                          "                      Write stalls\n"
+                          "Cause                      Count Time(sec)\n"
+                          "------------------------------------------\n");
+            value->append(buf);
+            for (int cause = 0; cause < kNumStallCauses; cause++) {
+                std::snprintf(buf, sizeof(buf), "%-23s %8llu %9.3f\n",
+                              kStallCauseNames[cause],
+                              static_cast<unsigned long long>(stall_count_[cause]),
+                              stall_micros_[cause] / 1e6);
+                value->append(buf);
+            }
+            UpdateWriteController();
+            std::snprintf(buf, sizeof(buf),
+                          "Delayed write rate: %.3f MB/s, "
+                          "pending compaction: %.0f MB\n",
+                          write_controller_.delayed_write_rate() / 1048576.0,
+                          versions_->EstimatedPendingCompactionBytes() / 1048576.0);
+            value->append(buf);
             return true;
+        } else if (in.starts_with("stall-micros")) {
+            in.remove_prefix(strlen("stall-micros"));
+            if (in.empty()) {
+                uint64_t total = 0;
+                for (int cause = 0; cause < kNumStallCauses; cause++) {
+                    total += stall_micros_[cause];
+                }
+                AppendNumberTo(value, total);
+                return true;
+            }
+            if (!in.starts_with(".")) {
+                return false;
+            }
+            in.remove_prefix(1);
+            for (int cause = 0; cause < kNumStallCauses; cause++) {
+                if (in == kStallCauseNames[cause]) {
+                    AppendNumberTo(value, stall_micros_[cause]);
+                    return true;
+                }
+            }
+            return false;
         } else if (in == "sstables") {
             *value = versions_->current()->DebugString();
             return true;
+        } else if (in == "delayed-write-rate") {
+            UpdateWriteController();
+            AppendNumberTo(value, write_controller_.delayed_write_rate());
+            return true;
+        } else if (in == "estimate-pending-compaction-bytes") {
+            AppendNumberTo(value, versions_->EstimatedPendingCompactionBytes());
+            return true;
+        } else if (in == "num-immutable-memtables") {
+            AppendNumberTo(value, imm_.size());
+            return true;
+        } else if (in == "compaction-bytes-written") {
+            uint64_t bytes = 0;
+            for (int level = 0; level < config::kNumLevels; level++) {
+                bytes += stats_[level].bytes_written;
+            }
+            AppendNumberTo(value, bytes);
+            return true;
         } else if (in == "approximate-memory-usage") {
             size_t total_usage = options_.block_cache->TotalCharge();
             if (mem_) {
                 total_usage += mem_->ApproximateMemoryUsage();
             }
-            if (imm_) {
-                total_usage += imm_->ApproximateMemoryUsage();
+            for (MemTable *imm : imm_) {
+                total_usage += imm->ApproximateMemoryUsage();
             }
             char buf[50];
             std::snprintf(buf, sizeof(buf), "%llu",
@@ -1480,6 +2472,20 @@ namespace leveldb {
         return Write(opt, &batch);
     }
 
+    Status DB::Merge(const WriteOptions &opt, const Slice &key,
+                     const Slice &value) {
+        WriteBatch batch;
+        batch.Merge(key, value);
+        return Write(opt, &batch);
+    }
+
+    Status DB::DeleteRange(const WriteOptions &opt, const Slice &begin_key,
+                           const Slice &end_key) {
+        WriteBatch batch;
+        batch.DeleteRange(begin_key, end_key);
+        return Write(opt, &batch);
+    }
+
     DB::~DB() = default;
 
     Status DB::Open(const Options &options, const std::string &dbname, DB **dbptr) {
@@ -1502,7 +2508,7 @@ namespace leveldb {
                 impl->logfile_ = lfile;
                 impl->logfile_number_ = new_log_number;
                 impl->log_ = new log::Writer(lfile);
-                impl->mem_ = new MemTable(impl->internal_comparator_);
+                impl->mem_ = impl->NewMemTable();
                 impl->mem_->Ref();
             }
         }
@@ -9,10 +9,12 @@
 #include <deque>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "db/dbformat.h"
 #include "db/log_writer.h"
 #include "db/snapshot.h"
+#include "db/write_controller.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "port/port.h"
@@ -22,6 +24,8 @@ namespace leveldb {
 
     class MemTable;
 
+    struct RangeTombstone;
+
     class TableCache;
 
     class Version;
@@ -46,6 +50,12 @@ namespace leveldb {
 
         Status Delete(const WriteOptions &, const Slice &key) override;
 
+        Status Merge(const WriteOptions &, const Slice &key,
+                     const Slice &value) override;
+
+        Status DeleteRange(const WriteOptions &, const Slice &begin_key,
+                           const Slice &end_key) override;
+
         Status Write(const WriteOptions &options, WriteBatch *updates) override;
 
         Status Get(const ReadOptions &options, const Slice &key,
@@ -89,6 +99,7 @@ namespace leveldb {
         friend class DB;
 
         struct CompactionState;
+        struct SubcompactionState;
         struct Writer;
 
         // Information for a manual compaction
@@ -103,22 +114,45 @@ namespace leveldb {
         // Per level compaction stats.  stats_[level] stores the stats for
         // compactions that produced data for the specified "level".
         struct CompactionStats {
-            CompactionStats() : micros(0), bytes_read(0), bytes_written(0) {}
+            CompactionStats()
+                    : micros(0), bytes_read(0), bytes_written(0), bytes_in(0) {}
 
             void Add(const CompactionStats &c) {
                 this->micros += c.micros;
                 this->bytes_read += c.bytes_read;
                 this->bytes_written += c.bytes_written;
+                this->bytes_in += c.bytes_in;
+            }
+
+            // Bytes written to the level for each byte that entered it
+            double WriteAmplification() const {
+                return (bytes_in > 0) ? static_cast<double>(bytes_written) / bytes_in
+                                      : 0.0;
             }
 
             int64_t micros;
             int64_t bytes_read;
             int64_t bytes_written;
+            // Bytes that entered the level from above: flushed tables, files
+            // moved into it and the files of a higher level compacted into it
+            int64_t bytes_in;
+        };
+
+        // Reasons for which MakeRoomForWrite() holds up a writer.
+        enum StallCause {
+            kStallDelayedWrite,           // paced by write_controller_
+            kStallMemtableFull,           // waiting for a flush of imm_ to make room
+            kStallLevel0Stop,             // waiting for L0 to drop below the stop trigger
+            kStallPendingCompactionStop,  // waiting for compactions to catch up
+            kNumStallCauses
         };
 
+        // If "range_dels" is non-null, the range tombstones of the returned
+        // entries are appended to it.
         Iterator *NewInternalIterator(const ReadOptions &,
                                       SequenceNumber *latest_snapshot,
-                                      uint32_t *seed);
+                                      uint32_t *seed,
+                                      std::vector<RangeTombstone> *range_dels = nullptr);
 
         Status NewDB();
 
@@ -138,28 +172,69 @@ namespace leveldb {
         // Errors are recorded in bg_error_.
         void CompactMemTable() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+        // Returns a new, empty memtable configured by options_.
+        MemTable *NewMemTable() const;
+
         Status RecoverLogFile(uint64_t log_number, bool last_log, bool *save_manifest,
                               VersionEdit *edit, SequenceNumber *max_sequence)
         EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-        Status WriteLevel0Table(MemTable *mem, VersionEdit *edit, Version *base)
+        // Builds a level-0 table from the merged contents of "mems" and records
+        // it in "*edit".  The new file number is stored in "*file_number" and
+        // stays in pending_outputs_ until the caller erases it, which must not
+        // happen before the edit has been applied or a concurrent compaction
+        // may delete the file.
+        Status WriteLevel0Table(const std::vector<MemTable *> &mems,
+                                VersionEdit *edit, Version *base,
+                                uint64_t *file_number)
         EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
         Status MakeRoomForWrite(bool force /* compact even if there is room? */)
         EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-        WriteBatch *BuildBatchGroup(Writer **last_writer)
+        // Holds up the write group at the front of writers_ for as long as
+        // write_controller_ asks for "bytes" to be written.
+        void DelayWrite(uint64_t bytes) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+        // Feeds the current shape of the tree to write_controller_.
+        void UpdateWriteController() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+        // Write() for options_.enable_pipelined_write: the log write of one
+        // batch group overlaps the memtable insert of the previous one.
+        Status PipelinedWrite(const WriteOptions &options, WriteBatch *updates);
+
+        // Pipelined writes with options_.allow_concurrent_memtable_write:
+        // every writer of "group" inserts its own batch into mem_ at once.
+        Status ConcurrentMemTableInsert(const std::vector<Writer *> &group,
+                                        WriteBatch *write_batch)
+        EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+        WriteBatch *BuildBatchGroup(Writer **last_writer, WriteBatch *tmp_batch)
         EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
         void RecordBackgroundError(const Status &s);
 
+        // Schedules a flush of imm_ on the high priority lane and as many
+        // compactions as are needed and allowed on the shared pool.
         void MaybeScheduleCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+        void MaybeScheduleFlush() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
         static void BGWork(void *db);
 
+        static void BGFlushWork(void *db);
+
         void BackgroundCall();
 
-        void BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+        void BackgroundFlushCall();
+
+        // Adds the time since "start_micros" to the stall statistics of "cause".
+        void RecordStall(StallCause cause, uint64_t start_micros)
+        EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+        // Runs one compaction.  Returns false if there was nothing that could
+        // be started next to the running compactions.
+        bool BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
         void CleanupCompaction(CompactionState *compact)
         EXCLUSIVE_LOCKS_REQUIRED(mutex_);
@@ -167,9 +242,37 @@ namespace leveldb {
         Status DoCompactionWork(CompactionState *compact)
         EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+        // Compacts the keys of "input" that fall into the range of "compact"
+        // and deletes "input".  Safe to call for disjoint ranges concurrently.
+        Status DoCompactionRange(CompactionState *compact, Iterator *input)
+        LOCKS_EXCLUDED(mutex_);
+
+        static void BGSubcompactionWork(void *arg);
+
         Status OpenCompactionOutputFile(CompactionState *compact);
 
-        Status FinishCompactionOutputFile(CompactionState *compact, Iterator *input);
+        // Closes the current output of "compact", which the next one starts at
+        // user key *upper (nullptr at the end of the range).
+        Status FinishCompactionOutputFile(CompactionState *compact, Iterator *input,
+                                          const Slice *upper);
+
+        // Stores in *pieces the parts of the range tombstones of "compact"
+        // that the output ending before user key *upper (nullptr at the end
+        // of the range) has to keep.
+        void ClipRangeTombstones(CompactionState *compact, const Slice *upper,
+                                 std::vector<RangeTombstone> *pieces);
+
+        // Adds an entry to the current output of "compact", closing the
+        // current output file first and opening a new one as needed.
+        Status AddCompactionOutput(CompactionState *compact, Iterator *input,
+                                   const Slice &key, const Slice &value);
+
+        // Writes out the run of merge operands for "user_key" that "input" is
+        // positioned at, combined into a single value where no snapshot can
+        // tell, and leaves "input" at the first entry it did not consume.
+        Status CompactMergeOperands(CompactionState *compact, Iterator *input,
+                                    const std::string &user_key,
+                                    SequenceNumber *last_sequence_for_key);
 
         Status InstallCompactionResults(CompactionState *compact)
         EXCLUSIVE_LOCKS_REQUIRED(mutex_);
@@ -198,8 +301,12 @@ namespace leveldb {
         std::atomic<bool> shutting_down_;
         port::CondVar background_work_finished_signal_ GUARDED_BY(mutex_);
         MemTable *mem_;
-        MemTable *imm_ GUARDED_BY(mutex_);  // Memtable being compacted
-        std::atomic<bool> has_imm_;         // So bg thread can detect non-null imm_
+        // Immutable memtables waiting to be flushed, oldest first, and the
+        // number of the log file that each of them was written to.  At most
+        // options_.max_write_buffer_number - 1 of them.
+        std::vector<MemTable *> imm_ GUARDED_BY(mutex_);
+        std::vector<uint64_t> imm_log_numbers_ GUARDED_BY(mutex_);
+        std::atomic<bool> has_imm_;  // So bg thread can detect non-empty imm_
         WritableFile *logfile_;
         uint64_t logfile_number_ GUARDED_BY(mutex_);
         log::Writer *log_;
@@ -209,14 +316,25 @@ namespace leveldb {
         std::deque<Writer *> writers_ GUARDED_BY(mutex_);
         WriteBatch *tmp_batch_ GUARDED_BY(mutex_);
 
+        // Leaders of the batch groups that have been logged and wait to be
+        // applied to the memtable, oldest first (pipelined writes only).
+        std::deque<Writer *> memtable_writers_ GUARDED_BY(mutex_);
+
         SnapshotList snapshots_ GUARDED_BY(mutex_);
 
         // Set of table files to protect from deletion because they are
         // part of ongoing compactions.
         std::set<uint64_t> pending_outputs_ GUARDED_BY(mutex_);
 
-        // Has a background compaction been scheduled or is running?
-        bool background_compaction_scheduled_ GUARDED_BY(mutex_);
+        // Number of background compactions that are scheduled or running.
+        // At most options_.max_background_compactions.
+        int background_compactions_scheduled_ GUARDED_BY(mutex_);
+
+        // Has a flush of imm_ been handed to the high priority lane?
+        bool background_flush_scheduled_ GUARDED_BY(mutex_);
+
+        // Is imm_ being flushed, either on that lane or by a compaction?
+        bool flush_in_progress_ GUARDED_BY(mutex_);
 
         ManualCompaction *manual_compaction_ GUARDED_BY(mutex_);
         // GUARDED_BY(mutex_); clang中用于编译器的静态检查
@@ -226,6 +344,14 @@ namespace leveldb {
         Status bg_error_ GUARDED_BY(mutex_);
 
         CompactionStats stats_[config::kNumLevels] GUARDED_BY(mutex_);
+        // Bytes of all the tables flushed from memtables
+        int64_t bytes_flushed_ GUARDED_BY(mutex_);
+
+        // Total time writers were held up, and how often, for each StallCause.
+        uint64_t stall_micros_[kNumStallCauses] GUARDED_BY(mutex_);
+        uint64_t stall_count_[kNumStallCauses] GUARDED_BY(mutex_);
+
+        WriteController write_controller_ GUARDED_BY(mutex_);
     };
 
 // Sanitize db options.  The caller should delete result.info_log if
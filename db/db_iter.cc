@@ -4,9 +4,13 @@
 
 #include "db/db_iter.h"
 
+#include <algorithm>
+
 #include "db/db_impl.h"
 #include "db/dbformat.h"
 #include "db/filename.h"
+#include "db/merge_helper.h"
+#include "db/range_tombstone.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
 #include "port/port.h"
@@ -35,23 +39,30 @@ namespace {
 // (userkey,seq,type) => uservalue entries.  DBIter
 // combines multiple entries for the same userkey found in the DB
 // representation into a single entry while accounting for sequence
-// numbers, deletion markers, overwrites, etc.
+// numbers, deletion markers, overwrites, merge operands, etc.
 class DBIter : public Iterator {
  public:
   // Which direction is the iterator currently moving?
   // (1) When moving forward, the internal iterator is positioned at
-  //     the exact entry that yields this->key(), this->value()
+  //     the exact entry that yields this->key(), this->value(), unless
+  //     the entry is a merge operand: its result is then kept in
+  //     saved_key_, saved_value_ and the internal iterator is positioned
+  //     after the entries that were merged.
   // (2) When moving backwards, the internal iterator is positioned
   //     just before all entries whose user key == this->key().
   enum Direction { kForward, kReverse };
 
-  DBIter(DBImpl* db, const Comparator* cmp, Iterator* iter, SequenceNumber s,
+  DBIter(DBImpl* db, const Comparator* cmp, const MergeOperator* merge_operator,
+         Iterator* iter, const RangeTombstoneSet* range_dels, SequenceNumber s,
          uint32_t seed)
       : db_(db),
         user_comparator_(cmp),
+        merge_operator_(merge_operator),
         iter_(iter),
+        range_dels_(range_dels),
         sequence_(s),
         direction_(kForward),
+        merged_(false),
         valid_(false),
         rnd_(seed),
         bytes_until_read_sampling_(RandomCompactionPeriod()) {}
@@ -59,15 +70,19 @@ class DBIter : public Iterator {
   DBIter(const DBIter&) = delete;
   DBIter& operator=(const DBIter&) = delete;
 
-  ~DBIter() override { delete iter_; }
+  ~DBIter() override {
+    delete iter_;
+    delete range_dels_;
+  }
   bool Valid() const override { return valid_; }
   Slice key() const override {
     assert(valid_);
-    return (direction_ == kForward) ? ExtractUserKey(iter_->key()) : saved_key_;
+    return (direction_ == kForward && !merged_) ? ExtractUserKey(iter_->key())
+                                                : saved_key_;
   }
   Slice value() const override {
     assert(valid_);
-    return (direction_ == kForward) ? iter_->value() : saved_value_;
+    return (direction_ == kForward && !merged_) ? iter_->value() : saved_value_;
   }
   Status status() const override {
     if (status_.ok()) {
@@ -86,6 +101,7 @@ class DBIter : public Iterator {
  private:
   void FindNextUserEntry(bool skipping, std::string* skip);
   void FindPrevUserEntry();
+  void MergeOlderEntries();
   bool ParseKey(ParsedInternalKey* key);
 
   inline void SaveKey(const Slice& k, std::string* dst) {
@@ -108,12 +124,16 @@ class DBIter : public Iterator {
 
   DBImpl* db_;
   const Comparator* const user_comparator_;
+  const MergeOperator* const merge_operator_;
   Iterator* const iter_;
+  const RangeTombstoneSet* const range_dels_;  // nullptr if there are none
   SequenceNumber const sequence_;
   Status status_;
   std::string saved_key_;    // == current key when direction_==kReverse
   std::string saved_value_;  // == current raw value when direction_==kReverse
+  std::vector<std::string> merge_operands_;  // Newest first
   Direction direction_;
+  bool merged_;  // Forward and saved_value_ holds the result of a merge
   bool valid_;
   Random rnd_;
   size_t bytes_until_read_sampling_;
@@ -133,9 +153,13 @@ inline bool DBIter::ParseKey(ParsedInternalKey* ikey) {
   if (!ParseInternalKey(k, ikey)) {
     status_ = Status::Corruption("corrupted internal key in DBIter");
     return false;
-  } else {
-    return true;
   }
+  if (range_dels_ != nullptr && ikey->sequence <= sequence_ &&
+      range_dels_->ShouldDelete(ikey->user_key, ikey->sequence, sequence_)) {
+    // Deleted by a range tombstone
+    ikey->type = kTypeDeletion;
+  }
+  return true;
 }
 
 void DBIter::Next() {
@@ -157,6 +181,14 @@ void DBIter::Next() {
       return;
     }
     // saved_key_ already contains the key to skip past.
+  } else if (merged_) {
+    // iter_ is past the entries that were merged, and saved_key_ already
+    // contains the key to skip past.
+    if (!iter_->Valid()) {
+      valid_ = false;
+      saved_key_.clear();
+      return;
+    }
   } else {
     // Store in saved_key_ the current key so we skip it below.
     SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
@@ -178,6 +210,7 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   // Loop until we hit an acceptable entry to yield
   assert(iter_->Valid());
   assert(direction_ == kForward);
+  merged_ = false;
   do {
     ParsedInternalKey ikey;
     if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
@@ -198,6 +231,19 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
             return;
           }
           break;
+        case kTypeMerge:
+          if (skipping &&
+              user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
+            // Entry hidden
+          } else {
+            MergeOlderEntries();
+            return;
+          }
+          break;
+        case kTypeRangeDeletion:
+          // Range tombstones are not mixed with the point entries
+          assert(false);
+          break;
       }
     }
     iter_->Next();
@@ -206,14 +252,63 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   valid_ = false;
 }
 
+void DBIter::MergeOlderEntries() {
+  // iter_ is positioned at the newest visible entry of its key, a merge
+  // operand.  Collect the operands down to the value or deletion that they
+  // were written on top of.
+  SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+  merge_operands_.clear();
+  merge_operands_.push_back(iter_->value().ToString());
+  bool has_value = false;
+  for (iter_->Next(); iter_->Valid(); iter_->Next()) {
+    ParsedInternalKey ikey;
+    if (!ParseKey(&ikey) ||
+        user_comparator_->Compare(ikey.user_key, saved_key_) != 0) {
+      break;
+    }
+    if (ikey.type == kTypeMerge) {
+      merge_operands_.push_back(iter_->value().ToString());
+      continue;
+    }
+    if (ikey.type == kTypeValue) {
+      Slice raw_value = iter_->value();
+      saved_value_.assign(raw_value.data(), raw_value.size());
+      has_value = true;
+    }
+    iter_->Next();
+    break;
+  }
+
+  const Slice existing_value(saved_value_);
+  Status s = FullMerge(merge_operator_, saved_key_,
+                       has_value ? &existing_value : nullptr, merge_operands_,
+                       &saved_value_);
+  if (!s.ok()) {
+    status_ = s;
+    valid_ = false;
+    return;
+  }
+  merged_ = true;
+  valid_ = true;
+}
+
 void DBIter::Prev() {
   assert(valid_);
 
   if (direction_ == kForward) {  // Switch directions?
-    // iter_ is pointing at the current entry.  Scan backwards until
-    // the key changes so we can use the normal reverse scanning code.
-    assert(iter_->Valid());  // Otherwise valid_ would have been false
-    SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+    // iter_ is pointing at the current entry, or past the entries that
+    // were merged into it.  Scan backwards until the key changes so we can
+    // use the normal reverse scanning code.
+    if (merged_) {
+      // saved_key_ already contains the current key.
+      if (!iter_->Valid()) {
+        iter_->SeekToLast();
+      }
+      merged_ = false;
+    } else {
+      assert(iter_->Valid());  // Otherwise valid_ would have been false
+      SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+    }
     while (true) {
       iter_->Prev();
       if (!iter_->Valid()) {
@@ -236,7 +331,11 @@ void DBIter::Prev() {
 void DBIter::FindPrevUserEntry() {
   assert(direction_ == kReverse);
 
+  // The entries of a key are visited from oldest to newest.  Merge operands
+  // are collected on top of the value in saved_value_, if has_value.
   ValueType value_type = kTypeDeletion;
+  bool has_value = false;
+  merge_operands_.clear();
   if (iter_->Valid()) {
     do {
       ParsedInternalKey ikey;
@@ -250,7 +349,9 @@ void DBIter::FindPrevUserEntry() {
         if (value_type == kTypeDeletion) {
           saved_key_.clear();
           ClearSavedValue();
-        } else {
+          has_value = false;
+          merge_operands_.clear();
+        } else if (value_type == kTypeValue) {
           Slice raw_value = iter_->value();
           if (saved_value_.capacity() > raw_value.size() + 1048576) {
             std::string empty;
@@ -258,12 +359,29 @@ void DBIter::FindPrevUserEntry() {
           }
           SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
           saved_value_.assign(raw_value.data(), raw_value.size());
+          has_value = true;
+          merge_operands_.clear();
+        } else {
+          SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+          merge_operands_.push_back(iter_->value().ToString());
         }
       }
       iter_->Prev();
     } while (iter_->Valid());
   }
 
+  if (value_type == kTypeMerge) {
+    std::reverse(merge_operands_.begin(), merge_operands_.end());
+    const Slice existing_value(saved_value_);
+    Status s = FullMerge(merge_operator_, saved_key_,
+                         has_value ? &existing_value : nullptr,
+                         merge_operands_, &saved_value_);
+    if (!s.ok()) {
+      status_ = s;
+      value_type = kTypeDeletion;
+    }
+  }
+
   if (value_type == kTypeDeletion) {
     // End
     valid_ = false;
@@ -277,6 +395,7 @@ void DBIter::FindPrevUserEntry() {
 
 void DBIter::Seek(const Slice& target) {
   direction_ = kForward;
+  merged_ = false;
   ClearSavedValue();
   saved_key_.clear();
   AppendInternalKey(&saved_key_,
@@ -291,6 +410,7 @@ void DBIter::Seek(const Slice& target) {
 
 void DBIter::SeekToFirst() {
   direction_ = kForward;
+  merged_ = false;
   ClearSavedValue();
   iter_->SeekToFirst();
   if (iter_->Valid()) {
@@ -302,6 +422,7 @@ void DBIter::SeekToFirst() {
 
 void DBIter::SeekToLast() {
   direction_ = kReverse;
+  merged_ = false;
   ClearSavedValue();
   iter_->SeekToLast();
   FindPrevUserEntry();
@@ -310,9 +431,12 @@ void DBIter::SeekToLast() {
 }  // anonymous namespace
 
 Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
-                        Iterator* internal_iter, SequenceNumber sequence,
-                        uint32_t seed) {
-  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed);
+                        const MergeOperator* merge_operator,
+                        Iterator* internal_iter,
+                        const RangeTombstoneSet* range_dels,
+                        SequenceNumber sequence, uint32_t seed) {
+  return new DBIter(db, user_key_comparator, merge_operator, internal_iter,
+                    range_dels, sequence, seed);
 }
 
 }  // namespace leveldb
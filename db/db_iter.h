@@ -12,13 +12,19 @@
 namespace leveldb {
 
 class DBImpl;
+class MergeOperator;
+class RangeTombstoneSet;
 
 // Return a new iterator that converts internal keys (yielded by
 // "*internal_iter") that were live at the specified "sequence" number
-// into appropriate user keys.
+// into appropriate user keys.  Merge operands are applied with
+// "merge_operator", and the entries deleted by "range_dels" are skipped.
+// Takes ownership of "range_dels", which may be nullptr.
 Iterator* NewDBIterator(DBImpl* db,
                         const Comparator* user_key_comparator,
+                        const MergeOperator* merge_operator,
                         Iterator* internal_iter,
+                        const RangeTombstoneSet* range_dels,
                         SequenceNumber sequence,
                         uint32_t seed);
 
@@ -15,8 +15,11 @@
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
 #include "leveldb/cache.h"
+#include "leveldb/compaction_filter.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/memtablerep.h"
+#include "leveldb/merge_operator.h"
 #include "leveldb/table.h"
 #include "port/port.h"
 #include "port/thread_annotations.h"
@@ -123,9 +126,20 @@ namespace leveldb {
         // Force write to manifest files to fail while this pointer is non-null.
         std::atomic<bool> manifest_write_error_;
 
+        // Work passed to Schedule() (but not ScheduleHighPriority()) does not
+        // start running while this is true.
+        std::atomic<bool> delay_background_work_;
+
+        // Work passed to ScheduleHighPriority() goes to Schedule() while
+        // this is true, as in an env without a high priority thread.
+        std::atomic<bool> no_high_priority_thread_;
+
         bool count_random_reads_;
         AtomicCounter random_read_counter_;
 
+        // Added to the time reported by NowMicros().
+        std::atomic<uint64_t> time_offset_micros_;
+
         explicit SpecialEnv(Env *base)
                 : EnvWrapper(base),
                   delay_data_sync_(false),
@@ -134,7 +148,47 @@ namespace leveldb {
                   non_writable_(false),
                   manifest_sync_error_(false),
                   manifest_write_error_(false),
-                  count_random_reads_(false) {}
+                  delay_background_work_(false),
+                  no_high_priority_thread_(false),
+                  count_random_reads_(false),
+                  time_offset_micros_(0) {}
+
+        uint64_t NowMicros() override {
+            return target()->NowMicros() +
+                   time_offset_micros_.load(std::memory_order_acquire);
+        }
+
+        void Schedule(void (*function)(void *), void *arg) override {
+            struct DelayedWork {
+                SpecialEnv *env;
+                void (*function)(void *);
+                void *arg;
+
+                static void Run(void *w) {
+                    DelayedWork *work = reinterpret_cast<DelayedWork *>(w);
+                    while (work->env->delay_background_work_.load(
+                            std::memory_order_acquire)) {
+                        DelayMilliseconds(10);
+                    }
+                    work->function(work->arg);
+                    delete work;
+                }
+            };
+            target()->Schedule(&DelayedWork::Run, new DelayedWork{this, function, arg});
+        }
+
+        void ScheduleHighPriority(void (*function)(void *), void *arg) override {
+            if (no_high_priority_thread_.load(std::memory_order_acquire)) {
+                Schedule(function, arg);
+            } else {
+                target()->ScheduleHighPriority(function, arg);
+            }
+        }
+
+        bool HasHighPriorityThread() override {
+            return !no_high_priority_thread_.load(std::memory_order_acquire) &&
+                   target()->HasHighPriorityThread();
+        }
 
         Status NewWritableFile(const std::string &f, WritableFile **r) {
             class DataFile : public WritableFile {
@@ -254,6 +308,8 @@ namespace leveldb {
 
         DBTest() : env_(new SpecialEnv(Env::Default())), option_config_(kDefault) {
             filter_policy_ = NewBloomFilterPolicy(10);
+            hash_skiplist_factory_ = NewHashSkipListRepFactory(3, 16);
+            vector_factory_ = NewVectorRepFactory();
             dbname_ = testing::TempDir() + "db_test";
             DestroyDB(dbname_, Options());
             db_ = nullptr;
@@ -265,6 +321,8 @@ namespace leveldb {
             DestroyDB(dbname_, Options());
             delete env_;
             delete filter_policy_;
+            delete hash_skiplist_factory_;
+            delete vector_factory_;
         }
 
         // Switch to a fresh database with the next option configuration to
@@ -293,6 +351,25 @@ namespace leveldb {
                 case kUncompressed:
                     options.compression = kNoCompression;
                     break;
+                case kPipelinedWrite:
+                    options.enable_pipelined_write = true;
+                    break;
+                case kConcurrentMemTableWrite:
+                    options.enable_pipelined_write = true;
+                    options.allow_concurrent_memtable_write = true;
+                    options.memtable_chunk_size = 2 << 20;
+                    options.memtable_huge_pages = true;
+                    break;
+                case kHashSkipListRep:
+                    options.memtable_factory = hash_skiplist_factory_;
+                    break;
+                case kVectorRep:
+                    options.memtable_factory = vector_factory_;
+                    break;
+                case kMultipleMemTables:
+                    options.max_write_buffer_number = 4;
+                    options.merge_memtables_on_flush = true;
+                    break;
                 default:
                     break;
             }
@@ -407,6 +484,12 @@ namespace leveldb {
                             case kTypeDeletion:
                                 result += "DEL";
                                 break;
+                            case kTypeMerge:
+                                result += "MERGE(" + iter->value().ToString() + ")";
+                                break;
+                            case kTypeRangeDeletion:
+                                result += "RANGE_DEL";
+                                break;
                         }
                     }
                     iter->Next();
@@ -550,10 +633,14 @@ namespace leveldb {
     private:
         // Sequence of option configurations to try
         enum OptionConfig {
-            kDefault, kReuse, kFilter, kUncompressed, kEnd
+            kDefault, kReuse, kFilter, kUncompressed, kPipelinedWrite,
+            kConcurrentMemTableWrite, kHashSkipListRep, kVectorRep,
+            kMultipleMemTables, kEnd
         };
 
         const FilterPolicy *filter_policy_;
+        const MemTableRepFactory *hash_skiplist_factory_;
+        const MemTableRepFactory *vector_factory_;
         int option_config_;
     };
 
@@ -626,6 +713,63 @@ namespace leveldb {
         } while (ChangeOptions());
     }
 
+    TEST_F(DBTest, GetFromMultipleImmutableLayers) {
+        for (bool merge : {false, true}) {
+            Options options = CurrentOptions();
+            options.env = env_;
+            options.write_buffer_size = 100000;  // Small write buffer
+            options.max_write_buffer_number = 4;
+            options.merge_memtables_on_flush = merge;
+            options.create_if_missing = true;
+            DestroyAndReopen(&options);
+
+            // Block sync calls, so that the first flush never finishes and
+            // each filled memtable joins the queue of immutable ones.
+            env_->delay_data_sync_.store(true, std::memory_order_release);
+            const Snapshot *snapshot = nullptr;
+            for (int i = 1; i <= 4; i++) {
+                ASSERT_LEVELDB_OK(Put("foo", "v" + std::to_string(i)));
+                if (i == 2) snapshot = db_->GetSnapshot();
+                if (i < 4) {
+                    // Fill memtable.
+                    ASSERT_LEVELDB_OK(Put("k" + std::to_string(i),
+                                          std::string(100000, 'x')));
+                }
+            }
+            std::string num;
+            ASSERT_TRUE(db_->GetProperty("leveldb.num-immutable-memtables", &num));
+            ASSERT_EQ("3", num);
+            ASSERT_EQ("v4", Get("foo"));
+            ASSERT_EQ("v2", Get("foo", snapshot));
+            ASSERT_EQ(std::string(100000, 'x'), Get("k1"));
+            ASSERT_EQ(std::string(100000, 'x'), Get("k3"));
+            Iterator *iter = db_->NewIterator(ReadOptions());
+            iter->SeekToFirst();
+            ASSERT_EQ("foo->v4", IterStatus(iter));
+            iter->Next();
+            ASSERT_EQ("k1", iter->key().ToString());
+            iter->Next();
+            iter->Next();
+            ASSERT_EQ("k3", iter->key().ToString());
+            iter->Next();
+            ASSERT_TRUE(!iter->Valid());
+            delete iter;
+
+            // Release sync calls.
+            env_->delay_data_sync_.store(false, std::memory_order_release);
+            ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+            ASSERT_TRUE(db_->GetProperty("leveldb.num-immutable-memtables", &num));
+            ASSERT_EQ("0", num);
+            ASSERT_EQ("v4", Get("foo"));
+            ASSERT_EQ("v2", Get("foo", snapshot));
+            db_->ReleaseSnapshot(snapshot);
+
+            Reopen(&options);
+            ASSERT_EQ("v4", Get("foo"));
+            ASSERT_EQ(std::string(100000, 'x'), Get("k2"));
+        }
+    }
+
     TEST_F(DBTest, GetFromVersions) {
         do {
             ASSERT_LEVELDB_OK(Put("foo", "v1"));
@@ -1143,6 +1287,661 @@ namespace leveldb {
         }
     }
 
+    TEST_F(DBTest, ConcurrentCompactions) {
+        Options options = CurrentOptions();
+        options.write_buffer_size = 100000;  // Small write buffer
+        options.max_file_size = 100000;
+        options.max_background_compactions = 4;
+        Reopen(&options);
+
+        // Overwrite a key space repeatedly so that several levels need
+        // compaction at once.
+        Random rnd(301);
+        const int kNumKeys = 2000;
+        std::vector<std::string> values(kNumKeys);
+        for (int round = 0; round < 4; round++) {
+            for (int i = 0; i < kNumKeys; i++) {
+                values[i] = RandomString(&rnd, 500);
+                ASSERT_LEVELDB_OK(Put(Key(i), values[i]));
+            }
+        }
+        ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+        for (int i = 0; i < kNumKeys; i++) {
+            ASSERT_EQ(Get(Key(i)), values[i]);
+        }
+        ASSERT_LT(NumTableFilesAtLevel(0), options.level0_stop_writes_trigger);
+        ASSERT_GT(TotalTableFiles(), NumTableFilesAtLevel(0));
+
+        // Data must survive a reopen with a single background thread.
+        options.max_background_compactions = 1;
+        Reopen(&options);
+        for (int i = 0; i < kNumKeys; i++) {
+            ASSERT_EQ(Get(Key(i)), values[i]);
+        }
+    }
+
+    // Holds up the compactions into level-1 at key "300" until released.
+    class BlockingCompactionFilter : public CompactionFilter {
+    public:
+        BlockingCompactionFilter() : blocked(false), released(false) {}
+
+        const char *Name() const override { return "BlockingCompactionFilter"; }
+
+        bool Filter(int level, const Slice &key, const Slice &existing_value,
+                    std::string *new_value, bool *value_changed) const override {
+            if (level == 1 && key == Slice("300")) {
+                blocked.store(true, std::memory_order_release);
+                while (!released.load(std::memory_order_acquire)) {
+                    Env::Default()->SleepForMicroseconds(1000);
+                }
+            }
+            return false;
+        }
+
+        mutable std::atomic<bool> blocked;
+        std::atomic<bool> released;
+    };
+
+    TEST_F(DBTest, IntraLevel0Compaction) {
+        BlockingCompactionFilter filter;
+        Options options = CurrentOptions();
+        options.max_background_compactions = 2;
+        options.compaction_filter = &filter;
+        Reopen(&options);
+
+        // Fill levels 1 and 2 so that the tables below stay in level-0.
+        ASSERT_LEVELDB_OK(Put("100", "v100"));
+        ASSERT_LEVELDB_OK(Put("999", "v999"));
+        dbfull()->TEST_CompactMemTable();
+        ASSERT_LEVELDB_OK(Delete("100"));
+        ASSERT_LEVELDB_OK(Delete("999"));
+        dbfull()->TEST_CompactMemTable();
+        ASSERT_EQ("0,1,1", FilesPerLevel());
+
+        // The compaction of the first four tables into level-1 gets stuck.
+        for (int i = 0; i < 4; i++) {
+            ASSERT_LEVELDB_OK(Put("300", "v" + std::to_string(i)));
+            ASSERT_LEVELDB_OK(Put("500", "v" + std::to_string(i)));
+            dbfull()->TEST_CompactMemTable();
+        }
+        for (int i = 0; i < 1000 && !filter.blocked.load(); i++) {
+            env_->SleepForMicroseconds(10000);
+        }
+        ASSERT_TRUE(filter.blocked.load());
+
+        // Meanwhile the newest tables are merged within level-0.
+        const int kNewTables = 6;
+        for (int i = 0; i < kNewTables; i++) {
+            ASSERT_LEVELDB_OK(Put("400", "w" + std::to_string(i)));
+            ASSERT_LEVELDB_OK(Put("500", "w" + std::to_string(i)));
+            dbfull()->TEST_CompactMemTable();
+        }
+        for (int i = 0; i < 1000 && NumTableFilesAtLevel(0) >= 4 + kNewTables;
+             i++) {
+            env_->SleepForMicroseconds(10000);
+        }
+        const int level0_files = NumTableFilesAtLevel(0);
+        const std::string v400 = Get("400");
+        const std::string v500 = Get("500");
+        filter.released.store(true, std::memory_order_release);
+        ASSERT_LT(level0_files, 4 + kNewTables);
+        ASSERT_EQ("w5", v400);
+        ASSERT_EQ("w5", v500);
+
+        for (int i = 0; i < 1000 && NumTableFilesAtLevel(0) >= 4; i++) {
+            env_->SleepForMicroseconds(10000);
+        }
+        ASSERT_LT(NumTableFilesAtLevel(0), 4);
+        ASSERT_EQ("v3", Get("300"));
+        ASSERT_EQ("w5", Get("400"));
+        ASSERT_EQ("w5", Get("500"));
+        Reopen(&options);
+        ASSERT_EQ("v3", Get("300"));
+        ASSERT_EQ("w5", Get("400"));
+        ASSERT_EQ("w5", Get("500"));
+    }
+
+    TEST_F(DBTest, Subcompactions) {
+        Options options = CurrentOptions();
+        options.write_buffer_size = 100000;  // Small write buffer
+        options.max_subcompactions = 4;
+        Reopen(&options);
+
+        Random rnd(301);
+        std::map<std::string, std::string> model;
+        for (int round = 0; round < 3; round++) {
+            for (int i = 0; i < 3000; i++) {
+                const std::string key = Key(rnd.Uniform(5000));
+                if (rnd.OneIn(7)) {
+                    ASSERT_LEVELDB_OK(Delete(key));
+                    model.erase(key);
+                } else {
+                    const std::string value = RandomString(&rnd, 100);
+                    ASSERT_LEVELDB_OK(Put(key, value));
+                    model[key] = value;
+                }
+            }
+            dbfull()->TEST_CompactMemTable();
+        }
+        const Snapshot *snapshot = db_->GetSnapshot();
+        const std::map<std::string, std::string> snapshot_model = model;
+        for (int i = 0; i < 1000; i++) {
+            const std::string key = Key(rnd.Uniform(5000));
+            ASSERT_LEVELDB_OK(Delete(key));
+            model.erase(key);
+        }
+        db_->CompactRange(nullptr, nullptr);
+
+        std::string expected;
+        for (const auto &kv : model) {
+            expected += "(" + kv.first + "->" + kv.second + ")";
+        }
+        ASSERT_EQ(expected, Contents());
+        for (const auto &kv : snapshot_model) {
+            ASSERT_EQ(kv.second, Get(kv.first, snapshot));
+        }
+        db_->ReleaseSnapshot(snapshot);
+    }
+
+    TEST_F(DBTest, Level0CompactionTrigger) {
+        Options options = CurrentOptions();
+        options.env = env_;
+        options.level0_file_num_compaction_trigger = 2;
+        Reopen(&options);
+
+        // The first flushes are pushed below level-0 until they overlap.
+        while (NumTableFilesAtLevel(0) == 0) {
+            ASSERT_LEVELDB_OK(Put("a", "va"));
+            ASSERT_LEVELDB_OK(Put("z", "vz"));
+            ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+        }
+        ASSERT_EQ(1, NumTableFilesAtLevel(0));
+
+        // A second level-0 file starts a compaction of level-0.
+        ASSERT_LEVELDB_OK(Put("a", "va2"));
+        ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+        for (int i = 0; i < 1000 && NumTableFilesAtLevel(0) > 0; i++) {
+            env_->SleepForMicroseconds(10000);
+        }
+        ASSERT_EQ(0, NumTableFilesAtLevel(0));
+        ASSERT_EQ("va2", Get("a"));
+        ASSERT_EQ("vz", Get("z"));
+    }
+
+    TEST_F(DBTest, DynamicLevelBytes) {
+        Options options = CurrentOptions();
+        options.env = env_;
+        options.write_buffer_size = 100000;
+        options.level_compaction_dynamic_level_bytes = true;
+        options.create_if_missing = true;
+        DestroyAndReopen(&options);
+
+        Random rnd(301);
+        std::map<std::string, std::string> values;
+        for (int i = 0; i < 2000; i++) {
+            std::string key = Key(i % 500);
+            values[key] = RandomString(&rnd, 500);
+            ASSERT_LEVELDB_OK(Put(key, values[key]));
+        }
+        for (int i = 0; i < 1000 && NumTableFilesAtLevel(0) >=
+                                            options.level0_file_num_compaction_trigger;
+             i++) {
+            env_->SleepForMicroseconds(10000);
+        }
+
+        // A small database has its base level at the bottom, so level-0 is
+        // compacted straight into the last level.
+        ASSERT_GT(NumTableFilesAtLevel(config::kNumLevels - 1), 0);
+        for (int level = 1; level < config::kNumLevels - 1; level++) {
+            ASSERT_EQ(0, NumTableFilesAtLevel(level)) << "level " << level;
+        }
+        for (const auto &kv : values) {
+            ASSERT_EQ(kv.second, Get(kv.first));
+        }
+    }
+
+    TEST_F(DBTest, UniversalCompaction) {
+        Options options = CurrentOptions();
+        options.env = env_;
+        options.write_buffer_size = 100000;
+        options.compaction_style = kCompactionStyleUniversal;
+        options.create_if_missing = true;
+        DestroyAndReopen(&options);
+
+        Random rnd(301);
+        std::map<std::string, std::string> values;
+        for (int i = 0; i < 3000; i++) {
+            std::string key = Key(i % 500);
+            values[key] = RandomString(&rnd, 500);
+            ASSERT_LEVELDB_OK(Put(key, values[key]));
+        }
+        for (int i = 0; i < 1000 && NumTableFilesAtLevel(0) >=
+                                            options.level0_file_num_compaction_trigger;
+             i++) {
+            env_->SleepForMicroseconds(10000);
+        }
+
+        // All sorted runs stay in level-0, and were merged into fewer runs
+        // than it takes to trigger a compaction.
+        ASSERT_GT(NumTableFilesAtLevel(0), 0);
+        ASSERT_LT(NumTableFilesAtLevel(0),
+                  options.level0_file_num_compaction_trigger);
+        ASSERT_EQ(NumTableFilesAtLevel(0), TotalTableFiles());
+        for (const auto &kv : values) {
+            ASSERT_EQ(kv.second, Get(kv.first));
+        }
+
+        std::string property;
+        ASSERT_TRUE(db_->GetProperty("leveldb.compaction-bytes-written", &property));
+        ASSERT_GT(std::stoull(property), 3000 * 500);
+    }
+
+    TEST_F(DBTest, UniversalCompactRange) {
+        Options options = CurrentOptions();
+        options.env = env_;
+        options.compaction_style = kCompactionStyleUniversal;
+        Reopen(&options);
+
+        ASSERT_LEVELDB_OK(Put("a", "va"));
+        ASSERT_LEVELDB_OK(Put("z", "vz"));
+        ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+        ASSERT_LEVELDB_OK(Delete("a"));
+        ASSERT_LEVELDB_OK(Put("m", "vm"));
+        ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+        ASSERT_LEVELDB_OK(Put("z", "vz2"));
+        ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+        ASSERT_EQ(3, NumTableFilesAtLevel(0));
+
+        // Whatever the range, all runs are merged into one, which drops the
+        // deletion along with the value it hides.
+        Slice begin("m");
+        db_->CompactRange(&begin, nullptr);
+        ASSERT_EQ(1, NumTableFilesAtLevel(0));
+        ASSERT_EQ(1, TotalTableFiles());
+        ASSERT_EQ("[ ]", AllEntriesFor("a"));
+        ASSERT_EQ("NOT_FOUND", Get("a"));
+        ASSERT_EQ("vm", Get("m"));
+        ASSERT_EQ("vz2", Get("z"));
+
+        // The merged run is read back in the right order after a restart.
+        ASSERT_LEVELDB_OK(Put("z", "vz3"));
+        ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+        Reopen(&options);
+        ASSERT_EQ("vz3", Get("z"));
+        ASSERT_EQ("vm", Get("m"));
+    }
+
+    TEST_F(DBTest, FIFOCompaction) {
+        Options options = CurrentOptions();
+        options.env = env_;
+        options.write_buffer_size = 100000;
+        options.compaction_style = kCompactionStyleFIFO;
+        options.fifo_max_table_files_size = 2 * 1048576;
+        options.create_if_missing = true;
+        DestroyAndReopen(&options);
+
+        // Many more level-0 files than the stop trigger never block writes.
+        Random rnd(301);
+        for (int i = 0; i < 6000; i++) {
+            ASSERT_LEVELDB_OK(Put(Key(i), RandomString(&rnd, 500)));
+        }
+        ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+        for (int i = 0; i < 1000 && Size(Key(0), Key(6000)) >
+                                            options.fifo_max_table_files_size;
+             i++) {
+            env_->SleepForMicroseconds(10000);
+        }
+        ASSERT_LE(Size(Key(0), Key(6000)), options.fifo_max_table_files_size);
+        ASSERT_GT(NumTableFilesAtLevel(0), options.level0_stop_writes_trigger);
+        ASSERT_EQ(NumTableFilesAtLevel(0), TotalTableFiles());
+
+        // The oldest files were deleted as a whole, without any rewrite.
+        ASSERT_EQ("NOT_FOUND", Get(Key(0)));
+        ASSERT_EQ(500, Get(Key(5999)).size());
+        std::string property;
+        ASSERT_TRUE(db_->GetProperty("leveldb.compaction-bytes-written", &property));
+        ASSERT_LT(std::stoull(property), 6000 * 600);
+    }
+
+    TEST_F(DBTest, FIFOCompactionTTL) {
+        Options options = CurrentOptions();
+        options.env = env_;
+        options.compaction_style = kCompactionStyleFIFO;
+        options.fifo_max_table_files_size = 0;
+        options.fifo_ttl = 3600;
+        Reopen(&options);
+
+        ASSERT_LEVELDB_OK(Put("old", "v1"));
+        ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+        env_->time_offset_micros_.store(uint64_t{3599} * 1000000,
+                                        std::memory_order_release);
+        ASSERT_LEVELDB_OK(Put("new", "v2"));
+        ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+        ASSERT_EQ(2, NumTableFilesAtLevel(0));
+
+        // Expiry is checked when the next memtable is flushed.
+        env_->time_offset_micros_.store(uint64_t{3700} * 1000000,
+                                        std::memory_order_release);
+        ASSERT_LEVELDB_OK(Put("newest", "v3"));
+        ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+        for (int i = 0; i < 1000 && NumTableFilesAtLevel(0) > 2; i++) {
+            env_->SleepForMicroseconds(10000);
+        }
+        ASSERT_EQ(2, NumTableFilesAtLevel(0));
+        ASSERT_EQ("NOT_FOUND", Get("old"));
+        ASSERT_EQ("v2", Get("new"));
+        ASSERT_EQ("v3", Get("newest"));
+
+        // The age counts from when the data was written, not flushed.
+        ASSERT_LEVELDB_OK(Put("idle", "v4"));
+        env_->time_offset_micros_.store(uint64_t{7000} * 1000000,
+                                        std::memory_order_release);
+        ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+        env_->time_offset_micros_.store(uint64_t{7400} * 1000000,
+                                        std::memory_order_release);
+        ASSERT_LEVELDB_OK(Put("fresh", "v5"));
+        ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+        for (int i = 0; i < 1000 && NumTableFilesAtLevel(0) > 1; i++) {
+            env_->SleepForMicroseconds(10000);
+        }
+        ASSERT_EQ(1, NumTableFilesAtLevel(0));
+        ASSERT_EQ("NOT_FOUND", Get("idle"));
+        ASSERT_EQ("v5", Get("fresh"));
+        env_->time_offset_micros_.store(0, std::memory_order_release);
+    }
+
+    // Removes the keys starting with "expired" and uppercases the values of
+    // the keys starting with "change".
+    class TestCompactionFilter : public CompactionFilter {
+    public:
+        const char *Name() const override { return "TestCompactionFilter"; }
+
+        bool Filter(int level, const Slice &key, const Slice &existing_value,
+                    std::string *new_value, bool *value_changed) const override {
+            if (key.starts_with("expired")) {
+                return true;
+            }
+            if (key.starts_with("change")) {
+                new_value->assign(existing_value.data(), existing_value.size());
+                for (char &c : *new_value) {
+                    c = static_cast<char>(toupper(c));
+                }
+                *value_changed = true;
+            }
+            return false;
+        }
+    };
+
+    TEST_F(DBTest, CompactionFilter) {
+        ASSERT_LEVELDB_OK(Put("expired", "v0"));
+        db_->CompactRange(nullptr, nullptr);
+
+        TestCompactionFilter filter;
+        Options options = CurrentOptions();
+        options.compaction_filter = &filter;
+        Reopen(&options);
+
+        // Values that a snapshot may read are left alone.
+        ASSERT_LEVELDB_OK(Put("expired_snap", "v1"));
+        const Snapshot *snapshot = db_->GetSnapshot();
+        ASSERT_LEVELDB_OK(Put("expired", "v1"));
+        ASSERT_LEVELDB_OK(Put("change", "value"));
+        ASSERT_LEVELDB_OK(Put("keep", "value"));
+        ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+        ASSERT_EQ("NOT_FOUND", Get("expired"));
+        ASSERT_EQ("v0", Get("expired", snapshot));
+        ASSERT_EQ("v1", Get("expired_snap"));
+        ASSERT_EQ("VALUE", Get("change"));
+        ASSERT_EQ("value", Get("keep"));
+
+        // Once nothing can read them, the removed keys are dropped for good.
+        db_->ReleaseSnapshot(snapshot);
+        db_->CompactRange(nullptr, nullptr);
+        ASSERT_EQ("NOT_FOUND", Get("expired_snap"));
+        ASSERT_EQ("[ ]", AllEntriesFor("expired"));
+        ASSERT_EQ("VALUE", Get("change"));
+        ASSERT_EQ("value", Get("keep"));
+    }
+
+    // Appends the operands to the existing value, separated by ','.
+    class AppendOperator : public MergeOperator {
+    public:
+        const char *Name() const override { return "AppendOperator"; }
+
+        bool FullMerge(const Slice &key, const Slice *existing_value,
+                       const std::vector<Slice> &operands,
+                       std::string *new_value) const override {
+            new_value->clear();
+            if (existing_value != nullptr) {
+                new_value->assign(existing_value->data(), existing_value->size());
+            }
+            for (const Slice &operand : operands) {
+                if (!new_value->empty()) {
+                    new_value->push_back(',');
+                }
+                new_value->append(operand.data(), operand.size());
+            }
+            return true;
+        }
+    };
+
+    TEST_F(DBTest, Merge) {
+        ASSERT_TRUE(db_->Merge(WriteOptions(), "a", "1").IsNotSupportedError());
+
+        AppendOperator merge_operator;
+        Options options = CurrentOptions();
+        options.merge_operator = &merge_operator;
+        Reopen(&options);
+
+        ASSERT_LEVELDB_OK(Put("a", "1"));
+        ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "a", "2"));
+        ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "b", "x"));
+        ASSERT_LEVELDB_OK(Put("c", "v"));
+        ASSERT_EQ("1,2", Get("a"));
+        ASSERT_EQ("x", Get("b"));
+        ASSERT_EQ("(a->1,2)(b->x)(c->v)", Contents());
+
+        // Operands spread over the memtable and several tables.
+        ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+        ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "a", "3"));
+        ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+        ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "a", "4"));
+        ASSERT_EQ("1,2,3,4", Get("a"));
+        ASSERT_EQ("(a->1,2,3,4)(b->x)(c->v)", Contents());
+
+        // A snapshot keeps seeing the operands written before it, even
+        // after a compaction.
+        const Snapshot *snapshot = db_->GetSnapshot();
+        ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "a", "5"));
+        ASSERT_LEVELDB_OK(Delete("b"));
+        ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "b", "y"));
+        db_->CompactRange(nullptr, nullptr);
+        ASSERT_EQ("1,2,3,4", Get("a", snapshot));
+        ASSERT_EQ("x", Get("b", snapshot));
+        ASSERT_EQ("1,2,3,4,5", Get("a"));
+        ASSERT_EQ("y", Get("b"));
+        ASSERT_EQ("(a->1,2,3,4,5)(b->y)(c->v)", Contents());
+        // Only what the snapshot cannot tell apart was combined.
+        ASSERT_EQ("[ MERGE(5), 1,2,3,4 ]", AllEntriesFor("a"));
+        ASSERT_EQ("[ y, x ]", AllEntriesFor("b"));
+
+        // Once nothing can see them apart, all of them are combined.
+        db_->ReleaseSnapshot(snapshot);
+        ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "a", "6"));
+        ASSERT_LEVELDB_OK(db_->Merge(WriteOptions(), "b", "z"));
+        db_->CompactRange(nullptr, nullptr);
+        ASSERT_EQ("[ 1,2,3,4,5,6 ]", AllEntriesFor("a"));
+        ASSERT_EQ("[ y,z ]", AllEntriesFor("b"));
+        ASSERT_EQ("(a->1,2,3,4,5,6)(b->y,z)(c->v)", Contents());
+    }
+
+    TEST_F(DBTest, DelayedWritesArePaced) {
+        Options options = CurrentOptions();
+        options.env = env_;
+        options.delayed_write_rate = 1 << 20;
+        Reopen(&options);
+
+        // Pile up level-0 files while no compaction can run.
+        env_->delay_background_work_.store(true, std::memory_order_release);
+        while (NumTableFilesAtLevel(0) < options.level0_slowdown_writes_trigger) {
+            ASSERT_LEVELDB_OK(Put("a", "va"));
+            ASSERT_LEVELDB_OK(Put("z", "vz"));
+            ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+        }
+
+        std::string property;
+        ASSERT_TRUE(db_->GetProperty("leveldb.delayed-write-rate", &property));
+        const uint64_t rate = std::stoull(property);
+        ASSERT_GT(rate, 0);
+        ASSERT_LT(rate, 1 << 20);
+        ASSERT_TRUE(db_->GetProperty("leveldb.estimate-pending-compaction-bytes",
+                                     &property));
+        ASSERT_GT(std::stoull(property), 0);
+
+        // Writes are paced at the delayed rate instead of sleeping a fixed
+        // time per write.
+        const uint64_t start_micros = env_->NowMicros();
+        for (int i = 0; i < 20; i++) {
+            ASSERT_LEVELDB_OK(Put(Key(i), std::string(10000, 'x')));
+        }
+        ASSERT_GE(env_->NowMicros() - start_micros,
+                  uint64_t{200000} * 1000000 / rate / 2);
+        ASSERT_TRUE(
+                db_->GetProperty("leveldb.stall-micros.delayed-write", &property));
+        ASSERT_GT(std::stoull(property), 0);
+
+        env_->delay_background_work_.store(false, std::memory_order_release);
+        Reopen(&options);
+        db_->CompactRange(nullptr, nullptr);
+        ASSERT_TRUE(db_->GetProperty("leveldb.delayed-write-rate", &property));
+        ASSERT_EQ("0", property);
+        ASSERT_EQ("va", Get("a"));
+        ASSERT_EQ(std::string(10000, 'x'), Get(Key(19)));
+    }
+
+    TEST_F(DBTest, FlushWhileCompactionsAreBlocked) {
+        BlockingCompactionFilter filter;
+        Options options = CurrentOptions();
+        options.env = env_;
+        options.compaction_filter = &filter;
+        Reopen(&options);
+
+        // Fill levels 1 and 2 so that the tables below stay in level-0.
+        ASSERT_LEVELDB_OK(Put("100", "v100"));
+        ASSERT_LEVELDB_OK(Put("999", "v999"));
+        ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+        ASSERT_LEVELDB_OK(Delete("100"));
+        ASSERT_LEVELDB_OK(Delete("999"));
+        ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+        ASSERT_EQ("0,1,1", FilesPerLevel());
+
+        // The compaction of the first four tables into level-1 gets stuck.
+        for (int i = 0; i < 4; i++) {
+            ASSERT_LEVELDB_OK(Put("300", "v" + std::to_string(i)));
+            ASSERT_LEVELDB_OK(Put("500", "v" + std::to_string(i)));
+            ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+        }
+        for (int i = 0; i < 1000 && !filter.blocked.load(); i++) {
+            env_->SleepForMicroseconds(10000);
+        }
+        ASSERT_TRUE(filter.blocked.load());
+
+        // Memtable flushes run on their own lane, so they still finish.
+        for (int i = 0; i < 3; i++) {
+            ASSERT_LEVELDB_OK(Put("400", "w" + std::to_string(i)));
+            ASSERT_LEVELDB_OK(Put("500", "w" + std::to_string(i)));
+            ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+        }
+        ASSERT_EQ(4 + 3, NumTableFilesAtLevel(0));
+        ASSERT_EQ("v3", Get("300"));
+        ASSERT_EQ("w2", Get("400"));
+        ASSERT_EQ("w2", Get("500"));
+
+        std::string property;
+        ASSERT_TRUE(db_->GetProperty("leveldb.stall-micros", &property));
+        ASSERT_TRUE(
+                db_->GetProperty("leveldb.stall-micros.memtable-full", &property));
+        ASSERT_FALSE(db_->GetProperty("leveldb.stall-micros.unknown", &property));
+
+        filter.released.store(true, std::memory_order_release);
+        Reopen(&options);
+        ASSERT_EQ("v3", Get("300"));
+        ASSERT_EQ("w2", Get("400"));
+        ASSERT_EQ("w2", Get("500"));
+    }
+
+    namespace {
+
+        struct ReleaseOnFlushState {
+            DB *db;
+            BlockingCompactionFilter *filter;
+            std::atomic<bool> done;
+        };
+
+        // Releases the blocked compaction once a memtable waits to be flushed.
+        void ReleaseOnFlush(void *arg) {
+            ReleaseOnFlushState *state = reinterpret_cast<ReleaseOnFlushState *>(arg);
+            std::string num = "0";
+            for (int i = 0; i < 1000 && num == "0"; i++) {
+                Env::Default()->SleepForMicroseconds(10000);
+                state->db->GetProperty("leveldb.num-immutable-memtables", &num);
+            }
+            state->filter->released.store(true, std::memory_order_release);
+            state->done.store(true, std::memory_order_release);
+        }
+
+    }  // namespace
+
+    TEST_F(DBTest, FlushFromCompactionWithoutHighPriorityThread) {
+        BlockingCompactionFilter filter;
+        Options options = CurrentOptions();
+        options.env = env_;
+        options.compaction_filter = &filter;
+        env_->no_high_priority_thread_.store(true, std::memory_order_release);
+        Reopen(&options);
+
+        // Fill levels 1 and 2 so that the tables below stay in level-0.
+        ASSERT_LEVELDB_OK(Put("100", "v100"));
+        ASSERT_LEVELDB_OK(Put("999", "v999"));
+        ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+        ASSERT_LEVELDB_OK(Delete("100"));
+        ASSERT_LEVELDB_OK(Delete("999"));
+        ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+        ASSERT_EQ("0,1,1", FilesPerLevel());
+
+        // The compaction of the first four tables into level-1 gets stuck.
+        for (int i = 0; i < 4; i++) {
+            ASSERT_LEVELDB_OK(Put("300", "v" + std::to_string(i)));
+            ASSERT_LEVELDB_OK(Put("500", "v" + std::to_string(i)));
+            ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+        }
+        for (int i = 0; i < 1000 && !filter.blocked.load(); i++) {
+            env_->SleepForMicroseconds(10000);
+        }
+        ASSERT_TRUE(filter.blocked.load());
+
+        // The flush is queued behind the compaction and never starts on its
+        // own, so only the running compaction can do it.
+        env_->delay_background_work_.store(true, std::memory_order_release);
+        ASSERT_LEVELDB_OK(Put("400", "w"));
+        ReleaseOnFlushState state{db_, &filter, {false}};
+        env_->StartThread(&ReleaseOnFlush, &state);
+        Status s = dbfull()->TEST_CompactMemTable();
+        while (!state.done.load(std::memory_order_acquire)) {
+            env_->SleepForMicroseconds(1000);
+        }
+        ASSERT_LEVELDB_OK(s);
+        ASSERT_EQ("v3", Get("300"));
+        ASSERT_EQ("w", Get("400"));
+
+        env_->delay_background_work_.store(false, std::memory_order_release);
+        env_->no_high_priority_thread_.store(false, std::memory_order_release);
+        Reopen(&options);
+        ASSERT_EQ("v3", Get("300"));
+        ASSERT_EQ("w", Get("400"));
+        ASSERT_EQ("v3", Get("500"));
+    }
+
     TEST_F(DBTest, RepeatedWritesToSameKey) {
         Options options = CurrentOptions();
         options.env = env_;
@@ -1150,8 +1949,8 @@ namespace leveldb {
         Reopen(&options);
 
         // We must have at most one file per level except for level-0,
-        // which may have up to kL0_StopWritesTrigger files.
-        const int kMaxFiles = config::kNumLevels + config::kL0_StopWritesTrigger;
+        // which may have up to level0_stop_writes_trigger files.
+        const int kMaxFiles = config::kNumLevels + options.level0_stop_writes_trigger;
 
         Random rnd(301);
         std::string value = RandomString(&rnd, 2 * options.write_buffer_size);
@@ -1426,6 +2225,82 @@ namespace leveldb {
         ASSERT_EQ(AllEntriesFor("foo"), "[ v2 ]");
     }
 
+    TEST_F(DBTest, CompactionKeepsOneVersionPerSnapshot) {
+        ASSERT_LEVELDB_OK(Put("foo", "v1"));
+        const Snapshot *s1 = db_->GetSnapshot();
+        ASSERT_LEVELDB_OK(Put("foo", "v2"));
+        ASSERT_LEVELDB_OK(Put("foo", "v3"));
+        const Snapshot *s2 = db_->GetSnapshot();
+        ASSERT_LEVELDB_OK(Put("foo", "v4"));
+        ASSERT_LEVELDB_OK(Delete("foo"));
+        ASSERT_LEVELDB_OK(Put("foo", "v5"));
+        ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+        const int last = config::kMaxMemCompactLevel;
+        ASSERT_EQ(NumTableFilesAtLevel(last), 1);
+        ASSERT_EQ(AllEntriesFor("foo"), "[ v5, DEL, v4, v3, v2, v1 ]");
+
+        // Only the newest version below each snapshot and above the newest
+        // one is read by anyone.
+        dbfull()->TEST_CompactRange(last, nullptr, nullptr);
+        ASSERT_EQ(AllEntriesFor("foo"), "[ v5, v3, v1 ]");
+        ASSERT_EQ("v1", Get("foo", s1));
+        ASSERT_EQ("v3", Get("foo", s2));
+        ASSERT_EQ("v5", Get("foo"));
+
+        db_->ReleaseSnapshot(s1);
+        dbfull()->TEST_CompactRange(last + 1, nullptr, nullptr);
+        ASSERT_EQ(AllEntriesFor("foo"), "[ v5, v3 ]");
+        ASSERT_EQ("v3", Get("foo", s2));
+        db_->ReleaseSnapshot(s2);
+    }
+
+    TEST_F(DBTest, ZeroSequenceAtLastLevel) {
+        ASSERT_LEVELDB_OK(Put("a", "va"));
+        ASSERT_LEVELDB_OK(Put("b", "vb"));
+        const Snapshot *snapshot = db_->GetSnapshot();
+        ASSERT_LEVELDB_OK(Put("b", "vb2"));
+        ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+        const int last = config::kMaxMemCompactLevel;
+        dbfull()->TEST_CompactRange(last, nullptr, nullptr);
+        ASSERT_EQ(1, NumTableFilesAtLevel(last + 1));
+
+        // Only the values that every snapshot reads lose their sequence.
+        auto sequences = [this](const Slice &user_key) {
+            Iterator *iter = dbfull()->TEST_NewInternalIterator();
+            InternalKey target(user_key, kMaxSequenceNumber, kValueTypeForSeek);
+            std::string result;
+            for (iter->Seek(target.Encode());
+                 iter->Valid() && ExtractUserKey(iter->key()) == user_key;
+                 iter->Next()) {
+                result += " " + NumberToString(ExtractSequence(iter->key()));
+            }
+            delete iter;
+            return result;
+        };
+        ASSERT_EQ(" 0", sequences("a"));
+        ASSERT_EQ(" 3 0", sequences("b"));
+        ASSERT_EQ("vb", Get("b", snapshot));
+        ASSERT_EQ("vb2", Get("b"));
+
+        db_->ReleaseSnapshot(snapshot);
+        dbfull()->TEST_CompactRange(last + 1, nullptr, nullptr);
+        ASSERT_EQ(" 0", sequences("b"));
+        ASSERT_EQ("va", Get("a"));
+        ASSERT_EQ("vb2", Get("b"));
+        ASSERT_EQ("(a->va)(b->vb2)", Contents());
+
+        // Newer writes still hide the rewritten values.
+        snapshot = db_->GetSnapshot();
+        ASSERT_LEVELDB_OK(Put("a", "va2"));
+        ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "b", "c"));
+        ASSERT_EQ("(a->va2)", Contents());
+        ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+        ASSERT_EQ("(a->va2)", Contents());
+        ASSERT_EQ("va", Get("a", snapshot));
+        ASSERT_EQ("vb2", Get("b", snapshot));
+        db_->ReleaseSnapshot(snapshot);
+    }
+
     TEST_F(DBTest, DeletionMarkers2) {
         Put("foo", "v1");
         ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
@@ -1452,6 +2327,219 @@ namespace leveldb {
         ASSERT_EQ(AllEntriesFor("foo"), "[ ]");
     }
 
+    TEST_F(DBTest, DeleteRange) {
+        ASSERT_TRUE(db_->DeleteRange(WriteOptions(), "b", "a").IsInvalidArgument());
+        ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "a", "a"));
+
+        ASSERT_LEVELDB_OK(Put("a", "va"));
+        ASSERT_LEVELDB_OK(Put("b", "vb"));
+        ASSERT_LEVELDB_OK(Put("c", "vc"));
+        ASSERT_LEVELDB_OK(Put("d", "vd"));
+        ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+        const Snapshot *snapshot = db_->GetSnapshot();
+        ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "b", "d"));
+        ASSERT_EQ("va", Get("a"));
+        ASSERT_EQ("NOT_FOUND", Get("b"));
+        ASSERT_EQ("NOT_FOUND", Get("c"));
+        ASSERT_EQ("vd", Get("d"));
+        ASSERT_EQ("(a->va)(d->vd)", Contents());
+        ASSERT_EQ("vb", Get("b", snapshot));
+
+        // Newer writes are not deleted by the tombstone.
+        ASSERT_LEVELDB_OK(Put("c", "vc2"));
+        ASSERT_EQ("vc2", Get("c"));
+        ASSERT_EQ("(a->va)(c->vc2)(d->vd)", Contents());
+
+        // Lookups see the tombstones added since the previous lookup.
+        ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "a", "b"));
+        ASSERT_EQ("NOT_FOUND", Get("a"));
+        ASSERT_LEVELDB_OK(Put("a", "va"));
+        ASSERT_EQ("va", Get("a"));
+
+        // The snapshot keeps the covered entries alive through compactions.
+        ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+        db_->CompactRange(nullptr, nullptr);
+        ASSERT_EQ("[ vb ]", AllEntriesFor("b"));
+        ASSERT_EQ("vb", Get("b", snapshot));
+        ASSERT_EQ("NOT_FOUND", Get("b"));
+        ASSERT_EQ("(a->va)(c->vc2)(d->vd)", Contents());
+
+        // Once nothing can read them, compactions drop them.  The new table
+        // makes the compaction rewrite the last level again.
+        db_->ReleaseSnapshot(snapshot);
+        ASSERT_LEVELDB_OK(Put("a", "va"));
+        ASSERT_LEVELDB_OK(Put("e", "ve"));
+        db_->CompactRange(nullptr, nullptr);
+        ASSERT_EQ("[ ]", AllEntriesFor("b"));
+        ASSERT_EQ("[ vc2 ]", AllEntriesFor("c"));
+        ASSERT_EQ("(a->va)(c->vc2)(d->vd)(e->ve)", Contents());
+
+        // Tombstones survive a reopen.
+        ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "d", "f"));
+        Reopen();
+        ASSERT_EQ("(a->va)(c->vc2)", Contents());
+        ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+        Reopen();
+        ASSERT_EQ("NOT_FOUND", Get("d"));
+        ASSERT_EQ("(a->va)(c->vc2)", Contents());
+    }
+
+    TEST_F(DBTest, DeleteRangeDropsCoveredFiles) {
+        ASSERT_LEVELDB_OK(Put("b", "vb"));
+        ASSERT_LEVELDB_OK(Put("c", "vc"));
+        ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+        const int last = config::kMaxMemCompactLevel;
+        ASSERT_EQ(1, NumTableFilesAtLevel(last));
+
+        // The table of the tombstone lands right above the one it covers.
+        ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "a", "z"));
+        ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+        ASSERT_EQ(1, NumTableFilesAtLevel(last - 1));
+        ASSERT_EQ("", Contents());
+
+        // Neither the covered table nor the tombstone, which is in the last
+        // level and older than every snapshot, outlives the compaction.
+        dbfull()->TEST_CompactRange(last - 1, nullptr, nullptr);
+        ASSERT_EQ(0, NumTableFilesAtLevel(last - 1));
+        ASSERT_EQ(0, NumTableFilesAtLevel(last));
+        ASSERT_EQ("", Contents());
+        ASSERT_LEVELDB_OK(Put("b", "vb2"));
+        ASSERT_EQ("vb2", Get("b"));
+    }
+
+    TEST_F(DBTest, DeletionRatioTriggersCompaction) {
+        Options options = CurrentOptions();
+        options.deletion_ratio_compaction_trigger = 0.8;
+        Reopen(&options);
+
+        for (int i = 0; i < 100; i++) {
+            ASSERT_LEVELDB_OK(Put(Key(i), "v"));
+        }
+        ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+        const int last = config::kMaxMemCompactLevel;
+        ASSERT_EQ(1, NumTableFilesAtLevel(last));
+
+        // Too few deletions leave the table above the data alone.
+        for (int i = 0; i < 10; i++) {
+            ASSERT_LEVELDB_OK(Delete(Key(i)));
+            ASSERT_LEVELDB_OK(Put(Key(i) + "x", "v"));
+        }
+        ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+        env_->SleepForMicroseconds(100000);
+        ASSERT_EQ(1, NumTableFilesAtLevel(last - 1));
+        ASSERT_EQ("[ DEL, v ]", AllEntriesFor(Key(0)));
+
+        // A table that is mostly deletion markers is compacted into the
+        // data it deletes, and the markers are dropped along with it.
+        for (int i = 10; i < 90; i++) {
+            ASSERT_LEVELDB_OK(Delete(Key(i)));
+        }
+        ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+        for (int i = 0; i < 1000 && NumTableFilesAtLevel(last - 1) > 1; i++) {
+            env_->SleepForMicroseconds(10000);
+        }
+        ASSERT_EQ("[ ]", AllEntriesFor(Key(50)));
+        ASSERT_EQ("[ v ]", AllEntriesFor(Key(95)));
+        ASSERT_EQ("NOT_FOUND", Get(Key(0)));
+        ASSERT_EQ("v", Get(Key(0) + "x"));
+    }
+
+    TEST_F(DBTest, TrivialMoveOfSequentialFiles) {
+        Options options = CurrentOptions();
+        options.max_bytes_for_level_base = 64 << 10;
+        Reopen(&options);
+
+        // Every table of a sequential load lands in level-2, which holds up
+        // to 640KB.  The seventh one pushes it over the limit.
+        const int last = config::kMaxMemCompactLevel;
+        Random rnd(301);
+        int key = 0;
+        for (int file = 0; file < 12; file++) {
+            for (int i = 0; i < 100; i++) {
+                ASSERT_LEVELDB_OK(Put(Key(key++), RandomString(&rnd, 1000)));
+            }
+            ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+            for (int i = 0; i < 1000 && NumTableFilesAtLevel(last) >= 7; i++) {
+                env_->SleepForMicroseconds(10000);
+            }
+        }
+
+        // All of level-2 was moved at once to the last level, which nothing
+        // else overlaps, instead of being merged one level down.
+        ASSERT_EQ(5, NumTableFilesAtLevel(last));
+        for (int level = last + 1; level < config::kNumLevels - 1; level++) {
+            ASSERT_EQ(0, NumTableFilesAtLevel(level));
+        }
+        ASSERT_EQ(7, NumTableFilesAtLevel(config::kNumLevels - 1));
+        ASSERT_EQ(1200, key);
+        Iterator *iter = db_->NewIterator(ReadOptions());
+        int count = 0;
+        for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+            ASSERT_EQ(Key(count), iter->key().ToString());
+            count++;
+        }
+        ASSERT_LEVELDB_OK(iter->status());
+        delete iter;
+        ASSERT_EQ(1200, count);
+    }
+
+    TEST_F(DBTest, CompactionPriPicksFile) {
+        // Level-1 holds "a" keys, which overlap 100KB of level-2, and "b"
+        // keys, which only overlap the small table of "c".  Together they
+        // push level-1 over its 64KB limit.
+        struct {
+            CompactionPri pri;
+            const char *kept;
+        } cases[] = {
+                {kCompactionPriRoundRobin, "'b"},
+                {kCompactionPriMinOverlappingRatio, "'a"},
+        };
+        for (const auto &c : cases) {
+            Options options = CurrentOptions();
+            options.max_bytes_for_level_base = 64 << 10;
+            options.compaction_pri = c.pri;
+            options.create_if_missing = true;
+            DestroyAndReopen(&options);
+
+            Random rnd(301);
+            for (int i = 0; i < 100; i++) {
+                ASSERT_LEVELDB_OK(Put("a" + Key(i), RandomString(&rnd, 1000)));
+            }
+            ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+            ASSERT_LEVELDB_OK(Put("c", "vc"));
+            ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+            ASSERT_EQ("0,0,2", FilesPerLevel());
+
+            for (int i = 0; i < 40; i++) {
+                ASSERT_LEVELDB_OK(Put("a" + Key(i), RandomString(&rnd, 1000)));
+            }
+            ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+            for (int i = 0; i < 40; i++) {
+                ASSERT_LEVELDB_OK(Put("b" + Key(i), RandomString(&rnd, 1000)));
+            }
+            ASSERT_LEVELDB_OK(Put("c", "vc2"));
+            ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+            for (int i = 0; i < 1000 && NumTableFilesAtLevel(1) > 1; i++) {
+                env_->SleepForMicroseconds(10000);
+            }
+            ASSERT_EQ(1, NumTableFilesAtLevel(1));
+
+            std::string sstables;
+            ASSERT_TRUE(db_->GetProperty("leveldb.sstables", &sstables));
+            const size_t begin = sstables.find("--- level 1 ---");
+            const size_t end = sstables.find("--- level 2 ---");
+            ASSERT_NE(std::string::npos,
+                      sstables.substr(begin, end - begin).find(c.kept))
+                    << sstables;
+            ASSERT_EQ("vc2", Get("c"));
+
+            std::string stats;
+            ASSERT_TRUE(db_->GetProperty("leveldb.stats", &stats));
+            ASSERT_NE(std::string::npos, stats.find("W-Amp")) << stats;
+            ASSERT_NE(std::string::npos, stats.find("\nSum ")) << stats;
+        }
+    }
+
     TEST_F(DBTest, OverlapInLevel0) {
         do {
             ASSERT_EQ(config::kMaxMemCompactLevel, 2) << "Fix test to match config";
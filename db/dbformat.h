@@ -24,14 +24,10 @@ namespace leveldb {
     namespace config {
         static const int kNumLevels = 7;
 
-// Level-0 compaction is started when we hit this many files.
-        static const int kL0_CompactionTrigger = 4;
-
-// Soft limit on number of level-0 files.  We slow down writes at this point.
-        static const int kL0_SlowdownWritesTrigger = 8;
-
-// Maximum number of level-0 files.  We stop writes at this point.
-        static const int kL0_StopWritesTrigger = 12;
+// The level-0 file count triggers are set by
+// Options::level0_file_num_compaction_trigger,
+// Options::level0_slowdown_writes_trigger and
+// Options::level0_stop_writes_trigger.
 
 // Maximum level to which a new compacted memtable is pushed if it
 // does not create overlap.  We try to push to level 2 to avoid the
@@ -52,7 +48,10 @@ namespace leveldb {
 // DO NOT CHANGE THESE ENUM VALUES: they are embedded in the on-disk
 // data structures.
     enum ValueType {
-        kTypeDeletion = 0x0, kTypeValue = 0x1
+        kTypeDeletion = 0x0, kTypeValue = 0x1, kTypeMerge = 0x2,
+        // Deletes the user keys in [user key, value) that are older than it.
+        // Kept apart from the point entries, see db/range_tombstone.h.
+        kTypeRangeDeletion = 0x3
     };
 // kValueTypeForSeek defines the ValueType that should be passed when
 // constructing a ParsedInternalKey object for seeking to a particular
@@ -60,7 +59,7 @@ namespace leveldb {
 // and the value type is embedded as the low 8 bits in the sequence
 // number in internal keys, we need to use the highest-numbered
 // ValueType, not the lowest).
-    static const ValueType kValueTypeForSeek = kTypeValue;
+    static const ValueType kValueTypeForSeek = kTypeRangeDeletion;
 
     typedef uint64_t SequenceNumber;
 
@@ -100,6 +99,19 @@ namespace leveldb {
         return Slice(internal_key.data(), internal_key.size() - 8);
     }
 
+// Returns the sequence number of an internal key.
+    inline SequenceNumber ExtractSequence(const Slice &internal_key) {
+        assert(internal_key.size() >= 8);
+        return DecodeFixed64(internal_key.data() + internal_key.size() - 8) >> 8;
+    }
+
+// Returns the type of an internal key.
+    inline ValueType ExtractValueType(const Slice &internal_key) {
+        assert(internal_key.size() >= 8);
+        return static_cast<ValueType>(
+                DecodeFixed64(internal_key.data() + internal_key.size() - 8) & 0xff);
+    }
+
 // A comparator for internal keys that uses a specified comparator for
 // the user key portion and breaks ties by decreasing sequence number.
     class InternalKeyComparator : public Comparator {
@@ -187,7 +199,7 @@ namespace leveldb {
         result->sequence = num >> 8;
         result->type = static_cast<ValueType>(c);
         result->user_key = Slice(internal_key.data(), n - 8);
-        return (c <= static_cast<uint8_t>(kTypeValue));
+        return (c <= static_cast<uint8_t>(kTypeRangeDeletion));
     }
 
 // A helper class useful for DBImpl::Get()
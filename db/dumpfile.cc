@@ -90,6 +90,24 @@ namespace leveldb {
                 dst_->Append(r);
             }
 
+            void Merge(const Slice &key, const Slice &value) override {
+                std::string r = "  merge '";
+                AppendEscapedStringTo(&r, key);
+                r += "' '";
+                AppendEscapedStringTo(&r, value);
+                r += "'\n";
+                dst_->Append(r);
+            }
+
+            void DeleteRange(const Slice &begin_key, const Slice &end_key) override {
+                std::string r = "  delete-range '";
+                AppendEscapedStringTo(&r, begin_key);
+                r += "' '";
+                AppendEscapedStringTo(&r, end_key);
+                r += "'\n";
+                dst_->Append(r);
+            }
+
             WritableFile *dst_;
         };
 
@@ -190,6 +208,8 @@ namespace leveldb {
                         r += "del";
                     } else if (key.type == kTypeValue) {
                         r += "val";
+                    } else if (key.type == kTypeMerge) {
+                        r += "merge";
                     } else {
                         AppendNumberTo(&r, key.type);
                     }
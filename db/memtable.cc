@@ -3,11 +3,16 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include "db/memtable.h"
+
+#include <algorithm>
+
 #include "db/dbformat.h"
+#include "db/range_tombstone.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
 #include "util/coding.h"
+#include "util/mutexlock.h"
 
 namespace leveldb {
 
@@ -18,19 +23,34 @@ static Slice GetLengthPrefixedSlice(const char* data) {
   return Slice(p, len);
 }
 
-MemTable::MemTable(const InternalKeyComparator& comparator)
-    : comparator_(comparator), refs_(0), table_(comparator_, &arena_) {}
+static uint64_t NewMemTableId() {
+  static std::atomic<uint64_t> next_id(1);
+  return next_id.fetch_add(1, std::memory_order_relaxed);
+}
 
-MemTable::~MemTable() { assert(refs_ == 0); }
+MemTable::MemTable(const InternalKeyComparator& comparator,
+                   const MemTableRepFactory* factory, size_t arena_chunk_size,
+                   bool huge_pages)
+    : comparator_(comparator),
+      id_(NewMemTableId()),
+      refs_(0),
+      arena_(arena_chunk_size, huge_pages),
+      table_(factory != nullptr ? ToImpl(factory)->NewRep(&comparator_, &arena_)
+                                : NewDefaultMemTableRep(&comparator_, &arena_)),
+      range_del_table_(NewDefaultMemTableRep(&comparator_, &arena_)),
+      num_range_dels_(0),
+      range_dels_count_(0),
+      first_write_time_(0) {}
 
-size_t MemTable::ApproximateMemoryUsage() { return arena_.MemoryUsage(); }
+MemTable::~MemTable() {
+  assert(refs_ == 0);
+  delete table_;
+  delete range_del_table_;
+}
 
-int MemTable::KeyComparator::operator()(const char* aptr,
-                                        const char* bptr) const {
-  // Internal keys are encoded as length-prefixed strings.
-  Slice a = GetLengthPrefixedSlice(aptr);
-  Slice b = GetLengthPrefixedSlice(bptr);
-  return comparator.Compare(a, b);
+size_t MemTable::ApproximateMemoryUsage() {
+  return arena_.MemoryUsage() + table_->ApproximateMemoryUsage() +
+         range_del_table_->ApproximateMemoryUsage();
 }
 
 // Encode a suitable internal key target for "target" and return it.
@@ -45,36 +65,46 @@ static const char* EncodeKey(std::string* scratch, const Slice& target) {
 
 class MemTableIterator : public Iterator {
  public:
-  explicit MemTableIterator(MemTable::Table* table) : iter_(table) {}
+  explicit MemTableIterator(MemTableRep::Iterator* iter) : iter_(iter) {}
 
   MemTableIterator(const MemTableIterator&) = delete;
   MemTableIterator& operator=(const MemTableIterator&) = delete;
 
-  ~MemTableIterator() override = default;
+  ~MemTableIterator() override { delete iter_; }
 
-  bool Valid() const override { return iter_.Valid(); }
-  void Seek(const Slice& k) override { iter_.Seek(EncodeKey(&tmp_, k)); }
-  void SeekToFirst() override { iter_.SeekToFirst(); }
-  void SeekToLast() override { iter_.SeekToLast(); }
-  void Next() override { iter_.Next(); }
-  void Prev() override { iter_.Prev(); }
-  Slice key() const override { return GetLengthPrefixedSlice(iter_.key()); }
+  bool Valid() const override { return iter_->Valid(); }
+  void Seek(const Slice& k) override { iter_->Seek(EncodeKey(&tmp_, k)); }
+  void SeekToFirst() override { iter_->SeekToFirst(); }
+  void SeekToLast() override { iter_->SeekToLast(); }
+  void Next() override { iter_->Next(); }
+  void Prev() override { iter_->Prev(); }
+  Slice key() const override { return GetLengthPrefixedSlice(iter_->key()); }
   Slice value() const override {
-    Slice key_slice = GetLengthPrefixedSlice(iter_.key());
+    Slice key_slice = GetLengthPrefixedSlice(iter_->key());
     return GetLengthPrefixedSlice(key_slice.data() + key_slice.size());
   }
 
   Status status() const override { return Status::OK(); }
 
  private:
-  MemTable::Table::Iterator iter_;
+  MemTableRep::Iterator* iter_;
   std::string tmp_;  // For passing to EncodeKey
 };
 
-Iterator* MemTable::NewIterator() { return new MemTableIterator(&table_); }
+Iterator* MemTable::NewIterator() {
+  return new MemTableIterator(table_->NewIterator());
+}
+
+Iterator* MemTable::NewRangeTombstoneIterator() {
+  if (num_range_dels_.load(std::memory_order_acquire) == 0) {
+    return nullptr;
+  }
+  return new MemTableIterator(range_del_table_->NewIterator());
+}
 
-void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
-                   const Slice& value) {
+const char* MemTable::EncodeEntry(SequenceNumber s, ValueType type,
+                                  const Slice& key, const Slice& value,
+                                  bool concurrent) {
   // Format of an entry is concatenation of:
   //  key_size     : varint32 of internal_key.size()
   //  key bytes    : char[internal_key.size()]
@@ -86,7 +116,8 @@ void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
   const size_t encoded_len = VarintLength(internal_key_size) +
                              internal_key_size + VarintLength(val_size) +
                              val_size;
-  char* buf = arena_.Allocate(encoded_len);
+  char* buf = concurrent ? arena_.AllocateAlignedConcurrently(encoded_len)
+                         : arena_.Allocate(encoded_len);
   char* p = EncodeVarint32(buf, internal_key_size);
   std::memcpy(p, key.data(), key_size);
   p += key_size;
@@ -95,14 +126,97 @@ void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
   p = EncodeVarint32(p, val_size);
   std::memcpy(p, value.data(), val_size);
   assert(p + val_size == buf + encoded_len);
-  table_.Insert(buf);
+  return buf;
 }
 
-bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
+void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
+                   const Slice& value) {
+  if (type == kTypeRangeDeletion) {
+    range_del_table_->Insert(EncodeEntry(s, type, key, value, false));
+    num_range_dels_.fetch_add(1, std::memory_order_release);
+    return;
+  }
+  table_->Insert(EncodeEntry(s, type, key, value, false));
+}
+
+MemTable::InsertHint* MemTable::ThreadInsertHint() {
+  // A hint left over from an older memtable is never used again, so it does
+  // not matter that the memtable may be gone.
+  struct ThreadHint {
+    uint64_t memtable_id = 0;
+    std::unique_ptr<InsertHint> hint;
+  };
+  thread_local ThreadHint thread_hint;
+  if (thread_hint.memtable_id != id_) {
+    thread_hint.hint.reset(new InsertHint);
+    thread_hint.memtable_id = id_;
+  }
+  return thread_hint.hint.get();
+}
+
+void MemTable::AddConcurrently(SequenceNumber s, ValueType type,
+                               const Slice& key, const Slice& value,
+                               InsertHint* hint) {
+  if (type == kTypeRangeDeletion) {
+    // Insert() would allocate its node with Arena::AllocateAligned(), which
+    // must not race with the other writers' allocations.
+    if (hint->range_del_hint_ == nullptr) {
+      hint->range_del_hint_.reset(range_del_table_->NewInsertHint());
+    }
+    range_del_table_->InsertConcurrently(EncodeEntry(s, type, key, value, true),
+                                         hint->range_del_hint_.get());
+    num_range_dels_.fetch_add(1, std::memory_order_release);
+    return;
+  }
+  if (hint->rep_hint_ == nullptr) {
+    hint->rep_hint_.reset(table_->NewInsertHint());
+  }
+  table_->InsertConcurrently(EncodeEntry(s, type, key, value, true),
+                             hint->rep_hint_.get());
+}
+
+std::shared_ptr<const RangeTombstoneSet> MemTable::RangeTombstones() {
+  // Every tombstone counted here is visible to the iterator below.
+  const uint64_t count = num_range_dels_.load(std::memory_order_acquire);
+  {
+    MutexLock l(&range_dels_mutex_);
+    if (range_dels_ != nullptr && range_dels_count_ >= count) {
+      return range_dels_;
+    }
+  }
+
+  // Built without the lock so that lookups covered by the cached set do
+  // not wait for it.
+  std::vector<RangeTombstone> tombstones;
+  // A memtable iterator cannot fail
+  AppendRangeTombstones(new MemTableIterator(range_del_table_->NewIterator()),
+                        &tombstones);
+  std::shared_ptr<const RangeTombstoneSet> range_dels =
+      std::make_shared<const RangeTombstoneSet>(
+          comparator_.comparator.user_comparator(), tombstones);
+
+  MutexLock l(&range_dels_mutex_);
+  if (range_dels_ == nullptr || range_dels_count_ < count) {
+    range_dels_ = range_dels;
+    range_dels_count_ = count;
+  }
+  return range_dels;
+}
+
+bool MemTable::Get(const LookupKey& key, std::string* value, Status* s,
+                   std::vector<std::string>* operands,
+                   SequenceNumber* max_covering_tombstone_seq) {
+  const Comparator* ucmp = comparator_.comparator.user_comparator();
+  if (num_range_dels_.load(std::memory_order_acquire) > 0) {
+    const SequenceNumber covering = RangeTombstones()->MaxCoveringSequence(
+        key.user_key(), ExtractSequence(key.internal_key()));
+    *max_covering_tombstone_seq =
+        std::max(*max_covering_tombstone_seq, covering);
+  }
+
   Slice memkey = key.memtable_key();
-  Table::Iterator iter(&table_);
-  iter.Seek(memkey.data());
-  if (iter.Valid()) {
+  const char* entry = table_->Lookup(memkey.data());
+  while (entry != nullptr) {
     // entry format is:
     //    klength  varint32
     //    userkey  char[klength]
@@ -110,15 +224,18 @@ bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
     //    vlength  varint32
     //    value    char[vlength]
     // Check that it belongs to same user key.  We do not check the
-    // sequence number since the Seek() call above should have skipped
+    // sequence number since the Lookup() call above should have skipped
     // all entries with overly large sequence numbers.
-    const char* entry = iter.key();
     uint32_t key_length;
     const char* key_ptr = GetVarint32Ptr(entry, entry + 5, &key_length);
-    if (comparator_.comparator.user_comparator()->Compare(
-            Slice(key_ptr, key_length - 8), key.user_key()) == 0) {
+    if (ucmp->Compare(Slice(key_ptr, key_length - 8), key.user_key()) == 0) {
       // Correct user key
       const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
+      if ((tag >> 8) < *max_covering_tombstone_seq) {
+        // Deleted by a range tombstone
+        *s = Status::NotFound(Slice());
+        return true;
+      }
       switch (static_cast<ValueType>(tag & 0xff)) {
         case kTypeValue: {
           Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
@@ -128,10 +245,30 @@ bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
         case kTypeDeletion:
           *s = Status::NotFound(Slice());
           return true;
+        case kTypeRangeDeletion:
+          break;  // Never stored in table_
+        case kTypeMerge: {
+          Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
+          operands->push_back(v.ToString());
+          // Look for the older entries of the key
+          const SequenceNumber sequence = tag >> 8;
+          if (sequence == 0) {
+            return false;
+          }
+          LookupKey older(key.user_key(), sequence - 1);
+          entry = table_->Lookup(older.memtable_key().data());
+          continue;
+        }
       }
     }
+    break;
   }
   return false;
 }
 
+void MemTable::MarkReadOnly() {
+  table_->MarkReadOnly();
+  range_del_table_->MarkReadOnly();
+}
+
 }  // namespace leveldb
@@ -5,23 +5,35 @@
 #ifndef STORAGE_LEVELDB_DB_MEMTABLE_H_
 #define STORAGE_LEVELDB_DB_MEMTABLE_H_
 
+#include <atomic>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "db/dbformat.h"
-#include "db/skiplist.h"
+#include "db/memtablerep.h"
 #include "leveldb/db.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
 #include "util/arena.h"
 
 namespace leveldb {
 
 class InternalKeyComparator;
 class MemTableIterator;
+class RangeTombstoneSet;
 
 class MemTable {
  public:
   // MemTables are reference counted.  The initial reference count
   // is zero and the caller must call Ref() at least once.
-  explicit MemTable(const InternalKeyComparator& comparator);
+  //
+  // Entries are kept in a representation created by "*factory", or in
+  // a skiplist if "factory" is null.  "arena_chunk_size" and "huge_pages"
+  // configure the arena that holds them (see Arena).
+  explicit MemTable(const InternalKeyComparator& comparator,
+                    const MemTableRepFactory* factory = nullptr,
+                    size_t arena_chunk_size = 0, bool huge_pages = false);
 
   MemTable(const MemTable&) = delete;
   MemTable& operator=(const MemTable&) = delete;
@@ -50,36 +62,102 @@ class MemTable {
   // db/format.{h,cc} module.
   Iterator* NewIterator();
 
+  // Return an iterator over the range tombstones of the memtable (see
+  // db/range_tombstone.h), or nullptr if there are none.  Same
+  // requirements as NewIterator().
+  Iterator* NewRangeTombstoneIterator();
+
   // Add an entry into memtable that maps key to value at the
   // specified sequence number and with the specified type.
-  // Typically value will be empty if type==kTypeDeletion.
+  // Typically value will be empty if type==kTypeDeletion.  A
+  // kTypeRangeDeletion entry deletes the keys in [key,value).
   void Add(SequenceNumber seq, ValueType type, const Slice& key,
            const Slice& value);
 
+  // Per-thread state for AddConcurrently().
+  class InsertHint;
+
+  // Return the calling thread's hint for this memtable.  It is kept until
+  // the thread asks another memtable for its hint, so that it carries over
+  // from one write batch to the next.
+  InsertHint* ThreadInsertHint();
+
+  // Like Add(), but may be called by several threads at the same time as
+  // long as each of them passes its own "*hint" and no Add() call is in
+  // progress.  "*hint" speeds up runs of ascending keys and must only be
+  // used with this memtable.
+  // REQUIRES: the representation supports concurrent inserts.
+  void AddConcurrently(SequenceNumber seq, ValueType type, const Slice& key,
+                       const Slice& value, InsertHint* hint);
+
   // If memtable contains a value for key, store it in *value and return true.
   // If memtable contains a deletion for key, store a NotFound() error
   // in *status and return true.
   // Else, return false.
-  bool Get(const LookupKey& key, std::string* value, Status* s);
+  // Merge operands found on top of the value or deletion, or of the end of
+  // the key's entries, are appended to *operands, newest first.
+  // *max_covering_tombstone_seq is raised to the sequence number of the
+  // newest range tombstone visible to "key" that covers its user key, and
+  // entries older than it are treated as deletions.
+  bool Get(const LookupKey& key, std::string* value, Status* s,
+           std::vector<std::string>* operands,
+           SequenceNumber* max_covering_tombstone_seq);
+
+  // Tell the representation that no more entries will be added, e.g.
+  // because the memtable is about to be flushed.
+  void MarkReadOnly();
+
+  // Seconds since the epoch at which the first entry was written to the
+  // memtable, or 0 if unknown.  Maintained by the DB under its mutex.
+  uint64_t first_write_time() const { return first_write_time_; }
+  void SetFirstWriteTime(uint64_t t) { first_write_time_ = t; }
 
  private:
-  friend class MemTableIterator;
-  friend class MemTableBackwardIterator;
-
-  struct KeyComparator {
-    const InternalKeyComparator comparator;
-    explicit KeyComparator(const InternalKeyComparator& c) : comparator(c) {}
-    int operator()(const char* a, const char* b) const;
-  };
+  ~MemTable();  // Private since only Unref() should be used to delete it
 
-  typedef SkipList<const char*, KeyComparator> Table;
+  // Encode an entry for table_ into memory allocated from arena_.
+  const char* EncodeEntry(SequenceNumber seq, ValueType type, const Slice& key,
+                          const Slice& value, bool concurrent);
 
-  ~MemTable();  // Private since only Unref() should be used to delete it
+  // Return the range tombstones added so far, fragmented for lookups.  The
+  // set is cached until more tombstones are added, so an immutable
+  // memtable builds it once.
+  std::shared_ptr<const RangeTombstoneSet> RangeTombstones();
 
-  KeyComparator comparator_;
+  MemTableKeyComparator comparator_;
+  const uint64_t id_;  // Unique within the process, for ThreadInsertHint()
   int refs_;
   Arena arena_;
-  Table table_;
+  MemTableRep* table_;
+
+  // Range tombstones, kept apart so that point lookups do not have to skip
+  // them.  Always the default representation, so AddConcurrently() can
+  // insert into it concurrently as well.
+  MemTableRep* range_del_table_;
+  std::atomic<uint64_t> num_range_dels_;  // Counted once inserted
+
+  // Cached result of RangeTombstones().  It holds at least the tombstones
+  // that were counted when num_range_dels_ was range_dels_count_.
+  port::Mutex range_dels_mutex_;
+  std::shared_ptr<const RangeTombstoneSet> range_dels_
+      GUARDED_BY(range_dels_mutex_);
+  uint64_t range_dels_count_ GUARDED_BY(range_dels_mutex_);
+
+  uint64_t first_write_time_;
+};
+
+class MemTable::InsertHint {
+ public:
+  InsertHint() = default;
+
+  InsertHint(const InsertHint&) = delete;
+  InsertHint& operator=(const InsertHint&) = delete;
+
+ private:
+  friend class MemTable;
+
+  std::unique_ptr<MemTableRep::InsertHint> rep_hint_;
+  std::unique_ptr<MemTableRep::InsertHint> range_del_hint_;
 };
 
 }  // namespace leveldb
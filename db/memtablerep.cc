@@ -0,0 +1,396 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/memtablerep.h"
+
+#include <algorithm>
+#include <atomic>
+#include <utility>
+#include <vector>
+
+#include "db/skiplist.h"
+#include "leveldb/comparator.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/arena.h"
+#include "util/coding.h"
+#include "util/hash.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+MemTableRepFactory::~MemTableRepFactory() = default;
+
+static Slice GetLengthPrefixedSlice(const char* data) {
+  uint32_t len;
+  const char* p = data;
+  p = GetVarint32Ptr(p, p + 5, &len);  // +5: we assume "p" is not corrupted
+  return Slice(p, len);
+}
+
+MemTableKeyComparator::MemTableKeyComparator(const InternalKeyComparator& c)
+    : comparator(c),
+      bytewise_(c.user_comparator() == BytewiseComparator()) {}
+
+int MemTableKeyComparator::operator()(const char* aptr,
+                                      const char* bptr) const {
+  // Internal keys are encoded as length-prefixed strings.
+  Slice a = GetLengthPrefixedSlice(aptr);
+  Slice b = GetLengthPrefixedSlice(bptr);
+  return comparator.Compare(a, b);
+}
+
+uint64_t MemTableKeyComparator::Prefix(const char* entry) const {
+  if (!bytewise_) {
+    return 0;
+  }
+  Slice user_key = ExtractUserKey(GetLengthPrefixedSlice(entry));
+  const unsigned char* p =
+      reinterpret_cast<const unsigned char*>(user_key.data());
+  const size_t n = std::min<size_t>(user_key.size(), 8);
+  uint64_t result = 0;
+  for (size_t i = 0; i < n; i++) {
+    result |= static_cast<uint64_t>(p[i]) << (56 - 8 * i);
+  }
+  return result;
+}
+
+namespace {
+
+typedef SkipList<const char*, MemTableKeyComparator> EntryList;
+
+class SkipListIterator : public MemTableRep::Iterator {
+ public:
+  explicit SkipListIterator(const EntryList* list) : iter_(list) {}
+
+  bool Valid() const override { return iter_.Valid(); }
+  const char* key() const override { return iter_.key(); }
+  void Next() override { iter_.Next(); }
+  void Prev() override { iter_.Prev(); }
+  void Seek(const char* target) override { iter_.Seek(target); }
+  void SeekToFirst() override { iter_.SeekToFirst(); }
+  void SeekToLast() override { iter_.SeekToLast(); }
+
+ private:
+  EntryList::Iterator iter_;
+};
+
+// Orders entries for std::sort() and std::lower_bound().
+struct EntryLess {
+  const MemTableKeyComparator* cmp;
+  bool operator()(const char* a, const char* b) const {
+    return (*cmp)(a, b) < 0;
+  }
+};
+
+// Iterates over a sorted vector of entries, which is either owned by the
+// iterator or immutable for as long as the iterator lives.
+class VectorIterator : public MemTableRep::Iterator {
+ public:
+  VectorIterator(const MemTableKeyComparator* cmp,
+                 std::vector<const char*>&& entries)
+      : cmp_(cmp),
+        owned_(std::move(entries)),
+        entries_(&owned_),
+        pos_(owned_.size()) {}
+
+  VectorIterator(const MemTableKeyComparator* cmp,
+                 const std::vector<const char*>* entries)
+      : cmp_(cmp), entries_(entries), pos_(entries->size()) {}
+
+  bool Valid() const override { return pos_ < entries_->size(); }
+  const char* key() const override {
+    assert(Valid());
+    return (*entries_)[pos_];
+  }
+  void Next() override {
+    assert(Valid());
+    pos_++;
+  }
+  void Prev() override {
+    assert(Valid());
+    pos_ = (pos_ == 0) ? entries_->size() : pos_ - 1;
+  }
+  void Seek(const char* target) override {
+    pos_ = std::lower_bound(entries_->begin(), entries_->end(), target,
+                            EntryLess{cmp_}) -
+           entries_->begin();
+  }
+  void SeekToFirst() override { pos_ = 0; }
+  void SeekToLast() override {
+    pos_ = entries_->empty() ? 0 : entries_->size() - 1;
+  }
+
+ private:
+  const MemTableKeyComparator* const cmp_;
+  std::vector<const char*> owned_;
+  const std::vector<const char*>* const entries_;
+  size_t pos_;
+};
+
+class SkipListRep : public MemTableRep {
+ public:
+  SkipListRep(const MemTableKeyComparator* cmp, Arena* arena)
+      : list_(*cmp, arena) {}
+
+  void Insert(const char* entry) override { list_.Insert(entry); }
+
+  InsertHint* NewInsertHint() override { return new Hint; }
+
+  void InsertConcurrently(const char* entry, InsertHint* hint) override {
+    list_.InsertConcurrently(entry, &static_cast<Hint*>(hint)->splice);
+  }
+
+  const char* Lookup(const char* key) const override {
+    EntryList::Iterator iter(&list_);
+    iter.Seek(key);
+    return iter.Valid() ? iter.key() : nullptr;
+  }
+
+  Iterator* NewIterator() override { return new SkipListIterator(&list_); }
+
+ private:
+  struct Hint : public InsertHint {
+    EntryList::Splice splice;
+  };
+
+  EntryList list_;
+};
+
+// Entries are spread over skiplists by a hash of their user key prefix, so
+// that a lookup only searches the entries that share its prefix.
+class HashSkipListRep : public MemTableRep {
+ public:
+  HashSkipListRep(const MemTableKeyComparator* cmp, Arena* arena,
+                  size_t prefix_length, size_t bucket_count)
+      : cmp_(cmp),
+        arena_(arena),
+        prefix_length_(prefix_length),
+        bucket_count_(bucket_count),
+        buckets_(new std::atomic<EntryList*>[bucket_count]),
+        read_only_(false),
+        sorted_valid_(false) {
+    for (size_t i = 0; i < bucket_count_; i++) {
+      buckets_[i].store(nullptr, std::memory_order_relaxed);
+    }
+  }
+
+  ~HashSkipListRep() override {
+    for (size_t i = 0; i < bucket_count_; i++) {
+      EntryList* list = buckets_[i].load(std::memory_order_relaxed);
+      if (list != nullptr) {
+        list->~EntryList();  // Memory belongs to the arena
+      }
+    }
+    delete[] buckets_;
+  }
+
+  void Insert(const char* entry) override {
+    std::atomic<EntryList*>* bucket = Bucket(entry);
+    EntryList* list = bucket->load(std::memory_order_relaxed);
+    if (list == nullptr) {
+      char* mem = arena_->AllocateAligned(sizeof(EntryList));
+      list = new (mem) EntryList(*cmp_, arena_);
+      // Release-store so that readers observe a fully constructed list.
+      bucket->store(list, std::memory_order_release);
+    }
+    list->Insert(entry);
+  }
+
+  const char* Lookup(const char* key) const override {
+    EntryList* list = Bucket(key)->load(std::memory_order_acquire);
+    if (list == nullptr) {
+      return nullptr;
+    }
+    EntryList::Iterator iter(list);
+    iter.Seek(key);
+    return iter.Valid() ? iter.key() : nullptr;
+  }
+
+  Iterator* NewIterator() override {
+    MutexLock l(&mu_);
+    if (sorted_valid_) {
+      return new VectorIterator(cmp_, &sorted_);
+    }
+    std::vector<const char*> entries;
+    for (size_t i = 0; i < bucket_count_; i++) {
+      EntryList* list = buckets_[i].load(std::memory_order_acquire);
+      if (list != nullptr) {
+        EntryList::Iterator iter(list);
+        for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+          entries.push_back(iter.key());
+        }
+      }
+    }
+    std::sort(entries.begin(), entries.end(), EntryLess{cmp_});
+    if (read_only_) {
+      // Nothing can be added any more, so keep the result for later
+      // iterators, e.g. the one that flushes this memtable.
+      sorted_ = std::move(entries);
+      sorted_valid_ = true;
+      return new VectorIterator(cmp_, &sorted_);
+    }
+    return new VectorIterator(cmp_, std::move(entries));
+  }
+
+  void MarkReadOnly() override {
+    MutexLock l(&mu_);
+    read_only_ = true;
+  }
+
+  size_t ApproximateMemoryUsage() const override {
+    return bucket_count_ * sizeof(std::atomic<EntryList*>);
+  }
+
+ private:
+  std::atomic<EntryList*>* Bucket(const char* entry) const {
+    Slice user_key = ExtractUserKey(GetLengthPrefixedSlice(entry));
+    size_t n = std::min(user_key.size(), prefix_length_);
+    return &buckets_[Hash(user_key.data(), n, 0) % bucket_count_];
+  }
+
+  const MemTableKeyComparator* const cmp_;
+  Arena* const arena_;
+  const size_t prefix_length_;
+  const size_t bucket_count_;
+  std::atomic<EntryList*>* const buckets_;
+
+  port::Mutex mu_;
+  bool read_only_ GUARDED_BY(mu_);
+  // All entries in order, once they have been sorted after MarkReadOnly().
+  // Immutable after sorted_valid_ is set.
+  std::vector<const char*> sorted_ GUARDED_BY(mu_);
+  bool sorted_valid_ GUARDED_BY(mu_);
+};
+
+// Entries are appended to a vector, which is sorted the first time it is
+// iterated over after MarkReadOnly().
+class VectorRep : public MemTableRep {
+ public:
+  explicit VectorRep(const MemTableKeyComparator* cmp)
+      : cmp_(cmp), read_only_(false), sorted_(false), memory_usage_(0) {}
+
+  void Insert(const char* entry) override {
+    MutexLock l(&mu_);
+    assert(!read_only_);
+    entries_.push_back(entry);
+    memory_usage_.store(entries_.capacity() * sizeof(const char*),
+                        std::memory_order_relaxed);
+  }
+
+  const char* Lookup(const char* key) const override {
+    MutexLock l(&mu_);
+    if (sorted_) {
+      auto iter = std::lower_bound(entries_.begin(), entries_.end(), key,
+                                   EntryLess{cmp_});
+      return iter == entries_.end() ? nullptr : *iter;
+    }
+    // Not sorted yet: look for the smallest entry at or after key.
+    const char* result = nullptr;
+    for (const char* entry : entries_) {
+      if ((*cmp_)(entry, key) >= 0 &&
+          (result == nullptr || (*cmp_)(entry, result) < 0)) {
+        result = entry;
+      }
+    }
+    return result;
+  }
+
+  Iterator* NewIterator() override {
+    std::vector<const char*> entries;
+    {
+      MutexLock l(&mu_);
+      if (read_only_) {
+        if (!sorted_) {
+          std::sort(entries_.begin(), entries_.end(), EntryLess{cmp_});
+          sorted_ = true;
+        }
+        // entries_ does not change any more.
+        return new VectorIterator(cmp_, &entries_);
+      }
+      entries = entries_;
+    }
+    std::sort(entries.begin(), entries.end(), EntryLess{cmp_});
+    return new VectorIterator(cmp_, std::move(entries));
+  }
+
+  void MarkReadOnly() override {
+    MutexLock l(&mu_);
+    read_only_ = true;
+  }
+
+  size_t ApproximateMemoryUsage() const override {
+    return memory_usage_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  const MemTableKeyComparator* const cmp_;
+  mutable port::Mutex mu_;
+  std::vector<const char*> entries_ GUARDED_BY(mu_);
+  bool read_only_ GUARDED_BY(mu_);
+  bool sorted_ GUARDED_BY(mu_);
+  std::atomic<size_t> memory_usage_;
+};
+
+class SkipListRepFactory : public MemTableRepFactoryImpl {
+ public:
+  const char* Name() const override { return "leveldb.SkipListRep"; }
+
+  MemTableRep* NewRep(const MemTableKeyComparator* cmp,
+                      Arena* arena) const override {
+    return new SkipListRep(cmp, arena);
+  }
+
+  bool SupportsConcurrentInserts() const override { return true; }
+};
+
+class HashSkipListRepFactory : public MemTableRepFactoryImpl {
+ public:
+  HashSkipListRepFactory(size_t prefix_length, size_t bucket_count)
+      : prefix_length_(prefix_length), bucket_count_(bucket_count) {}
+
+  const char* Name() const override { return "leveldb.HashSkipListRep"; }
+
+  MemTableRep* NewRep(const MemTableKeyComparator* cmp,
+                      Arena* arena) const override {
+    return new HashSkipListRep(cmp, arena, prefix_length_, bucket_count_);
+  }
+
+ private:
+  const size_t prefix_length_;
+  const size_t bucket_count_;
+};
+
+class VectorRepFactory : public MemTableRepFactoryImpl {
+ public:
+  const char* Name() const override { return "leveldb.VectorRep"; }
+
+  MemTableRep* NewRep(const MemTableKeyComparator* cmp,
+                      Arena* arena) const override {
+    return new VectorRep(cmp);
+  }
+};
+
+}  // namespace
+
+MemTableRep* NewDefaultMemTableRep(const MemTableKeyComparator* cmp,
+                                   Arena* arena) {
+  return new SkipListRep(cmp, arena);
+}
+
+const MemTableRepFactory* NewSkipListRepFactory() {
+  return new SkipListRepFactory;
+}
+
+const MemTableRepFactory* NewHashSkipListRepFactory(size_t prefix_length,
+                                                    size_t bucket_count) {
+  return new HashSkipListRepFactory(prefix_length,
+                                    std::max<size_t>(bucket_count, 1));
+}
+
+const MemTableRepFactory* NewVectorRepFactory() {
+  return new VectorRepFactory;
+}
+
+}  // namespace leveldb
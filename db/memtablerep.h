@@ -0,0 +1,139 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_MEMTABLEREP_H_
+#define STORAGE_LEVELDB_DB_MEMTABLEREP_H_
+
+#include <cassert>
+
+#include "db/dbformat.h"
+#include "leveldb/memtablerep.h"
+
+namespace leveldb {
+
+class Arena;
+
+// Orders memtable entries.  Entries, and the keys they are looked up by,
+// start with a length-prefixed internal key.
+struct MemTableKeyComparator {
+  const InternalKeyComparator comparator;
+  explicit MemTableKeyComparator(const InternalKeyComparator& c);
+  int operator()(const char* a, const char* b) const;
+
+  // Return the first 8 bytes of the user key as a big-endian number, so
+  // that skiplist nodes can be ordered without touching the entry.  Only
+  // meaningful for the bytewise comparator; 0 for any other comparator.
+  uint64_t Prefix(const char* entry) const;
+
+ private:
+  const bool bytewise_;
+};
+
+// A MemTableRep holds the entries of a MemTable, which encodes them into
+// the arena; the representation only keeps them in order.
+//
+// Insert() requires external synchronization, but may run alongside any
+// number of Lookup() calls and iterators.
+class MemTableRep {
+ public:
+  // Iteration over the entries of a representation in comparator order.
+  class Iterator {
+   public:
+    Iterator() = default;
+
+    Iterator(const Iterator&) = delete;
+    Iterator& operator=(const Iterator&) = delete;
+
+    virtual ~Iterator() = default;
+
+    virtual bool Valid() const = 0;
+
+    // REQUIRES: Valid()
+    virtual const char* key() const = 0;
+
+    // REQUIRES: Valid()
+    virtual void Next() = 0;
+
+    // REQUIRES: Valid()
+    virtual void Prev() = 0;
+
+    // Advance to the first entry at or after "target", a length-prefixed
+    // internal key.
+    virtual void Seek(const char* target) = 0;
+
+    virtual void SeekToFirst() = 0;
+
+    virtual void SeekToLast() = 0;
+  };
+
+  // Per-thread state for InsertConcurrently().
+  class InsertHint {
+   public:
+    virtual ~InsertHint() = default;
+  };
+
+  MemTableRep() = default;
+
+  MemTableRep(const MemTableRep&) = delete;
+  MemTableRep& operator=(const MemTableRep&) = delete;
+
+  virtual ~MemTableRep() = default;
+
+  // REQUIRES: nothing that compares equal to entry is in the representation.
+  virtual void Insert(const char* entry) = 0;
+
+  // Return new per-thread state for InsertConcurrently().  Only called if
+  // the factory supports concurrent inserts.
+  virtual InsertHint* NewInsertHint() {
+    assert(false);
+    return nullptr;
+  }
+
+  // Like Insert(), but may run alongside other InsertConcurrently() calls
+  // that pass their own "*hint".  Must not run alongside Insert().
+  virtual void InsertConcurrently(const char* entry, InsertHint* hint) {
+    assert(false);
+  }
+
+  // Return the first entry at or after "key", a length-prefixed internal
+  // key, or nullptr if there is none.  Entries for a different user key
+  // than the one in "key" may be skipped.
+  virtual const char* Lookup(const char* key) const = 0;
+
+  // Return a new iterator over all entries.
+  virtual Iterator* NewIterator() = 0;
+
+  // Called once nothing will be inserted any more, before the memtable
+  // is flushed.
+  virtual void MarkReadOnly() {}
+
+  // Return an estimate of the memory in use that was not allocated from
+  // the arena.  Safe to call while entries are being inserted.
+  virtual size_t ApproximateMemoryUsage() const { return 0; }
+};
+
+// The factories of leveldb/memtablerep.h, which all derive from this class.
+class MemTableRepFactoryImpl : public MemTableRepFactory {
+ public:
+  MemTableRepFactoryImpl() = default;
+
+  // Return a new, empty representation that orders its entries with
+  // "*cmp" and allocates any memory it needs from "*arena".  Both outlive
+  // the result.
+  virtual MemTableRep* NewRep(const MemTableKeyComparator* cmp,
+                              Arena* arena) const = 0;
+};
+
+// Return "factory", which was created by leveldb/memtablerep.h.
+inline const MemTableRepFactoryImpl* ToImpl(const MemTableRepFactory* factory) {
+  return static_cast<const MemTableRepFactoryImpl*>(factory);
+}
+
+// Return the representation used when Options::memtable_factory is null.
+MemTableRep* NewDefaultMemTableRep(const MemTableKeyComparator* cmp,
+                                   Arena* arena);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_MEMTABLEREP_H_
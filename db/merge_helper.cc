@@ -0,0 +1,28 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/merge_helper.h"
+
+#include "leveldb/merge_operator.h"
+
+namespace leveldb {
+
+Status FullMerge(const MergeOperator* op, const Slice& user_key,
+                 const Slice* existing_value,
+                 const std::vector<std::string>& operands,
+                 std::string* result) {
+  if (op == nullptr) {
+    return Status::NotSupported("merge operands found without a merge operator",
+                                user_key);
+  }
+  std::vector<Slice> oldest_first(operands.rbegin(), operands.rend());
+  std::string merged;
+  if (!op->FullMerge(user_key, existing_value, oldest_first, &merged)) {
+    return Status::Corruption("merge failed for", user_key);
+  }
+  result->swap(merged);
+  return Status::OK();
+}
+
+}  // namespace leveldb
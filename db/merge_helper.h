@@ -0,0 +1,27 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_MERGE_HELPER_H_
+#define STORAGE_LEVELDB_DB_MERGE_HELPER_H_
+
+#include <string>
+#include <vector>
+
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class MergeOperator;
+
+// Apply the merge "operands" of "user_key", newest first as they are found
+// by lookups, to "existing_value" (nullptr if there is none) with "op", and
+// store the result in *result.  Fails with NotSupported if "op" is null.
+Status FullMerge(const MergeOperator* op, const Slice& user_key,
+                 const Slice* existing_value,
+                 const std::vector<std::string>& operands, std::string* result);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_MERGE_HELPER_H_
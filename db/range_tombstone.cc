@@ -0,0 +1,121 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/range_tombstone.h"
+
+#include <algorithm>
+#include <functional>
+
+#include "leveldb/comparator.h"
+#include "leveldb/iterator.h"
+
+namespace leveldb {
+
+Status AppendRangeTombstones(Iterator* iter,
+                             std::vector<RangeTombstone>* tombstones) {
+  Status s;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ParsedInternalKey ikey;
+    if (!ParseInternalKey(iter->key(), &ikey) ||
+        ikey.type != kTypeRangeDeletion) {
+      s = Status::Corruption("bad range tombstone");
+      break;
+    }
+    tombstones->emplace_back(ikey.user_key, iter->value(), ikey.sequence);
+  }
+  if (s.ok()) {
+    s = iter->status();
+  }
+  delete iter;
+  return s;
+}
+
+RangeTombstoneSet::RangeTombstoneSet(
+    const Comparator* ucmp, const std::vector<RangeTombstone>& tombstones)
+    : ucmp_(ucmp), tombstones_(tombstones) {
+  auto less = [ucmp](const std::string& a, const std::string& b) {
+    return ucmp->Compare(a, b) < 0;
+  };
+  for (const RangeTombstone& t : tombstones_) {
+    if (ucmp_->Compare(t.start, t.end) < 0) {
+      boundaries_.push_back(t.start);
+      boundaries_.push_back(t.end);
+    }
+  }
+  std::sort(boundaries_.begin(), boundaries_.end(), less);
+  boundaries_.erase(
+      std::unique(boundaries_.begin(), boundaries_.end(),
+                  [ucmp](const std::string& a, const std::string& b) {
+                    return ucmp->Compare(a, b) == 0;
+                  }),
+      boundaries_.end());
+  if (boundaries_.empty()) {
+    return;
+  }
+
+  seqs_.resize(boundaries_.size() - 1);
+  for (const RangeTombstone& t : tombstones_) {
+    if (ucmp_->Compare(t.start, t.end) >= 0) {
+      continue;
+    }
+    size_t i = std::lower_bound(boundaries_.begin(), boundaries_.end(),
+                                t.start, less) -
+               boundaries_.begin();
+    for (; ucmp_->Compare(boundaries_[i], t.end) < 0; i++) {
+      seqs_[i].push_back(t.seq);
+    }
+  }
+  for (std::vector<SequenceNumber>& s : seqs_) {
+    std::sort(s.begin(), s.end(), std::greater<SequenceNumber>());
+  }
+}
+
+int RangeTombstoneSet::FindFragment(const Slice& user_key) const {
+  // Index of the first boundary after "user_key"
+  size_t left = 0;
+  size_t right = boundaries_.size();
+  while (left < right) {
+    const size_t mid = (left + right) / 2;
+    if (ucmp_->Compare(boundaries_[mid], user_key) <= 0) {
+      left = mid + 1;
+    } else {
+      right = mid;
+    }
+  }
+  if (left == 0 || left == boundaries_.size()) {
+    return -1;
+  }
+  return static_cast<int>(left - 1);
+}
+
+SequenceNumber RangeTombstoneSet::MaxCoveringSequence(
+    const Slice& user_key, SequenceNumber upper) const {
+  const int f = FindFragment(user_key);
+  if (f < 0) {
+    return 0;
+  }
+  const std::vector<SequenceNumber>& s = seqs_[f];
+  auto it = std::lower_bound(s.begin(), s.end(), upper,
+                             std::greater<SequenceNumber>());
+  return (it == s.end()) ? 0 : *it;
+}
+
+bool RangeTombstoneSet::CoversRange(const Slice& smallest,
+                                    const Slice& largest,
+                                    SequenceNumber upper) const {
+  const int first = FindFragment(smallest);
+  const int last = FindFragment(largest);
+  if (first < 0 || last < 0) {
+    return false;
+  }
+  for (int f = first; f <= last; f++) {
+    // Fragments without tombstones are gaps between them
+    if (seqs_[f].empty() || seqs_[f].back() > upper) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,102 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A range tombstone, written by DB::DeleteRange(), deletes the user keys in
+// [start,end) whose entries are older than it.  Tombstones are not mixed
+// with the point entries: a memtable keeps them in a representation of
+// their own and a table in its range deletion meta block, both as entries
+// whose key is the internal key (start, seq, kTypeRangeDeletion) and whose
+// value is "end".  They are only taken into account by the readers, which
+// treat a covered entry as a deletion, and by compactions, which drop
+// covered entries once no snapshot can read them.
+
+#ifndef STORAGE_LEVELDB_DB_RANGE_TOMBSTONE_H_
+#define STORAGE_LEVELDB_DB_RANGE_TOMBSTONE_H_
+
+#include <string>
+#include <vector>
+
+#include "db/dbformat.h"
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class Comparator;
+class Iterator;
+
+struct RangeTombstone {
+  RangeTombstone() : seq(0) {}
+  RangeTombstone(const Slice& s, const Slice& e, SequenceNumber sq)
+      : start(s.ToString()), end(e.ToString()), seq(sq) {}
+
+  // Key of the entry that stores the tombstone.
+  InternalKey SerializeKey() const {
+    return InternalKey(start, seq, kTypeRangeDeletion);
+  }
+
+  // Smallest internal key of "end".  Used as the largest key of a table
+  // whose range ends with the tombstone; it sorts before every entry of
+  // "end", which the tombstone does not cover.
+  InternalKey SerializeEndKey() const {
+    return InternalKey(end, kMaxSequenceNumber, kTypeRangeDeletion);
+  }
+
+  std::string start;
+  std::string end;  // Exclusive
+  SequenceNumber seq;
+};
+
+// Append the tombstones stored in the entries of "iter" to *tombstones and
+// delete "iter".  Returns the first corrupted entry or iterator error.
+Status AppendRangeTombstones(Iterator* iter,
+                             std::vector<RangeTombstone>* tombstones);
+
+// An immutable set of tombstones, split at their boundaries into
+// non-overlapping fragments that each list the sequence numbers of the
+// tombstones covering them.  Safe for concurrent use.
+class RangeTombstoneSet {
+ public:
+  RangeTombstoneSet(const Comparator* ucmp,
+                    const std::vector<RangeTombstone>& tombstones);
+
+  RangeTombstoneSet(const RangeTombstoneSet&) = delete;
+  RangeTombstoneSet& operator=(const RangeTombstoneSet&) = delete;
+
+  bool empty() const { return tombstones_.empty(); }
+  const std::vector<RangeTombstone>& tombstones() const { return tombstones_; }
+
+  // Return the largest sequence number <= "upper" of the tombstones that
+  // cover "user_key", or 0 if there is none.
+  SequenceNumber MaxCoveringSequence(const Slice& user_key,
+                                     SequenceNumber upper) const;
+
+  // Returns true iff the entry of "user_key" at "seq" is deleted by a
+  // tombstone that is visible at sequence number "upper".
+  bool ShouldDelete(const Slice& user_key, SequenceNumber seq,
+                    SequenceNumber upper) const {
+    return MaxCoveringSequence(user_key, upper) > seq;
+  }
+
+  // Returns true iff every user key in [smallest,largest] is covered by a
+  // tombstone whose sequence number is <= "upper".
+  bool CoversRange(const Slice& smallest, const Slice& largest,
+                   SequenceNumber upper) const;
+
+ private:
+  // Index of the fragment that contains "user_key", or -1.
+  int FindFragment(const Slice& user_key) const;
+
+  const Comparator* const ucmp_;
+  const std::vector<RangeTombstone> tombstones_;
+
+  // Fragment i is [boundaries_[i], boundaries_[i+1]) and is covered by the
+  // tombstones whose sequence numbers are in seqs_[i], largest first.
+  std::vector<std::string> boundaries_;
+  std::vector<std::vector<SequenceNumber>> seqs_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_RANGE_TOMBSTONE_H_
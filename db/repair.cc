@@ -31,6 +31,7 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/range_tombstone.h"
 #include "db/table_cache.h"
 #include "db/version_edit.h"
 #include "db/write_batch_internal.h"
@@ -177,7 +178,7 @@ class Repairer {
     std::string scratch;
     Slice record;
     WriteBatch batch;
-    MemTable* mem = new MemTable(icmp_);
+    MemTable* mem = new MemTable(icmp_, options_.memtable_factory);
     mem->Ref();
     int counter = 0;
     while (reader.ReadRecord(&record, &scratch)) {
@@ -202,8 +203,17 @@ class Repairer {
     // since ExtractMetaData() will also generate edits.
     FileMetaData meta;
     meta.number = next_file_number_++;
+    mem->MarkReadOnly();
+    std::vector<RangeTombstone> range_dels;
+    Iterator* range_del_iter = mem->NewRangeTombstoneIterator();
+    if (range_del_iter != nullptr) {
+      status = AppendRangeTombstones(range_del_iter, &range_dels);
+    }
     Iterator* iter = mem->NewIterator();
-    status = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    if (status.ok()) {
+      status = BuildTable(dbname_, env_, options_, table_cache_, iter,
+                          range_dels, &meta, kMaxSequenceNumber);
+    }
     delete iter;
     mem->Unref();
     mem = nullptr;
@@ -259,6 +269,7 @@ class Repairer {
     bool empty = true;
     ParsedInternalKey parsed;
     t.max_sequence = 0;
+    t.meta.num_deletions = 0;
     for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
       Slice key = iter->key();
       if (!ParseInternalKey(key, &parsed)) {
@@ -276,11 +287,28 @@ class Repairer {
       if (parsed.sequence > t.max_sequence) {
         t.max_sequence = parsed.sequence;
       }
+      if (parsed.type == kTypeDeletion) {
+        t.meta.num_deletions++;
+      }
     }
+    t.meta.num_entries = counter;
     if (!iter->status().ok()) {
       status = iter->status();
     }
     delete iter;
+
+    // The range of the table includes its tombstones
+    std::vector<RangeTombstone> range_dels;
+    if (status.ok()) {
+      status = AppendRangeTombstones(
+          table_cache_->NewRangeTombstoneIterator(t.meta.number,
+                                                  t.meta.file_size),
+          &range_dels);
+    }
+    for (const RangeTombstone& r : range_dels) {
+      AddRangeTombstone(r, &t, &empty);
+    }
+    t.meta.num_range_deletions = range_dels.size();
     Log(options_.info_log, "Table #%llu: %d entries %s",
         (unsigned long long)t.meta.number, counter, status.ToString().c_str());
 
@@ -291,6 +319,23 @@ class Repairer {
     }
   }
 
+  // Widen the range and sequence numbers of *t to those of a tombstone
+  // stored in the table.  *empty tells whether the range is still unset.
+  void AddRangeTombstone(const RangeTombstone& r, TableInfo* t, bool* empty) {
+    const InternalKey start = r.SerializeKey();
+    const InternalKey end = r.SerializeEndKey();
+    if (*empty || icmp_.Compare(start, t->meta.smallest) < 0) {
+      t->meta.smallest = start;
+    }
+    if (*empty || icmp_.Compare(end, t->meta.largest) > 0) {
+      t->meta.largest = end;
+    }
+    *empty = false;
+    if (r.seq > t->max_sequence) {
+      t->max_sequence = r.seq;
+    }
+  }
+
   void RepairTable(const std::string& src, TableInfo t) {
     // We will copy src contents to a new table and then rename the
     // new table over the source.
@@ -307,12 +352,31 @@ class Repairer {
     // Copy data.
     Iterator* iter = NewTableIterator(t.meta);
     int counter = 0;
+    t.meta.num_deletions = 0;
     for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
       builder->Add(iter->key(), iter->value());
       counter++;
+      if (iter->key().size() >= 8 &&
+          ExtractValueType(iter->key()) == kTypeDeletion) {
+        t.meta.num_deletions++;
+      }
     }
+    t.meta.num_entries = counter;
     delete iter;
 
+    // Copy the range tombstones that can still be read
+    std::vector<RangeTombstone> range_dels;
+    AppendRangeTombstones(table_cache_->NewRangeTombstoneIterator(
+                              t.meta.number, t.meta.file_size),
+                          &range_dels);
+    bool empty = (counter == 0);
+    for (const RangeTombstone& r : range_dels) {
+      builder->AddRangeTombstone(r.SerializeKey().Encode(), r.end);
+      AddRangeTombstone(r, &t, &empty);
+      counter++;
+    }
+    t.meta.num_range_deletions = range_dels.size();
+
     ArchiveFile(src);
     if (counter == 0) {
       builder->Abandon();  // Nothing to save
@@ -368,8 +432,7 @@ class Repairer {
     for (size_t i = 0; i < tables_.size(); i++) {
       // TODO(opt): separate out into multiple levels
       const TableInfo& t = tables_[i];
-      edit_.AddFile(0, t.meta.number, t.meta.file_size, t.meta.smallest,
-                    t.meta.largest);
+      edit_.AddFile(0, t.meta);
     }
 
     // std::fprintf(stderr,
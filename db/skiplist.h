@@ -8,7 +8,10 @@
 // Thread safety
 // -------------
 //
-// Writes require external synchronization, most likely a mutex.
+// Insert() requires external synchronization, most likely a mutex.
+// InsertConcurrently() may be called from several threads at the same
+// time, as long as no Insert() runs alongside it and each thread passes
+// its own Splice; nodes are linked in with compare-and-swap.
 // Reads require a guarantee that the SkipList will not be destroyed
 // while the read is in progress.  Apart from that, reads progress
 // without any internal locking or synchronization.
@@ -21,17 +24,31 @@
 //
 // (2) The contents of a Node except for the next/prev pointers are
 // immutable after the Node has been linked into the SkipList.
-// Only Insert() modifies the list, and it is careful to initialize
-// a node and use release-stores to publish the nodes in one or
-// more lists.
+// Only Insert() and InsertConcurrently() modify the list, and they
+// are careful to initialize a node and use release-stores (or
+// release compare-and-swaps) to publish the nodes in one or more lists.
 //
 // ... prev vs. next pointer ordering ...
+//
+// Key prefixes
+// ------------
+//
+// Comparator must provide "uint64_t Prefix(const Key&) const", which maps
+// keys to numbers such that Prefix(a) < Prefix(b) implies a < b.  Each node
+// stores the prefix of its key next to its links, so a search only looks at
+// the key itself (usually a pointer into the arena, and a cache miss) when
+// the prefixes are equal.  A comparator that cannot order keys by a prefix
+// may return the same value for every key.
 
 #include <atomic>
 #include <cassert>
+#include <cstdint>
 #include <cstdlib>
+#include <functional>
+#include <thread>
 
 #include "util/arena.h"
+#include "util/hash.h"
 #include "util/random.h"
 
 namespace leveldb {
@@ -43,6 +60,10 @@ namespace leveldb {
     private:
         struct Node;
 
+        enum {
+            kMaxHeight = 12
+        };
+
     public:
         // Create a new SkipList object that will use "cmp" for comparing keys,
         // and will allocate memory using "*arena".  Objects allocated in the arena
@@ -53,13 +74,65 @@ namespace leveldb {
 
         SkipList &operator=(const SkipList &) = delete;
 
-        // Insert key into the list.
+        // Insert key into the list.  Inserting keys in ascending order (e.g.
+        // a sequential bulk load) is cheap, since a key that lands right after
+        // the previously inserted one is found without a top-down search.
         // REQUIRES: nothing that compares equal to key is currently in the list.
         void Insert(const Key &key);
 
+        // Per-thread state for InsertConcurrently().  Remembers the neighbours
+        // of the key most recently inserted through it, so that a thread
+        // inserting keys in roughly ascending order only has to search the
+        // lowest levels of the list.  A Splice must not be shared between
+        // threads, and must only be used with a single list.
+        class Splice {
+        public:
+            Splice() : height_(0), rnd_(NewSeed()) {}
+
+            Splice(const Splice &) = delete;
+
+            Splice &operator=(const Splice &) = delete;
+
+        private:
+            friend class SkipList;
+
+            // Return a seed for rnd_ that differs between all splices of the
+            // process, including ones created in turn at the same address
+            // (e.g. one per write batch on the stack), so that their nodes do
+            // not all get the same heights.
+            static uint32_t NewSeed() {
+                static std::atomic<uint32_t> next_seed(0);
+                const uint32_t n = next_seed.fetch_add(1, std::memory_order_relaxed);
+                const size_t thread_hash =
+                        std::hash<std::thread::id>()(std::this_thread::get_id());
+                return Hash(reinterpret_cast<const char *>(&n), sizeof(n),
+                            static_cast<uint32_t>(thread_hash));
+            }
+
+            // prev_[i] and next_[i] for i in [0..height_] are a guess at the
+            // nodes surrounding the next key at level i.  prev_[height_] is
+            // always head_ and next_[height_] always nullptr.
+            int height_;
+            Node *prev_[kMaxHeight + 1];
+            Node *next_[kMaxHeight + 1];
+
+            // Used for node heights, since rnd_ may only be used by Insert().
+            Random rnd_;
+        };
+
+        // Like Insert(), but may be called from several threads at the same
+        // time.  Each thread must pass its own "*splice".
+        // REQUIRES: nothing that compares equal to key is currently in the list,
+        // and no Insert() call is in progress.
+        void InsertConcurrently(const Key &key, Splice *splice);
+
         // Returns true iff an entry that compares equal to key is in the list.
         bool Contains(const Key &key) const;
 
+        // Return the number of nodes linked in at "level"; every node is at
+        // level 0.  For tests, while nothing is being inserted.
+        size_t TEST_CountNodesAtLevel(int level) const;
+
         // Iteration over the contents of a skip list
         class Iterator {
         public:
@@ -100,22 +173,22 @@ namespace leveldb {
         };
 
     private:
-        enum {
-            kMaxHeight = 12
-        };
-
         inline int GetMaxHeight() const {
             return max_height_.load(std::memory_order_relaxed);
         }
 
-        Node *NewNode(const Key &key, int height);
+        // If "concurrent" is true, the node memory is allocated in a way
+        // that is safe against other threads allocating from the same arena.
+        Node *NewNode(const Key &key, uint64_t prefix, int height,
+                      bool concurrent = false);
 
-        int RandomHeight();
+        int RandomHeight(Random *rnd);
 
         bool Equal(const Key &a, const Key &b) const { return (compare_(a, b) == 0); }
 
-        // Return true if key is greater than the data stored in "n"
-        bool KeyIsAfterNode(const Key &key, Node *n) const;
+        // Return true if key is greater than the data stored in "n".
+        // "prefix" must be compare_.Prefix(key).
+        bool KeyIsAfterNode(const Key &key, uint64_t prefix, Node *n) const;
 
         // Return the earliest node that comes at or after key.
         // Return nullptr if there is no such node.
@@ -132,26 +205,44 @@ namespace leveldb {
         // Return head_ if list is empty.
         Node *FindLast() const;
 
+        // Starting at "before", which must precede key, walk the list at
+        // "level" and store in *out_prev and *out_next the nodes between which
+        // key belongs.  The walk stops early when it reaches "after", which
+        // must be nullptr or a node at or after key.
+        void FindSpliceForLevel(const Key &key, uint64_t prefix, Node *before,
+                                Node *after, int level, Node **out_prev,
+                                Node **out_next) const;
+
+        // Bring *splice up to date for key on every level in [0..max_height-1],
+        // reusing as many of its cached levels as still bracket key.
+        // REQUIRES: max_height <= GetMaxHeight()
+        void FindSplice(const Key &key, uint64_t prefix, Splice *splice,
+                        int max_height) const;
+
         // Immutable after construction
         Comparator const compare_;
         Arena *const arena_;  // Arena used for allocations of nodes
 
         Node *const head_;
 
-        // Modified only by Insert().  Read racily by readers, but stale
-        // values are ok.
+        // Modified only by Insert() and InsertConcurrently().  Read racily by
+        // readers, but stale values are ok.
         std::atomic<int> max_height_;  // Height of the entire list
 
         // Read/written only by Insert().
         Random rnd_;
+
+        // Position of the previous Insert().  Read/written only by Insert().
+        Splice last_insert_;
     };
 
 // Implementation details follow
     template<typename Key, class Comparator>
     struct SkipList<Key, Comparator>::Node {
-        explicit Node(const Key &k) : key(k) {}
+        Node(const Key &k, uint64_t p) : key(k), prefix(p) {}
 
         Key const key;
+        uint64_t const prefix;  // Comparator::Prefix(key)
 
         // Accessors/mutators for links.  Wrapped in methods so we can
         // add the appropriate barriers as necessary.
@@ -180,6 +271,15 @@ namespace leveldb {
             next_[n].store(x, std::memory_order_relaxed);
         }
 
+        // Link "x" in at level n if the current successor is still "expected".
+        // Release semantics on success, like SetNext().
+        bool CASNext(int n, Node *expected, Node *x) {
+            assert(n >= 0);
+            return next_[n].compare_exchange_strong(expected, x,
+                                                    std::memory_order_release,
+                                                    std::memory_order_relaxed);
+        }
+
     private:
         // Array of length equal to the node height.  next_[0] is lowest level link.
         std::atomic<Node *> next_[1];
@@ -187,10 +287,12 @@ namespace leveldb {
 
     template<typename Key, class Comparator>
     typename SkipList<Key, Comparator>::Node *SkipList<Key, Comparator>::NewNode(
-            const Key &key, int height) {
-        char *const node_memory = arena_->AllocateAligned(
-                sizeof(Node) + sizeof(std::atomic<Node *>) * (height - 1));
-        return new(node_memory) Node(key);
+            const Key &key, uint64_t prefix, int height, bool concurrent) {
+        const size_t size = sizeof(Node) + sizeof(std::atomic<Node *>) * (height - 1);
+        char *const node_memory = concurrent
+                                  ? arena_->AllocateAlignedConcurrently(size)
+                                  : arena_->AllocateAligned(size);
+        return new(node_memory) Node(key, prefix);
     }
 
     template<typename Key, class Comparator>
@@ -246,11 +348,11 @@ namespace leveldb {
     }
 
     template<typename Key, class Comparator>
-    int SkipList<Key, Comparator>::RandomHeight() {
+    int SkipList<Key, Comparator>::RandomHeight(Random *rnd) {
         // Increase height with probability 1 in kBranching
         static const unsigned int kBranching = 4;
         int height = 1;
-        while (height < kMaxHeight && ((rnd_.Next() % kBranching) == 0)) {
+        while (height < kMaxHeight && ((rnd->Next() % kBranching) == 0)) {
             height++;
         }
         assert(height > 0);
@@ -259,20 +361,29 @@ namespace leveldb {
     }
 
     template<typename Key, class Comparator>
-    bool SkipList<Key, Comparator>::KeyIsAfterNode(const Key &key, Node *n) const {
+    bool SkipList<Key, Comparator>::KeyIsAfterNode(const Key &key,
+                                                   uint64_t prefix,
+                                                   Node *n) const {
         // null n is considered infinite
-        return (n != nullptr) && (compare_(n->key, key) < 0);
+        if (n == nullptr) {
+            return false;
+        } else if (n->prefix != prefix) {
+            return n->prefix < prefix;
+        } else {
+            return compare_(n->key, key) < 0;
+        }
     }
 
     template<typename Key, class Comparator>
     typename SkipList<Key, Comparator>::Node *
     SkipList<Key, Comparator>::FindGreaterOrEqual(const Key &key,
                                                   Node **prev) const {
+        const uint64_t prefix = compare_.Prefix(key);
         Node *x = head_;
         int level = GetMaxHeight() - 1;
         while (true) {
             Node *next = x->Next(level);
-            if (KeyIsAfterNode(key, next)) {
+            if (KeyIsAfterNode(key, prefix, next)) {
                 // Keep searching in this list
                 x = next;
             } else {
@@ -290,12 +401,13 @@ namespace leveldb {
     template<typename Key, class Comparator>
     typename SkipList<Key, Comparator>::Node *
     SkipList<Key, Comparator>::FindLessThan(const Key &key) const {
+        const uint64_t prefix = compare_.Prefix(key);
         Node *x = head_;
         int level = GetMaxHeight() - 1;
         while (true) {
             assert(x == head_ || compare_(x->key, key) < 0);
             Node *next = x->Next(level);
-            if (next == nullptr || compare_(next->key, key) >= 0) {
+            if (!KeyIsAfterNode(key, prefix, next)) {
                 if (level == 0) {
                     return x;
                 } else {
@@ -328,11 +440,69 @@ namespace leveldb {
         }
     }
 
+    template<typename Key, class Comparator>
+    void SkipList<Key, Comparator>::FindSpliceForLevel(const Key &key,
+                                                       uint64_t prefix,
+                                                       Node *before, Node *after,
+                                                       int level, Node **out_prev,
+                                                       Node **out_next) const {
+        while (true) {
+            Node *next = before->Next(level);
+            if (next == after || !KeyIsAfterNode(key, prefix, next)) {
+                *out_prev = before;
+                *out_next = next;
+                return;
+            }
+            before = next;
+        }
+    }
+
+    template<typename Key, class Comparator>
+    void SkipList<Key, Comparator>::FindSplice(const Key &key, uint64_t prefix,
+                                               Splice *splice,
+                                               int max_height) const {
+        // Find the lowest level at which the cached splice still brackets
+        // key.  Everything below it has to be searched again, starting from
+        // the nodes the splice remembers at that level.
+        int recompute_height = 0;
+        if (splice->height_ < max_height) {
+            // Never used, or the list has grown taller since: search it all.
+            splice->prev_[max_height] = head_;
+            splice->next_[max_height] = nullptr;
+            splice->height_ = max_height;
+            recompute_height = max_height;
+        } else {
+            while (recompute_height < max_height) {
+                Node *prev = splice->prev_[recompute_height];
+                Node *next = splice->next_[recompute_height];
+                if (prev->Next(recompute_height) != next) {
+                    // Other keys were inserted here since the splice was
+                    // recorded.  Fixing it up at this level could take long,
+                    // so move up to a level that is still tight.
+                    recompute_height++;
+                } else if (prev != head_ && !KeyIsAfterNode(key, prefix, prev)) {
+                    // key is before the splice
+                    recompute_height++;
+                } else if (KeyIsAfterNode(key, prefix, next)) {
+                    // key is after the splice
+                    recompute_height++;
+                } else {
+                    break;
+                }
+            }
+        }
+        for (int i = recompute_height - 1; i >= 0; i--) {
+            FindSpliceForLevel(key, prefix, splice->prev_[i + 1],
+                               splice->next_[i + 1], i, &splice->prev_[i],
+                               &splice->next_[i]);
+        }
+    }
+
     template<typename Key, class Comparator>
     SkipList<Key, Comparator>::SkipList(Comparator cmp, Arena *arena)
             : compare_(cmp),
               arena_(arena),
-              head_(NewNode(0 /* any key will do */, kMaxHeight)),
+              head_(NewNode(0 /* any key will do */, 0, kMaxHeight)),
               max_height_(1),
               rnd_(0xdeadbeef) {
         for (int i = 0; i < kMaxHeight; i++) {
@@ -342,19 +512,23 @@ namespace leveldb {
 
     template<typename Key, class Comparator>
     void SkipList<Key, Comparator>::Insert(const Key &key) {
-        // TODO(opt): We can use a barrier-free variant of FindGreaterOrEqual()
+        // TODO(opt): We can use a barrier-free variant of FindSpliceForLevel()
         // here since Insert() is externally synchronized.
-        Node *prev[kMaxHeight];
-        Node *x = FindGreaterOrEqual(key, prev);
+        const uint64_t prefix = compare_.Prefix(key);
+        int max_height = GetMaxHeight();
+        FindSplice(key, prefix, &last_insert_, max_height);
 
         // Our data structure does not allow duplicate insertion
-        assert(x == nullptr || !Equal(key, x->key));
-
-        int height = RandomHeight();
-        if (height > GetMaxHeight()) {
-            for (int i = GetMaxHeight(); i < height; i++) {
-                prev[i] = head_;
+        assert(last_insert_.next_[0] == nullptr ||
+               !Equal(key, last_insert_.next_[0]->key));
+
+        int height = RandomHeight(&rnd_);
+        if (height > max_height) {
+            for (int i = max_height; i <= height; i++) {
+                last_insert_.prev_[i] = head_;
+                last_insert_.next_[i] = nullptr;
             }
+            last_insert_.height_ = height;
             // It is ok to mutate max_height_ without any synchronization
             // with concurrent readers.  A concurrent reader that observes
             // the new value of max_height_ will see either the old value of
@@ -365,12 +539,59 @@ namespace leveldb {
             max_height_.store(height, std::memory_order_relaxed);
         }
 
-        x = NewNode(key, height);
+        Node *x = NewNode(key, prefix, height);
         for (int i = 0; i < height; i++) {
             // NoBarrier_SetNext() suffices since we will add a barrier when
             // we publish a pointer to "x" in prev[i].
-            x->NoBarrier_SetNext(i, prev[i]->NoBarrier_Next(i));
-            prev[i]->SetNext(i, x);
+            x->NoBarrier_SetNext(i, last_insert_.next_[i]);
+            last_insert_.prev_[i]->SetNext(i, x);
+            // The next key most likely follows x.
+            last_insert_.prev_[i] = x;
+        }
+    }
+
+    template<typename Key, class Comparator>
+    void SkipList<Key, Comparator>::InsertConcurrently(const Key &key,
+                                                       Splice *splice) {
+        const uint64_t prefix = compare_.Prefix(key);
+        const int height = RandomHeight(&splice->rnd_);
+        Node *x = NewNode(key, prefix, height, true);
+
+        // Other threads may be raising max_height_ at the same time, so it
+        // is only ever moved upwards.  Readers cope with a taller list whose
+        // new head_ levels are still nullptr exactly as they do in Insert().
+        int max_height = GetMaxHeight();
+        while (height > max_height) {
+            if (max_height_.compare_exchange_weak(max_height, height,
+                                                  std::memory_order_relaxed)) {
+                max_height = height;
+                break;
+            }
+        }
+
+        FindSplice(key, prefix, splice, max_height);
+
+        // Our data structure does not allow duplicate insertion
+        assert(splice->next_[0] == nullptr || !Equal(key, splice->next_[0]->key));
+
+        // Link x in from the bottom up, so that it becomes visible to readers
+        // in the same order as with Insert().  If another thread wins the race
+        // for a link, search forward from our predecessor at that level (it
+        // still precedes key) and try again.
+        for (int i = 0; i < height; i++) {
+            while (true) {
+                x->NoBarrier_SetNext(i, splice->next_[i]);
+                if (splice->prev_[i]->CASNext(i, splice->next_[i], x)) {
+                    break;
+                }
+                FindSpliceForLevel(key, prefix, splice->prev_[i], nullptr, i,
+                                   &splice->prev_[i], &splice->next_[i]);
+            }
+        }
+
+        // The next key inserted by this thread most likely follows x.
+        for (int i = 0; i < height; i++) {
+            splice->prev_[i] = x;
         }
     }
 
@@ -384,6 +605,16 @@ namespace leveldb {
         }
     }
 
+    template<typename Key, class Comparator>
+    size_t SkipList<Key, Comparator>::TEST_CountNodesAtLevel(int level) const {
+        assert(level >= 0 && level < kMaxHeight);
+        size_t count = 0;
+        for (Node *x = head_->Next(level); x != nullptr; x = x->Next(level)) {
+            count++;
+        }
+        return count;
+    }
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_DB_SKIPLIST_H_
@@ -4,15 +4,19 @@
 
 #include "db/skiplist.h"
 
+#include <algorithm>
 #include <atomic>
 #include <set>
+#include <vector>
 
 #include "gtest/gtest.h"
+#include "benchmark/benchmark.h"
 #include "leveldb/env.h"
 #include "port/port.h"
 #include "port/thread_annotations.h"
 #include "util/arena.h"
 #include "util/hash.h"
+#include "util/mutexlock.h"
 #include "util/random.h"
 #include "util/testutil.h"
 
@@ -30,6 +34,7 @@ struct Comparator {
       return 0;
     }
   }
+  uint64_t Prefix(const Key& k) const { return k; }
 };
 
 TEST(SkipTest, Empty) {
@@ -365,9 +370,230 @@ TEST(SkipTest, Concurrent3) { RunConcurrent(3); }
 TEST(SkipTest, Concurrent4) { RunConcurrent(4); }
 TEST(SkipTest, Concurrent5) { RunConcurrent(5); }
 
+// Several threads fill one list through InsertConcurrently(), each with its
+// own Splice, while a reader keeps checking that the list stays sorted.
+class ConcurrentInsertState {
+ public:
+  ConcurrentInsertState(int num_writers, int keys_per_writer,
+                        bool splice_per_key = false)
+      : list(Comparator(), &arena),
+        num_writers(num_writers),
+        keys_per_writer(keys_per_writer),
+        splice_per_key(splice_per_key),
+        quit_reader(false),
+        next_writer_(0),
+        running_(0),
+        done_cv_(&mu_) {}
+
+  Arena arena;
+  SkipList<Key, Comparator> list;
+  const int num_writers;
+  const int keys_per_writer;
+  // Insert every key with a fresh Splice, as a batch of a single key does.
+  const bool splice_per_key;
+  std::atomic<bool> quit_reader;
+
+  // Writer w inserts the keys that are congruent to w modulo num_writers,
+  // in ascending order for even w and in random order for odd w, so that
+  // both the cached and the recomputed splice paths are exercised.
+  static void Writer(void* arg) {
+    ConcurrentInsertState* state = reinterpret_cast<ConcurrentInsertState*>(arg);
+    const int w = state->next_writer_.fetch_add(1);
+    std::vector<Key> keys;
+    for (int i = 0; i < state->keys_per_writer; i++) {
+      keys.push_back(static_cast<Key>(i) * state->num_writers + w);
+    }
+    if (w % 2 == 1) {
+      Random rnd(test::RandomSeed() + w);
+      for (size_t i = keys.size() - 1; i > 0; i--) {
+        std::swap(keys[i], keys[rnd.Uniform(i + 1)]);
+      }
+    }
+    SkipList<Key, Comparator>::Splice splice;
+    for (Key key : keys) {
+      if (state->splice_per_key) {
+        SkipList<Key, Comparator>::Splice key_splice;
+        state->list.InsertConcurrently(key, &key_splice);
+      } else {
+        state->list.InsertConcurrently(key, &splice);
+      }
+    }
+    state->Done();
+  }
+
+  static void Reader(void* arg) {
+    ConcurrentInsertState* state = reinterpret_cast<ConcurrentInsertState*>(arg);
+    while (!state->quit_reader.load(std::memory_order_acquire)) {
+      SkipList<Key, Comparator>::Iterator iter(&state->list);
+      Key last = 0;
+      bool first = true;
+      for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+        if (!first) {
+          EXPECT_LT(last, iter.key());
+        }
+        last = iter.key();
+        first = false;
+      }
+    }
+    state->Done();
+  }
+
+  void Start(void (*function)(void*)) {
+    mu_.Lock();
+    running_++;
+    mu_.Unlock();
+    Env::Default()->StartThread(function, this);
+  }
+
+  void WaitForThreads() {
+    mu_.Lock();
+    while (running_ > 0) {
+      done_cv_.Wait();
+    }
+    mu_.Unlock();
+  }
+
+ private:
+  void Done() {
+    mu_.Lock();
+    running_--;
+    done_cv_.SignalAll();
+    mu_.Unlock();
+  }
+
+  std::atomic<int> next_writer_;
+  port::Mutex mu_;
+  int running_ GUARDED_BY(mu_);
+  port::CondVar done_cv_ GUARDED_BY(mu_);
+};
+
+TEST(SkipTest, ConcurrentInsert) {
+  for (int run = 0; run < 20; run++) {
+    ConcurrentInsertState state(4, 2000);
+    state.Start(ConcurrentInsertState::Reader);
+    for (int i = 0; i < state.num_writers; i++) {
+      state.Start(ConcurrentInsertState::Writer);
+    }
+    // Let the reader run until the writers are done.
+    while (true) {
+      SkipList<Key, Comparator>::Iterator iter(&state.list);
+      int count = 0;
+      for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+        count++;
+      }
+      if (count == state.num_writers * state.keys_per_writer) {
+        break;
+      }
+      Env::Default()->SleepForMicroseconds(1000);
+    }
+    state.quit_reader.store(true, std::memory_order_release);
+    state.WaitForThreads();
+
+    SkipList<Key, Comparator>::Iterator iter(&state.list);
+    iter.SeekToFirst();
+    for (int i = 0; i < state.num_writers * state.keys_per_writer; i++) {
+      ASSERT_TRUE(iter.Valid());
+      ASSERT_EQ(static_cast<Key>(i), iter.key());
+      iter.Next();
+    }
+    ASSERT_TRUE(!iter.Valid());
+  }
+}
+
+TEST(SkipTest, ConcurrentInsertHeights) {
+  // A new Splice for every key must still give each node a height of its
+  // own: about 1 in 4 nodes reach level 1, and 1 in 16 level 2.
+  ConcurrentInsertState state(4, 4000, true);
+  for (int i = 0; i < state.num_writers; i++) {
+    state.Start(ConcurrentInsertState::Writer);
+  }
+  state.WaitForThreads();
+
+  const size_t n = state.num_writers * state.keys_per_writer;
+  ASSERT_EQ(n, state.list.TEST_CountNodesAtLevel(0));
+  const size_t level1 = state.list.TEST_CountNodesAtLevel(1);
+  ASSERT_GT(level1, n / 8);
+  ASSERT_LT(level1, n / 2);
+  const size_t level2 = state.list.TEST_CountNodesAtLevel(2);
+  ASSERT_GT(level2, n / 32);
+  ASSERT_LT(level2, n / 8);
+}
+
+// Insert "num_keys" random keys from "num_threads" threads, either through
+// Insert() serialized by a mutex or through InsertConcurrently().
+struct InsertBenchmarkState {
+  InsertBenchmarkState(int num_threads, int num_keys, bool concurrent)
+      : list(Comparator(), &arena),
+        num_threads(num_threads),
+        keys_per_thread(num_keys / num_threads),
+        concurrent(concurrent),
+        next_thread(0),
+        running(num_threads),
+        done_cv(&mu) {}
+
+  Arena arena;
+  SkipList<Key, Comparator> list;
+  const int num_threads;
+  const int keys_per_thread;
+  const bool concurrent;
+  std::atomic<int> next_thread;
+  port::Mutex mu;
+  int running GUARDED_BY(mu);
+  port::CondVar done_cv GUARDED_BY(mu);
+};
+
+static void InsertBenchmarkThread(void* arg) {
+  InsertBenchmarkState* state = reinterpret_cast<InsertBenchmarkState*>(arg);
+  const int t = state->next_thread.fetch_add(1);
+  Random rnd(301 + t);
+  SkipList<Key, Comparator>::Splice splice;
+  for (int i = 0; i < state->keys_per_thread; i++) {
+    // Distinct across threads since the low bits hold the thread number.
+    const Key key = (static_cast<Key>(rnd.Next()) << 32 | i) * state->num_threads + t;
+    if (state->concurrent) {
+      state->list.InsertConcurrently(key, &splice);
+    } else {
+      MutexLock l(&state->mu);
+      state->list.Insert(key);
+    }
+  }
+  MutexLock l(&state->mu);
+  if (--state->running == 0) {
+    state->done_cv.Signal();
+  }
+}
+
+static void BM_SkipListInsert(benchmark::State& state, bool concurrent) {
+  const int num_threads = state.range(0);
+  const int kNumKeys = 100000;
+  for (auto st : state) {
+    InsertBenchmarkState bench(num_threads, kNumKeys, concurrent);
+    for (int i = 0; i < num_threads; i++) {
+      Env::Default()->StartThread(InsertBenchmarkThread, &bench);
+    }
+    MutexLock l(&bench.mu);
+    while (bench.running > 0) {
+      bench.done_cv.Wait();
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * kNumKeys);
+}
+
+static void BM_SkipListInsertLocked(benchmark::State& state) {
+  BM_SkipListInsert(state, false);
+}
+
+static void BM_SkipListInsertConcurrently(benchmark::State& state) {
+  BM_SkipListInsert(state, true);
+}
+
+BENCHMARK(BM_SkipListInsertLocked)->Arg(1)->Arg(4)->UseRealTime();
+BENCHMARK(BM_SkipListInsertConcurrently)->Arg(1)->Arg(4)->UseRealTime();
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
   testing::InitGoogleTest(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
   return RUN_ALL_TESTS();
 }
@@ -5,6 +5,8 @@
 #ifndef STORAGE_LEVELDB_DB_SNAPSHOT_H_
 #define STORAGE_LEVELDB_DB_SNAPSHOT_H_
 
+#include <vector>
+
 #include "db/dbformat.h"
 #include "leveldb/db.h"
 
@@ -53,6 +55,17 @@ class SnapshotList {
     return head_.prev_;
   }
 
+  // Store in *sequences the distinct sequence numbers of the snapshots,
+  // oldest first.
+  void GetSequenceNumbers(std::vector<SequenceNumber>* sequences) const {
+    sequences->clear();
+    for (const SnapshotImpl* s = head_.next_; s != &head_; s = s->next_) {
+      if (sequences->empty() || sequences->back() != s->sequence_number_) {
+        sequences->push_back(s->sequence_number_);
+      }
+    }
+  }
+
   // Creates a SnapshotImpl and appends it to the end of the list.
   SnapshotImpl* New(SequenceNumber sequence_number) {
     assert(empty() || newest()->sequence_number_ <= sequence_number);
@@ -4,7 +4,11 @@
 
 #include "db/table_cache.h"
 
+#include <algorithm>
+#include <atomic>
+
 #include "db/filename.h"
+#include "db/range_tombstone.h"
 #include "leveldb/env.h"
 #include "leveldb/table.h"
 #include "util/coding.h"
@@ -14,10 +18,14 @@ namespace leveldb {
     struct TableAndFile {
         RandomAccessFile *file;
         Table *table;
+        // Range tombstones of the table, built by the first lookup that
+        // needs them.
+        std::atomic<const RangeTombstoneSet *> range_dels;
     };
 
     static void DeleteEntry(const Slice &key, void *value) {
         TableAndFile *tf = reinterpret_cast<TableAndFile *>(value);
+        delete tf->range_dels.load(std::memory_order_relaxed);
         delete tf->table;
         delete tf->file;
         delete tf;
@@ -69,6 +77,7 @@ namespace leveldb {
                 TableAndFile *tf = new TableAndFile;
                 tf->file = file;
                 tf->table = table;
+                tf->range_dels.store(nullptr, std::memory_order_relaxed);
                 *handle = cache_->Insert(key, tf, 1, &DeleteEntry);
             }
         }
@@ -97,6 +106,57 @@ namespace leveldb {
         return result;
     }
 
+    Iterator *TableCache::NewRangeTombstoneIterator(uint64_t file_number,
+                                                    uint64_t file_size) {
+        Cache::Handle *handle = nullptr;
+        Status s = FindTable(file_number, file_size, &handle);
+        if (!s.ok()) {
+            return NewErrorIterator(s);
+        }
+
+        Table *table = reinterpret_cast<TableAndFile *>(cache_->Value(handle))->table;
+        Iterator *result = table->NewRangeTombstoneIterator();
+        result->RegisterCleanup(&UnrefEntry, cache_, handle);
+        return result;
+    }
+
+    Status TableCache::UpdateMaxCoveringTombstoneSeq(
+            uint64_t file_number, uint64_t file_size, const Comparator *ucmp,
+            const Slice &user_key, SequenceNumber upper,
+            SequenceNumber *max_covering_seq) {
+        Cache::Handle *handle = nullptr;
+        Status s = FindTable(file_number, file_size, &handle);
+        if (!s.ok()) {
+            return s;
+        }
+
+        TableAndFile *tf = reinterpret_cast<TableAndFile *>(cache_->Value(handle));
+        const RangeTombstoneSet *range_dels =
+                tf->range_dels.load(std::memory_order_acquire);
+        if (range_dels == nullptr) {
+            // Concurrent lookups may build the set at the same time; the
+            // first one to finish publishes it.
+            std::vector<RangeTombstone> tombstones;
+            s = AppendRangeTombstones(tf->table->NewRangeTombstoneIterator(),
+                                      &tombstones);
+            if (s.ok()) {
+                RangeTombstoneSet *built = new RangeTombstoneSet(ucmp, tombstones);
+                if (tf->range_dels.compare_exchange_strong(
+                        range_dels, built, std::memory_order_acq_rel)) {
+                    range_dels = built;
+                } else {
+                    delete built;
+                }
+            }
+        }
+        if (s.ok()) {
+            *max_covering_seq = std::max(
+                    *max_covering_seq, range_dels->MaxCoveringSequence(user_key, upper));
+        }
+        cache_->Release(handle);
+        return s;
+    }
+
     Status TableCache::Get(const ReadOptions &options, uint64_t file_number,
                            uint64_t file_size, const Slice &k, void *arg,
                            void (*handle_result)(void *, const Slice &,
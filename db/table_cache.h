@@ -34,6 +34,22 @@ class TableCache {
   Iterator* NewIterator(const ReadOptions& options, uint64_t file_number,
                         uint64_t file_size, Table** tableptr = nullptr);
 
+  // Return an iterator over the range tombstones of the specified file (see
+  // db/range_tombstone.h).
+  Iterator* NewRangeTombstoneIterator(uint64_t file_number,
+                                      uint64_t file_size);
+
+  // Raise *max_covering_seq to the largest sequence number <= "upper" of
+  // the range tombstones of the specified file that cover "user_key", which
+  // is ordered by "ucmp".  The tombstones are fragmented when first needed
+  // and kept with the cached table, so a lookup is a binary search.
+  Status UpdateMaxCoveringTombstoneSeq(uint64_t file_number,
+                                       uint64_t file_size,
+                                       const Comparator* ucmp,
+                                       const Slice& user_key,
+                                       SequenceNumber upper,
+                                       SequenceNumber* max_covering_seq);
+
   // If a seek to internal key "k" in specified file finds an entry,
   // call (*handle_result)(arg, found_key, found_value).
   Status Get(const ReadOptions& options, uint64_t file_number,
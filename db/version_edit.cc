@@ -20,7 +20,19 @@ enum Tag {
   kDeletedFile = 6,
   kNewFile = 7,
   // 8 was used for large value refs
-  kPrevLogNumber = 9
+  kPrevLogNumber = 9,
+  kNewFile2 = 10  // kNewFile followed by optional fields
+};
+
+// Optional fields of a kNewFile2 entry.  Each field is written as its tag
+// followed by a length-prefixed value, and the list ends with kTerminate.
+// These numbers are written to disk and should not be changed.
+enum NewFileField {
+  kTerminate = 1,
+  kCreationTime = 2,
+  kRangeDeletions = 3,
+  kNumEntries = 4,
+  kNumDeletions = 5
 };
 
 void VersionEdit::Clear() {
@@ -74,12 +86,44 @@ void VersionEdit::EncodeTo(std::string* dst) const {
 
   for (size_t i = 0; i < new_files_.size(); i++) {
     const FileMetaData& f = new_files_[i].second;
-    PutVarint32(dst, kNewFile);
+    // Stick to kNewFile when there are no optional fields, so that older
+    // versions can still read the descriptor.
+    const bool has_fields =
+        (f.creation_time != 0 || f.num_range_deletions != 0 ||
+         f.num_entries != 0 || f.num_deletions != 0);
+    PutVarint32(dst, has_fields ? kNewFile2 : kNewFile);
     PutVarint32(dst, new_files_[i].first);  // level
     PutVarint64(dst, f.number);
     PutVarint64(dst, f.file_size);
     PutLengthPrefixedSlice(dst, f.smallest.Encode());
     PutLengthPrefixedSlice(dst, f.largest.Encode());
+    if (has_fields) {
+      std::string value;
+      if (f.creation_time != 0) {
+        PutVarint64(&value, f.creation_time);
+        PutVarint32(dst, kCreationTime);
+        PutLengthPrefixedSlice(dst, value);
+      }
+      if (f.num_range_deletions != 0) {
+        value.clear();
+        PutVarint64(&value, f.num_range_deletions);
+        PutVarint32(dst, kRangeDeletions);
+        PutLengthPrefixedSlice(dst, value);
+      }
+      if (f.num_entries != 0) {
+        value.clear();
+        PutVarint64(&value, f.num_entries);
+        PutVarint32(dst, kNumEntries);
+        PutLengthPrefixedSlice(dst, value);
+      }
+      if (f.num_deletions != 0) {
+        value.clear();
+        PutVarint64(&value, f.num_deletions);
+        PutVarint32(dst, kNumDeletions);
+        PutLengthPrefixedSlice(dst, value);
+      }
+      PutVarint32(dst, kTerminate);
+    }
   }
 }
 
@@ -92,6 +136,49 @@ static bool GetInternalKey(Slice* input, InternalKey* dst) {
   }
 }
 
+// Parse the optional fields of a kNewFile2 entry into *f.
+static bool GetNewFileFields(Slice* input, FileMetaData* f) {
+  uint32_t field;
+  Slice value;
+  while (GetVarint32(input, &field)) {
+    if (field == kTerminate) {
+      return true;
+    } else if (!GetLengthPrefixedSlice(input, &value)) {
+      return false;
+    }
+    switch (field) {
+      case kCreationTime:
+        if (!GetVarint64(&value, &f->creation_time)) {
+          return false;
+        }
+        break;
+
+      case kRangeDeletions:
+        if (!GetVarint64(&value, &f->num_range_deletions)) {
+          return false;
+        }
+        break;
+
+      case kNumEntries:
+        if (!GetVarint64(&value, &f->num_entries)) {
+          return false;
+        }
+        break;
+
+      case kNumDeletions:
+        if (!GetVarint64(&value, &f->num_deletions)) {
+          return false;
+        }
+        break;
+
+      default:
+        // A field added by a newer version; all of them are optional.
+        break;
+    }
+  }
+  return false;
+}
+
 static bool GetLevel(Slice* input, int* level) {
   uint32_t v;
   if (GetVarint32(input, &v) && v < config::kNumLevels) {
@@ -175,10 +262,16 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
         break;
 
       case kNewFile:
+      case kNewFile2:
+        f.creation_time = 0;
+        f.num_range_deletions = 0;
+        f.num_entries = 0;
+        f.num_deletions = 0;
         if (GetLevel(&input, &level) && GetVarint64(&input, &f.number) &&
             GetVarint64(&input, &f.file_size) &&
             GetInternalKey(&input, &f.smallest) &&
-            GetInternalKey(&input, &f.largest)) {
+            GetInternalKey(&input, &f.largest) &&
+            (tag == kNewFile || GetNewFileFields(&input, &f))) {
           new_files_.push_back(std::make_pair(level, f));
         } else {
           msg = "new-file entry";
@@ -249,6 +342,20 @@ std::string VersionEdit::DebugString() const {
     r.append(f.smallest.DebugString());
     r.append(" .. ");
     r.append(f.largest.DebugString());
+    if (f.creation_time != 0) {
+      r.append(" created ");
+      AppendNumberTo(&r, f.creation_time);
+    }
+    if (f.num_range_deletions != 0) {
+      r.append(" range-deletions ");
+      AppendNumberTo(&r, f.num_range_deletions);
+    }
+    if (f.num_entries != 0) {
+      r.append(" entries ");
+      AppendNumberTo(&r, f.num_entries);
+      r.append(" deletions ");
+      AppendNumberTo(&r, f.num_deletions);
+    }
   }
   r.append("\n}\n");
   return r;
@@ -16,7 +16,15 @@ namespace leveldb {
     class VersionSet;
 
     struct FileMetaData {
-        FileMetaData() : refs(0), allowed_seeks(1 << 30), file_size(0) {}
+        FileMetaData()
+                : refs(0),
+                  allowed_seeks(1 << 30),
+                  file_size(0),
+                  creation_time(0),
+                  num_range_deletions(0),
+                  num_entries(0),
+                  num_deletions(0),
+                  being_compacted(false) {}
 
         int refs;
         int allowed_seeks;  // Seeks allowed until compaction
@@ -24,6 +32,17 @@ namespace leveldb {
         uint64_t file_size;    // File size in bytes
         InternalKey smallest;  // Smallest internal key served by table
         InternalKey largest;   // Largest internal key served by table
+        // Seconds since the epoch at which the oldest data in the table was
+        // written to a memtable, or 0 if unknown
+        uint64_t creation_time;
+        // Number of range tombstones in the table, whose range they are
+        // part of (see db/range_tombstone.h)
+        uint64_t num_range_deletions;
+        // Number of entries in the table and how many of them are deletion
+        // markers, or 0 if unknown
+        uint64_t num_entries;
+        uint64_t num_deletions;
+        bool being_compacted;  // Input of a running compaction (not persisted)
     };
 
     class VersionEdit {
@@ -76,6 +95,15 @@ namespace leveldb {
             new_files_.push_back(std::make_pair(level, f));
         }
 
+        // Add the persistent fields of "f" at the specified level.
+        void AddFile(int level, const FileMetaData &f) {
+            AddFile(level, f.number, f.file_size, f.smallest, f.largest);
+            new_files_.back().second.creation_time = f.creation_time;
+            new_files_.back().second.num_range_deletions = f.num_range_deletions;
+            new_files_.back().second.num_entries = f.num_entries;
+            new_files_.back().second.num_deletions = f.num_deletions;
+        }
+
         // Delete the specified "file" from the specified "level".
         void RemoveFile(int level, uint64_t file) {
             deleted_files_.insert(std::make_pair(level, file));
@@ -31,6 +31,14 @@ TEST(VersionEditTest, EncodeDecode) {
     edit.SetCompactPointer(i, InternalKey("x", kBig + 900 + i, kTypeValue));
   }
 
+  FileMetaData f;
+  f.number = kBig + 800;
+  f.file_size = kBig + 801;
+  f.smallest = InternalKey("bar", kBig + 802, kTypeValue);
+  f.largest = InternalKey("baz", kBig + 803, kTypeValue);
+  f.creation_time = 1600000000;
+  edit.AddFile(5, f);
+
   edit.SetComparatorName("foo");
   edit.SetLogNumber(kBig + 100);
   edit.SetNextFile(kBig + 200);
@@ -38,6 +46,43 @@ TEST(VersionEditTest, EncodeDecode) {
   TestEncodeDecode(edit);
 }
 
+TEST(VersionEditTest, NewFileFields) {
+  FileMetaData f;
+  f.number = 7;
+  f.file_size = 100;
+  f.smallest = InternalKey("a", 1, kTypeValue);
+  f.largest = InternalKey("b", 2, kTypeValue);
+  VersionEdit edit;
+  edit.AddFile(1, f);
+  f.number = 8;
+  f.creation_time = 1600000000;
+  edit.AddFile(2, f);
+  f.number = 9;
+  f.creation_time = 0;
+  f.num_range_deletions = 3;
+  edit.AddFile(3, f);
+  f.number = 10;
+  f.num_range_deletions = 0;
+  f.num_entries = 50;
+  f.num_deletions = 20;
+  edit.AddFile(4, f);
+
+  TestEncodeDecode(edit);
+
+  std::string encoded;
+  edit.EncodeTo(&encoded);
+  VersionEdit parsed;
+  ASSERT_TRUE(parsed.DecodeFrom(encoded).ok());
+  const std::string debug = parsed.DebugString();
+  const size_t pos = debug.find(" created 1600000000");
+  ASSERT_NE(std::string::npos, pos);
+  ASSERT_EQ(pos, debug.rfind(" created "));
+  ASSERT_LT(debug.find("AddFile: 2 8 "), pos);
+  ASSERT_LT(debug.find("AddFile: 3 9 "), debug.find(" range-deletions 3"));
+  ASSERT_LT(debug.find("AddFile: 4 10 "),
+            debug.find(" entries 50 deletions 20"));
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -7,10 +7,12 @@
 #include <algorithm>
 #include <cstdio>
 
+#include "db/compaction_picker.h"
 #include "db/filename.h"
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/range_tombstone.h"
 #include "db/table_cache.h"
 #include "leveldb/env.h"
 #include "leveldb/table_builder.h"
@@ -31,6 +33,27 @@ namespace leveldb {
         return 10 * TargetFileSize(options);
     }
 
+// Returns true iff none of "files" overlaps more than
+// MaxGrandParentOverlapBytes() of "grandparents".
+    static bool WithinGrandParentOverlap(const Options *options,
+                                         const Comparator *ucmp,
+                                         const std::vector<FileMetaData *> &files,
+                                         const std::vector<FileMetaData *> &grandparents) {
+        for (FileMetaData *f : files) {
+            int64_t overlap = 0;
+            for (FileMetaData *g : grandparents) {
+                if (ucmp->Compare(f->smallest.user_key(), g->largest.user_key()) <= 0 &&
+                    ucmp->Compare(g->smallest.user_key(), f->largest.user_key()) <= 0) {
+                    overlap += g->file_size;
+                }
+            }
+            if (overlap > MaxGrandParentOverlapBytes(options)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
 // Maximum number of bytes in all compacted files.  We avoid expanding
 // the lower level file set of a compaction if it would make the
 // total compaction cover more than this many bytes.
@@ -43,20 +66,27 @@ namespace leveldb {
         // the level-0 compaction threshold based on number of files.
 
         // Result for both level-0 and level-1
-        double result = 10. * 1048576.0;
-        while (level > 1) {
-            result *= 10;
-            level--;
+        double result = static_cast<double>(options->max_bytes_for_level_base);
+        const std::vector<int> &additional =
+                options->max_bytes_for_level_multiplier_additional;
+        for (int i = 1; i < level; i++) {
+            result *= options->max_bytes_for_level_multiplier;
+            if (static_cast<size_t>(i - 1) < additional.size()) {
+                result *= additional[i - 1];
+            }
         }
         return result;
     }
 
-    static uint64_t MaxFileSizeForLevel(const Options *options, int level) {
-        // We could vary per level to reduce number of files?
-        return TargetFileSize(options);
+    uint64_t MaxFileSizeForLevel(const Options *options, int level) {
+        uint64_t result = TargetFileSize(options);
+        for (int i = 1; i < level; i++) {
+            result *= options->target_file_size_multiplier;
+        }
+        return result;
     }
 
-    static int64_t TotalFileSize(const std::vector<FileMetaData *> &files) {
+    int64_t TotalFileSize(const std::vector<FileMetaData *> &files) {
         int64_t sum = 0;
         for (size_t i = 0; i < files.size(); i++) {
             sum += files[i]->file_size;
@@ -64,6 +94,15 @@ namespace leveldb {
         return sum;
     }
 
+    bool AnyBeingCompacted(const std::vector<FileMetaData *> &files) {
+        for (size_t i = 0; i < files.size(); i++) {
+            if (files[i]->being_compacted) {
+                return true;
+            }
+        }
+        return false;
+    }
+
     Version::~Version() {
         assert(refs_ == 0);
 
@@ -260,12 +299,18 @@ namespace leveldb {
             kFound,
             kDeleted,
             kCorrupt,
+            kMerge,
         };
         struct Saver {
             SaverState state;
             const Comparator *ucmp;
             Slice user_key;
             std::string *value;
+            std::vector<std::string> *operands;
+            SequenceNumber merge_sequence;  // Of the last operand found
+            // Entries older than the newest range tombstone found so far
+            // that covers user_key are deleted.
+            SequenceNumber *max_covering_tombstone_seq;
         };
     }  // namespace
     static void SaveValue(void *arg, const Slice &ikey, const Slice &v) {
@@ -275,14 +320,58 @@ namespace leveldb {
             s->state = kCorrupt;
         } else {
             if (s->ucmp->Compare(parsed_key.user_key, s->user_key) == 0) {
-                s->state = (parsed_key.type == kTypeValue) ? kFound : kDeleted;
-                if (s->state == kFound) {
-                    s->value->assign(v.data(), v.size());
+                if (parsed_key.sequence < *s->max_covering_tombstone_seq) {
+                    s->state = kDeleted;
+                    return;
+                }
+                switch (parsed_key.type) {
+                    case kTypeValue:
+                        s->state = kFound;
+                        s->value->assign(v.data(), v.size());
+                        break;
+                    case kTypeDeletion:
+                        s->state = kDeleted;
+                        break;
+                    case kTypeMerge:
+                        s->state = kMerge;
+                        s->operands->push_back(v.ToString());
+                        s->merge_sequence = parsed_key.sequence;
+                        break;
+                    case kTypeRangeDeletion:
+                        break;  // Stored apart from the entries
                 }
             }
         }
     }
 
+    // Append the range tombstones of "files" to *tombstones.
+    static Status AddFileRangeTombstones(TableCache *table_cache,
+                                         const std::vector<FileMetaData *> &files,
+                                         std::vector<RangeTombstone> *tombstones) {
+        for (FileMetaData *f : files) {
+            if (f->num_range_deletions > 0) {
+                Status s = AppendRangeTombstones(
+                        table_cache->NewRangeTombstoneIterator(f->number, f->file_size),
+                        tombstones);
+                if (!s.ok()) {
+                    return s;
+                }
+            }
+        }
+        return Status::OK();
+    }
+
+    Status Version::AddRangeTombstones(std::vector<RangeTombstone> *tombstones) {
+        for (int level = 0; level < config::kNumLevels; level++) {
+            Status s = AddFileRangeTombstones(vset_->table_cache_, files_[level],
+                                              tombstones);
+            if (!s.ok()) {
+                return s;
+            }
+        }
+        return Status::OK();
+    }
+
     static bool NewestFirst(FileMetaData *a, FileMetaData *b) {
         return a->number > b->number;
     }
@@ -331,7 +420,9 @@ namespace leveldb {
     }
 
     Status Version::Get(const ReadOptions &options, const LookupKey &k,
-                        std::string *value, GetStats *stats) {
+                        std::string *value, std::vector<std::string> *operands,
+                        SequenceNumber *max_covering_tombstone_seq,
+                        GetStats *stats) {
         stats->seek_file = nullptr;
         stats->seek_file_level = -1;
 
@@ -339,14 +430,49 @@ namespace leveldb {
             Saver saver;
             GetStats *stats;
             const ReadOptions *options;
-            Slice ikey;
+            std::string ikey;
+            SequenceNumber snapshot;
             FileMetaData *last_file_read;
             int last_file_read_level;
 
+            Version *version;
             VersionSet *vset;
             Status s;
             bool found;
 
+            // Look for the key in "f", following the merge operands found to
+            // the older entries of the key.
+            static void Search(State *state, FileMetaData *f) {
+                if (f->num_range_deletions > 0) {
+                    TableCache *table_cache = state->vset->table_cache_;
+                    state->s = table_cache->UpdateMaxCoveringTombstoneSeq(
+                            f->number, f->file_size, state->saver.ucmp,
+                            state->saver.user_key, state->snapshot,
+                            state->saver.max_covering_tombstone_seq);
+                    if (!state->s.ok()) {
+                        return;
+                    }
+                }
+                state->s = state->vset->table_cache_->Get(*state->options, f->number,
+                                                          f->file_size, state->ikey,
+                                                          &state->saver, SaveValue);
+                while (state->s.ok() && state->saver.state == kMerge) {
+                    if (state->saver.merge_sequence == 0) {
+                        state->saver.state = kDeleted;  // Nothing is older
+                        break;
+                    }
+                    state->ikey.clear();
+                    AppendInternalKey(&state->ikey,
+                                      ParsedInternalKey(state->saver.user_key,
+                                                        state->saver.merge_sequence - 1,
+                                                        kValueTypeForSeek));
+                    state->saver.state = kNotFound;
+                    state->s = state->vset->table_cache_->Get(
+                            *state->options, f->number, f->file_size, state->ikey,
+                            &state->saver, SaveValue);
+                }
+            }
+
             static bool Match(void *arg, int level, FileMetaData *f) {
                 State *state = reinterpret_cast<State *>(arg);
 
@@ -360,9 +486,26 @@ namespace leveldb {
                 state->last_file_read = f;
                 state->last_file_read_level = level;
 
-                state->s = state->vset->table_cache_->Get(*state->options, f->number,
-                                                          f->file_size, state->ikey,
-                                                          &state->saver, SaveValue);
+                const size_t num_operands = state->saver.operands->size();
+                Search(state, f);
+                if (level > 0 && state->s.ok() && state->saver.state == kNotFound &&
+                    state->saver.operands->size() > num_operands) {
+                    // The merge operands found in "f" may sit on top of entries
+                    // in the next files of the level, which can begin with the
+                    // same user key.
+                    const std::vector<FileMetaData *> &files =
+                            state->version->files_[level];
+                    const Comparator *ucmp = state->saver.ucmp;
+                    for (size_t i = FindFile(state->vset->icmp_, files,
+                                             f->largest.Encode()) + 1;
+                         i < files.size() && state->s.ok() &&
+                         state->saver.state == kNotFound &&
+                         ucmp->Compare(files[i]->smallest.user_key(),
+                                       state->saver.user_key) == 0;
+                         i++) {
+                        Search(state, files[i]);
+                    }
+                }
                 if (!state->s.ok()) {
                     state->found = true;
                     return false;
@@ -380,6 +523,8 @@ namespace leveldb {
                                 Status::Corruption("corrupted key for ", state->saver.user_key);
                         state->found = true;
                         return false;
+                    case kMerge:
+                        break;  // Not reached
                 }
 
                 // Not reached. Added to avoid false compilation warnings of
@@ -395,15 +540,21 @@ namespace leveldb {
         state.last_file_read_level = -1;
 
         state.options = &options;
-        state.ikey = k.internal_key();
+        state.ikey = k.internal_key().ToString();
+        state.snapshot = ExtractSequence(k.internal_key());
+        state.version = this;
         state.vset = vset_;
 
         state.saver.state = kNotFound;
         state.saver.ucmp = vset_->icmp_.user_comparator();
         state.saver.user_key = k.user_key();
         state.saver.value = value;
+        state.saver.operands = operands;
+        state.saver.merge_sequence = 0;
+        state.saver.max_covering_tombstone_seq = max_covering_tombstone_seq;
 
-        ForEachOverlapping(state.saver.user_key, state.ikey, &state, &State::Match);
+        ForEachOverlapping(state.saver.user_key, k.internal_key(), &state,
+                           &State::Match);
 
         return state.found ? state.s : Status::NotFound(Slice());
     }
@@ -479,6 +630,12 @@ namespace leveldb {
     int Version::PickLevelForMemTableOutput(const Slice &smallest_user_key,
                                             const Slice &largest_user_key) {
         int level = 0;
+        if (vset_->options_->level_compaction_dynamic_level_bytes ||
+            vset_->options_->compaction_style != kCompactionStyleLevel) {
+            // Levels above the base level are kept empty, and the other
+            // compaction styles keep all of their files in level-0.
+            return level;
+        }
         if (!OverlapInLevel(0, &smallest_user_key, &largest_user_key)) {
             // Push to next level if there is no overlap in next level,
             // and the #bytes overlapping in the level after that are limited.
@@ -489,6 +646,11 @@ namespace leveldb {
                 if (OverlapInLevel(level + 1, &smallest_user_key, &largest_user_key)) {
                     break;
                 }
+                if (vset_->RangeOverlapsRunningCompaction(level + 1, smallest_user_key,
+                                                          largest_user_key)) {
+                    // A running compaction may place files in this range.
+                    break;
+                }
                 if (level + 2 < config::kNumLevels) {
                     // Check that file does not overlap too many grandparent bytes.
                     GetOverlappingInputs(level + 2, &start, &limit, &overlaps);
@@ -755,7 +917,9 @@ namespace leveldb {
               descriptor_file_(nullptr),
               descriptor_log_(nullptr),
               dummy_versions_(this),
-              current_(nullptr) {
+              current_(nullptr),
+              flush_running_(false),
+              picker_(NewCompactionPicker(this, *options)) {
         AppendVersion(new Version(this));
     }
 
@@ -764,6 +928,7 @@ namespace leveldb {
         assert(dummy_versions_.next_ == &dummy_versions_);  // List must be empty
         delete descriptor_log_;
         delete descriptor_file_;
+        delete picker_;
     }
 
     void VersionSet::AppendVersion(Version *v) {
@@ -783,7 +948,23 @@ namespace leveldb {
         v->next_->prev_ = v;
     }
 
+    // A thread waiting in LogAndApply() for its turn to write the MANIFEST.
+    struct VersionSet::ManifestWriter {
+        explicit ManifestWriter(port::Mutex *mu) : cv(mu) {}
+
+        port::CondVar cv;
+    };
+
     Status VersionSet::LogAndApply(VersionEdit *edit, port::Mutex *mu) {
+        // Background compactions may finish concurrently.  Only the writer at
+        // the front of the queue touches the MANIFEST, and every edit is applied
+        // on top of the version installed by the writer before it.
+        ManifestWriter w(mu);
+        manifest_writers_.push_back(&w);
+        while (&w != manifest_writers_.front()) {
+            w.cv.Wait();
+        }
+
         if (edit->has_log_number_) {
             assert(edit->log_number_ >= log_number_);
             assert(edit->log_number_ < next_file_number_);
@@ -865,6 +1046,10 @@ namespace leveldb {
             }
         }
 
+        manifest_writers_.pop_front();
+        if (!manifest_writers_.empty()) {
+            manifest_writers_.front()->cv.Signal();
+        }
         return s;
     }
 
@@ -1039,7 +1224,75 @@ namespace leveldb {
         }
     }
 
+    void VersionSet::CalculateLevelMaxBytes(Version *v) const {
+        if (!options_->level_compaction_dynamic_level_bytes) {
+            v->base_level_ = 1;
+            for (int level = 1; level < config::kNumLevels; level++) {
+                v->level_max_bytes_[level] = MaxBytesForLevel(options_, level);
+            }
+            return;
+        }
+
+        // Derive the limits backwards from the largest level, so that it
+        // holds about (multiplier - 1) / multiplier of the data no matter how
+        // large the DB is.  Levels whose limit would be less than
+        // max_bytes_for_level_base / multiplier are skipped: level-0 is
+        // compacted straight into the first level below them.
+        const double base_bytes_max =
+                static_cast<double>(options_->max_bytes_for_level_base);
+        const double multiplier = options_->max_bytes_for_level_multiplier;
+        const double base_bytes_min = base_bytes_max / multiplier;
+        const int last_level = config::kNumLevels - 1;
+
+        int first_non_empty_level = -1;
+        uint64_t max_level_bytes = 0;
+        for (int level = 1; level <= last_level; level++) {
+            const uint64_t level_bytes = TotalFileSize(v->files_[level]);
+            if (level_bytes > 0 && first_non_empty_level == -1) {
+                first_non_empty_level = level;
+            }
+            max_level_bytes = std::max(max_level_bytes, level_bytes);
+        }
+
+        double base_level_bytes;
+        if (first_non_empty_level == -1) {
+            // Empty DB: level-0 goes straight to the last level.
+            v->base_level_ = last_level;
+            base_level_bytes = base_bytes_max;
+        } else {
+            // The limit of the first non-empty level if the largest level
+            // were the last one and at its limit.
+            double level_bytes = static_cast<double>(max_level_bytes);
+            for (int level = last_level; level > first_non_empty_level; level--) {
+                level_bytes /= multiplier;
+            }
+            v->base_level_ = first_non_empty_level;
+            if (level_bytes <= base_bytes_min) {
+                base_level_bytes = base_bytes_min;
+            } else {
+                // Move the base level up until its limit is small enough.
+                while (v->base_level_ > 1 && level_bytes > base_bytes_max) {
+                    v->base_level_--;
+                    level_bytes /= multiplier;
+                }
+                base_level_bytes = std::min(level_bytes, base_bytes_max);
+            }
+        }
+
+        double limit = base_level_bytes;
+        for (int level = 1; level <= last_level; level++) {
+            if (level > v->base_level_) {
+                limit *= multiplier;
+            }
+            // No level is limited to less than the base size, so that the
+            // levels keep growing downwards.
+            v->level_max_bytes_[level] = std::max(limit, base_bytes_max);
+        }
+    }
+
     void VersionSet::Finalize(Version *v) {
+        CalculateLevelMaxBytes(v);
+
         // Precomputed best level for next compaction
         int best_level = -1;
         double best_score = -1;
@@ -1059,14 +1312,14 @@ namespace leveldb {
                 // setting, or very high compression ratios, or lots of
                 // overwrites/deletions).
                 score = v->files_[level].size() /
-                        static_cast<double>(config::kL0_CompactionTrigger);
+                        static_cast<double>(options_->level0_file_num_compaction_trigger);
             } else {
                 // Compute the ratio of current size to size limit.
                 const uint64_t level_bytes = TotalFileSize(v->files_[level]);
-                score =
-                        static_cast<double>(level_bytes) / MaxBytesForLevel(options_, level);
+                score = static_cast<double>(level_bytes) / v->level_max_bytes_[level];
             }
 
+            v->level_scores_[level] = score;
             if (score > best_score) {
                 best_level = level;
                 best_score = score;
@@ -1075,6 +1328,48 @@ namespace leveldb {
 
         v->compaction_level_ = best_level;
         v->compaction_score_ = best_score;
+
+        // Files that are mostly deletion markers are pushed down to the
+        // levels where the markers and the data they hide can be dropped.
+        v->files_marked_for_compaction_.clear();
+        const double ratio = options_->deletion_ratio_compaction_trigger;
+        if (options_->compaction_style == kCompactionStyleLevel && ratio > 0) {
+            for (int level = 0; level < config::kNumLevels - 1; level++) {
+                for (FileMetaData *f : v->files_[level]) {
+                    if (f->num_entries > 0 &&
+                        f->num_deletions >= f->num_entries * ratio) {
+                        v->files_marked_for_compaction_.emplace_back(level, f);
+                    }
+                }
+            }
+        }
+
+        // Estimate how much data compactions still have to rewrite: level-0
+        // and all of the base level once level-0 is due for compaction, and
+        // then for every level the bytes over its limit, which take as much
+        // of the next level along as their share of their own level.  Bytes
+        // pushed down count towards the size of the next level.
+        uint64_t pending = 0;
+        uint64_t incoming = 0;
+        if (options_->compaction_style == kCompactionStyleFIFO) {
+            // FIFO compaction only ever deletes files.
+        } else if (v->files_[0].size() >=
+            static_cast<size_t>(options_->level0_file_num_compaction_trigger)) {
+            incoming = TotalFileSize(v->files_[0]);
+            pending += incoming + TotalFileSize(v->files_[v->base_level_]);
+        }
+        for (int level = v->base_level_; level < config::kNumLevels - 1; level++) {
+            const uint64_t level_bytes = TotalFileSize(v->files_[level]) + incoming;
+            incoming = 0;
+            const double limit = v->level_max_bytes_[level];
+            if (level_bytes > limit) {
+                incoming = level_bytes - static_cast<uint64_t>(limit);
+                const uint64_t next_bytes = TotalFileSize(v->files_[level + 1]);
+                pending += static_cast<uint64_t>(
+                        incoming * (static_cast<double>(next_bytes) / level_bytes + 1));
+            }
+        }
+        v->pending_compaction_bytes_ = pending;
     }
 
     Status VersionSet::WriteSnapshot(log::Writer *log) {
@@ -1098,7 +1393,7 @@ namespace leveldb {
             const std::vector<FileMetaData *> &files = current_->files_[level];
             for (size_t i = 0; i < files.size(); i++) {
                 const FileMetaData *f = files[i];
-                edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest);
+                edit.AddFile(level, *f);
             }
         }
 
@@ -1157,6 +1452,69 @@ namespace leveldb {
         return result;
     }
 
+    void VersionSet::SplitCompaction(Compaction *c, int max_ranges,
+                                     std::vector<Slice> *boundaries) {
+        boundaries->clear();
+        if (max_ranges <= 1 || c->output_level() == 0) {
+            // Level-0 outputs have to stay a single file.
+            return;
+        }
+        const Comparator *user_cmp = icmp_.user_comparator();
+        std::vector<FileMetaData *> files(c->inputs_[0]);
+        files.insert(files.end(), c->inputs_[1].begin(), c->inputs_[1].end());
+        std::vector<Slice> candidates;
+        for (size_t i = 0; i < files.size(); i++) {
+            candidates.push_back(files[i]->smallest.user_key());
+            candidates.push_back(files[i]->largest.user_key());
+        }
+        std::sort(candidates.begin(), candidates.end(),
+                  [user_cmp](const Slice &a, const Slice &b) {
+                      return user_cmp->Compare(a, b) < 0;
+                  });
+
+        // Walk the candidates in order and cut in front of the first one at
+        // which the input data before it reaches the next multiple of
+        // total/max_ranges.  Cuts that would leave less than half of that
+        // on either side are skipped, as inputs whose bounds all cluster at
+        // the ends of the key space are better compacted as a whole.  Every
+        // user key stays within a single range, so the ranges can be
+        // compacted independently of each other.
+        const uint64_t total = TotalFileSize(files);
+        const uint64_t min_range_bytes = total / (2 * max_ranges);
+        uint64_t last_cut = 0;
+        for (size_t k = 1; k < candidates.size() &&
+                           boundaries->size() + 1 < static_cast<size_t>(max_ranges);
+             k++) {
+            const Slice key = candidates[k];
+            if (user_cmp->Compare(key, candidates.back()) == 0) {
+                break;  // Would leave just the largest key to the last range
+            } else if (user_cmp->Compare(key, candidates[k - 1]) == 0) {
+                continue;
+            }
+            const InternalKey ikey(key, kMaxSequenceNumber, kValueTypeForSeek);
+            uint64_t before = 0;
+            for (size_t i = 0; i < files.size(); i++) {
+                if (user_cmp->Compare(files[i]->largest.user_key(), key) < 0) {
+                    before += files[i]->file_size;
+                } else if (user_cmp->Compare(files[i]->smallest.user_key(), key) < 0) {
+                    Table *tableptr;
+                    Iterator *iter = table_cache_->NewIterator(
+                            ReadOptions(), files[i]->number, files[i]->file_size, &tableptr);
+                    if (tableptr != nullptr) {
+                        before += tableptr->ApproximateOffsetOf(ikey.Encode());
+                    }
+                    delete iter;
+                }
+            }
+            if (before >= total * (boundaries->size() + 1) / max_ranges &&
+                before >= last_cut + min_range_bytes &&
+                before + min_range_bytes <= total) {
+                boundaries->push_back(key);
+                last_cut = before;
+            }
+        }
+    }
+
     void VersionSet::AddLiveFiles(std::set<uint64_t> *live) {
         for (Version *v = dummy_versions_.next_; v != &dummy_versions_;
              v = v->next_) {
@@ -1239,9 +1597,11 @@ namespace leveldb {
         Iterator **list = new Iterator *[space];
         int num = 0;
         for (int which = 0; which < 2; which++) {
-            if (!c->inputs_[which].empty()) {
-                if (c->level() + which == 0) {
-                    const std::vector<FileMetaData *> &files = c->inputs_[which];
+            const std::vector<FileMetaData *> &files =
+                    (which == 1 && c->skips_inputs_) ? c->read_inputs_
+                                                     : c->inputs_[which];
+            if (!files.empty()) {
+                if ((which == 0 ? c->level() : c->output_level()) == 0) {
                     for (size_t i = 0; i < files.size(); i++) {
                         list[num++] = table_cache_->NewIterator(options, files[i]->number,
                                                                 files[i]->file_size);
@@ -1249,7 +1609,7 @@ namespace leveldb {
                 } else {
                     // Create concatenating iterator for the files from this level
                     list[num++] = NewTwoLevelIterator(
-                            new Version::LevelFileNumIterator(icmp_, &c->inputs_[which]),
+                            new Version::LevelFileNumIterator(icmp_, &files),
                             &GetFileIterator, table_cache_, options);
                 }
             }
@@ -1261,57 +1621,82 @@ namespace leveldb {
     }
 
     Compaction *VersionSet::PickCompaction() {
-        Compaction *c;
-        int level;
-
-        // We prefer compactions triggered by too much data in a level over
-        // the compactions triggered by seeks.
-        const bool size_compaction = (current_->compaction_score_ >= 1);
-        const bool seek_compaction = (current_->file_to_compact_ != nullptr);
-        if (size_compaction) {
-            level = current_->compaction_level_;
-            assert(level >= 0);
-            assert(level + 1 < config::kNumLevels);
-            c = new Compaction(options_, level);
-
-            // Pick the first file that comes after compact_pointer_[level]
-            for (size_t i = 0; i < current_->files_[level].size(); i++) {
-                FileMetaData *f = current_->files_[level][i];
-                if (compact_pointer_[level].empty() ||
-                    icmp_.Compare(f->largest.Encode(), compact_pointer_[level]) > 0) {
-                    c->inputs_[0].push_back(f);
-                    break;
-                }
-            }
-            if (c->inputs_[0].empty()) {
-                // Wrap-around to the beginning of the key space
-                c->inputs_[0].push_back(current_->files_[level][0]);
+        Compaction *c = picker_->PickCompaction();
+        if (c != nullptr) {
+            RegisterCompaction(c);
+        }
+        return c;
+    }
+
+    bool VersionSet::NeedsCompaction() const {
+        return picker_->NeedsCompaction();
+    }
+
+    bool VersionSet::RangeOverlapsRunningCompaction(
+            int level, const Slice &smallest_user_key,
+            const Slice &largest_user_key) const {
+        const Comparator *ucmp = icmp_.user_comparator();
+        for (Compaction *r : running_compactions_) {
+            if (r->output_level() == level &&
+                ucmp->Compare(smallest_user_key, r->largest_.user_key()) <= 0 &&
+                ucmp->Compare(largest_user_key, r->smallest_.user_key()) >= 0) {
+                return true;
             }
-        } else if (seek_compaction) {
-            level = current_->file_to_compact_level_;
-            c = new Compaction(options_, level);
-            c->inputs_[0].push_back(current_->file_to_compact_);
-        } else {
-            return nullptr;
         }
+        return false;
+    }
 
-        c->input_version_ = current_;
-        c->input_version_->Ref();
+    bool VersionSet::ConflictsWithRunningCompaction(Compaction *c) const {
+        if (AnyBeingCompacted(c->inputs_[0]) || AnyBeingCompacted(c->inputs_[1])) {
+            return true;
+        }
+        if (c->level() == 0) {
+            // Level-0 files overlap each other, so their relative order is only
+            // preserved if a single compaction works on level-0 at a time.  The
+            // exception is a merge of the newest files within level-0, which
+            // may run next to a compaction of older files out of it.
+            for (Compaction *r : running_compactions_) {
+                if (r->level() == 0 &&
+                    (r->output_level() == 0) == (c->output_level() == 0)) {
+                    return true;
+                }
+            }
+        }
+        return RangeOverlapsRunningCompaction(c->output_level(),
+                                              c->smallest_.user_key(),
+                                              c->largest_.user_key());
+    }
 
-        // Files in level 0 may overlap each other, so pick up all overlapping ones
-        if (level == 0) {
-            InternalKey smallest, largest;
-            GetRange(c->inputs_[0], &smallest, &largest);
-            // Note that the next call will discard the file we placed in
-            // c->inputs_[0] earlier and replace it with an overlapping set
-            // which will include the picked file.
-            current_->GetOverlappingInputs(0, &smallest, &largest, &c->inputs_[0]);
-            assert(!c->inputs_[0].empty());
+    void VersionSet::RegisterCompaction(Compaction *c) {
+        assert(c->running_vset_ == nullptr);
+        for (int which = 0; which < 2; which++) {
+            for (FileMetaData *f : c->inputs_[which]) {
+                assert(!f->being_compacted);
+                f->being_compacted = true;
+            }
         }
+        running_compactions_.insert(c);
+        c->running_vset_ = this;
 
-        SetupOtherInputs(c);
+        // Update the place where we will do the next compaction for this level.
+        // We update this immediately instead of waiting for the VersionEdit
+        // to be applied so that if the compaction fails, we will try a different
+        // key range next time.
+        InternalKey smallest, largest;
+        GetRange(c->inputs_[0], &smallest, &largest);
+        compact_pointer_[c->level()] = largest.Encode().ToString();
+        c->edit_.SetCompactPointer(c->level(), largest);
+    }
 
-        return c;
+    void VersionSet::UnregisterCompaction(Compaction *c) {
+        assert(c->running_vset_ == this);
+        for (int which = 0; which < 2; which++) {
+            for (FileMetaData *f : c->inputs_[which]) {
+                f->being_compacted = false;
+            }
+        }
+        running_compactions_.erase(c);
+        c->running_vset_ = nullptr;
     }
 
 // Finds the largest key in a vector of files. Returns true if files it not
@@ -1340,6 +1725,11 @@ namespace leveldb {
             const InternalKey &largest_key) {
         const Comparator *user_cmp = icmp.user_comparator();
         FileMetaData *smallest_boundary_file = nullptr;
+        if (ExtractSequence(largest_key.Encode()) == kMaxSequenceNumber) {
+            // The range of b1 ends with a range tombstone, which does not
+            // cover user_key(u1) (see RangeTombstone::SerializeEndKey()).
+            return nullptr;
+        }
         for (size_t i = 0; i < level_files.size(); ++i) {
             FileMetaData *f = level_files[i];
             if (icmp.Compare(f->smallest, largest_key) > 0 &&
@@ -1395,21 +1785,22 @@ namespace leveldb {
 
     void VersionSet::SetupOtherInputs(Compaction *c) {
         const int level = c->level();
+        const int output_level = c->output_level();
         InternalKey smallest, largest;
 
         AddBoundaryInputs(icmp_, current_->files_[level], &c->inputs_[0]);
         GetRange(c->inputs_[0], &smallest, &largest);
 
-        current_->GetOverlappingInputs(level + 1, &smallest, &largest,
+        current_->GetOverlappingInputs(output_level, &smallest, &largest,
                                        &c->inputs_[1]);
-        AddBoundaryInputs(icmp_, current_->files_[level + 1], &c->inputs_[1]);
+        AddBoundaryInputs(icmp_, current_->files_[output_level], &c->inputs_[1]);
 
         // Get entire range covered by compaction
         InternalKey all_start, all_limit;
         GetRange2(c->inputs_[0], c->inputs_[1], &all_start, &all_limit);
 
         // See if we can grow the number of inputs in "level" without
-        // changing the number of "level+1" files we pick up.
+        // changing the number of "output_level" files we pick up.
         if (!c->inputs_[1].empty()) {
             std::vector<FileMetaData *> expanded0;
             current_->GetOverlappingInputs(level, &all_start, &all_limit, &expanded0);
@@ -1419,14 +1810,16 @@ namespace leveldb {
             const int64_t expanded0_size = TotalFileSize(expanded0);
             if (expanded0.size() > c->inputs_[0].size() &&
                 inputs1_size + expanded0_size <
-                ExpandedCompactionByteSizeLimit(options_)) {
+                ExpandedCompactionByteSizeLimit(options_) &&
+                !AnyBeingCompacted(expanded0)) {
                 InternalKey new_start, new_limit;
                 GetRange(expanded0, &new_start, &new_limit);
                 std::vector<FileMetaData *> expanded1;
-                current_->GetOverlappingInputs(level + 1, &new_start, &new_limit,
+                current_->GetOverlappingInputs(output_level, &new_start, &new_limit,
                                                &expanded1);
-                AddBoundaryInputs(icmp_, current_->files_[level + 1], &expanded1);
-                if (expanded1.size() == c->inputs_[1].size()) {
+                AddBoundaryInputs(icmp_, current_->files_[output_level], &expanded1);
+                if (expanded1.size() == c->inputs_[1].size() &&
+                    !AnyBeingCompacted(expanded1)) {
                     Log(options_->info_log,
                         "Expanding@%d %d+%d (%ld+%ld bytes) to %d+%d (%ld+%ld bytes)\n",
                         level, int(c->inputs_[0].size()), int(c->inputs_[1].size()),
@@ -1442,96 +1835,157 @@ namespace leveldb {
         }
 
         // Compute the set of grandparent files that overlap this compaction
-        // (parent == level+1; grandparent == level+2)
-        if (level + 2 < config::kNumLevels) {
-            current_->GetOverlappingInputs(level + 2, &all_start, &all_limit,
+        // (parent == output_level; grandparent == output_level+1)
+        if (output_level + 1 < config::kNumLevels) {
+            current_->GetOverlappingInputs(output_level + 1, &all_start, &all_limit,
                                            &c->grandparents_);
         }
 
-        // Update the place where we will do the next compaction for this level.
-        // We update this immediately instead of waiting for the VersionEdit
-        // to be applied so that if the compaction fails, we will try a different
-        // key range next time.
-        compact_pointer_[level] = largest.Encode().ToString();
-        c->edit_.SetCompactPointer(level, largest);
+        c->smallest_ = all_start;
+        c->largest_ = all_limit;
     }
 
-    Compaction *VersionSet::CompactRange(int level, const InternalKey *begin,
-                                         const InternalKey *end) {
-        std::vector<FileMetaData *> inputs;
-        current_->GetOverlappingInputs(level, begin, end, &inputs);
-        if (inputs.empty()) {
-            return nullptr;
+    bool VersionSet::CanMoveTo(int level, const std::vector<FileMetaData *> &files,
+                               const InternalKey &smallest,
+                               const InternalKey &largest) {
+        const Slice smallest_user_key = smallest.user_key();
+        const Slice largest_user_key = largest.user_key();
+        if (current_->OverlapInLevel(level, &smallest_user_key, &largest_user_key) ||
+            RangeOverlapsRunningCompaction(level, smallest_user_key,
+                                           largest_user_key)) {
+            return false;
         }
+        if (level + 1 < config::kNumLevels) {
+            InternalKey files_smallest, files_largest;
+            GetRange(files, &files_smallest, &files_largest);
+            std::vector<FileMetaData *> grandparents;
+            current_->GetOverlappingInputs(level + 1, &files_smallest, &files_largest,
+                                           &grandparents);
+            return WithinGrandParentOverlap(options_, icmp_.user_comparator(), files,
+                                            grandparents);
+        }
+        return true;
+    }
 
-        // Avoid compacting too much in one shot in case the range is large.
-        // But we cannot do this for level-0 since level-0 files can overlap
-        // and we must not pick one file and drop another older file if the
-        // two files overlap.
+    void VersionSet::ExpandTrivialMove(Compaction *c) {
+        if (!c->IsTrivialMove()) {
+            return;
+        }
+        InternalKey smallest, largest;
+        GetRange(c->inputs_[0], &smallest, &largest);
+
+        // Take the next files of the level along for as long as they can be
+        // moved too, without making the move too large to pick under the
+        // lock.  Level-0 files may overlap each other, so they are moved one
+        // at a time.
+        const int level = c->level();
         if (level > 0) {
-            const uint64_t limit = MaxFileSizeForLevel(options_, level);
-            uint64_t total = 0;
-            for (size_t i = 0; i < inputs.size(); i++) {
-                uint64_t s = inputs[i]->file_size;
-                total += s;
-                if (total >= limit) {
-                    inputs.resize(i + 1);
+            const Comparator *user_cmp = icmp_.user_comparator();
+            const std::vector<FileMetaData *> &files = current_->files_[level];
+            size_t next = std::find(files.begin(), files.end(), c->inputs_[0].back()) -
+                          files.begin() + 1;
+            int64_t total = TotalFileSize(c->inputs_[0]);
+            while (next < files.size()) {
+                // Files that share a boundary user key have to move together
+                std::vector<FileMetaData *> added(1, files[next]);
+                while (next + added.size() < files.size() &&
+                       user_cmp->Compare(files[next + added.size()]->smallest.user_key(),
+                                         added.back()->largest.user_key()) == 0) {
+                    added.push_back(files[next + added.size()]);
+                }
+                const int64_t added_size = TotalFileSize(added);
+                if (total + added_size > ExpandedCompactionByteSizeLimit(options_) ||
+                    AnyBeingCompacted(added) ||
+                    !CanMoveTo(c->output_level_, added, smallest, added.back()->largest)) {
                     break;
                 }
+                c->inputs_[0].insert(c->inputs_[0].end(), added.begin(), added.end());
+                total += added_size;
+                largest = added.back()->largest;
+                next += added.size();
             }
         }
 
-        Compaction *c = new Compaction(options_, level);
-        c->input_version_ = current_;
-        c->input_version_->Ref();
-        c->inputs_[0] = inputs;
-        SetupOtherInputs(c);
+        // Skip the levels below that hold nothing in the range of the files
+        while (c->output_level_ + 1 < config::kNumLevels &&
+               CanMoveTo(c->output_level_ + 1, c->inputs_[0], smallest, largest)) {
+            c->output_level_++;
+        }
+        c->max_output_file_size_ = MaxFileSizeForLevel(options_, c->output_level_);
+        c->grandparents_.clear();
+        if (c->output_level_ + 1 < config::kNumLevels) {
+            current_->GetOverlappingInputs(c->output_level_ + 1, &smallest, &largest,
+                                           &c->grandparents_);
+        }
+        c->smallest_ = smallest;
+        c->largest_ = largest;
+    }
+
+    Compaction *VersionSet::CompactRange(int level, const InternalKey *begin,
+                                         const InternalKey *end) {
+        Compaction *c = picker_->CompactRange(level, begin, end);
+        if (c != nullptr) {
+            RegisterCompaction(c);
+        }
         return c;
     }
 
-    Compaction::Compaction(const Options *options, int level)
+    Compaction::Compaction(const Options *options, int level, int output_level)
             : level_(level),
-              max_output_file_size_(MaxFileSizeForLevel(options, level)),
+              output_level_(output_level),
+              max_output_file_size_(MaxFileSizeForLevel(options, output_level)),
+              output_number_(0),
+              deletion_compaction_(false),
               input_version_(nullptr),
-              grandparent_index_(0),
-              seen_key_(false),
-              overlapped_bytes_(0) {
+              running_vset_(nullptr),
+              skips_inputs_(false) {}
+
+    Compaction::Cursor::Cursor()
+            : grandparent_index(0), seen_key(false), overlapped_bytes(0) {
         for (int i = 0; i < config::kNumLevels; i++) {
-            level_ptrs_[i] = 0;
+            level_ptrs[i] = 0;
         }
     }
 
     Compaction::~Compaction() {
-        if (input_version_ != nullptr) {
-            input_version_->Unref();
-        }
+        ReleaseInputs();
     }
 
     bool Compaction::IsTrivialMove() const {
         const VersionSet *vset = input_version_->vset_;
         // Avoid a move if there is lots of overlapping grandparent data.
         // Otherwise, the move could create a parent file that will require
-        // a very expensive merge later on.
-        return (num_input_files(0) == 1 && num_input_files(1) == 0 &&
-                TotalFileSize(grandparents_) <=
-                MaxGrandParentOverlapBytes(vset->options_));
+        // a very expensive merge later on.  Files of a level above level-0
+        // do not overlap each other and can be moved together.
+        return (level_ != output_level_ && num_input_files(1) == 0 &&
+                (level_ > 0 || num_input_files(0) == 1) &&
+                WithinGrandParentOverlap(vset->options_,
+                                         vset->icmp_.user_comparator(),
+                                         inputs_[0], grandparents_));
     }
 
     void Compaction::AddInputDeletions(VersionEdit *edit) {
         for (int which = 0; which < 2; which++) {
             for (size_t i = 0; i < inputs_[which].size(); i++) {
-                edit->RemoveFile(level_ + which, inputs_[which][i]->number);
+                edit->RemoveFile(which == 0 ? level_ : output_level_,
+                                 inputs_[which][i]->number);
             }
         }
     }
 
-    bool Compaction::IsBaseLevelForKey(const Slice &user_key) {
+    bool Compaction::IsBaseLevelForKey(const Slice &user_key,
+                                       Cursor *cursor) const {
         // Maybe use binary search to find right entry instead of linear search?
         const Comparator *user_cmp = input_version_->vset_->icmp_.user_comparator();
-        for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
+        if (output_level_ == 0 &&
+            inputs_[0].size() < input_version_->files_[0].size()) {
+            // The level-0 files left out of the compaction hold older data.
+            return false;
+        }
+        for (int lvl = output_level_ + 1; lvl < config::kNumLevels; lvl++) {
             const std::vector<FileMetaData *> &files = input_version_->files_[lvl];
-            while (level_ptrs_[lvl] < files.size()) {
-                FileMetaData *f = files[level_ptrs_[lvl]];
+            while (cursor->level_ptrs[lvl] < files.size()) {
+                FileMetaData *f = files[cursor->level_ptrs[lvl]];
                 if (user_cmp->Compare(user_key, f->largest.user_key()) <= 0) {
                     // We've advanced far enough
                     if (user_cmp->Compare(user_key, f->smallest.user_key()) >= 0) {
@@ -1540,30 +1994,63 @@ namespace leveldb {
                     }
                     break;
                 }
-                level_ptrs_[lvl]++;
+                cursor->level_ptrs[lvl]++;
             }
         }
         return true;
     }
 
-    bool Compaction::ShouldStopBefore(const Slice &internal_key) {
+    bool Compaction::IsBaseLevelForRange(const Slice &begin,
+                                         const Slice &end) const {
+        if (output_level_ == 0 &&
+            inputs_[0].size() < input_version_->files_[0].size()) {
+            // The level-0 files left out of the compaction hold older data.
+            return false;
+        }
+        for (int lvl = output_level_ + 1; lvl < config::kNumLevels; lvl++) {
+            if (input_version_->OverlapInLevel(lvl, &begin, &end)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    Status Compaction::AddRangeTombstones(
+            int which, std::vector<RangeTombstone> *tombstones) const {
+        return AddFileRangeTombstones(input_version_->vset_->table_cache_,
+                                      inputs_[which], tombstones);
+    }
+
+    void Compaction::SkipCoveredInputs(const std::vector<FileMetaData *> &covered) {
+        read_inputs_.clear();
+        for (FileMetaData *f : inputs_[1]) {
+            if (std::find(covered.begin(), covered.end(), f) == covered.end()) {
+                read_inputs_.push_back(f);
+            }
+        }
+        skips_inputs_ = true;
+    }
+
+    bool Compaction::ShouldStopBefore(const Slice &internal_key,
+                                      Cursor *cursor) const {
         const VersionSet *vset = input_version_->vset_;
         // Scan to find earliest grandparent file that contains key.
         const InternalKeyComparator *icmp = &vset->icmp_;
-        while (grandparent_index_ < grandparents_.size() &&
+        while (cursor->grandparent_index < grandparents_.size() &&
                icmp->Compare(internal_key,
-                             grandparents_[grandparent_index_]->largest.Encode()) >
+                             grandparents_[cursor->grandparent_index]->largest.Encode()) >
                0) {
-            if (seen_key_) {
-                overlapped_bytes_ += grandparents_[grandparent_index_]->file_size;
+            if (cursor->seen_key) {
+                cursor->overlapped_bytes +=
+                        grandparents_[cursor->grandparent_index]->file_size;
             }
-            grandparent_index_++;
+            cursor->grandparent_index++;
         }
-        seen_key_ = true;
+        cursor->seen_key = true;
 
-        if (overlapped_bytes_ > MaxGrandParentOverlapBytes(vset->options_)) {
+        if (cursor->overlapped_bytes > MaxGrandParentOverlapBytes(vset->options_)) {
             // Too much overlap for current output; start new output
-            overlapped_bytes_ = 0;
+            cursor->overlapped_bytes = 0;
             return true;
         } else {
             return false;
@@ -1571,6 +2058,11 @@ namespace leveldb {
     }
 
     void Compaction::ReleaseInputs() {
+        // Unregister first: the input files may be freed along with the
+        // input version.
+        if (running_vset_ != nullptr) {
+            running_vset_->UnregisterCompaction(this);
+        }
         if (input_version_ != nullptr) {
             input_version_->Unref();
             input_version_ = nullptr;
@@ -15,8 +15,10 @@
 #ifndef STORAGE_LEVELDB_DB_VERSION_SET_H_
 #define STORAGE_LEVELDB_DB_VERSION_SET_H_
 
+#include <deque>
 #include <map>
 #include <set>
+#include <utility>
 #include <vector>
 
 #include "db/dbformat.h"
@@ -31,8 +33,10 @@ class Writer;
 }
 
 class Compaction;
+class CompactionPicker;
 class Iterator;
 class MemTable;
+struct RangeTombstone;
 class TableBuilder;
 class TableCache;
 class Version;
@@ -57,6 +61,15 @@ bool SomeFileOverlapsRange(const InternalKeyComparator& icmp,
                            const Slice* smallest_user_key,
                            const Slice* largest_user_key);
 
+// Return the combined size of "files".
+int64_t TotalFileSize(const std::vector<FileMetaData*>& files);
+
+// Returns true iff some file in "files" is an input of a running compaction.
+bool AnyBeingCompacted(const std::vector<FileMetaData*>& files);
+
+// Return the size of the files that compactions write to "level".
+uint64_t MaxFileSizeForLevel(const Options* options, int level);
+
 class Version {
  public:
   // Lookup the value for key.  If found, store it in *val and
@@ -72,8 +85,18 @@ class Version {
   // REQUIRES: This version has been saved (see VersionSet::SaveTo)
   void AddIterators(const ReadOptions&, std::vector<Iterator*>* iters);
 
+  // Merge operands found on top of the value, or of the end of the key's
+  // entries, are appended to *operands, newest first.  Entries older than
+  // *max_covering_tombstone_seq are deleted; it is raised by the range
+  // tombstones of the tables that are searched.
   Status Get(const ReadOptions&, const LookupKey& key, std::string* val,
-             GetStats* stats);
+             std::vector<std::string>* operands,
+             SequenceNumber* max_covering_tombstone_seq, GetStats* stats);
+
+  // Append the range tombstones of the tables of this version to
+  // *tombstones.
+  // REQUIRES: This version has been saved (see VersionSet::SaveTo)
+  Status AddRangeTombstones(std::vector<RangeTombstone>* tombstones);
 
   // Adds "stats" into the current state.  Returns true if a new
   // compaction may need to be triggered, false otherwise.
@@ -116,6 +139,9 @@ class Version {
 
  private:
   friend class Compaction;
+  friend class FIFOCompactionPicker;
+  friend class LevelCompactionPicker;
+  friend class UniversalCompactionPicker;
   friend class VersionSet;
 
   class LevelFileNumIterator;
@@ -128,7 +154,14 @@ class Version {
         file_to_compact_(nullptr),
         file_to_compact_level_(-1),
         compaction_score_(-1),
-        compaction_level_(-1) {}
+        compaction_level_(-1),
+        base_level_(1),
+        pending_compaction_bytes_(0) {
+    for (int level = 0; level < config::kNumLevels; level++) {
+      level_scores_[level] = -1;
+      level_max_bytes_[level] = 0;
+    }
+  }
 
   Version(const Version&) = delete;
   Version& operator=(const Version&) = delete;
@@ -157,11 +190,32 @@ class Version {
   FileMetaData* file_to_compact_;
   int file_to_compact_level_;
 
+  // Files whose share of deletion markers reaches
+  // Options::deletion_ratio_compaction_trigger, with their levels, from the
+  // top level down.  Initialized by Finalize().
+  std::vector<std::pair<int, FileMetaData*>> files_marked_for_compaction_;
+
   // Level that should be compacted next and its compaction score.
   // Score < 1 means compaction is not strictly needed.  These fields
   // are initialized by Finalize().
   double compaction_score_;
   int compaction_level_;
+
+  // Compaction score of every level, as computed by Finalize().  Used to
+  // find another level to work on when the best one is taken by a running
+  // compaction.
+  double level_scores_[config::kNumLevels];
+
+  // Level that level-0 is compacted into and the size limit of every level,
+  // as computed by Finalize().  The base level is always 1 unless
+  // Options::level_compaction_dynamic_level_bytes is set, and the levels
+  // between level-0 and the base level are empty.
+  int base_level_;
+  double level_max_bytes_[config::kNumLevels];
+
+  // Estimated number of bytes that compactions have to rewrite before no
+  // level is over its size limit.  Initialized by Finalize().
+  uint64_t pending_compaction_bytes_;
 };
 
 class VersionSet {
@@ -176,8 +230,8 @@ class VersionSet {
   // Apply *edit to the current version to form a new descriptor that
   // is both saved to persistent state and installed as the new
   // current version.  Will release *mu while actually writing to the file.
+  // Concurrent callers are queued and apply their edits one at a time.
   // REQUIRES: *mu is held on entry.
-  // REQUIRES: no other thread concurrently calls LogAndApply()
   Status LogAndApply(VersionEdit* edit, port::Mutex* mu)
       EXCLUSIVE_LOCKS_REQUIRED(mu);
 
@@ -208,6 +262,12 @@ class VersionSet {
   // Return the combined file size of all files at the specified level.
   int64_t NumLevelBytes(int level) const;
 
+  // Return an estimate of the number of bytes that compactions have to
+  // rewrite before the current version needs no more compactions.
+  uint64_t EstimatedPendingCompactionBytes() const {
+    return current_->pending_compaction_bytes_;
+  }
+
   // Return the last sequence number.
   uint64_t LastSequence() const { return last_sequence_; }
 
@@ -227,19 +287,40 @@ class VersionSet {
   // being compacted, or zero if there is no such log file.
   uint64_t PrevLogNumber() const { return prev_log_number_; }
 
-  // Pick level and inputs for a new compaction.
+  // Pick level and inputs for a new compaction.  Files that are inputs of
+  // a running compaction are never picked, and neither is a compaction
+  // whose output range overlaps the output of a running compaction.
   // Returns nullptr if there is no compaction to be done.
   // Otherwise returns a pointer to a heap-allocated object that
-  // describes the compaction.  Caller should delete the result.
+  // describes the compaction.  The compaction is registered as running
+  // until it is deleted.  Caller should delete the result.
   Compaction* PickCompaction();
 
   // Return a compaction object for compacting the range [begin,end] in
   // the specified level.  Returns nullptr if there is nothing in that
   // level that overlaps the specified range.  Caller should delete
   // the result.
+  // REQUIRES: no other compaction is running.
   Compaction* CompactRange(int level, const InternalKey* begin,
                            const InternalKey* end);
 
+  // Return the number of compactions that have been picked but not yet
+  // deleted.
+  int NumRunningCompactions() const {
+    return static_cast<int>(running_compactions_.size());
+  }
+
+  // Record whether a memtable is being flushed to a level-0 table, whose
+  // file number was taken when the flush started.
+  void SetFlushRunning(bool running) { flush_running_ = running; }
+  bool FlushRunning() const { return flush_running_; }
+
+  // Returns true iff the output of some running compaction into "level"
+  // may overlap the user key range [smallest_user_key,largest_user_key].
+  bool RangeOverlapsRunningCompaction(int level,
+                                      const Slice& smallest_user_key,
+                                      const Slice& largest_user_key) const;
+
   // Return the maximum overlapping data (in bytes) at next level for any
   // file at a level >= 1.
   int64_t MaxNextLevelOverlappingBytes();
@@ -248,11 +329,16 @@ class VersionSet {
   // The caller should delete the iterator when no longer needed.
   Iterator* MakeInputIterator(Compaction* c);
 
-  // Returns true iff some level needs a compaction.
-  bool NeedsCompaction() const {
-    Version* v = current_;
-    return (v->compaction_score_ >= 1) || (v->file_to_compact_ != nullptr);
-  }
+  // Store in *boundaries at most "max_ranges - 1" increasing user keys,
+  // chosen among the bounds of the input files of "*c", that split it into
+  // key ranges [boundary[i-1],boundary[i]) holding roughly equal amounts
+  // of input data.  Leaves *boundaries empty if "*c" cannot be split.
+  void SplitCompaction(Compaction* c, int max_ranges,
+                       std::vector<Slice>* boundaries);
+
+  // Returns true iff some level needs a compaction that does not conflict
+  // with the running ones.
+  bool NeedsCompaction() const;
 
   // Add all files listed in any live version to *live.
   // May also mutate some internal state.
@@ -271,8 +357,12 @@ class VersionSet {
 
  private:
   class Builder;
+  struct ManifestWriter;
 
   friend class Compaction;
+  friend class FIFOCompactionPicker;
+  friend class LevelCompactionPicker;
+  friend class UniversalCompactionPicker;
   friend class Version;
 
   bool ReuseManifest(const std::string& dscname, const std::string& dscbase);
@@ -288,6 +378,36 @@ class VersionSet {
 
   void SetupOtherInputs(Compaction* c);
 
+  // Returns true iff files spanning [smallest,largest] can be moved to
+  // "level" as they are: nothing in "level" overlaps the range and no
+  // running compaction writes to it in "level".  Of the files, only those
+  // in "files" are checked for overlapping too much of the level below.
+  bool CanMoveTo(int level, const std::vector<FileMetaData*>& files,
+                 const InternalKey& smallest, const InternalKey& largest);
+
+  // If "c" is a trivial move, grow it to the next files of its level that
+  // can be moved along, up to ExpandedCompactionByteSizeLimit() bytes, and
+  // move all of them down past the levels that hold nothing in their range.
+  void ExpandTrivialMove(Compaction* c);
+
+  // Return the level that a compaction of "level" writes to in "v".
+  static int OutputLevel(const Version* v, int level) {
+    return (level == 0) ? v->base_level_ : level + 1;
+  }
+
+  // Compute the base level and the size limit of every level of "v" from
+  // the sizes of its levels.
+  void CalculateLevelMaxBytes(Version* v) const;
+
+  // Returns true iff "c" cannot run concurrently with the running
+  // compactions.
+  bool ConflictsWithRunningCompaction(Compaction* c) const;
+
+  // Mark the inputs of "c" as being compacted and remember "c" until it is
+  // deleted.  Also advances compact_pointer_ past the inputs of "c".
+  void RegisterCompaction(Compaction* c);
+  void UnregisterCompaction(Compaction* c);
+
   // Save current contents to *log
   Status WriteSnapshot(log::Writer* log);
 
@@ -313,6 +433,17 @@ class VersionSet {
   // Per-level key at which the next compaction at that level should start.
   // Either an empty string, or a valid InternalKey.
   std::string compact_pointer_[config::kNumLevels];
+
+  // Compactions that have been picked and not yet deleted.
+  std::set<Compaction*> running_compactions_;
+
+  bool flush_running_;
+
+  // Chooses the compactions, see Options::compaction_style.
+  CompactionPicker* picker_;
+
+  // Queue of LogAndApply() callers; the front one owns the MANIFEST.
+  std::deque<ManifestWriter*> manifest_writers_;
 };
 
 // A Compaction encapsulates information about a compaction.
@@ -321,9 +452,15 @@ class Compaction {
   ~Compaction();
 
   // Return the level that is being compacted.  Inputs from "level"
-  // and "level+1" will be merged to produce a set of "level+1" files.
+  // and "output_level" will be merged to produce a set of "output_level"
+  // files.
   int level() const { return level_; }
 
+  // Return the level that the compaction writes to.  Usually level+1, but
+  // level-0 is compacted straight into the base level (see
+  // Options::level_compaction_dynamic_level_bytes).
+  int output_level() const { return output_level_; }
+
   // Return the object that holds the edits to the descriptor done
   // by this compaction.
   VersionEdit* edit() { return &edit_; }
@@ -331,61 +468,109 @@ class Compaction {
   // "which" must be either 0 or 1
   int num_input_files(int which) const { return inputs_[which].size(); }
 
-  // Return the ith input file at "level()+which" ("which" must be 0 or 1).
+  // Return the ith input file at "level()" if "which" is 0 or at
+  // "output_level()" if "which" is 1.
   FileMetaData* input(int which, int i) const { return inputs_[which][i]; }
 
   // Maximum size of files to build during this compaction.
   uint64_t MaxOutputFileSize() const { return max_output_file_size_; }
 
+  // Return the number that was set aside for the single output file of
+  // the compaction, or 0 if output files get a new number each.
+  uint64_t output_number() const { return output_number_; }
+
+  // Returns true iff the compaction just deletes its input files instead
+  // of merging them (see Options::compaction_style).
+  bool IsDeletionCompaction() const { return deletion_compaction_; }
+
   // Is this a trivial compaction that can be implemented by just
-  // moving a single input file to the next level (no merging or splitting)
+  // moving the input files to the output level (no merging or splitting)
   bool IsTrivialMove() const;
 
   // Add all inputs to this compaction as delete operations to *edit.
   void AddInputDeletions(VersionEdit* edit);
 
+  // Position of one pass over the compaction's keys in increasing order,
+  // as needed by IsBaseLevelForKey() and ShouldStopBefore().  Passes over
+  // disjoint key ranges that run concurrently each use their own Cursor.
+  struct Cursor {
+    Cursor();
+
+    // State used to check for number of overlapping grandparent files
+    // (parent == output_level_, grandparent == output_level_ + 1)
+    size_t grandparent_index;  // Index in grandparents_
+    bool seen_key;             // Some output key has been seen
+    int64_t overlapped_bytes;  // Bytes of overlap between current output
+                               // and grandparent files
+
+    // State for implementing IsBaseLevelForKey
+
+    // level_ptrs holds indices into input_version_->levels_: our state
+    // is that we are positioned at one of the file ranges for each
+    // higher level than the ones involved in this compaction (i.e. for
+    // all L > output_level_).
+    size_t level_ptrs[config::kNumLevels];
+  };
+
   // Returns true if the information we have available guarantees that
-  // the compaction is producing data in "level+1" for which no data exists
-  // in levels greater than "level+1".
-  bool IsBaseLevelForKey(const Slice& user_key);
+  // the compaction is producing data in "output_level" for which no data
+  // exists in levels greater than "output_level".
+  bool IsBaseLevelForKey(const Slice& user_key, Cursor* cursor) const;
+
+  // Like IsBaseLevelForKey(), for all user keys in [begin,end).
+  bool IsBaseLevelForRange(const Slice& begin, const Slice& end) const;
+
+  // Append the range tombstones of the input files "which" to *tombstones.
+  Status AddRangeTombstones(int which,
+                            std::vector<RangeTombstone>* tombstones) const;
+
+  // Stop reading the files of output_level() in "covered", all of whose
+  // entries are deleted by the range tombstones of the files of level().
+  // They are still deleted by AddInputDeletions().
+  void SkipCoveredInputs(const std::vector<FileMetaData*>& covered);
 
   // Returns true iff we should stop building the current output
   // before processing "internal_key".
-  bool ShouldStopBefore(const Slice& internal_key);
+  bool ShouldStopBefore(const Slice& internal_key, Cursor* cursor) const;
 
   // Release the input version for the compaction, once the compaction
-  // is successful.
+  // is successful.  Also stops treating the inputs as being compacted.
   void ReleaseInputs();
 
  private:
+  friend class FIFOCompactionPicker;
+  friend class LevelCompactionPicker;
+  friend class UniversalCompactionPicker;
   friend class Version;
   friend class VersionSet;
 
-  Compaction(const Options* options, int level);
+  Compaction(const Options* options, int level, int output_level);
 
   int level_;
+  int output_level_;
   uint64_t max_output_file_size_;
+  uint64_t output_number_;
+  bool deletion_compaction_;
   Version* input_version_;
   VersionEdit edit_;
 
-  // Each compaction reads inputs from "level_" and "level_+1"
+  // Set while the compaction is registered as running.
+  VersionSet* running_vset_;
+
+  // Range covered by all inputs.  Filled in by SetupOtherInputs().
+  InternalKey smallest_;
+  InternalKey largest_;
+
+  // Each compaction reads inputs from "level_" and "output_level_"
   std::vector<FileMetaData*> inputs_[2];  // The two sets of inputs
 
-  // State used to check for number of overlapping grandparent files
-  // (parent == level_ + 1, grandparent == level_ + 2)
+  // The files of inputs_[1] that are read, if SkipCoveredInputs() left out
+  // some of them.
+  bool skips_inputs_;
+  std::vector<FileMetaData*> read_inputs_;
+
+  // Files in output_level_ + 1 that overlap the inputs (see Cursor)
   std::vector<FileMetaData*> grandparents_;
-  size_t grandparent_index_;  // Index in grandparent_starts_
-  bool seen_key_;             // Some output key has been seen
-  int64_t overlapped_bytes_;  // Bytes of overlap between current output
-                              // and grandparent files
-
-  // State for implementing IsBaseLevelForKey
-
-  // level_ptrs_ holds indices into input_version_->levels_: our state
-  // is that we are positioned at one of the file ranges for each
-  // higher level than the ones involved in this compaction (i.e. for
-  // all L >= level_ + 2).
-  size_t level_ptrs_[config::kNumLevels];
 };
 
 }  // namespace leveldb
@@ -8,7 +8,9 @@
 //    data: record[count]
 // record :=
 //    kTypeValue varstring varstring         |
-//    kTypeDeletion varstring
+//    kTypeDeletion varstring                |
+//    kTypeMerge varstring varstring         |
+//    kTypeRangeDeletion varstring varstring
 // varstring :=
 //    len: varint32
 //    data: uint8[len]
@@ -32,6 +34,11 @@ namespace leveldb {
 
     WriteBatch::Handler::~Handler() = default;
 
+    void WriteBatch::Handler::Merge(const Slice &key, const Slice &value) {}
+
+    void WriteBatch::Handler::DeleteRange(const Slice &begin_key,
+                                          const Slice &end_key) {}
+
     void WriteBatch::Clear() {
         rep_.clear();
         rep_.resize(kHeader);
@@ -68,6 +75,22 @@ namespace leveldb {
                         return Status::Corruption("bad WriteBatch Delete");
                     }
                     break;
+                case kTypeMerge:
+                    if (GetLengthPrefixedSlice(&input, &key) &&
+                        GetLengthPrefixedSlice(&input, &value)) {
+                        handler->Merge(key, value);
+                    } else {
+                        return Status::Corruption("bad WriteBatch Merge");
+                    }
+                    break;
+                case kTypeRangeDeletion:
+                    if (GetLengthPrefixedSlice(&input, &key) &&
+                        GetLengthPrefixedSlice(&input, &value)) {
+                        handler->DeleteRange(key, value);
+                    } else {
+                        return Status::Corruption("bad WriteBatch DeleteRange");
+                    }
+                    break;
                 default:
                     return Status::Corruption("unknown WriteBatch tag");
             }
@@ -108,6 +131,20 @@ namespace leveldb {
         PutLengthPrefixedSlice(&rep_, key);
     }
 
+    void WriteBatch::Merge(const Slice &key, const Slice &value) {
+        WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+        rep_.push_back(static_cast<char>(kTypeMerge));
+        PutLengthPrefixedSlice(&rep_, key);
+        PutLengthPrefixedSlice(&rep_, value);
+    }
+
+    void WriteBatch::DeleteRange(const Slice &begin_key, const Slice &end_key) {
+        WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+        rep_.push_back(static_cast<char>(kTypeRangeDeletion));
+        PutLengthPrefixedSlice(&rep_, begin_key);
+        PutLengthPrefixedSlice(&rep_, end_key);
+    }
+
     void WriteBatch::Append(const WriteBatch &source) {
         WriteBatchInternal::Append(this, &source);
     }
@@ -117,14 +154,31 @@ namespace leveldb {
         public:
             SequenceNumber sequence_;
             MemTable *mem_;
+            MemTable::InsertHint *hint_ = nullptr;  // Non-null for concurrent inserts
 
             void Put(const Slice &key, const Slice &value) override {
-                mem_->Add(sequence_, kTypeValue, key, value);
-                sequence_++;
+                Add(kTypeValue, key, value);
             }
 
             void Delete(const Slice &key) override {
-                mem_->Add(sequence_, kTypeDeletion, key, Slice());
+                Add(kTypeDeletion, key, Slice());
+            }
+
+            void Merge(const Slice &key, const Slice &value) override {
+                Add(kTypeMerge, key, value);
+            }
+
+            void DeleteRange(const Slice &begin_key, const Slice &end_key) override {
+                Add(kTypeRangeDeletion, begin_key, end_key);
+            }
+
+        private:
+            void Add(ValueType type, const Slice &key, const Slice &value) {
+                if (hint_ != nullptr) {
+                    mem_->AddConcurrently(sequence_, type, key, value, hint_);
+                } else {
+                    mem_->Add(sequence_, type, key, value);
+                }
                 sequence_++;
             }
         };
@@ -137,6 +191,15 @@ namespace leveldb {
         return b->Iterate(&inserter);
     }
 
+    Status WriteBatchInternal::InsertIntoConcurrently(const WriteBatch *b,
+                                                      MemTable *memtable) {
+        MemTableInserter inserter;
+        inserter.sequence_ = WriteBatchInternal::Sequence(b);
+        inserter.mem_ = memtable;
+        inserter.hint_ = memtable->ThreadInsertHint();
+        return b->Iterate(&inserter);
+    }
+
     void WriteBatchInternal::SetContents(WriteBatch *b, const Slice &contents) {
         assert(contents.size() >= kHeader);
         b->rep_.assign(contents.data(), contents.size());
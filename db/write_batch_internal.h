@@ -37,6 +37,12 @@ class WriteBatchInternal {
 
   static Status InsertInto(const WriteBatch* batch, MemTable* memtable);
 
+  // Like InsertInto(), but may run alongside other InsertIntoConcurrently()
+  // calls on the same memtable.  Uses the calling thread's insert hint for
+  // the memtable, see MemTable::ThreadInsertHint().
+  static Status InsertIntoConcurrently(const WriteBatch* batch,
+                                       MemTable* memtable);
+
   static void Append(WriteBatch* dst, const WriteBatch* src);
 };
 
@@ -2,12 +2,20 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
+#include <algorithm>
+#include <vector>
+
 #include "gtest/gtest.h"
+#include "benchmark/benchmark.h"
 #include "db/memtable.h"
 #include "db/write_batch_internal.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
 #include "util/logging.h"
+#include "util/mutexlock.h"
+#include "util/random.h"
 
 namespace leveldb {
 
@@ -21,7 +29,10 @@ static std::string PrintContents(WriteBatch* b) {
   Iterator* iter = mem->NewIterator();
   for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
     ParsedInternalKey ikey;
-    EXPECT_TRUE(ParseInternalKey(iter->key(), &ikey));
+    if (!ParseInternalKey(iter->key(), &ikey)) {
+      ADD_FAILURE() << "bad entry";
+      continue;
+    }
     switch (ikey.type) {
       case kTypeValue:
         state.append("Put(");
@@ -37,11 +48,39 @@ static std::string PrintContents(WriteBatch* b) {
         state.append(")");
         count++;
         break;
+      case kTypeMerge:
+        state.append("Merge(");
+        state.append(ikey.user_key.ToString());
+        state.append(", ");
+        state.append(iter->value().ToString());
+        state.append(")");
+        count++;
+        break;
+      case kTypeRangeDeletion:
+        // Stored apart from the entries, see below
+        ADD_FAILURE() << "range tombstone among the entries";
+        break;
     }
     state.append("@");
     state.append(NumberToString(ikey.sequence));
   }
   delete iter;
+  iter = mem->NewRangeTombstoneIterator();
+  if (iter != nullptr) {
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      ParsedInternalKey ikey;
+      EXPECT_TRUE(ParseInternalKey(iter->key(), &ikey));
+      EXPECT_EQ(kTypeRangeDeletion, ikey.type);
+      state.append("DeleteRange(");
+      state.append(ikey.user_key.ToString());
+      state.append(", ");
+      state.append(iter->value().ToString());
+      state.append(")@");
+      state.append(NumberToString(ikey.sequence));
+      count++;
+    }
+    delete iter;
+  }
   if (!s.ok()) {
     state.append("ParseError()");
   } else if (count != WriteBatchInternal::Count(b)) {
@@ -72,6 +111,36 @@ TEST(WriteBatchTest, Multiple) {
       PrintContents(&batch));
 }
 
+TEST(WriteBatchTest, Merge) {
+  WriteBatch batch;
+  batch.Put(Slice("foo"), Slice("bar"));
+  batch.Merge(Slice("foo"), Slice("baz"));
+  batch.Merge(Slice("box"), Slice("boo"));
+  WriteBatchInternal::SetSequence(&batch, 100);
+  ASSERT_EQ(3, WriteBatchInternal::Count(&batch));
+  ASSERT_EQ(
+      "Merge(box, boo)@102"
+      "Merge(foo, baz)@101"
+      "Put(foo, bar)@100",
+      PrintContents(&batch));
+}
+
+TEST(WriteBatchTest, DeleteRange) {
+  WriteBatch batch;
+  batch.Put(Slice("foo"), Slice("bar"));
+  batch.DeleteRange(Slice("a"), Slice("g"));
+  batch.Delete(Slice("box"));
+  batch.DeleteRange(Slice("b"), Slice("c"));
+  WriteBatchInternal::SetSequence(&batch, 100);
+  ASSERT_EQ(4, WriteBatchInternal::Count(&batch));
+  ASSERT_EQ(
+      "Delete(box)@102"
+      "Put(foo, bar)@100"
+      "DeleteRange(a, g)@101"
+      "DeleteRange(b, c)@103",
+      PrintContents(&batch));
+}
+
 TEST(WriteBatchTest, Corruption) {
   WriteBatch batch;
   batch.Put(Slice("foo"), Slice("bar"));
@@ -112,6 +181,116 @@ TEST(WriteBatchTest, Append) {
       PrintContents(&b1));
 }
 
+// Several threads apply batches of a single key to one memtable at the
+// same time, as the followers of a write group do.  With "delete_ranges",
+// the odd threads delete a range starting at their key instead of putting
+// it.
+struct ConcurrentBatchState {
+  ConcurrentBatchState(MemTable* mem, int num_threads, int batches_per_thread,
+                       bool delete_ranges = false)
+      : mem(mem),
+        num_threads(num_threads),
+        batches_per_thread(batches_per_thread),
+        delete_ranges(delete_ranges),
+        next_thread(0),
+        running(num_threads),
+        done_cv(&mu) {}
+
+  MemTable* const mem;
+  const int num_threads;
+  const int batches_per_thread;
+  const bool delete_ranges;
+  std::atomic<int> next_thread;
+  port::Mutex mu;
+  int running GUARDED_BY(mu);
+  port::CondVar done_cv GUARDED_BY(mu);
+};
+
+static void InsertOneKeyBatches(void* arg) {
+  ConcurrentBatchState* state = reinterpret_cast<ConcurrentBatchState*>(arg);
+  const int t = state->next_thread.fetch_add(1);
+  MemTable::InsertHint* hint = state->mem->ThreadInsertHint();
+  for (int i = 0; i < state->batches_per_thread; i++) {
+    const int n = i * state->num_threads + t;
+    char key[20];
+    std::snprintf(key, sizeof(key), "%08d", n);
+    WriteBatch batch;
+    if (state->delete_ranges && t % 2 == 1) {
+      batch.DeleteRange(key, std::string(key) + "0");
+    } else {
+      batch.Put(key, "v");
+    }
+    WriteBatchInternal::SetSequence(&batch, n + 1);
+    EXPECT_TRUE(WriteBatchInternal::InsertIntoConcurrently(&batch, state->mem)
+                    .ok());
+    // The hint outlives the batch.
+    EXPECT_EQ(hint, state->mem->ThreadInsertHint());
+  }
+  MutexLock l(&state->mu);
+  if (--state->running == 0) {
+    state->done_cv.Signal();
+  }
+}
+
+TEST(WriteBatchTest, ConcurrentOneKeyBatches) {
+  InternalKeyComparator cmp(BytewiseComparator());
+  MemTable* mem = new MemTable(cmp);
+  mem->Ref();
+  ConcurrentBatchState state(mem, 4, 2000);
+  for (int i = 0; i < state.num_threads; i++) {
+    Env::Default()->StartThread(InsertOneKeyBatches, &state);
+  }
+  {
+    MutexLock l(&state.mu);
+    while (state.running > 0) {
+      state.done_cv.Wait();
+    }
+  }
+
+  Iterator* iter = mem->NewIterator();
+  int n = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next(), n++) {
+    char key[20];
+    std::snprintf(key, sizeof(key), "%08d", n);
+    ASSERT_EQ(key, ExtractUserKey(iter->key()).ToString());
+  }
+  ASSERT_EQ(state.num_threads * state.batches_per_thread, n);
+  delete iter;
+  mem->Unref();
+}
+
+TEST(WriteBatchTest, ConcurrentDeleteRangeAndPut) {
+  InternalKeyComparator cmp(BytewiseComparator());
+  MemTable* mem = new MemTable(cmp);
+  mem->Ref();
+  ConcurrentBatchState state(mem, 4, 2000, true);
+  for (int i = 0; i < state.num_threads; i++) {
+    Env::Default()->StartThread(InsertOneKeyBatches, &state);
+  }
+  {
+    MutexLock l(&state.mu);
+    while (state.running > 0) {
+      state.done_cv.Wait();
+    }
+  }
+
+  // Even keys were put, odd keys start a range tombstone.
+  for (int type = 0; type < 2; type++) {
+    Iterator* iter =
+        (type == 0) ? mem->NewIterator() : mem->NewRangeTombstoneIterator();
+    ASSERT_TRUE(iter != nullptr);
+    int n = type;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), n += 2) {
+      char key[20];
+      std::snprintf(key, sizeof(key), "%08d", n);
+      ASSERT_EQ(key, ExtractUserKey(iter->key()).ToString());
+    }
+    ASSERT_EQ(state.num_threads * state.batches_per_thread + type, n);
+    delete iter;
+  }
+  mem->Unref();
+}
+
 TEST(WriteBatchTest, ApproximateSize) {
   WriteBatch batch;
   size_t empty_size = batch.ApproximateSize();
@@ -129,9 +308,56 @@ TEST(WriteBatchTest, ApproximateSize) {
   ASSERT_LT(two_keys_size, post_delete_size);
 }
 
+// Fill a memtable with "num_keys" 16-byte keys, in ascending order when
+// "sequential" is true and in random order otherwise.  Unless "spread" is
+// true, all keys share their first 8 bytes.
+static void BM_MemTableFill(benchmark::State& state, bool sequential,
+                            bool spread = false) {
+  const int num_keys = state.range(0);
+  std::vector<std::string> keys;
+  Random rnd(301);
+  for (int i = 0; i < num_keys; i++) {
+    char buf[100];
+    std::snprintf(buf, sizeof(buf), "%016d",
+                  sequential ? i : static_cast<int>(rnd.Uniform(num_keys)));
+    if (spread) {
+      std::reverse(buf, buf + 16);  // Low digits first, so keys differ early
+    }
+    keys.push_back(buf);
+  }
+  InternalKeyComparator cmp(BytewiseComparator());
+  for (auto st : state) {
+    MemTable* mem = new MemTable(cmp);
+    mem->Ref();
+    SequenceNumber seq = 0;
+    for (const std::string& key : keys) {
+      mem->Add(++seq, kTypeValue, key, Slice());
+    }
+    mem->Unref();
+  }
+  state.SetItemsProcessed(state.iterations() * num_keys);
+}
+
+static void BM_MemTableFillSeq(benchmark::State& state) {
+  BM_MemTableFill(state, true);
+}
+
+static void BM_MemTableFillRandom(benchmark::State& state) {
+  BM_MemTableFill(state, false);
+}
+
+static void BM_MemTableFillRandomSpread(benchmark::State& state) {
+  BM_MemTableFill(state, false, true);
+}
+
+BENCHMARK(BM_MemTableFillSeq)->Arg(10000)->Arg(100000);
+BENCHMARK(BM_MemTableFillRandom)->Arg(10000)->Arg(100000);
+BENCHMARK(BM_MemTableFillRandomSpread)->Arg(10000)->Arg(100000);
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
   testing::InitGoogleTest(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
   return RUN_ALL_TESTS();
 }
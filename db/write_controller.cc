@@ -0,0 +1,80 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/write_controller.h"
+
+#include <algorithm>
+
+namespace leveldb {
+
+// Writes never slow down below this rate, so that a tree on the verge of
+// stopping still makes progress.
+static const uint64_t kMinDelayedWriteRate = 16 << 10;
+
+// The bucket holds at most this many microseconds worth of tokens.
+static const uint64_t kRefillMicros = 1000;
+
+WriteController::WriteController(const Options& options)
+    : level0_slowdown_writes_trigger_(options.level0_slowdown_writes_trigger),
+      level0_stop_writes_trigger_(options.level0_stop_writes_trigger),
+      max_delayed_write_rate_(options.delayed_write_rate),
+      soft_pending_compaction_bytes_limit_(
+          options.soft_pending_compaction_bytes_limit),
+      hard_pending_compaction_bytes_limit_(
+          options.hard_pending_compaction_bytes_limit),
+      delayed_write_rate_(0),
+      next_token_micros_(0) {}
+
+void WriteController::Update(int level0_files,
+                             uint64_t pending_compaction_bytes) {
+  // How far the tree has moved from the slowdown towards the stop point,
+  // or a negative number if writes need not slow down.
+  double progress = -1;
+  if (level0_files >= level0_slowdown_writes_trigger_) {
+    progress =
+        static_cast<double>(level0_files - level0_slowdown_writes_trigger_ + 1) /
+        (level0_stop_writes_trigger_ - level0_slowdown_writes_trigger_ + 1);
+  }
+  if (soft_pending_compaction_bytes_limit_ > 0 &&
+      pending_compaction_bytes >= soft_pending_compaction_bytes_limit_) {
+    double p = 0;
+    if (hard_pending_compaction_bytes_limit_ >
+        soft_pending_compaction_bytes_limit_) {
+      p = static_cast<double>(pending_compaction_bytes -
+                              soft_pending_compaction_bytes_limit_) /
+          (hard_pending_compaction_bytes_limit_ -
+           soft_pending_compaction_bytes_limit_);
+    }
+    progress = std::max(progress, p);
+  }
+
+  if (progress < 0) {
+    delayed_write_rate_ = 0;
+    // Start the next slowdown with a full bucket.
+    next_token_micros_ = 0;
+    return;
+  }
+  progress = std::min(progress, 1.0);
+  const uint64_t rate =
+      static_cast<uint64_t>(max_delayed_write_rate_ * (1 - progress));
+  delayed_write_rate_ = std::max(
+      rate, std::min(kMinDelayedWriteRate, max_delayed_write_rate_));
+}
+
+uint64_t WriteController::GetDelay(uint64_t now_micros, uint64_t bytes) {
+  if (delayed_write_rate_ == 0) {
+    return 0;
+  }
+  // Tokens that were not used while no one wrote pile up, but only up to
+  // the size of the bucket.
+  if (next_token_micros_ + kRefillMicros < now_micros) {
+    next_token_micros_ = now_micros - kRefillMicros;
+  }
+  next_token_micros_ += static_cast<uint64_t>(
+      static_cast<double>(bytes) * 1000000 / delayed_write_rate_);
+  return next_token_micros_ > now_micros ? next_token_micros_ - now_micros
+                                         : 0;
+}
+
+}  // namespace leveldb
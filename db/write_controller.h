@@ -0,0 +1,65 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
+#define STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
+
+#include <cstdint>
+
+#include "leveldb/options.h"
+
+namespace leveldb {
+
+// Decides how fast writes may go while compactions fall behind.
+//
+// Once level-0 reaches Options::level0_slowdown_writes_trigger files, or the
+// estimated number of bytes that compactions still have to rewrite
+// reaches Options::soft_pending_compaction_bytes_limit, writes are limited
+// to a rate that starts at Options::delayed_write_rate and falls linearly
+// as the tree approaches the point where writes stop altogether.  Writes
+// are paced with a token bucket, so that their latency stays smooth
+// instead of jumping between no delay and a fixed sleep.
+//
+// Not thread-safe: the DB calls it with its mutex held.
+class WriteController {
+ public:
+  explicit WriteController(const Options& options);
+
+  WriteController(const WriteController&) = delete;
+  WriteController& operator=(const WriteController&) = delete;
+
+  // Recompute the write rate from the number of level-0 files and the
+  // estimated pending compaction bytes.
+  void Update(int level0_files, uint64_t pending_compaction_bytes);
+
+  // Return true if writes are currently rate limited.
+  bool IsDelayed() const { return delayed_write_rate_ > 0; }
+
+  // Return the current write rate in bytes per second, or 0 if writes are
+  // not rate limited.
+  uint64_t delayed_write_rate() const { return delayed_write_rate_; }
+
+  // Take "bytes" worth of tokens out of the bucket and return the number of
+  // microseconds the write has to wait for them.  Returns 0 if writes are
+  // not rate limited.
+  uint64_t GetDelay(uint64_t now_micros, uint64_t bytes);
+
+ private:
+  const int level0_slowdown_writes_trigger_;
+  const int level0_stop_writes_trigger_;
+  const uint64_t max_delayed_write_rate_;
+  const uint64_t soft_pending_compaction_bytes_limit_;
+  const uint64_t hard_pending_compaction_bytes_limit_;
+
+  uint64_t delayed_write_rate_;
+
+  // Time at which the tokens handed out so far will all have been earned.
+  // Never more than one refill period behind the current time, which bounds
+  // the burst that the bucket allows.
+  uint64_t next_token_micros_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
@@ -0,0 +1,80 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/write_controller.h"
+
+#include "gtest/gtest.h"
+
+namespace leveldb {
+
+static Options ControllerOptions() {
+  Options options;
+  options.delayed_write_rate = 1 << 20;
+  options.soft_pending_compaction_bytes_limit = 100 << 20;
+  options.hard_pending_compaction_bytes_limit = 200 << 20;
+  return options;
+}
+
+TEST(WriteControllerTest, NotDelayed) {
+  const Options options = ControllerOptions();
+  WriteController controller(options);
+  controller.Update(options.level0_slowdown_writes_trigger - 1, 99 << 20);
+  ASSERT_FALSE(controller.IsDelayed());
+  ASSERT_EQ(0, controller.delayed_write_rate());
+  ASSERT_EQ(0, controller.GetDelay(1000000, 100 << 20));
+}
+
+TEST(WriteControllerTest, RateFallsTowardsStop) {
+  const Options options = ControllerOptions();
+  WriteController controller(options);
+  uint64_t last_rate = 1 << 20;
+  for (int files = options.level0_slowdown_writes_trigger;
+       files < options.level0_stop_writes_trigger; files++) {
+    controller.Update(files, 0);
+    ASSERT_TRUE(controller.IsDelayed());
+    ASSERT_LT(controller.delayed_write_rate(), last_rate);
+    last_rate = controller.delayed_write_rate();
+  }
+
+  controller.Update(0, 100 << 20);
+  ASSERT_EQ(1 << 20, controller.delayed_write_rate());
+  controller.Update(0, 150 << 20);
+  ASSERT_EQ(1 << 19, controller.delayed_write_rate());
+  // The tighter of the two limits wins.
+  controller.Update(options.level0_stop_writes_trigger - 1, 150 << 20);
+  ASSERT_LT(controller.delayed_write_rate(), 1 << 19);
+  // Never stops writes altogether.
+  controller.Update(0, 300 << 20);
+  ASSERT_GT(controller.delayed_write_rate(), 0);
+
+  controller.Update(0, 0);
+  ASSERT_FALSE(controller.IsDelayed());
+}
+
+TEST(WriteControllerTest, TokenBucket) {
+  WriteController controller(ControllerOptions());
+  controller.Update(0, 150 << 20);  // 512KB/s
+  uint64_t now = 10000000;
+
+  // The bucket starts out with 1ms worth of tokens.
+  ASSERT_EQ(0, controller.GetDelay(now, 512));
+  // Then writes are paced at the delayed rate...
+  ASSERT_NEAR(1000000, controller.GetDelay(now, 512 << 10), 1000);
+  ASSERT_NEAR(2000000, controller.GetDelay(now, 512 << 10), 1000);
+  // ...even if the writer did not wait for its delay.
+  now += 1000000;
+  ASSERT_NEAR(1500000, controller.GetDelay(now, 256 << 10), 1000);
+
+  // Idle time earns at most 1ms worth of tokens.
+  now += 10000000;
+  ASSERT_EQ(0, controller.GetDelay(now, 512));
+  ASSERT_NEAR(1000000, controller.GetDelay(now, 512 << 10), 1000);
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
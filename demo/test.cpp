@@ -20,6 +20,7 @@
 
 #include "leveldb/write_batch.h"
 #include "leveldb/db.h"
+#include "leveldb/env.h"
 
 #include <fstream>
 #include <iostream>
@@ -54,7 +55,7 @@ public:
 
     SingletonEnv &operator=(const SingletonEnv &) = delete;
 
-    Env *env() { return reinterpret_cast<Env *>(&env_storage_); }
+    leveldb::Env *env() { return reinterpret_cast<leveldb::Env *>(&env_storage_); }
 
     static void AssertEnvNotInitialized() {
     }
@@ -69,12 +70,5 @@ private:
 
 
 int main() {
-    Derived derived;
-    derived.a();
-
-    derived.name = 12;
-
-
-
     return 0;
 }
\ No newline at end of file
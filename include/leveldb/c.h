@@ -54,12 +54,15 @@ extern "C" {
 
 typedef struct leveldb_t leveldb_t;
 typedef struct leveldb_cache_t leveldb_cache_t;
+typedef struct leveldb_memtablerep_factory_t leveldb_memtablerep_factory_t;
+typedef struct leveldb_compactionfilter_t leveldb_compactionfilter_t;
 typedef struct leveldb_comparator_t leveldb_comparator_t;
 typedef struct leveldb_env_t leveldb_env_t;
 typedef struct leveldb_filelock_t leveldb_filelock_t;
 typedef struct leveldb_filterpolicy_t leveldb_filterpolicy_t;
 typedef struct leveldb_iterator_t leveldb_iterator_t;
 typedef struct leveldb_logger_t leveldb_logger_t;
+typedef struct leveldb_mergeoperator_t leveldb_mergeoperator_t;
 typedef struct leveldb_options_t leveldb_options_t;
 typedef struct leveldb_randomfile_t leveldb_randomfile_t;
 typedef struct leveldb_readoptions_t leveldb_readoptions_t;
@@ -86,6 +89,19 @@ LEVELDB_EXPORT void leveldb_delete(leveldb_t* db,
                                    const char* key, size_t keylen,
                                    char** errptr);
 
+LEVELDB_EXPORT void leveldb_merge(leveldb_t* db,
+                                  const leveldb_writeoptions_t* options,
+                                  const char* key, size_t keylen,
+                                  const char* val, size_t vallen,
+                                  char** errptr);
+
+LEVELDB_EXPORT void leveldb_delete_range(leveldb_t* db,
+                                         const leveldb_writeoptions_t* options,
+                                         const char* start_key,
+                                         size_t start_keylen,
+                                         const char* limit_key,
+                                         size_t limit_keylen, char** errptr);
+
 LEVELDB_EXPORT void leveldb_write(leveldb_t* db,
                                   const leveldb_writeoptions_t* options,
                                   leveldb_writebatch_t* batch, char** errptr);
@@ -155,6 +171,12 @@ LEVELDB_EXPORT void leveldb_writebatch_put(leveldb_writebatch_t*,
                                            const char* val, size_t vlen);
 LEVELDB_EXPORT void leveldb_writebatch_delete(leveldb_writebatch_t*,
                                               const char* key, size_t klen);
+LEVELDB_EXPORT void leveldb_writebatch_merge(leveldb_writebatch_t*,
+                                             const char* key, size_t klen,
+                                             const char* val, size_t vlen);
+LEVELDB_EXPORT void leveldb_writebatch_delete_range(
+    leveldb_writebatch_t*, const char* start_key, size_t start_klen,
+    const char* limit_key, size_t limit_klen);
 LEVELDB_EXPORT void leveldb_writebatch_iterate(
     const leveldb_writebatch_t*, void* state,
     void (*put)(void*, const char* k, size_t klen, const char* v, size_t vlen),
@@ -170,6 +192,10 @@ LEVELDB_EXPORT void leveldb_options_set_comparator(leveldb_options_t*,
                                                    leveldb_comparator_t*);
 LEVELDB_EXPORT void leveldb_options_set_filter_policy(leveldb_options_t*,
                                                       leveldb_filterpolicy_t*);
+LEVELDB_EXPORT void leveldb_options_set_compaction_filter(
+    leveldb_options_t*, leveldb_compactionfilter_t*);
+LEVELDB_EXPORT void leveldb_options_set_merge_operator(
+    leveldb_options_t*, leveldb_mergeoperator_t*);
 LEVELDB_EXPORT void leveldb_options_set_create_if_missing(leveldb_options_t*,
                                                           uint8_t);
 LEVELDB_EXPORT void leveldb_options_set_error_if_exists(leveldb_options_t*,
@@ -189,10 +215,79 @@ LEVELDB_EXPORT void leveldb_options_set_block_restart_interval(
     leveldb_options_t*, int);
 LEVELDB_EXPORT void leveldb_options_set_max_file_size(leveldb_options_t*,
                                                       size_t);
+LEVELDB_EXPORT void leveldb_options_set_target_file_size_multiplier(
+    leveldb_options_t*, int);
+LEVELDB_EXPORT void leveldb_options_set_level0_file_num_compaction_trigger(
+    leveldb_options_t*, int);
+LEVELDB_EXPORT void leveldb_options_set_level0_slowdown_writes_trigger(
+    leveldb_options_t*, int);
+LEVELDB_EXPORT void leveldb_options_set_level0_stop_writes_trigger(
+    leveldb_options_t*, int);
+LEVELDB_EXPORT void leveldb_options_set_max_bytes_for_level_base(
+    leveldb_options_t*, uint64_t);
+LEVELDB_EXPORT void leveldb_options_set_max_bytes_for_level_multiplier(
+    leveldb_options_t*, double);
+LEVELDB_EXPORT void leveldb_options_set_max_bytes_for_level_multiplier_additional(
+    leveldb_options_t*, const int* level_values, size_t num_levels);
+LEVELDB_EXPORT void leveldb_options_set_level_compaction_dynamic_level_bytes(
+    leveldb_options_t*, uint8_t);
+LEVELDB_EXPORT void leveldb_options_set_deletion_ratio_compaction_trigger(
+    leveldb_options_t*, double);
+LEVELDB_EXPORT void leveldb_options_set_max_background_compactions(
+    leveldb_options_t*, int);
+LEVELDB_EXPORT void leveldb_options_set_max_subcompactions(leveldb_options_t*,
+                                                           int);
+LEVELDB_EXPORT void leveldb_options_set_enable_pipelined_write(
+    leveldb_options_t*, uint8_t);
+LEVELDB_EXPORT void leveldb_options_set_allow_concurrent_memtable_write(
+    leveldb_options_t*, uint8_t);
+LEVELDB_EXPORT void leveldb_options_set_max_write_buffer_number(
+    leveldb_options_t*, int);
+LEVELDB_EXPORT void leveldb_options_set_merge_memtables_on_flush(
+    leveldb_options_t*, uint8_t);
+LEVELDB_EXPORT void leveldb_options_set_delayed_write_rate(leveldb_options_t*,
+                                                           uint64_t);
+LEVELDB_EXPORT void leveldb_options_set_soft_pending_compaction_bytes_limit(
+    leveldb_options_t*, uint64_t);
+LEVELDB_EXPORT void leveldb_options_set_hard_pending_compaction_bytes_limit(
+    leveldb_options_t*, uint64_t);
+LEVELDB_EXPORT void leveldb_options_set_memtable_factory(
+    leveldb_options_t*, leveldb_memtablerep_factory_t*);
+LEVELDB_EXPORT void leveldb_options_set_memtable_chunk_size(leveldb_options_t*,
+                                                            size_t);
+LEVELDB_EXPORT void leveldb_options_set_memtable_huge_pages(leveldb_options_t*,
+                                                            uint8_t);
 
 enum { leveldb_no_compression = 0, leveldb_snappy_compression = 1 };
 LEVELDB_EXPORT void leveldb_options_set_compression(leveldb_options_t*, int);
 
+enum {
+  leveldb_level_compaction = 0,
+  leveldb_universal_compaction = 1,
+  leveldb_fifo_compaction = 2
+};
+LEVELDB_EXPORT void leveldb_options_set_compaction_style(leveldb_options_t*,
+                                                         int);
+
+enum {
+  leveldb_compaction_pri_round_robin = 0,
+  leveldb_compaction_pri_min_overlapping_ratio = 1,
+  leveldb_compaction_pri_oldest_data_first = 2
+};
+LEVELDB_EXPORT void leveldb_options_set_compaction_pri(leveldb_options_t*,
+                                                       int);
+LEVELDB_EXPORT void leveldb_options_set_universal_size_ratio(
+    leveldb_options_t*, int);
+LEVELDB_EXPORT void leveldb_options_set_universal_min_merge_width(
+    leveldb_options_t*, int);
+LEVELDB_EXPORT void leveldb_options_set_universal_max_merge_width(
+    leveldb_options_t*, int);
+LEVELDB_EXPORT void leveldb_options_set_universal_max_size_amplification_percent(
+    leveldb_options_t*, int);
+LEVELDB_EXPORT void leveldb_options_set_fifo_max_table_files_size(
+    leveldb_options_t*, uint64_t);
+LEVELDB_EXPORT void leveldb_options_set_fifo_ttl(leveldb_options_t*, uint64_t);
+
 /* Comparator */
 
 LEVELDB_EXPORT leveldb_comparator_t* leveldb_comparator_create(
@@ -217,6 +312,41 @@ LEVELDB_EXPORT void leveldb_filterpolicy_destroy(leveldb_filterpolicy_t*);
 LEVELDB_EXPORT leveldb_filterpolicy_t* leveldb_filterpolicy_create_bloom(
     int bits_per_key);
 
+/* Compaction filter */
+
+/* "filter" returns 1 to remove the key.  Otherwise it may set *value_changed
+   to 1 and *new_value to a malloc()ed replacement value, which is freed by
+   leveldb. */
+LEVELDB_EXPORT leveldb_compactionfilter_t* leveldb_compactionfilter_create(
+    void* state, void (*destructor)(void*),
+    uint8_t (*filter)(void*, int level, const char* key, size_t key_length,
+                      const char* existing_value, size_t value_length,
+                      char** new_value, size_t* new_value_length,
+                      uint8_t* value_changed),
+    const char* (*name)(void*));
+LEVELDB_EXPORT void leveldb_compactionfilter_destroy(
+    leveldb_compactionfilter_t*);
+
+/* Merge operator */
+
+/* "full_merge" applies the "num_operands" operands, oldest first, to the
+   existing value of the key, if "has_existing_value" is 1.  On success it
+   sets *success to 1 and returns the malloc()ed result, which is freed by
+   leveldb. */
+LEVELDB_EXPORT leveldb_mergeoperator_t* leveldb_mergeoperator_create(
+    void* state, void (*destructor)(void*),
+    char* (*full_merge)(void*, const char* key, size_t key_length,
+                        const char* existing_value, size_t value_length,
+                        uint8_t has_existing_value,
+                        const char* const* operands_list,
+                        const size_t* operands_list_length, int num_operands,
+                        uint8_t* success, size_t* new_value_length),
+    const char* (*name)(void*));
+LEVELDB_EXPORT void leveldb_mergeoperator_destroy(leveldb_mergeoperator_t*);
+
+LEVELDB_EXPORT leveldb_mergeoperator_t* leveldb_mergeoperator_create_uint64add(
+    void);
+
 /* Read options */
 
 LEVELDB_EXPORT leveldb_readoptions_t* leveldb_readoptions_create(void);
@@ -238,8 +368,22 @@ LEVELDB_EXPORT void leveldb_writeoptions_set_sync(leveldb_writeoptions_t*,
 /* Cache */
 
 LEVELDB_EXPORT leveldb_cache_t* leveldb_cache_create_lru(size_t capacity);
+LEVELDB_EXPORT leveldb_cache_t* leveldb_cache_create_clock(
+    size_t capacity, int num_shard_bits, size_t estimated_entry_charge);
 LEVELDB_EXPORT void leveldb_cache_destroy(leveldb_cache_t* cache);
 
+/* MemTable representations */
+
+LEVELDB_EXPORT leveldb_memtablerep_factory_t*
+leveldb_memtablerep_factory_create_skiplist(void);
+LEVELDB_EXPORT leveldb_memtablerep_factory_t*
+leveldb_memtablerep_factory_create_hash_skiplist(size_t prefix_length,
+                                                 size_t bucket_count);
+LEVELDB_EXPORT leveldb_memtablerep_factory_t*
+leveldb_memtablerep_factory_create_vector(void);
+LEVELDB_EXPORT void leveldb_memtablerep_factory_destroy(
+    leveldb_memtablerep_factory_t* factory);
+
 /* Env */
 
 LEVELDB_EXPORT leveldb_env_t* leveldb_create_default_env(void);
@@ -10,8 +10,8 @@
 // length strings, may use the length of the string as the charge for
 // the string.
 //
-// A builtin cache implementation with a least-recently-used eviction
-// policy is provided.  Clients may use their own implementations if
+// Builtin cache implementations with a least-recently-used and a CLOCK
+// eviction policy are provided.  Clients may use their own implementations if
 // they want something more sophisticated (like scan-resistance, a
 // custom eviction policy, variable cache sizing, etc.)
 
@@ -31,6 +31,20 @@ namespace leveldb {
 // of Cache uses a least-recently-used eviction policy.
     LEVELDB_EXPORT Cache *NewLRUCache(size_t capacity);
 
+// Create a new cache with a fixed size capacity.  This implementation
+// of Cache uses the CLOCK eviction policy, an approximation of LRU.
+// Lookup() and Release() of cached entries only use atomic operations,
+// so it scales better than NewLRUCache() when many threads read the
+// same hot entries.
+//
+// The cache is split into 2^num_shard_bits shards by key hash.  Each
+// shard has a fixed number of slots, sized to hold its share of
+// "capacity" in entries of "estimated_entry_charge"; if entries are much
+// smaller than that, the cache holds fewer entries than its capacity
+// allows.
+    LEVELDB_EXPORT Cache *NewClockCache(size_t capacity, int num_shard_bits = 4,
+                                        size_t estimated_entry_charge = 4096);
+
     class LEVELDB_EXPORT Cache {
     public:
         Cache() = default;
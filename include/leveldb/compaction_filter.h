@@ -0,0 +1,48 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A database can be configured with a custom CompactionFilter object,
+// which is shown the values that are written out by memtable flushes and
+// compactions.  It may remove a value or replace it with another one, e.g.
+// to expire old data or to collect garbage in the background instead of
+// issuing a Delete() for each of the keys.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
+#define STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
+
+#include <string>
+
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+class Slice;
+
+class LEVELDB_EXPORT CompactionFilter {
+ public:
+  virtual ~CompactionFilter();
+
+  // Return the name of this filter, for the info log.
+  virtual const char* Name() const = 0;
+
+  // Called for the newest value of "key" that is written to "level" by a
+  // compaction, or to level-0 by a memtable flush.  Values that may still
+  // be read through a snapshot are not shown to the filter, and neither
+  // are values that were already replaced by a newer value or deletion in
+  // the same compaction.
+  //
+  // Return true to remove the key: the value is then turned into a
+  // deletion, which hides any older value of the key in the levels below.
+  // Otherwise the value is kept, unless the filter stores a replacement in
+  // *new_value and sets *value_changed to true.
+  //
+  // Filter() may be called from several background threads at the same
+  // time and must not call back into the DB.
+  virtual bool Filter(int level, const Slice& key, const Slice& existing_value,
+                      std::string* new_value, bool* value_changed) const = 0;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
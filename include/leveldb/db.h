@@ -75,6 +75,23 @@ namespace leveldb {
         // Note: consider setting options.sync = true.
         virtual Status Delete(const WriteOptions &options, const Slice &key) = 0;
 
+        // Merge "value" into the database entry for "key" with
+        // Options::merge_operator, without reading the entry.  Returns OK on
+        // success, and a non-OK status on error, e.g. if the database has no
+        // merge operator.
+        // Note: consider setting options.sync = true.
+        virtual Status Merge(const WriteOptions &options, const Slice &key,
+                             const Slice &value);
+
+        // Remove the database entries (if any) for all keys in
+        // [begin_key, end_key).  The range is stored as a single tombstone,
+        // so the cost does not depend on the number of keys it covers.
+        // Returns OK on success, and a non-OK status on error, e.g. if
+        // end_key is before begin_key.
+        // Note: consider setting options.sync = true.
+        virtual Status DeleteRange(const WriteOptions &options,
+                                   const Slice &begin_key, const Slice &end_key);
+
         // Apply the specified updates to the database.
         // Returns OK on success, non-OK on failure.
         // Note: consider setting options.sync = true.
@@ -114,11 +131,26 @@ namespace leveldb {
         //  "leveldb.num-files-at-level<N>" - return the number of files at level <N>,
         //     where <N> is an ASCII representation of a level number (e.g. "0").
         //  "leveldb.stats" - returns a multi-line string that describes statistics
-        //     about the internal operation of the DB.
+        //     about the internal operation of the DB, including the write
+        //     amplification of each level and of the whole DB.
         //  "leveldb.sstables" - returns a multi-line string that describes all
         //     of the sstables that make up the db contents.
         //  "leveldb.approximate-memory-usage" - returns the approximate number of
         //     bytes of memory in use by the DB.
+        //  "leveldb.stall-micros" - returns the total number of microseconds
+        //     writers have been held up waiting for background work.
+        //  "leveldb.stall-micros.<cause>" - the same for one cause only, where
+        //     <cause> is "delayed-write", "memtable-full", "level0-stop" or
+        //     "pending-compaction-stop".
+        //  "leveldb.delayed-write-rate" - returns the rate in bytes per second
+        //     that writes are currently limited to, or 0 if they are not.
+        //  "leveldb.estimate-pending-compaction-bytes" - returns the estimated
+        //     number of bytes that compactions still have to rewrite.
+        //  "leveldb.num-immutable-memtables" - returns the number of memtables
+        //     that are waiting to be flushed.
+        //  "leveldb.compaction-bytes-written" - returns the number of bytes that
+        //     memtable flushes and compactions wrote to table files since the
+        //     DB was opened.
         virtual bool GetProperty(const Slice &property, std::string *value) = 0;
 
         // For each i in [0,n-1], store in "sizes[i]", the approximate
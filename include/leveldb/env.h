@@ -204,6 +204,28 @@ namespace leveldb {
         // serialized.
         virtual void Schedule(void (*function)(void *arg), void *arg) = 0;
 
+        // Make at least "number" threads available for running the functions
+        // passed to Schedule(), so that up to "number" of them may execute
+        // concurrently.  Calls never shrink the pool.
+        //
+        // The default implementation does nothing.
+        virtual void SetBackgroundThreads(int number);
+
+        // Like Schedule(), but "function(arg)" runs on a separate background
+        // thread reserved for short, latency-sensitive work (e.g. memtable
+        // flushes), so it never queues behind long-running items passed to
+        // Schedule().
+        //
+        // The default implementation forwards to Schedule().
+        virtual void ScheduleHighPriority(void (*function)(void *arg), void *arg);
+
+        // Returns true if the functions passed to ScheduleHighPriority() run
+        // on a thread of their own, and false if they may queue behind the
+        // ones passed to Schedule().
+        //
+        // The default implementation returns false.
+        virtual bool HasHighPriorityThread();
+
         // Start a new thread, invoking "function(arg)" within the new thread.
         // When "function(arg)" returns, the thread will be destroyed.
         virtual void StartThread(void (*function)(void *arg), void *arg) = 0;
@@ -412,6 +434,18 @@ namespace leveldb {
             return target_->Schedule(f, a);
         }
 
+        void SetBackgroundThreads(int number) override {
+            return target_->SetBackgroundThreads(number);
+        }
+
+        void ScheduleHighPriority(void (*f)(void *), void *a) override {
+            return target_->ScheduleHighPriority(f, a);
+        }
+
+        bool HasHighPriorityThread() override {
+            return target_->HasHighPriorityThread();
+        }
+
         void StartThread(void (*f)(void *), void *a) override {
             return target_->StartThread(f, a);
         }
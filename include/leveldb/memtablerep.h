@@ -0,0 +1,75 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A database can be configured with a MemTableRepFactory, which picks the
+// data structure that holds the entries of each memtable.  The default is
+// a skiplist, which is a good fit for most workloads.  The alternatives
+// below trade scan and flush cost for cheaper point lookups or inserts.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_MEMTABLEREP_H_
+#define STORAGE_LEVELDB_INCLUDE_MEMTABLEREP_H_
+
+#include <cstddef>
+
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+class MemTableRepFactoryImpl;
+
+// Only the functions below create factories.  The interface through which
+// a factory builds representations is internal, so the class cannot be
+// implemented outside of the library.
+class LEVELDB_EXPORT MemTableRepFactory {
+ public:
+  MemTableRepFactory(const MemTableRepFactory&) = delete;
+  MemTableRepFactory& operator=(const MemTableRepFactory&) = delete;
+
+  virtual ~MemTableRepFactory();
+
+  // Return the name of this representation, for the info log.
+  virtual const char* Name() const = 0;
+
+  // Return true if several threads may insert into the representations
+  // created by this factory at the same time.  Needed for
+  // Options::allow_concurrent_memtable_write.
+  virtual bool SupportsConcurrentInserts() const { return false; }
+
+ private:
+  friend class MemTableRepFactoryImpl;
+
+  MemTableRepFactory() = default;
+};
+
+// Return a factory for skiplists, the default representation.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+LEVELDB_EXPORT const MemTableRepFactory* NewSkipListRepFactory();
+
+// Return a factory for a hash table of skiplists: entries are spread over
+// "bucket_count" skiplists by a hash of the first "prefix_length" bytes of
+// their user key.  Point lookups only search one small skiplist, but
+// iterating over the memtable (for scans and for flushes) has to sort all
+// of its entries first.  Good for point-lookup-heavy workloads.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+LEVELDB_EXPORT const MemTableRepFactory* NewHashSkipListRepFactory(
+    size_t prefix_length, size_t bucket_count = 50000);
+
+// Return a factory for an append-only vector that is sorted once, when the
+// memtable is flushed.  Inserts are much cheaper than with a skiplist, but
+// reads of a memtable that is still being written scan or sort all of its
+// entries.  A DB::Get() scans them under the lock that inserts take, so it
+// holds up every writer for as long as the scan runs.  Only use it for
+// write-only bulk loads that do not read until the load is done.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+LEVELDB_EXPORT const MemTableRepFactory* NewVectorRepFactory();
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_MEMTABLEREP_H_
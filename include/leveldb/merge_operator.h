@@ -0,0 +1,55 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A database can be configured with a custom MergeOperator object, which
+// gives a meaning to the operands written by DB::Merge().  Merges are blind
+// writes: the operands of a key are only combined with its value when the
+// key is read, or when a compaction finds them next to each other.  This
+// turns read-modify-write updates, e.g. of counters or lists, into a single
+// write that needs no Get() and no application lock.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+#define STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+
+#include <string>
+#include <vector>
+
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT MergeOperator {
+ public:
+  virtual ~MergeOperator();
+
+  // Return the name of this operator.  Note that the operands written to a
+  // database have to be understood by the operator it is reopened with.
+  virtual const char* Name() const = 0;
+
+  // Apply "operands", oldest first, to the value of "key" that they were
+  // written on top of, and store the result in *new_value.
+  // "existing_value" is nullptr if the key had no value or was deleted.
+  //
+  // Return false if the operands cannot be applied.  Reads of the key then
+  // fail with a Corruption error, and compactions keep the operands as they
+  // are.
+  //
+  // FullMerge() may be called from several threads at the same time.
+  virtual bool FullMerge(const Slice& key, const Slice* existing_value,
+                         const std::vector<Slice>& operands,
+                         std::string* new_value) const = 0;
+};
+
+// Return a new merge operator for counters: values and operands are
+// unsigned 64-bit integers in little-endian fixed-width encoding, and each
+// operand is added to the value.  A missing value counts as 0.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+LEVELDB_EXPORT const MergeOperator* NewUInt64AddOperator();
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
@@ -6,6 +6,8 @@
 #define STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
 
 #include <cstddef>
+#include <cstdint>
+#include <vector>
 
 #include "leveldb/export.h"
 
@@ -13,6 +15,8 @@ namespace leveldb {
 
     class Cache;
 
+    class CompactionFilter;
+
     class Comparator;
 
     class Env;
@@ -21,6 +25,10 @@ namespace leveldb {
 
     class Logger;
 
+    class MemTableRepFactory;
+
+    class MergeOperator;
+
     class Snapshot;
 
 // DB contents are stored in a set of blocks, each of which holds a
@@ -34,6 +42,34 @@ namespace leveldb {
         kSnappyCompression = 0x1
     };
 
+// How the DB decides which files to merge in the background.
+    enum CompactionStyle {
+        // Keep the data in levels of growing size, each one a single
+        // sorted run (except level-0).  Lowest space and read amplification.
+        kCompactionStyleLevel = 0x0,
+        // Keep the data in level-0 as a list of sorted runs, and merge runs
+        // of similar size.  Lowest write amplification.
+        kCompactionStyleUniversal = 0x1,
+        // Keep the data in level-0 in the order it was written, and delete
+        // the oldest files once they grow too large or too old.  Never
+        // rewrites any data.
+        kCompactionStyleFIFO = 0x2
+    };
+
+// Which file of a level the level style compacts next when the level has
+// grown over its size limit.
+    enum CompactionPri {
+        // Go through the files in key order, each compaction starting after
+        // the range of the previous one.
+        kCompactionPriRoundRobin = 0x0,
+        // The file that overlaps the fewest bytes of the next level relative
+        // to its own size.  Fewest bytes rewritten per byte moved down.
+        kCompactionPriMinOverlappingRatio = 0x1,
+        // The file whose oldest data was written first, so that old updates
+        // and deletions keep moving towards the last level.
+        kCompactionPriOldestDataFirst = 0x2
+    };
+
 // Options 通过传入给 DB::OPen 来控制数据库行为
     struct LEVELDB_EXPORT Options {
         // 使用默认值构造Options
@@ -70,6 +106,31 @@ namespace leveldb {
         // 状态。一个大的写缓存可能会导致比较长的数据库恢复时间
         size_t write_buffer_size = 4 * 1024 * 1024;
 
+        // 内存中最多同时存在的写缓存(memtable)数量，包括正在写入的一个和等待落盘的只读memtable。
+        // 大于2时，在前一个memtable还没有落盘的时候写满的memtable会排队等待落盘，而不会马上阻塞写入，
+        // 用来吸收突发的写入。查询会按照从新到旧的顺序查找所有的memtable，数量越多点查越慢，占用内存也越多
+        // 默认为2，也就是和原来一样只有一个等待落盘的memtable
+        int max_write_buffer_number = 2;
+
+        // 如果设置为true，一次落盘会把所有排队的只读memtable合并成一个level-0文件，
+        // 可以减少level-0文件的数量；否则每次只把最旧的一个memtable写成一个文件
+        // 默认为false
+        bool merge_memtables_on_flush = false;
+
+        // level-0文件数量达到slowdown的阈值，或者预估还需要compaction重写的数据量达到
+        // soft_pending_compaction_bytes_limit时，写入速度会被限制在这个值(字节/秒)以下，
+        // 并且越接近停止写入的阈值限制的速度越低。写入按照令牌桶平滑的延迟，而不是每次固定的sleep 1ms
+        // 默认为16MB/s
+        uint64_t delayed_write_rate = 16 * 1024 * 1024;
+
+        // 预估需要compaction的数据量达到该值后开始限制写入速度，为0表示不按照该值限速
+        // 默认为64GB
+        uint64_t soft_pending_compaction_bytes_limit = 64ull * 1024 * 1024 * 1024;
+
+        // 预估需要compaction的数据量达到该值后停止写入，直到compaction追上来，为0表示不按照该值停止写入
+        // 默认为256GB
+        uint64_t hard_pending_compaction_bytes_limit = 256ull * 1024 * 1024 * 1024;
+
         // 数据库允许打开文件的最大数量，当你预估数据库存储的内容可能会很大时，可以根据需要适当增大该值
         // 进行预算时，按照每2M内容一个文件来进行预算
         int max_open_files = 1000;
@@ -97,6 +158,133 @@ namespace leveldb {
         // 大部分客户端应该保持改制不变，但是当你的系统对大文件更加高效的时候，你应该考虑适当的增加该值的大小
         size_t max_file_size = 2 * 1024 * 1024;
 
+        // level-1往下每一层的文件大小是上一层的多少倍，level-0和level-1的文件大小为max_file_size
+        // 默认为1，也就是每一层的文件大小都一样
+        int target_file_size_multiplier = 1;
+
+        // level-0的文件数量达到该值时开始level-0的compaction
+        // 默认为4
+        int level0_file_num_compaction_trigger = 4;
+
+        // level-0的文件数量达到该值时开始限制写入速度(见delayed_write_rate)
+        // 默认为8
+        int level0_slowdown_writes_trigger = 8;
+
+        // level-0的文件数量达到该值时停止写入，直到compaction把文件数量降下来
+        // 默认为12
+        int level0_stop_writes_trigger = 12;
+
+        // level-1中所有文件的总大小上限，超过之后会往level-2进行compaction
+        // 默认为10MB
+        uint64_t max_bytes_for_level_base = 10 * 1048576;
+
+        // level-2往下每一层的总大小上限是上一层的多少倍。增大该值可以减少层数、降低读放大和空间放大，
+        // 但是每次compaction需要重写的下一层数据变多，写放大会变大
+        // 默认为10
+        double max_bytes_for_level_multiplier = 10;
+
+        // 对每一层的大小上限再单独乘上的系数：第i个元素作用于level-(i+1)相对于level-i的倍数，
+        // 也就是level-(i+1)的上限为level-i的上限 * max_bytes_for_level_multiplier * 第i个元素。
+        // 缺少的元素按照1处理
+        // 默认为空
+        std::vector<int> max_bytes_for_level_multiplier_additional;
+
+        // 如果设置为true，每一层的大小上限不再从level-1的max_bytes_for_level_base往下推算，而是从当前最大的
+        // 一层(通常是最后一层)的实际大小按照max_bytes_for_level_multiplier往上倒推，上限小于
+        // max_bytes_for_level_base / max_bytes_for_level_multiplier的层保持为空，level-0直接compaction到
+        // 下面第一个非空的层(base level)。这样不管数据库多大，最后一层都保存了大约90%的数据，空间放大和写放大都有上界
+        // 打开之后max_bytes_for_level_multiplier_additional不再生效，memtable落盘也总是写到level-0
+        // 默认为false
+        bool level_compaction_dynamic_level_bytes = false;
+
+        // kCompactionStyleLevel下，一个文件中删除标记占所有entry的比例达到该值时，即使所在层没有超过大小上限，
+        // 也会把它compaction到下一层，让删除标记和被它覆盖的旧数据尽快被清理掉，避免迭代器每次Next都要跳过大量删除标记。
+        // 适合先写入后删除的队列类负载。最后一层的文件不会因此compaction。0表示不开启
+        // 默认为0
+        double deletion_ratio_compaction_trigger = 0;
+
+        // kCompactionStyleLevel下，level-1及以上的层超过大小上限时选择哪个文件compaction到下一层，见CompactionPri。
+        // kCompactionPriMinOverlappingRatio选择和下一层重叠的数据量与自身大小之比最小的文件，
+        // 每次compaction重写的下一层数据最少，可以降低写放大，写放大可以通过leveldb.stats查看。
+        // kCompactionPriOldestDataFirst选择最老的数据最早写入的文件。level-0总是合并所有重叠的文件，不受影响
+        // 默认为kCompactionPriRoundRobin，也就是和原来一样按key的顺序轮流选择
+        CompactionPri compaction_pri = kCompactionPriRoundRobin;
+
+        // compaction的方式，见CompactionStyle。
+        // kCompactionStyleUniversal下所有数据都以sorted run(有序段)的形式保存在level-0，每次flush生成一个新的run，
+        // compaction把最新的若干个大小相近的run合并成一个，用更多的空间放大和读放大换取小得多的写放大，适合写多读少的场景。
+        // 此时level0_file_num_compaction_trigger表示run的数量达到多少时开始compaction，
+        // 分层相关的选项(max_bytes_for_level_*等)不再生效
+        // 默认为kCompactionStyleLevel
+        CompactionStyle compaction_style = kCompactionStyleLevel;
+
+        // kCompactionStyleUniversal下，从最新的run开始合并时，下一个run的大小不超过已选中run的总大小的
+        // (100 + universal_size_ratio)%，就把它一起合并
+        // 默认为1
+        int universal_size_ratio = 1;
+
+        // kCompactionStyleUniversal下一次合并的run数量的下限和上限
+        // 默认为2和不限
+        int universal_min_merge_width = 2;
+        int universal_max_merge_width = 1 << 30;
+
+        // kCompactionStyleUniversal下，除最老的run以外所有run的总大小超过最老的run的百分之多少时，
+        // 把所有run合并成一个，以此来限制空间放大
+        // 默认为200
+        int universal_max_size_amplification_percent = 200;
+
+        // kCompactionStyleFIFO下所有文件都保存在level-0，从不合并，所有文件的总大小超过该值时，
+        // 从最老的文件开始整个删除，直到总大小不超过该值。0表示不限制大小
+        // 默认为1GB
+        uint64_t fifo_max_table_files_size = 1024 * 1048576;
+
+        // kCompactionStyleFIFO下文件中最老的数据写入超过这么多秒之后，整个文件会被删除。
+        // 写入时间按数据所在的memtable收到第一次写入的时间计算，重启时从日志恢复的数据按落盘的时间计算。
+        // 只在memtable落盘的时候检查，没有写入时过期的文件会保留到下一次落盘。0表示不过期
+        // level-0文件数量的写入限速和停写在这种方式下不生效
+        // 默认为0
+        uint64_t fifo_ttl = 0;
+
+        // 允许同时执行的后台compaction的最大数量。大于1时，DB会让Env准备相应数量的后台线程，
+        // 并且并行执行互不重叠(层级不同或者key范围不相交)的compaction，用来在持续写入时更快的消化level-0文件
+        // 默认为1，也就是和原来一样只有一个后台compaction
+        int max_background_compactions = 1;
+
+        // 单个compaction最多拆分成的key范围(subcompaction)数量。大于1时，会按照输入文件的边界把
+        // compaction切分成互不相交的key范围，由多个线程并行的合并和生成文件，最后在同一个VersionEdit
+        // 中一起生效，可以显著的缩短大的level-0 -> level-1 compaction的耗时
+        // 默认为1，也就是不拆分
+        int max_subcompactions = 1;
+
+        // 如果设置为true，写入会分成两个流水线阶段：一组写入在写WAL的同时，上一组写入可以插入memtable，
+        // 这样多线程写入的时候写日志和写内存表可以重叠执行，提高吞吐量
+        // 默认为false，每组写入在写完日志并插入memtable之后下一组才能开始
+        bool enable_pipelined_write = false;
+
+        // 只在enable_pipelined_write为true时生效。如果设置为true，同一组写入中的每个线程会并发的把
+        // 自己的batch插入memtable(跳表使用CAS无锁插入)，而不是由组长一个线程插入整组数据
+        // 默认为false
+        bool allow_concurrent_memtable_write = false;
+
+        // 用来指定memtable内部保存数据的数据结构，为空时使用跳表
+        // 可以使用NewHashSkipListRepFactory()让点查只需要查找一个很小的跳表，或者使用NewVectorRepFactory()
+        // 让只写不读的批量导入阶段插入更快(数据在flush的时候才排序一次)，具体取舍见leveldb/memtablerep.h。
+        // 后者在导入期间不能读：Get要在插入使用的锁内扫描整个memtable，会阻塞所有写入。
+        // 只能使用上面这些函数返回的factory，不支持自己实现
+        // 默认: nullptr
+        const MemTableRepFactory *memtable_factory = nullptr;
+
+        // 如果非0，memtable的内存不再按4K的block逐个new出来，而是按这个大小整块的向操作系统(mmap)申请，
+        // 再从中切分block，对于很大的write_buffer_size可以省掉绝大部分的内存分配调用
+        // 默认为0，也就是和原来一样逐个申请block
+        size_t memtable_chunk_size = 0;
+
+        // 只在memtable_chunk_size非0时生效。如果设置为true，memtable的整块内存会尽量使用大页
+        // (先尝试MAP_HUGETLB，需要系统预留大页，失败后使用madvise(MADV_HUGEPAGE)透明大页)，用来减少TLB miss
+        // 使用MAP_HUGETLB时memtable_chunk_size需要是2M的整数倍
+        // 默认为false
+        bool memtable_huge_pages = false;
+
         // 用来指定压缩算法，可以动态修改
         // 默认: kSnappyCompression压缩算法，能给出极速但是轻量级压缩.
         //
@@ -119,6 +307,18 @@ namespace leveldb {
         // 使用指定的过滤条件，来讲减少对磁盘的访问(设置为NewBloomFilterPolicy之后，能很大程度的减少对磁盘的访问次数)
         // NewBloomFilterPolicy()
         const FilterPolicy *filter_policy = nullptr;
+
+        // 如果非空，memtable落盘和compaction写出每个key的最新值之前都会交给它过滤，它可以删除这个值或者
+        // 替换成新的值，用来在后台做过期数据清理和垃圾回收，而不用对每个key调用Delete()
+        // 还可能被快照读到的值不会交给它过滤，具体见leveldb/compaction_filter.h
+        // 默认: nullptr
+        const CompactionFilter *compaction_filter = nullptr;
+
+        // 使用DB::Merge()时必须设置，用来把一个key的多个合并操作数和它原来的值合并成一个值
+        // 操作数只在读取时或者compaction遇到时才合并，所以计数器、追加列表这类的更新不用先Get再Put
+        // 数据库写入了操作数之后，重新打开时要使用能识别它们的合并算子
+        // 默认: nullptr
+        const MergeOperator *merge_operator = nullptr;
     };
 
 // Options that control read operations
@@ -57,6 +57,11 @@ namespace leveldb {
         // call one of the Seek methods on the iterator before using it).
         Iterator *NewIterator(const ReadOptions &) const;
 
+        // Returns a new iterator over the entries added to the table with
+        // TableBuilder::AddRangeTombstone(), which NewIterator() does not
+        // yield.  The iterator is empty if there are none.
+        Iterator *NewRangeTombstoneIterator() const;
+
         // Given a key, return an approximate byte offset in the file where
         // the data for that key begins (or would begin if the key were
         // present in the file).  The returned value is in terms of file
@@ -85,6 +90,8 @@ namespace leveldb {
 
         void ReadFilter(const Slice &filter_handle_value);
 
+        void ReadRangeDelBlock(const Slice &range_del_handle_value);
+
         Rep *const rep_;
     };
 
@@ -54,6 +54,12 @@ namespace leveldb {
         // REQUIRES: Finish(), Abandon() have not been called
         void Add(const Slice &key, const Slice &value);
 
+        // Add key,value to the range deletion meta block of the table.  The
+        // entries of that block are kept apart from the ones added by Add()
+        // and may be added in any order; they are sorted by Finish().
+        // REQUIRES: Finish(), Abandon() have not been called
+        void AddRangeTombstone(const Slice &key, const Slice &value);
+
         // Advanced operation: flush any buffered key/value pairs to file.
         // Can be used to ensure that two adjacent entries never live in
         // the same data block.  Most clients should not need to use this method.
@@ -78,6 +84,9 @@ namespace leveldb {
         // Number of calls to Add() so far.
         uint64_t NumEntries() const;
 
+        // Number of calls to AddRangeTombstone() so far.
+        uint64_t NumRangeTombstones() const;
+
         // Size of the file generated so far.  If invoked after a successful
         // Finish() call, returns the size of the final generated file.
         uint64_t FileSize() const;
@@ -39,6 +39,14 @@ namespace leveldb {
             virtual void Put(const Slice &key, const Slice &value) = 0;
 
             virtual void Delete(const Slice &key) = 0;
+
+            // Called for the operands added by WriteBatch::Merge().  The default
+            // implementation ignores them.
+            virtual void Merge(const Slice &key, const Slice &value);
+
+            // Called for the ranges added by WriteBatch::DeleteRange().  The
+            // default implementation ignores them.
+            virtual void DeleteRange(const Slice &begin_key, const Slice &end_key);
         };
 
         WriteBatch();
@@ -56,6 +64,13 @@ namespace leveldb {
         // If the database contains a mapping for "key", erase it.  Else do nothing.
         void Delete(const Slice &key);
 
+        // Merge "value" into the value of "key" with Options::merge_operator.
+        void Merge(const Slice &key, const Slice &value);
+
+        // Erase the mappings of all keys in [begin_key, end_key).  Stored as
+        // a single range tombstone, whatever the number of keys.
+        void DeleteRange(const Slice &begin_key, const Slice &end_key);
+
         // Clear all updates buffered in this batch.
         void Clear();
 
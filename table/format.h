@@ -92,6 +92,9 @@ namespace leveldb {
 // 1-byte type + 32-bit crc
     static const size_t kBlockTrailerSize = 5;
 
+// Metaindex key of the block that holds the range tombstones of a table.
+    static const char kRangeDelBlockName[] = "leveldb.range_del";
+
     struct BlockContents {
         Slice data;           // Actual contents of data
         bool cachable;        // True iff data can be cached
@@ -22,6 +22,7 @@ namespace leveldb {
             delete filter;
             delete[] filter_data;
             delete index_block;
+            delete range_del_block;
         }
 
         Options options;
@@ -33,6 +34,10 @@ namespace leveldb {
 
         BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
         Block *index_block{};
+
+        // Range tombstones, if any, and the error met while reading them.
+        Block *range_del_block{};
+        Status range_del_status;
     };
 
     Status Table::Open(const Options &options, RandomAccessFile *file,
@@ -80,29 +85,38 @@ namespace leveldb {
     }
 
     void Table::ReadMeta(const Footer &footer) {
-        if (rep_->options.filter_policy == nullptr) {
-            return;  // Do not need any metadata
+        // An empty block is a single restart point and the restart count.
+        if (footer.metaindex_handle().size() <= 2 * sizeof(uint32_t)) {
+            return;  // No metadata
         }
 
-        // TODO(sanjay): Skip this if footer.metaindex_handle() size indicates
-        // it is an empty block.
         ReadOptions opt;
         if (rep_->options.paranoid_checks) {
             opt.verify_checksums = true;
         }
         BlockContents contents;
-        if (!ReadBlock(rep_->file, opt, footer.metaindex_handle(), &contents).ok()) {
-            // Do not propagate errors since meta info is not needed for operation
+        Status s = ReadBlock(rep_->file, opt, footer.metaindex_handle(), &contents);
+        if (!s.ok()) {
+            // Do not propagate errors since meta info is not needed for
+            // operation, except for the range tombstones, which are only
+            // read for tables that have some.
+            rep_->range_del_status = s;
             return;
         }
         Block *meta = new Block(contents);
 
         Iterator *iter = meta->NewIterator(BytewiseComparator());
-        std::string key = "filter.";
-        key.append(rep_->options.filter_policy->Name());
-        iter->Seek(key);
-        if (iter->Valid() && iter->key() == Slice(key)) {
-            ReadFilter(iter->value());
+        if (rep_->options.filter_policy != nullptr) {
+            std::string key = "filter.";
+            key.append(rep_->options.filter_policy->Name());
+            iter->Seek(key);
+            if (iter->Valid() && iter->key() == Slice(key)) {
+                ReadFilter(iter->value());
+            }
+        }
+        iter->Seek(kRangeDelBlockName);
+        if (iter->Valid() && iter->key() == Slice(kRangeDelBlockName)) {
+            ReadRangeDelBlock(iter->value());
         }
         delete iter;
         delete meta;
@@ -131,6 +145,23 @@ namespace leveldb {
         rep_->filter = new FilterBlockReader(rep_->options.filter_policy, block.data);
     }
 
+    void Table::ReadRangeDelBlock(const Slice &range_del_handle_value) {
+        Slice v = range_del_handle_value;
+        BlockHandle handle;
+        Status s = handle.DecodeFrom(&v);
+        BlockContents block;
+        if (s.ok()) {
+            ReadOptions opt;
+            opt.verify_checksums = true;
+            s = ReadBlock(rep_->file, opt, handle, &block);
+        }
+        if (s.ok()) {
+            rep_->range_del_block = new Block(block);
+        } else {
+            rep_->range_del_status = s;
+        }
+    }
+
     Table::~Table() { delete rep_; }
 
     static void DeleteBlock(void *arg, void *ignored) {
@@ -211,6 +242,16 @@ namespace leveldb {
                 &Table::BlockReader, const_cast<Table *>(this), options);
     }
 
+    Iterator *Table::NewRangeTombstoneIterator() const {
+        if (!rep_->range_del_status.ok()) {
+            return NewErrorIterator(rep_->range_del_status);
+        }
+        if (rep_->range_del_block == nullptr) {
+            return NewEmptyIterator();
+        }
+        return rep_->range_del_block->NewIterator(rep_->options.comparator);
+    }
+
     Status Table::InternalGet(const ReadOptions &options, const Slice &k, void *arg,
                               void (*handle_result)(void *, const Slice &,
                                                     const Slice &)) {
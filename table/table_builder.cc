@@ -4,6 +4,7 @@
 
 #include "leveldb/table_builder.h"
 
+#include <algorithm>
 #include <cassert>
 
 #include "leveldb/comparator.h"
@@ -46,6 +47,7 @@ namespace leveldb {
         int64_t num_entries;
         bool closed;  // Either Finish() or Abandon() has been called.
         FilterBlockBuilder *filter_block;
+        std::vector<std::pair<std::string, std::string>> range_dels;
 
         // We do not emit the index entry for a block until we have seen the
         // first key for the next data block.  This allows us to use shorter
@@ -122,6 +124,13 @@ namespace leveldb {
         }
     }
 
+    void TableBuilder::AddRangeTombstone(const Slice &key, const Slice &value) {
+        Rep *r = rep_;
+        assert(!r->closed);
+        if (!ok()) return;
+        r->range_dels.emplace_back(key.ToString(), value.ToString());
+    }
+
     void TableBuilder::Flush() {
         Rep *r = rep_;
         assert(!r->closed);
@@ -201,7 +210,8 @@ namespace leveldb {
         assert(!r->closed);
         r->closed = true;
 
-        BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle;
+        BlockHandle filter_block_handle, range_del_block_handle,
+                metaindex_block_handle, index_block_handle;
 
         // Write filter block
         if (ok() && r->filter_block != nullptr) {
@@ -209,9 +219,27 @@ namespace leveldb {
                           &filter_block_handle);
         }
 
+        // Write range deletion block
+        if (ok() && !r->range_dels.empty()) {
+            const Comparator *cmp = r->options.comparator;
+            std::sort(r->range_dels.begin(), r->range_dels.end(),
+                      [cmp](const std::pair<std::string, std::string> &a,
+                            const std::pair<std::string, std::string> &b) {
+                          return cmp->Compare(a.first, b.first) < 0;
+                      });
+            BlockBuilder range_del_block(&r->options);
+            for (const auto &entry : r->range_dels) {
+                range_del_block.Add(entry.first, entry.second);
+            }
+            WriteBlock(&range_del_block, &range_del_block_handle);
+        }
+
         // Write metaindex block
         if (ok()) {
-            BlockBuilder meta_index_block(&r->options);
+            // Metaindex keys are plain strings
+            Options meta_index_options = r->options;
+            meta_index_options.comparator = BytewiseComparator();
+            BlockBuilder meta_index_block(&meta_index_options);
             if (r->filter_block != nullptr) {
                 // Add mapping from "filter.Name" to location of filter data
                 std::string key = "filter.";
@@ -220,6 +248,11 @@ namespace leveldb {
                 filter_block_handle.EncodeTo(&handle_encoding);
                 meta_index_block.Add(key, handle_encoding);
             }
+            if (!r->range_dels.empty()) {
+                std::string handle_encoding;
+                range_del_block_handle.EncodeTo(&handle_encoding);
+                meta_index_block.Add(kRangeDelBlockName, handle_encoding);
+            }
 
             // TODO(postrelease): Add stats and other meta blocks
             WriteBlock(&meta_index_block, &metaindex_block_handle);
@@ -260,6 +293,10 @@ namespace leveldb {
 
     uint64_t TableBuilder::NumEntries() const { return rep_->num_entries; }
 
+    uint64_t TableBuilder::NumRangeTombstones() const {
+        return rep_->range_dels.size();
+    }
+
     uint64_t TableBuilder::FileSize() const { return rep_->offset; }
 
 }  // namespace leveldb
@@ -14,6 +14,7 @@
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
+#include "leveldb/memtablerep.h"
 #include "leveldb/table_builder.h"
 #include "table/block.h"
 #include "table/block_builder.h"
@@ -316,9 +317,10 @@ namespace leveldb {
 
     class MemTableConstructor : public Constructor {
     public:
-        explicit MemTableConstructor(const Comparator *cmp)
-                : Constructor(cmp), internal_comparator_(cmp) {
-            memtable_ = new MemTable(internal_comparator_);
+        MemTableConstructor(const Comparator *cmp,
+                            const MemTableRepFactory *factory)
+                : Constructor(cmp), internal_comparator_(cmp), factory_(factory) {
+            memtable_ = new MemTable(internal_comparator_, factory_);
             memtable_->Ref();
         }
 
@@ -326,13 +328,14 @@ namespace leveldb {
 
         Status FinishImpl(const Options &options, const KVMap &data) override {
             memtable_->Unref();
-            memtable_ = new MemTable(internal_comparator_);
+            memtable_ = new MemTable(internal_comparator_, factory_);
             memtable_->Ref();
             int seq = 1;
             for (const auto &kvp : data) {
                 memtable_->Add(seq, kTypeValue, kvp.first, kvp.second);
                 seq++;
             }
+            memtable_->MarkReadOnly();
             return Status::OK();
         }
 
@@ -342,6 +345,7 @@ namespace leveldb {
 
     private:
         const InternalKeyComparator internal_comparator_;
+        const MemTableRepFactory *const factory_;
         MemTable *memtable_;
     };
 
@@ -394,7 +398,8 @@ namespace leveldb {
     };
 
     enum TestType {
-        TABLE_TEST, BLOCK_TEST, MEMTABLE_TEST, DB_TEST
+        TABLE_TEST, BLOCK_TEST, MEMTABLE_TEST, HASH_SKIPLIST_MEMTABLE_TEST,
+        VECTOR_MEMTABLE_TEST, DB_TEST
     };
 
     struct TestArgs {
@@ -421,6 +426,10 @@ namespace leveldb {
             // Restart interval does not matter for memtables
             {MEMTABLE_TEST, false, 16},
             {MEMTABLE_TEST, true,  16},
+            {HASH_SKIPLIST_MEMTABLE_TEST, false, 16},
+            {HASH_SKIPLIST_MEMTABLE_TEST, true,  16},
+            {VECTOR_MEMTABLE_TEST, false, 16},
+            {VECTOR_MEMTABLE_TEST, true,  16},
 
             // Do not bother with restart interval variations for DB
             {DB_TEST,       false, 16},
@@ -430,11 +439,13 @@ namespace leveldb {
 
     class Harness : public testing::Test {
     public:
-        Harness() : constructor_(nullptr) {}
+        Harness() : constructor_(nullptr), memtable_factory_(nullptr) {}
 
         void Init(const TestArgs &args) {
             delete constructor_;
             constructor_ = nullptr;
+            delete memtable_factory_;
+            memtable_factory_ = nullptr;
             options_ = Options();
 
             options_.block_restart_interval = args.restart_interval;
@@ -452,7 +463,18 @@ namespace leveldb {
                     constructor_ = new BlockConstructor(options_.comparator);
                     break;
                 case MEMTABLE_TEST:
-                    constructor_ = new MemTableConstructor(options_.comparator);
+                    constructor_ = new MemTableConstructor(options_.comparator, nullptr);
+                    break;
+                case HASH_SKIPLIST_MEMTABLE_TEST:
+                    // Few, short prefixes so that buckets are shared
+                    memtable_factory_ = NewHashSkipListRepFactory(1, 7);
+                    constructor_ = new MemTableConstructor(options_.comparator,
+                                                           memtable_factory_);
+                    break;
+                case VECTOR_MEMTABLE_TEST:
+                    memtable_factory_ = NewVectorRepFactory();
+                    constructor_ = new MemTableConstructor(options_.comparator,
+                                                           memtable_factory_);
                     break;
                 case DB_TEST:
                     constructor_ = new DBConstructor(options_.comparator);
@@ -460,7 +482,10 @@ namespace leveldb {
             }
         }
 
-        ~Harness() { delete constructor_; }
+        ~Harness() {
+            delete constructor_;
+            delete memtable_factory_;
+        }
 
         void Add(const std::string &key, const std::string &value) {
             constructor_->Add(key, value);
@@ -631,6 +656,7 @@ namespace leveldb {
     private:
         Options options_;
         Constructor *constructor_;
+        const MemTableRepFactory *memtable_factory_;
     };
 
 // Test empty table/block.
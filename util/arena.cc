@@ -4,17 +4,110 @@
 
 #include "util/arena.h"
 
+#if defined(LEVELDB_PLATFORM_POSIX)
+#include <sys/mman.h>
+#endif  // defined(LEVELDB_PLATFORM_POSIX)
+
+#include <algorithm>
+#include <new>
+#include <thread>
+
+#include "util/mutexlock.h"
+
 namespace leveldb {
 
     static const int kBlockSize = 4096;
 
-    Arena::Arena()
-            : alloc_ptr_(nullptr), alloc_bytes_remaining_(0), memory_usage_(0) {}
+    // Alignment of AllocateAligned() results and of blocks cut from chunks.
+    static const size_t kAlign = (sizeof(void *) > 8) ? sizeof(void *) : 8;
+
+    // MAP_HUGETLB mappings must be a multiple of the huge page size.
+    static const size_t kHugePageSize = 2 << 20;
+
+    // A block that AllocateAlignedConcurrently() callers on one core share.
+    // Aligned so that shards do not share cache lines.
+    struct alignas(64) Arena::Shard {
+        Shard() : alloc_ptr(nullptr), alloc_bytes_remaining(0) {}
+
+        port::Mutex mu;
+        char *alloc_ptr GUARDED_BY(mu);
+        size_t alloc_bytes_remaining GUARDED_BY(mu);
+    };
+
+    // Return the shard index of the calling thread.  Every thread sticks to
+    // one shard, and consecutive threads use different shards, so that with
+    // one shard per core, threads that run at the same time rarely share one.
+    static size_t ThreadShardIndex() {
+        static std::atomic<size_t> next_index(0);
+        thread_local size_t index =
+                next_index.fetch_add(1, std::memory_order_relaxed);
+        return index;
+    }
+
+    static size_t NumShards() {
+        size_t cores = std::thread::hardware_concurrency();
+        return std::min<size_t>(std::max<size_t>(cores, 1), 64);
+    }
+
+    Arena::Arena() : Arena(0, false) {}
+
+    Arena::Arena(size_t chunk_size, bool huge_pages)
+            : chunk_size_(chunk_size),
+              huge_pages_(huge_pages),
+              alloc_ptr_(nullptr),
+              alloc_bytes_remaining_(0),
+              chunk_ptr_(nullptr),
+              chunk_bytes_remaining_(0),
+              memory_usage_(0),
+              shards_(nullptr),
+              shard_memory_(nullptr),
+              num_shards_(NumShards()) {}
 
     Arena::~Arena() {
         for (auto & block : blocks_) {
             delete[] block;
         }
+        for (const Chunk &chunk : chunks_) {
+#if defined(LEVELDB_PLATFORM_POSIX)
+            if (chunk.mapped) {
+                munmap(chunk.data, chunk.size);
+                continue;
+            }
+#endif  // defined(LEVELDB_PLATFORM_POSIX)
+            delete[] chunk.data;
+        }
+        Shard *shards = shards_.load(std::memory_order_relaxed);
+        if (shards != nullptr) {
+            for (size_t i = 0; i < num_shards_; i++) {
+                shards[i].~Shard();
+            }
+            delete[] shard_memory_;
+        }
+    }
+
+    Arena::Shard *Arena::Shards() {
+        Shard *shards = shards_.load(std::memory_order_acquire);
+        if (shards != nullptr) {
+            return shards;
+        }
+        MutexLock l(&mu_);
+        shards = shards_.load(std::memory_order_relaxed);
+        if (shards == nullptr) {
+            // new[] does not honor the alignment of Shard before C++17, so
+            // place the shards in a buffer with room to align them.
+            const size_t bytes = num_shards_ * sizeof(Shard) + alignof(Shard) - 1;
+            shard_memory_ = new char[bytes];
+            const uintptr_t aligned =
+                    (reinterpret_cast<uintptr_t>(shard_memory_) + alignof(Shard) - 1) &
+                    ~static_cast<uintptr_t>(alignof(Shard) - 1);
+            shards = reinterpret_cast<Shard *>(aligned);
+            for (size_t i = 0; i < num_shards_; i++) {
+                new(&shards[i]) Shard();
+            }
+            memory_usage_.fetch_add(bytes, std::memory_order_relaxed);
+            shards_.store(shards, std::memory_order_release);
+        }
+        return shards;
     }
 
     char *Arena::AllocateFallback(size_t bytes) {
@@ -43,9 +136,9 @@ namespace leveldb {
 
     char *Arena::AllocateAligned(size_t bytes) {
         // 如果当前系统指针大于8字节，就按照指针大小进行对齐，如果不是就按照8字节对齐
-        const int align = (sizeof(void *) > 8) ? sizeof(void *) : 8;
+        const int align = kAlign;
         // 确保对齐字节大小是2的次方
-        static_assert((align & (align - 1)) == 0,
+        static_assert((kAlign & (kAlign - 1)) == 0,
                       "Pointer size should be a power of 2");
         // 看当前的alloc_ptr_是否是8字节对齐
         size_t current_mod = reinterpret_cast<uintptr_t>(alloc_ptr_) & (align - 1);
@@ -67,14 +160,101 @@ namespace leveldb {
         return result;
     }
 
+    char *Arena::AllocateAlignedConcurrently(size_t bytes) {
+        if (bytes > kBlockSize / 4) {
+            MutexLock l(&mu_);
+            return AllocateNewBlock(bytes);
+        }
+
+        Shard *shard = &Shards()[ThreadShardIndex() % num_shards_];
+        MutexLock l(&shard->mu);
+        size_t current_mod =
+                reinterpret_cast<uintptr_t>(shard->alloc_ptr) & (kAlign - 1);
+        size_t slop = (current_mod == 0 ? 0 : kAlign - current_mod);
+        size_t needed = bytes + slop;
+        char *result;
+        if (needed <= shard->alloc_bytes_remaining) {
+            result = shard->alloc_ptr + slop;
+            shard->alloc_ptr += needed;
+            shard->alloc_bytes_remaining -= needed;
+        } else {
+            // We waste the remaining space in the shard's current block.
+            {
+                MutexLock arena_lock(&mu_);
+                result = AllocateNewBlock(kBlockSize);
+            }
+            shard->alloc_ptr = result + bytes;
+            shard->alloc_bytes_remaining = kBlockSize - bytes;
+        }
+        assert((reinterpret_cast<uintptr_t>(result) & (kAlign - 1)) == 0);
+        return result;
+    }
+
     char *Arena::AllocateNewBlock(size_t block_bytes) {
-        char *result = new char[block_bytes];
-        // 将每次new出来的指针方能如到blocks中
-        blocks_.push_back(result);
-        // 已经使用的内存，是一个指针的大小和指定内存大小的和
-        memory_usage_.fetch_add(block_bytes + sizeof(char *),
-                                std::memory_order_relaxed);
+        if (chunk_size_ == 0) {
+            char *result = new char[block_bytes];
+            // 将每次new出来的指针方能如到blocks中
+            blocks_.push_back(result);
+            // 已经使用的内存，是一个指针的大小和指定内存大小的和
+            memory_usage_.fetch_add(block_bytes + sizeof(char *),
+                                    std::memory_order_relaxed);
+            return result;
+        }
+
+        // Round up so that the next block carved out of the chunk is aligned.
+        const size_t needed = (block_bytes + kAlign - 1) & ~(kAlign - 1);
+        char *result;
+        if (needed > chunk_bytes_remaining_) {
+            if (needed > chunk_size_ / 4) {
+                // Like large objects in blocks, give large blocks a chunk of
+                // their own instead of wasting the rest of the current chunk.
+                result = NewChunk(needed);
+                memory_usage_.fetch_add(needed + sizeof(Chunk),
+                                        std::memory_order_relaxed);
+                return result;
+            }
+            chunk_ptr_ = NewChunk(chunk_size_);
+            chunk_bytes_remaining_ = chunk_size_;
+            memory_usage_.fetch_add(sizeof(Chunk), std::memory_order_relaxed);
+        }
+        result = chunk_ptr_;
+        chunk_ptr_ += needed;
+        chunk_bytes_remaining_ -= needed;
+        memory_usage_.fetch_add(needed, std::memory_order_relaxed);
         return result;
     }
 
+    char *Arena::NewChunk(size_t bytes) {
+        Chunk chunk = {nullptr, bytes, false};
+#if defined(LEVELDB_PLATFORM_POSIX)
+        void *mem = MAP_FAILED;
+#if defined(MAP_HUGETLB)
+        // Only succeeds if the administrator reserved huge pages.
+        if (huge_pages_ && bytes % kHugePageSize == 0) {
+            mem = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        }
+#endif  // defined(MAP_HUGETLB)
+        if (mem == MAP_FAILED) {
+            mem = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#if defined(MADV_HUGEPAGE)
+            // Ask for transparent huge pages instead.
+            if (huge_pages_ && mem != MAP_FAILED) {
+                madvise(mem, bytes, MADV_HUGEPAGE);
+            }
+#endif  // defined(MADV_HUGEPAGE)
+        }
+        if (mem != MAP_FAILED) {
+            chunk.data = static_cast<char *>(mem);
+            chunk.mapped = true;
+        }
+#endif  // defined(LEVELDB_PLATFORM_POSIX)
+        if (chunk.data == nullptr) {
+            chunk.data = new char[bytes];
+        }
+        chunks_.push_back(chunk);
+        return chunk.data;
+    }
+
 }  // namespace leveldb
@@ -11,12 +11,23 @@
 #include <cstdint>
 #include <vector>
 
+#include "port/port.h"
+#include "port/thread_annotations.h"
+
 namespace leveldb {
 
     class Arena {
     public:
         Arena();
 
+        // Instead of allocating every block with new[], carve blocks out of
+        // chunks of "chunk_size" bytes that are reserved from the operating
+        // system in one piece, which saves most of the allocator calls for
+        // large memtables.  If "huge_pages" is true, chunks are backed by huge
+        // pages where the platform supports them, to reduce TLB misses.  A
+        // "chunk_size" of 0 behaves like Arena().
+        Arena(size_t chunk_size, bool huge_pages);
+
         Arena(const Arena &) = delete;
 
         Arena &operator=(const Arena &) = delete;
@@ -29,17 +40,42 @@ namespace leveldb {
         // Allocate memory with the normal alignment guarantees provided by malloc.
         char *AllocateAligned(size_t bytes);
 
+        // Like AllocateAligned(), but safe to call from several threads at the
+        // same time.  Must not race with calls to Allocate() or AllocateAligned().
+        // Each thread allocates from one of several shards, so threads on
+        // different cores rarely contend.
+        char *AllocateAlignedConcurrently(size_t bytes) LOCKS_EXCLUDED(mu_);
+
         // Returns an estimate of the total memory usage of data allocated
-        // by the arena.
+        // by the arena.  The unused part of a chunk is not counted until
+        // blocks are carved out of it, so that the result tracks the memory
+        // that is actually in use rather than jumping by a chunk at a time.
         size_t MemoryUsage() const {
             return memory_usage_.load(std::memory_order_relaxed);
         }
 
     private:
+        struct Chunk {
+            char *data;
+            size_t size;
+            bool mapped;  // Allocated with mmap() rather than new[]
+        };
+
+        struct Shard;
+
+        // Return the shards, allocating them on the first call.
+        Shard *Shards() LOCKS_EXCLUDED(mu_);
+
         char *AllocateFallback(size_t bytes);
 
         char *AllocateNewBlock(size_t block_bytes);
 
+        // Reserve a new chunk of "bytes" bytes.
+        char *NewChunk(size_t bytes);
+
+        const size_t chunk_size_;
+        const bool huge_pages_;
+
         // Allocation state
         char *alloc_ptr_;
         size_t alloc_bytes_remaining_;
@@ -47,11 +83,26 @@ namespace leveldb {
         // Array of new[] allocated memory blocks
         std::vector<char *> blocks_;
 
+        // Chunks that blocks are carved out of, and the unused rest of the
+        // last one.  Only used if chunk_size_ > 0.
+        std::vector<Chunk> chunks_;
+        char *chunk_ptr_;
+        size_t chunk_bytes_remaining_;
+
         // Total memory usage of the arena.
         //
         // TODO(costan): This member is accessed via atomics, but the others are
         //               accessed without any locking. Is this OK?
         std::atomic<size_t> memory_usage_;
+
+        // Protects the state above from concurrent shard refills.
+        port::Mutex mu_;
+
+        // Blocks that AllocateAlignedConcurrently() hands out memory from.
+        // Arenas that are only used from a single thread never allocate them.
+        std::atomic<Shard *> shards_;
+        char *shard_memory_ GUARDED_BY(mu_);  // Holds shards_, suitably aligned
+        const size_t num_shards_;
     };
 
     inline char *Arena::Allocate(size_t bytes) {
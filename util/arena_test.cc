@@ -4,6 +4,10 @@
 
 #include "util/arena.h"
 
+#include <cstring>
+#include <thread>
+#include <vector>
+
 #include "gtest/gtest.h"
 #include "util/random.h"
 
@@ -90,6 +94,74 @@ ASSERT_EQ(int(p[b]) & 0xff, i % 256);
 }
 }
 
+TEST(ArenaTest, Chunks) {
+  for (bool huge_pages : {false, true}) {
+    std::vector<std::pair<size_t, char*>> allocated;
+    Arena arena(2 << 20, huge_pages);
+    const int N = 100000;
+    size_t bytes = 0;
+    Random rnd(301);
+    for (int i = 0; i < N; i++) {
+      size_t s;
+      if (rnd.OneIn(1000)) {
+        s = 1 << 20;  // Larger than a quarter of a chunk
+      } else if (rnd.OneIn(4000)) {
+        s = 1 + rnd.Uniform(6000);
+      } else {
+        s = 1 + rnd.Uniform(20);
+      }
+      char* r = rnd.OneIn(10) ? arena.AllocateAligned(s) : arena.Allocate(s);
+      std::memset(r, i % 256, s);
+      bytes += s;
+      allocated.push_back(std::make_pair(s, r));
+      ASSERT_GE(arena.MemoryUsage(), bytes);
+      if (i > N / 10) {
+        ASSERT_LE(arena.MemoryUsage(), bytes * 1.10);
+      }
+    }
+    for (size_t i = 0; i < allocated.size(); i++) {
+      for (size_t b = 0; b < allocated[i].first; b++) {
+        ASSERT_EQ(int(allocated[i].second[b]) & 0xff, i % 256);
+      }
+    }
+  }
+}
+
+TEST(ArenaTest, Concurrent) {
+  for (size_t chunk_size : {size_t{0}, size_t{1} << 20}) {
+    Arena arena(chunk_size, false);
+    const int kThreads = 4;
+    const int kPerThread = 20000;
+    std::vector<std::vector<std::pair<size_t, char*>>> allocated(kThreads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; t++) {
+      threads.emplace_back([&arena, &allocated, t]() {
+        Random rnd(301 + t);
+        for (int i = 0; i < kPerThread; i++) {
+          size_t s = 1 + (rnd.OneIn(100) ? rnd.Uniform(3000) : rnd.Uniform(40));
+          char* r = arena.AllocateAlignedConcurrently(s);
+          ASSERT_EQ(0, reinterpret_cast<uintptr_t>(r) & (sizeof(void*) - 1));
+          std::memset(r, t, s);
+          allocated[t].push_back(std::make_pair(s, r));
+        }
+      });
+    }
+    size_t bytes = 0;
+    for (int t = 0; t < kThreads; t++) {
+      threads[t].join();
+    }
+    for (int t = 0; t < kThreads; t++) {
+      for (const auto& a : allocated[t]) {
+        bytes += a.first;
+        for (size_t b = 0; b < a.first; b++) {
+          ASSERT_EQ(t, a.second[b]);
+        }
+      }
+    }
+    ASSERT_GE(arena.MemoryUsage(), bytes);
+  }
+}
+
 }  // namespace leveldb
 
 int main(int argc, char **argv) {
@@ -110,7 +110,7 @@ namespace leveldb {
     }  // namespace
 
     // 匿名空间的元素只有在同一个源文件中能够之间调用
-    const FilterPolicy *sNewBloomFilterPolicy(int bits_per_key) {
+    const FilterPolicy *NewBloomFilterPolicy(int bits_per_key) {
         return new BloomFilterPolicy(bits_per_key);
     }
 
@@ -4,9 +4,12 @@
 
 #include "leveldb/cache.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 
 #include "port/port.h"
 #include "port/thread_annotations.h"
@@ -459,8 +462,451 @@ namespace leveldb {
             }
         };
 
+// CLOCK cache implementation
+//
+// Each shard keeps its entries directly in a fixed-size, open-addressed
+// table of slots (linear probing).  Lookup() and Release() of a cached entry
+// only use atomic operations on the slot's "meta" word, so cache hits never
+// take a mutex; Insert(), Erase() and eviction are serialized by the shard's
+// mutex.  Slots are never freed while the cache is alive, which makes it safe
+// for a reader to touch a slot that is being evicted at the same time: it
+// only takes a reference if the slot is visible at that moment, and checks
+// the key once it holds the reference.  A slot cannot be reused while it is
+// referenced.
+//
+// Instead of an LRU list, every slot has a small clock counter that is
+// bumped by each hit.  Eviction sweeps a clock hand over the table,
+// decrementing counters and evicting unreferenced entries whose counter
+// has dropped to zero.
+        struct ClockHandle {
+            ClockHandle()
+                    : meta(0), displacements(0), hash(0), detached(false),
+                      key_data(nullptr), key_length(0), value(nullptr),
+                      deleter(nullptr), charge(0) {}
+
+            // State, clock counter and reference count; see below.
+            std::atomic<uint64_t> meta;
+            // Number of entries whose probe sequence passes this slot, so that
+            // Lookup() knows when to stop probing.  Changed under the mutex.
+            std::atomic<uint32_t> displacements;
+
+            // Read by Lookup() before it holds a reference, so atomic.
+            std::atomic<uint32_t> hash;
+
+            // Only valid while the slot is visible or invisible.
+            bool detached;  // Allocated outside the table; never cached
+            char *key_data;
+            size_t key_length;
+            void *value;
+            void (*deleter)(const Slice &, void *value);
+            size_t charge;
+
+            Slice key() const { return Slice(key_data, key_length); }
+        };
+
+        // Layout of ClockHandle::meta: the reference count is in the low 32
+        // bits, the clock counter in bits 32-33 and the state in bits 62-63.
+        const uint64_t kOneRef = 1;
+        const uint64_t kRefMask = 0xffffffffu;
+        const int kClockShift = 32;
+        const uint64_t kMaxClock = 3;
+        const int kStateShift = 62;
+
+        // Slot states.  Only visible slots can be looked up, and only slots
+        // that are not referenced can be made exclusive.
+        const uint64_t kEmpty = 0;      // Holds no entry
+        const uint64_t kExclusive = 1;  // Being freed by the mutex holder
+        const uint64_t kVisible = 2;    // Cached
+        const uint64_t kInvisible = 3;  // Erased, but still referenced
+
+        inline uint64_t State(uint64_t meta) { return meta >> kStateShift; }
+
+        inline uint64_t Clock(uint64_t meta) {
+            return (meta >> kClockShift) & kMaxClock;
+        }
+
+        inline uint64_t Refs(uint64_t meta) { return meta & kRefMask; }
+
+        // A single shard of sharded cache.
+        class ClockCache {
+        public:
+            ClockCache();
+
+            ~ClockCache();
+
+            // Separate from constructor so caller can easily make an array of
+            // ClockCache.  The table holds at most "table_size" entries, which
+            // must be a power of two.
+            void Init(size_t capacity, size_t table_size);
+
+            // Like Cache methods, but with an extra "hash" parameter.
+            Cache::Handle *Insert(const Slice &key, uint32_t hash, void *value,
+                                  size_t charge,
+                                  void (*deleter)(const Slice &key, void *value));
+
+            Cache::Handle *Lookup(const Slice &key, uint32_t hash);
+
+            void Release(Cache::Handle *handle);
+
+            void Erase(const Slice &key, uint32_t hash);
+
+            void Prune();
+
+            size_t TotalCharge() const {
+                MutexLock l(&mutex_);
+                return usage_;
+            }
+
+        private:
+            // Evict entries until "charge" more fits into the cache and the
+            // table is not too full, or until everything left is in use.
+            void EvictLocked(size_t charge) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+            void EraseLocked(const Slice &key, uint32_t hash)
+            EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+            // Make the slot "h", which is exclusive, empty again.
+            void FreeSlot(ClockHandle *h) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+            static void DeleteDetached(ClockHandle *h);
+
+            size_t capacity_;
+            size_t mask_;           // Table size - 1
+            size_t max_occupancy_;  // Evict rather than fill the table further
+            ClockHandle *slots_;
+
+            mutable port::Mutex mutex_;
+            size_t usage_ GUARDED_BY(mutex_);
+            size_t occupancy_ GUARDED_BY(mutex_);  // Non-empty slots
+            size_t clock_hand_ GUARDED_BY(mutex_);
+        };
+
+        ClockCache::ClockCache()
+                : capacity_(0), mask_(0), max_occupancy_(0), slots_(nullptr),
+                  usage_(0), occupancy_(0), clock_hand_(0) {}
+
+        ClockCache::~ClockCache() {
+            if (slots_ == nullptr) {
+                return;
+            }
+            for (size_t i = 0; i <= mask_; i++) {
+                ClockHandle *h = &slots_[i];
+                const uint64_t meta = h->meta.load(std::memory_order_relaxed);
+                // Error if caller has an unreleased handle
+                assert(State(meta) == kEmpty || State(meta) == kVisible);
+                assert(Refs(meta) == 0);
+                if (State(meta) == kVisible) {
+                    (*h->deleter)(h->key(), h->value);
+                    delete[] h->key_data;
+                }
+            }
+            delete[] slots_;
+        }
+
+        void ClockCache::Init(size_t capacity, size_t table_size) {
+            assert((table_size & (table_size - 1)) == 0);
+            capacity_ = capacity;
+            mask_ = table_size - 1;
+            // Linear probing gets slow as the table fills up.
+            max_occupancy_ = table_size * 7 / 10;
+            slots_ = new ClockHandle[table_size];
+        }
+
+        Cache::Handle *ClockCache::Lookup(const Slice &key, uint32_t hash) {
+            const size_t home = hash & mask_;
+            for (size_t i = 0; i <= mask_; i++) {
+                ClockHandle *h = &slots_[(home + i) & mask_];
+                uint64_t meta = h->meta.load(std::memory_order_acquire);
+                // Skip other entries without touching their meta word, so
+                // that only hits count towards the clock.
+                while (State(meta) == kVisible &&
+                       h->hash.load(std::memory_order_relaxed) == hash) {
+                    // Take a reference and count the hit in one step.
+                    uint64_t desired = meta + kOneRef;
+                    if (Clock(meta) < kMaxClock) {
+                        desired += uint64_t{1} << kClockShift;
+                    }
+                    if (h->meta.compare_exchange_weak(meta, desired,
+                                                      std::memory_order_acq_rel,
+                                                      std::memory_order_acquire)) {
+                        // The slot cannot be reused while we hold a reference.
+                        if (h->hash.load(std::memory_order_relaxed) == hash &&
+                            h->key() == key) {
+                            return reinterpret_cast<Cache::Handle *>(h);
+                        }
+                        Release(reinterpret_cast<Cache::Handle *>(h));
+                        break;
+                    }
+                }
+                if (h->displacements.load(std::memory_order_relaxed) == 0) {
+                    break;
+                }
+            }
+            return nullptr;
+        }
+
+        void ClockCache::Release(Cache::Handle *handle) {
+            auto *h = reinterpret_cast<ClockHandle *>(handle);
+            const uint64_t old = h->meta.fetch_sub(kOneRef, std::memory_order_acq_rel);
+            assert(Refs(old) > 0);
+            if (Refs(old) != 1 || State(old) != kInvisible) {
+                return;
+            }
+            // This was the last reference to an erased entry.
+            if (h->detached) {
+                DeleteDetached(h);
+                return;
+            }
+            MutexLock l(&mutex_);
+            uint64_t meta = h->meta.load(std::memory_order_relaxed);
+            assert(State(meta) == kInvisible && Refs(meta) == 0);
+            h->meta.store(kExclusive << kStateShift, std::memory_order_relaxed);
+            FreeSlot(h);
+        }
+
+        Cache::Handle *ClockCache::Insert(const Slice &key, uint32_t hash,
+                                          void *value, size_t charge,
+                                          void (*deleter)(const Slice &key,
+                                                          void *value)) {
+            char *key_data = new char[key.size()];
+            std::memcpy(key_data, key.data(), key.size());
+
+            MutexLock l(&mutex_);
+            ClockHandle *h = nullptr;
+            if (capacity_ > 0) {
+                EraseLocked(key, hash);
+                EvictLocked(charge);
+                // Even if nothing could be evicted, use the table as long as it
+                // has room.
+                const size_t home = hash & mask_;
+                for (size_t i = 0; i <= mask_; i++) {
+                    ClockHandle *slot = &slots_[(home + i) & mask_];
+                    if (State(slot->meta.load(std::memory_order_relaxed)) == kEmpty) {
+                        for (size_t j = 0; j < i; j++) {
+                            slots_[(home + j) & mask_].displacements.fetch_add(
+                                    1, std::memory_order_relaxed);
+                        }
+                        h = slot;
+                        break;
+                    }
+                }
+            }
+            if (h == nullptr) {
+                // don't cache. (capacity_==0 is supported and turns off caching.)
+                h = new ClockHandle;
+                h->detached = true;
+            }
+            h->hash.store(hash, std::memory_order_relaxed);
+            h->key_data = key_data;
+            h->key_length = key.size();
+            h->value = value;
+            h->deleter = deleter;
+            h->charge = charge;
+            if (h->detached) {
+                h->meta.store((kInvisible << kStateShift) | kOneRef,
+                              std::memory_order_relaxed);
+            } else {
+                usage_ += charge;
+                occupancy_++;
+                // One reference for the returned handle.  Publishes the fields
+                // above to readers.
+                h->meta.store((kVisible << kStateShift) |
+                              (uint64_t{1} << kClockShift) | kOneRef,
+                              std::memory_order_release);
+            }
+            return reinterpret_cast<Cache::Handle *>(h);
+        }
+
+        void ClockCache::EvictLocked(size_t charge) {
+            // Every unreferenced entry is evicted within kMaxClock + 1 turns of
+            // the clock hand.
+            const size_t max_steps = (mask_ + 1) * (kMaxClock + 1);
+            for (size_t step = 0;
+                 step < max_steps &&
+                 (usage_ + charge > capacity_ || occupancy_ >= max_occupancy_);
+                 step++) {
+                ClockHandle *h = &slots_[clock_hand_];
+                clock_hand_ = (clock_hand_ + 1) & mask_;
+                uint64_t meta = h->meta.load(std::memory_order_relaxed);
+                if (State(meta) != kVisible || Refs(meta) != 0) {
+                    continue;
+                }
+                if (Clock(meta) > 0) {
+                    // Fails if a reader got here first, which is fine.
+                    h->meta.compare_exchange_strong(
+                            meta, meta - (uint64_t{1} << kClockShift),
+                            std::memory_order_relaxed);
+                } else if (h->meta.compare_exchange_strong(
+                        meta, kExclusive << kStateShift,
+                        std::memory_order_acquire)) {
+                    usage_ -= h->charge;
+                    FreeSlot(h);
+                }
+            }
+        }
+
+        void ClockCache::EraseLocked(const Slice &key, uint32_t hash) {
+            const size_t home = hash & mask_;
+            for (size_t i = 0; i <= mask_; i++) {
+                ClockHandle *h = &slots_[(home + i) & mask_];
+                uint64_t meta = h->meta.load(std::memory_order_relaxed);
+                // Visible slots stay visible until we change them.
+                if (State(meta) == kVisible &&
+                    h->hash.load(std::memory_order_relaxed) == hash &&
+                    h->key() == key) {
+                    usage_ -= h->charge;
+                    while (true) {
+                        if (Refs(meta) == 0) {
+                            if (h->meta.compare_exchange_weak(
+                                    meta, kExclusive << kStateShift,
+                                    std::memory_order_acquire)) {
+                                FreeSlot(h);
+                                return;
+                            }
+                        } else if (h->meta.compare_exchange_weak(
+                                meta, (kInvisible << kStateShift) | Refs(meta),
+                                std::memory_order_relaxed)) {
+                            // The last Release() frees the slot.
+                            return;
+                        }
+                    }
+                }
+                if (h->displacements.load(std::memory_order_relaxed) == 0) {
+                    return;
+                }
+            }
+        }
+
+        void ClockCache::FreeSlot(ClockHandle *h) {
+            assert(State(h->meta.load(std::memory_order_relaxed)) == kExclusive);
+            (*h->deleter)(h->key(), h->value);
+            delete[] h->key_data;
+            const size_t home = h->hash.load(std::memory_order_relaxed) & mask_;
+            for (size_t i = home; i != static_cast<size_t>(h - slots_);
+                 i = (i + 1) & mask_) {
+                slots_[i].displacements.fetch_sub(1, std::memory_order_relaxed);
+            }
+            occupancy_--;
+            h->meta.store(kEmpty << kStateShift, std::memory_order_release);
+        }
+
+        void ClockCache::DeleteDetached(ClockHandle *h) {
+            (*h->deleter)(h->key(), h->value);
+            delete[] h->key_data;
+            delete h;
+        }
+
+        void ClockCache::Erase(const Slice &key, uint32_t hash) {
+            MutexLock l(&mutex_);
+            EraseLocked(key, hash);
+        }
+
+        void ClockCache::Prune() {
+            MutexLock l(&mutex_);
+            for (size_t i = 0; i <= mask_; i++) {
+                ClockHandle *h = &slots_[i];
+                uint64_t meta = h->meta.load(std::memory_order_relaxed);
+                if (State(meta) == kVisible && Refs(meta) == 0 &&
+                    h->meta.compare_exchange_strong(meta, kExclusive << kStateShift,
+                                                    std::memory_order_acquire)) {
+                    usage_ -= h->charge;
+                    FreeSlot(h);
+                }
+            }
+        }
+
+        class ShardedClockCache : public Cache {
+        private:
+            ClockCache *shard_;
+            const int num_shard_bits_;
+            port::Mutex id_mutex_;
+            uint64_t last_id_;
+
+            static inline uint32_t HashSlice(const Slice &s) {
+                return Hash(s.data(), s.size(), 0);
+            }
+
+            uint32_t Shard(uint32_t hash) const {
+                return num_shard_bits_ == 0 ? 0 : hash >> (32 - num_shard_bits_);
+            }
+
+        public:
+            ShardedClockCache(size_t capacity, int num_shard_bits,
+                              size_t estimated_entry_charge)
+                    : shard_(new ClockCache[size_t{1} << num_shard_bits]),
+                      num_shard_bits_(num_shard_bits),
+                      last_id_(0) {
+                const size_t num_shards = size_t{1} << num_shard_bits;
+                const size_t per_shard = (capacity + (num_shards - 1)) / num_shards;
+                // Aim for a table that is 70% full when the shard is.
+                const size_t entries =
+                        per_shard / std::max<size_t>(estimated_entry_charge, 1) + 1;
+                size_t table_size = 16;
+                while (table_size * 7 / 10 < entries) {
+                    table_size *= 2;
+                }
+                for (size_t i = 0; i < num_shards; i++) {
+                    shard_[i].Init(per_shard, table_size);
+                }
+            }
+
+            ~ShardedClockCache() override { delete[] shard_; }
+
+            Handle *Insert(const Slice &key, void *value, size_t charge,
+                           void (*deleter)(const Slice &key, void *value)) override {
+                const uint32_t hash = HashSlice(key);
+                return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter);
+            }
+
+            Handle *Lookup(const Slice &key) override {
+                const uint32_t hash = HashSlice(key);
+                return shard_[Shard(hash)].Lookup(key, hash);
+            }
+
+            void Release(Handle *handle) override {
+                auto *h = reinterpret_cast<ClockHandle *>(handle);
+                const uint32_t hash = h->hash.load(std::memory_order_relaxed);
+                shard_[Shard(hash)].Release(handle);
+            }
+
+            void Erase(const Slice &key) override {
+                const uint32_t hash = HashSlice(key);
+                shard_[Shard(hash)].Erase(key, hash);
+            }
+
+            void *Value(Handle *handle) override {
+                return reinterpret_cast<ClockHandle *>(handle)->value;
+            }
+
+            uint64_t NewId() override {
+                MutexLock l(&id_mutex_);
+                return ++(last_id_);
+            }
+
+            void Prune() override {
+                for (size_t i = 0; i < (size_t{1} << num_shard_bits_); i++) {
+                    shard_[i].Prune();
+                }
+            }
+
+            size_t TotalCharge() const override {
+                size_t total = 0;
+                for (size_t i = 0; i < (size_t{1} << num_shard_bits_); i++) {
+                    total += shard_[i].TotalCharge();
+                }
+                return total;
+            }
+        };
+
     }  // end anonymous namespace
 
     Cache *NewLRUCache(size_t capacity) { return new ShardedLRUCache(capacity); }
 
+    Cache *NewClockCache(size_t capacity, int num_shard_bits,
+                         size_t estimated_entry_charge) {
+        num_shard_bits = std::min(std::max(num_shard_bits, 0), 16);
+        return new ShardedClockCache(capacity, num_shard_bits,
+                                     estimated_entry_charge);
+    }
+
 }  // namespace leveldb
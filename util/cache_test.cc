@@ -4,10 +4,13 @@
 
 #include "leveldb/cache.h"
 
+#include <atomic>
+#include <thread>
 #include <vector>
 
 #include "gtest/gtest.h"
 #include "util/coding.h"
+#include "util/random.h"
 
 namespace leveldb {
 
@@ -27,7 +30,11 @@ namespace leveldb {
 
     static int DecodeValue(void *v) { return reinterpret_cast<uintptr_t>(v); }
 
-    class CacheTest : public testing::Test {
+    static void NopDeleter(const Slice &key, void *v) {}
+
+    enum CacheType { kLRU, kClock };
+
+    class CacheTest : public testing::TestWithParam<CacheType> {
     public:
         static void Deleter(const Slice &key, void *v) {
             current_->deleted_keys_.push_back(DecodeKey(key));
@@ -39,10 +46,18 @@ namespace leveldb {
         std::vector<int> deleted_values_;
         Cache *cache_;
 
-        CacheTest() : cache_(NewLRUCache(kCacheSize)) { current_ = this; }
+        CacheTest() : cache_(NewCache(kCacheSize)) { current_ = this; }
 
         ~CacheTest() { delete cache_; }
 
+        Cache *NewCache(size_t capacity) {
+            if (GetParam() == kClock) {
+                // Entries are charged 1 by default.
+                return NewClockCache(capacity, 4, 1);
+            }
+            return NewLRUCache(capacity);
+        }
+
         int Lookup(int key) {
             Cache::Handle *handle = cache_->Lookup(EncodeKey(key));
             const int r = (handle == nullptr) ? -1 : DecodeValue(cache_->Value(handle));
@@ -69,7 +84,7 @@ namespace leveldb {
 
     CacheTest *CacheTest::current_;
 
-    TEST_F(CacheTest, HitAndMiss
+    TEST_P(CacheTest, HitAndMiss
     ) {
     ASSERT_EQ(-1, Lookup(100));
 
@@ -97,7 +112,7 @@ namespace leveldb {
     ASSERT_EQ(101, deleted_values_[0]);
 }
 
-TEST_F(CacheTest, Erase
+TEST_P(CacheTest, Erase
 ) {
 Erase(200);
 ASSERT_EQ(0, deleted_keys_.
@@ -129,7 +144,7 @@ size()
 );
 }
 
-TEST_F(CacheTest, EntriesArePinned
+TEST_P(CacheTest, EntriesArePinned
 ) {
 Insert(100, 101);
 Cache::Handle *h1 = cache_->Lookup(EncodeKey(100));
@@ -181,7 +196,7 @@ ASSERT_EQ(100, deleted_keys_[1]);
 ASSERT_EQ(102, deleted_values_[1]);
 }
 
-TEST_F(CacheTest, EvictionPolicy
+TEST_P(CacheTest, EvictionPolicy
 ) {
 Insert(100, 101);
 Insert(200, 201);
@@ -204,7 +219,7 @@ cache_->
 Release(h);
 }
 
-TEST_F(CacheTest, UseExceedsCacheSize
+TEST_P(CacheTest, UseExceedsCacheSize
 ) {
 // Overfill the cache, keeping handles on all inserted entries.
 std::vector<Cache::Handle *> h;
@@ -239,7 +254,7 @@ Release(h[i]);
 }
 }
 
-TEST_F(CacheTest, HeavyEntries
+TEST_P(CacheTest, HeavyEntries
 ) {
 // Add a bunch of light and heavy entries and then count the combined
 // size of items still in the cache, which must be approximately the
@@ -274,7 +289,7 @@ ASSERT_LE(cached_weight, kCacheSize
 + kCacheSize / 10);
 }
 
-TEST_F(CacheTest, NewId
+TEST_P(CacheTest, NewId
 ) {
 uint64_t a = cache_->NewId();
 uint64_t b = cache_->NewId();
@@ -282,7 +297,7 @@ ASSERT_NE(a, b
 );
 }
 
-TEST_F(CacheTest, Prune
+TEST_P(CacheTest, Prune
 ) {
 Insert(1, 100);
 Insert(2, 200);
@@ -300,16 +315,82 @@ ASSERT_EQ(100, Lookup(1));
 ASSERT_EQ(-1, Lookup(2));
 }
 
-TEST_F(CacheTest, ZeroSizeCache
+TEST_P(CacheTest, ZeroSizeCache
 ) {
 delete
 cache_;
-cache_ = NewLRUCache(0);
+cache_ = NewCache(0);
 
 Insert(1, 100);
 ASSERT_EQ(-1, Lookup(1));
 }
 
+// Readers and writers hammering a small set of keys must always see the
+// value that belongs to the key they looked up.
+TEST_P(CacheTest, Concurrent) {
+  const int kThreads = 4;
+  const int kKeys = 200;
+  std::atomic<bool> failed(false);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([this, t, &failed]() {
+      Random rnd(301 + t);
+      for (int i = 0; i < 20000; i++) {
+        const int k = rnd.Uniform(kKeys);
+        if (rnd.OneIn(10)) {
+          cache_->Release(cache_->Insert(EncodeKey(k), EncodeValue(k + 1000),
+                                         1 + rnd.Uniform(10), &NopDeleter));
+        } else if (rnd.OneIn(100)) {
+          cache_->Erase(EncodeKey(k));
+        } else {
+          Cache::Handle* h = cache_->Lookup(EncodeKey(k));
+          if (h != nullptr) {
+            if (DecodeValue(cache_->Value(h)) != k + 1000) {
+              failed = true;
+            }
+            cache_->Release(h);
+          }
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  ASSERT_FALSE(failed);
+  ASSERT_LE(cache_->TotalCharge(), static_cast<size_t>(kCacheSize));
+}
+
+INSTANTIATE_TEST_SUITE_P(CacheTypes, CacheTest, testing::Values(kLRU, kClock));
+
+// A clock cache with fewer slots than entries that fit its capacity keeps
+// working: it holds fewer entries, and hands out uncached handles when all
+// slots are in use.
+TEST(ClockCacheTest, FullTable) {
+  Cache* cache = NewClockCache(1000000, 0, 1000000);
+  std::vector<Cache::Handle*> handles;
+  for (int i = 0; i < 100; i++) {
+    handles.push_back(cache->Insert(EncodeKey(i), EncodeValue(i), 1,
+                                    &NopDeleter));
+  }
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(i, DecodeValue(cache->Value(handles[i])));
+    cache->Release(handles[i]);
+  }
+  int cached = 0;
+  for (int i = 0; i < 100; i++) {
+    Cache::Handle* h = cache->Lookup(EncodeKey(i));
+    if (h != nullptr) {
+      ASSERT_EQ(i, DecodeValue(cache->Value(h)));
+      cache->Release(h);
+      cached++;
+    }
+  }
+  ASSERT_GT(cached, 0);
+  ASSERT_LE(cached, 16);
+  delete cache;
+}
+
 }  // namespace leveldb
 
 int main(int argc, char **argv) {
@@ -31,6 +31,14 @@ namespace leveldb {
 
     Status Env::DeleteFile(const std::string &fname) { return RemoveFile(fname); }
 
+    void Env::SetBackgroundThreads(int number) {}
+
+    void Env::ScheduleHighPriority(void (*function)(void *arg), void *arg) {
+        Schedule(function, arg);
+    }
+
+    bool Env::HasHighPriorityThread() { return false; }
+
     SequentialFile::~SequentialFile() = default;
 
     RandomAccessFile::~RandomAccessFile() = default;
@@ -603,6 +603,14 @@ namespace leveldb {
             void Schedule(void (*background_work_function)(void *background_work_arg),
                           void *background_work_arg) override;
 
+            void SetBackgroundThreads(int number) override;
+
+            void ScheduleHighPriority(
+                    void (*background_work_function)(void *background_work_arg),
+                    void *background_work_arg) override;
+
+            bool HasHighPriorityThread() override { return true; }
+
             void StartThread(void (*thread_main)(void *thread_main_arg),
                              void *thread_main_arg) override {
                 std::thread new_thread(thread_main, thread_main_arg);
@@ -658,10 +666,12 @@ namespace leveldb {
             }
 
         private:
-            void BackgroundThreadMain();
+            // Runs the items of the high priority queue if "high_priority" is
+            // true, else those of the shared pool queue.
+            void BackgroundThreadMain(bool high_priority);
 
-            static void BackgroundThreadEntryPoint(WindowsEnv *env) {
-                env->BackgroundThreadMain();
+            static void BackgroundThreadEntryPoint(WindowsEnv *env, bool high_priority) {
+                env->BackgroundThreadMain(high_priority);
             }
 
             // Stores the work item data in a Schedule() call.
@@ -681,11 +691,21 @@ namespace leveldb {
 
             port::Mutex background_work_mutex_;
             port::CondVar background_work_cv_ GUARDED_BY(background_work_mutex_);
-            bool started_background_thread_ GUARDED_BY(background_work_mutex_);
+            // Number of threads running BackgroundThreadMain(), and the number the
+            // pool should grow to once the first work item is scheduled.
+            int started_background_threads_ GUARDED_BY(background_work_mutex_);
+            int target_background_threads_ GUARDED_BY(background_work_mutex_);
 
             std::queue<BackgroundWorkItem> background_work_queue_
             GUARDED_BY(background_work_mutex_);
 
+            // Items passed to ScheduleHighPriority(), run by a single dedicated
+            // thread that is started on first use.
+            port::CondVar high_priority_work_cv_ GUARDED_BY(background_work_mutex_);
+            bool started_high_priority_thread_ GUARDED_BY(background_work_mutex_);
+            std::queue<BackgroundWorkItem> high_priority_work_queue_
+            GUARDED_BY(background_work_mutex_);
+
             Limiter mmap_limiter_;  // Thread-safe.
         };
 
@@ -694,7 +714,10 @@ namespace leveldb {
 
         WindowsEnv::WindowsEnv()
                 : background_work_cv_(&background_work_mutex_),
-                  started_background_thread_(false),
+                  started_background_threads_(0),
+                  target_background_threads_(1),
+                  high_priority_work_cv_(&background_work_mutex_),
+                  started_high_priority_thread_(false),
                   mmap_limiter_(MaxMmaps()) {}
 
         void WindowsEnv::Schedule(
@@ -702,35 +725,75 @@ namespace leveldb {
                 void *background_work_arg) {
             background_work_mutex_.Lock();
 
-            // Start the background thread, if we haven't done so already.
-            if (!started_background_thread_) {
-                started_background_thread_ = true;
-                std::thread background_thread(WindowsEnv::BackgroundThreadEntryPoint, this);
+            // Start the background threads, if we haven't done so already.
+            while (started_background_threads_ < target_background_threads_) {
+                started_background_threads_++;
+                std::thread background_thread(WindowsEnv::BackgroundThreadEntryPoint,
+                                              this, false);
                 background_thread.detach();
             }
 
-            // If the queue is empty, the background thread may be waiting for work.
-            if (background_work_queue_.empty()) {
-                background_work_cv_.Signal();
+            background_work_queue_.emplace(background_work_function, background_work_arg);
+
+            // Wake up one of the background threads, which may be waiting for work.
+            background_work_cv_.Signal();
+            background_work_mutex_.Unlock();
+        }
+
+        void WindowsEnv::SetBackgroundThreads(int number) {
+            background_work_mutex_.Lock();
+            if (number > target_background_threads_) {
+                target_background_threads_ = number;
             }
 
-            background_work_queue_.emplace(background_work_function, background_work_arg);
+            // Threads are started lazily by Schedule().  Once the pool is running,
+            // grow it right away so queued work can make use of the new threads.
+            if (started_background_threads_ > 0) {
+                while (started_background_threads_ < target_background_threads_) {
+                    started_background_threads_++;
+                    std::thread background_thread(WindowsEnv::BackgroundThreadEntryPoint,
+                                                  this, false);
+                    background_thread.detach();
+                }
+            }
+            background_work_mutex_.Unlock();
+        }
+
+        void WindowsEnv::ScheduleHighPriority(
+                void (*background_work_function)(void *background_work_arg),
+                void *background_work_arg) {
+            background_work_mutex_.Lock();
+
+            // Start the dedicated thread, if we haven't done so already.
+            if (!started_high_priority_thread_) {
+                started_high_priority_thread_ = true;
+                std::thread background_thread(WindowsEnv::BackgroundThreadEntryPoint, this,
+                                              true);
+                background_thread.detach();
+            }
+
+            high_priority_work_queue_.emplace(background_work_function,
+                                              background_work_arg);
+            high_priority_work_cv_.Signal();
             background_work_mutex_.Unlock();
         }
 
-        void WindowsEnv::BackgroundThreadMain() {
+        void WindowsEnv::BackgroundThreadMain(bool high_priority) {
+            std::queue<BackgroundWorkItem> &queue =
+                    high_priority ? high_priority_work_queue_ : background_work_queue_;
+            port::CondVar &cv = high_priority ? high_priority_work_cv_ : background_work_cv_;
             while (true) {
                 background_work_mutex_.Lock();
 
                 // Wait until there is work to be done.
-                while (background_work_queue_.empty()) {
-                    background_work_cv_.Wait();
+                while (queue.empty()) {
+                    cv.Wait();
                 }
 
-                assert(!background_work_queue_.empty());
-                auto background_work_function = background_work_queue_.front().function;
-                void *background_work_arg = background_work_queue_.front().arg;
-                background_work_queue_.pop();
+                assert(!queue.empty());
+                auto background_work_function = queue.front().function;
+                void *background_work_arg = queue.front().arg;
+                queue.pop();
 
                 background_work_mutex_.Unlock();
                 background_work_function(background_work_arg);
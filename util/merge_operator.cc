@@ -0,0 +1,45 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/merge_operator.h"
+
+#include "util/coding.h"
+
+namespace leveldb {
+
+MergeOperator::~MergeOperator() {}
+
+namespace {
+
+class UInt64AddOperator : public MergeOperator {
+ public:
+  const char* Name() const override { return "leveldb.UInt64AddOperator"; }
+
+  bool FullMerge(const Slice& key, const Slice* existing_value,
+                 const std::vector<Slice>& operands,
+                 std::string* new_value) const override {
+    uint64_t sum = 0;
+    if (existing_value != nullptr) {
+      if (existing_value->size() != sizeof(uint64_t)) {
+        return false;
+      }
+      sum = DecodeFixed64(existing_value->data());
+    }
+    for (const Slice& operand : operands) {
+      if (operand.size() != sizeof(uint64_t)) {
+        return false;
+      }
+      sum += DecodeFixed64(operand.data());
+    }
+    new_value->clear();
+    PutFixed64(new_value, sum);
+    return true;
+  }
+};
+
+}  // namespace
+
+const MergeOperator* NewUInt64AddOperator() { return new UInt64AddOperator; }
+
+}  // namespace leveldb